@@ -18,21 +18,33 @@ SOURCES += \
     skyviewcontroller.cpp \
     AstronomyCalculator.cpp \
     SolarSystemCalculator.cpp \
+    EphemerisSession.cpp \
     GeoCoordinate.cpp \
     src/argparse/argparse.c \
     src/coreUtils/asciiDouble.c \
     src/coreUtils/errorReport.c \
     src/coreUtils/makeRasters.c \
+    src/coreUtils/mappedFile.c \
+    src/coreUtils/outputBuffer.c \
+    src/coreUtils/recordCache.c \
+    src/coreUtils/textFile.c \
+    src/ephemCalc/columnarOutput.c \
     src/ephemCalc/constellations.c \
+    src/ephemCalc/ephemContext.c \
     src/ephemCalc/jpl.c \
+    src/ephemCalc/keplerBatch.c \
     src/ephemCalc/magnitudeEstimate.c \
     src/ephemCalc/meeus.c \
+    src/ephemCalc/observerState.c \
     src/ephemCalc/orbitalElements.c \
+    src/ephemCalc/spk.c \
+    src/ephemCalc/universalKepler.c \
     src/listTools/ltDict.c \
     src/listTools/ltList.c \
     src/listTools/ltMemory.c \
     src/listTools/ltStringProc.c \
     src/main.c \
+    src/mathsTools/chebyshev.c \
     src/mathsTools/julianDate.c \
     src/mathsTools/precess_equinoxes.c \
     src/mathsTools/sphericalAst.c \
@@ -44,21 +56,34 @@ HEADERS += \
     IOSSensorBridge.h \
     AstronomyCalculator.h \
     SolarSystemCalculator.h \
+    EphemerisSession.h \
     GeoCoordinate.h \
     src/argparse/argparse.h \
     src/coreUtils/asciiDouble.h \
     src/coreUtils/errorReport.h \
     src/coreUtils/makeRasters.h \
+    src/coreUtils/mappedFile.h \
+    src/coreUtils/outputBuffer.h \
+    src/coreUtils/recordCache.h \
+    src/coreUtils/textFile.h \
     src/coreUtils/strConstants.h \
+    src/ephemCalc/bodyLookup.h \
+    src/ephemCalc/columnarOutput.h \
     src/ephemCalc/constellations.h \
+    src/ephemCalc/ephemContext.h \
     src/ephemCalc/jpl.h \
+    src/ephemCalc/keplerBatch.h \
     src/ephemCalc/magnitudeEstimate.h \
     src/ephemCalc/meeus.h \
+    src/ephemCalc/observerState.h \
     src/ephemCalc/orbitalElements.h \
+    src/ephemCalc/spk.h \
+    src/ephemCalc/universalKepler.h \
     src/listTools/ltDict.h \
     src/listTools/ltList.h \
     src/listTools/ltMemory.h \
     src/listTools/ltStringProc.h \
+    src/mathsTools/chebyshev.h \
     src/mathsTools/julianDate.h \
     src/mathsTools/precess_equinoxes.h \
     src/mathsTools/sphericalAst.h \
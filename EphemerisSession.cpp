@@ -0,0 +1,92 @@
+#include "EphemerisSession.h"
+
+#include <algorithm>
+
+#include "ephemCalc/bodyLookup.h"
+#include "ephemCalc/ephemContext.h"
+#include "ephemCalc/jpl.h"
+
+// The engine's settings and working space. These are large, so they live on the heap with the session.
+struct EphemerisSession::Engine {
+    settings ephemerisSettings;
+    ephem_context context;
+};
+
+EphemerisSession::EphemerisSession()
+    : m_engine(new Engine)
+{
+    settings_default(&m_engine->ephemerisSettings);
+    ephem_context_init(&m_engine->context, &m_engine->ephemerisSettings);
+}
+
+EphemerisSession::~EphemerisSession()
+{
+    settings_close(&m_engine->ephemerisSettings);
+}
+
+int EphemerisSession::findBody(const std::string& name)
+{
+    return orbitalElements_findBody(name.c_str());
+}
+
+void EphemerisSession::setBodies(const std::vector<int>& bodyIds)
+{
+    m_bodyIds = bodyIds;
+    m_positions.resize(bodyIds.size());
+}
+
+void EphemerisSession::setObserver(double latitude, double longitude, bool topocentric)
+{
+    m_engine->ephemerisSettings.latitude = latitude;
+    m_engine->ephemerisSettings.longitude = longitude;
+    m_engine->ephemerisSettings.enable_topocentric_correction = topocentric ? 1 : 0;
+}
+
+void EphemerisSession::setUseOrbitalElements(bool useOrbitalElements)
+{
+    m_engine->ephemerisSettings.use_orbital_elements = useOrbitalElements ? 1 : 0;
+}
+
+void EphemerisSession::preload(double jdMin, double jdMax)
+{
+    jpl_setActiveWindow(jdMin, jdMax);
+}
+
+const std::vector<EphemerisPosition>& EphemerisSession::compute(double jd)
+{
+    const double *results = m_engine->context.results;
+
+    // The engine computes up to EPHEM_CHUNK_OBJECTS bodies at a time
+    ephem_context_beginStep(&m_engine->context, jd);
+    for (size_t first = 0; first < m_bodyIds.size(); first += EPHEM_CHUNK_OBJECTS) {
+        const size_t count = std::min(m_bodyIds.size() - first, static_cast<size_t>(EPHEM_CHUNK_OBJECTS));
+        ephem_context_computeObjects(&m_engine->context, m_bodyIds.data() + first, static_cast<int>(count));
+
+        for (size_t i = 0; i < count; i++) {
+            const double *r = results + i * EPHEM_PARAMETERS;
+            EphemerisPosition& p = m_positions[first + i];
+            p.bodyId = m_bodyIds[first + i];
+            p.x = r[0];
+            p.y = r[1];
+            p.z = r[2];
+            p.ra = r[3];
+            p.dec = r[4];
+            p.magnitude = r[5];
+            p.phase = r[6];
+            p.angularSize = r[7];
+            p.physicalSize = r[8];
+            p.albedo = r[9];
+            p.sunDistance = r[10];
+            p.earthDistance = r[11];
+            p.sunAngularDistance = r[12];
+            p.thetaESO = r[13];
+            p.eclipticLongitude = r[14];
+            p.eclipticDistance = r[15];
+            p.eclipticLatitude = r[16];
+            p.vx = r[17];
+            p.vy = r[18];
+            p.vz = r[19];
+        }
+    }
+    return m_positions;
+}
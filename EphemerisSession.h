@@ -0,0 +1,94 @@
+#ifndef EPHEMERISSESSION_H
+#define EPHEMERISSESSION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The position and appearance of one solar system object at one time, as computed by the ephemeris engine
+ */
+struct EphemerisPosition {
+    int bodyId;                  // Engine body ID, e.g. 0 = Mercury, 9 = Moon, 10 = Sun, 10000000 + n = asteroid n
+    double x, y, z;              // Position relative to the solar system barycentre; AU; ICRF
+    double ra, dec;              // Right ascension and declination, relative to the geocentre; radians
+    double magnitude;            // Estimated V-band magnitude
+    double phase;                // Illuminated fraction (0-1)
+    double angularSize;          // Angular size; arcseconds
+    double physicalSize;         // Physical size; metres
+    double albedo;
+    double sunDistance;          // Distance from the Sun; AU
+    double earthDistance;        // Distance from the Earth; AU
+    double sunAngularDistance;   // Angular distance from the Sun, as seen from the Earth; radians
+    double thetaESO;             // Angular distance from the Earth, as seen from the Sun; radians
+    double eclipticLongitude;    // Ecliptic longitude in the epoch of the query; radians
+    double eclipticDistance;     // Separation from the Sun in ecliptic longitude; radians
+    double eclipticLatitude;     // Ecliptic latitude in the epoch of the query; radians
+    double vx, vy, vz;           // Velocity relative to the solar system barycentre; AU/day
+};
+
+/**
+ * @brief A persistent handle on the ephemeris engine, which computes a fixed list of bodies at one time per call.
+ *
+ * Bodies are given by numeric engine ID, so no names are parsed and nothing is printed while computing. Each session
+ * owns its own working space, so sessions on different threads may compute at the same time. The engine must already
+ * have been initialised with ephem_main().
+ */
+class EphemerisSession
+{
+public:
+    EphemerisSession();
+    ~EphemerisSession();
+
+    EphemerisSession(const EphemerisSession&) = delete;
+    EphemerisSession& operator=(const EphemerisSession&) = delete;
+
+    /**
+     * @brief Look up the engine body ID of a named object, e.g. "mars", "moon" or "ceres"
+     * @param name Name of the object
+     * @return Engine body ID, or -1 if the name is not recognised
+     */
+    static int findBody(const std::string& name);
+
+    /**
+     * @brief Set the bodies which compute() returns, in order
+     * @param bodyIds Engine body IDs
+     */
+    void setBodies(const std::vector<int>& bodyIds);
+
+    /**
+     * @brief Set the observer's location. By default, positions are geocentric.
+     * @param latitude Latitude of the observer; degrees
+     * @param longitude Longitude of the observer; degrees
+     * @param topocentric Whether to correct positions for the observer's location on the Earth's surface
+     */
+    void setObserver(double latitude, double longitude, bool topocentric);
+
+    /**
+     * @brief Choose whether positions come from orbital elements rather than the JPL ephemeris
+     * @param useOrbitalElements True to use orbital elements, which are needed for asteroids and comets
+     */
+    void setUseOrbitalElements(bool useOrbitalElements);
+
+    /**
+     * @brief Load the ephemeris data covering a span of time now, so that compute() never waits for disk I/O
+     * @param jdMin Julian date of the start of the span; TT
+     * @param jdMax Julian date of the end of the span; TT
+     */
+    void preload(double jdMin, double jdMax);
+
+    /**
+     * @brief Compute all of the bodies set by setBodies() at one time
+     * @param jd Julian date; TT
+     * @return One position per body, in the order given to setBodies(). This is overwritten by the next call.
+     */
+    const std::vector<EphemerisPosition>& compute(double jd);
+
+private:
+    struct Engine;
+    std::unique_ptr<Engine> m_engine;
+    std::vector<int> m_bodyIds;
+    std::vector<EphemerisPosition> m_positions;
+};
+
+#endif // EPHEMERISSESSION_H
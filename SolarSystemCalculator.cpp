@@ -184,12 +184,24 @@ void SolarSystemCalculator::updatePositions(double jd, const GeoCoordinate& obse
     // Clear previous positions
     m_visibleObjects.clear();
 
+    // Compute every object in one call to the ephemeris engine
+    m_ephemeris.setObserver(observer.latitude(), observer.longitude(), false);
+    const std::vector<EphemerisPosition>& positions = m_ephemeris.compute(jd);
+
+    // positions[k] belongs to m_objects[k]; this holds because only initialize() changes m_objects
+    Q_ASSERT(positions.size() == static_cast<size_t>(m_objects.size()));
+    if (positions.size() != static_cast<size_t>(m_objects.size())) {
+        qWarning() << "Solar system objects changed without calling initialize(); skipping update";
+        return;
+    }
+
     // Calculate for each planet (existing code)
-    for (const SolarSystemObject& object : m_objects) {
+    for (int k = 0; k < m_objects.size(); k++) {
+        const SolarSystemObject& object = m_objects[k];
         double ra, dec, distance, phase, mag, az, alt;
         
         // Calculate position
-        calculateAccuratePlanetPosition(object.id, object.name, jd, observer, ra, dec, distance, phase, mag, alt, az);
+        calculateAccuratePlanetPosition(object.id, object.name, jd, positions[k], ra, dec, distance, phase, mag, alt, az);
         
         // Angular distance from viewing center
         double dAz = az - m_controller->azimuth();
@@ -339,32 +351,39 @@ void SolarSystemCalculator::debugMarsJ2000Position() {
 void SolarSystemCalculator::initialize()
 {
     initializePlanets();
+
+    // Look up each object's engine body ID once, so that updates need no name lookups. Objects the engine does not
+    // recognise are dropped, so that m_objects and the session's bodies stay in step.
+    std::vector<int> bodyIds;
+    for (int k = 0; k < m_objects.size(); ) {
+        const int bodyId = EphemerisSession::findBody(m_objects[k].name.toLower().toStdString());
+        if (bodyId < 0) {
+            qWarning() << "Ephemeris engine does not recognise" << m_objects[k].name << "- dropping it";
+            m_objects.remove(k);
+            continue;
+        }
+        bodyIds.push_back(bodyId);
+        k++;
+    }
+    m_ephemeris.setBodies(bodyIds);
     // initializeSunAndMoon();
     // debugMarsJ2000Position();
 }
 
-void SolarSystemCalculator::calculateAccuratePlanetPosition(int ix, const QString& planetName, double jd, const GeoCoordinate& observer, double& ra, double& dec, double& distance, double& phase, double& mag, double& alt, double& az) {
-    // Convert QString to C-string
-    QByteArray bodyNameBytes = planetName.toLatin1();
-    const char* bodyName = bodyNameBytes.constData();
+void SolarSystemCalculator::calculateAccuratePlanetPosition(int ix, const QString& planetName, double jd, const EphemerisPosition& position, double& ra, double& dec, double& distance, double& phase, double& mag, double& alt, double& az) {
     static double prev[11]; // increase this if we discover new planets (?)
     
-    // Call the external ephemeris function
-    double *buffer = ephem(bodyName, jd, observer.latitude(), observer.longitude());
-    
-    // The function prints results, but we also need to capture them
-    // Assuming buffer[3], buffer[4], buffer[5] contain the results in radians
-    // and are accessible here after calling ephem
-    ra = buffer[3] * 180.0 / M_PI;  // Convert to degrees
-    dec = buffer[4] * 180.0 / M_PI; // Convert to degrees
-    distance = buffer[11];
-    phase = buffer[6];
-    mag = buffer[5];
+    // The ephemeris engine gives RA and Dec in radians
+    ra = position.ra * 180.0 / M_PI;  // Convert to degrees
+    dec = position.dec * 180.0 / M_PI; // Convert to degrees
+    distance = position.earthDistance;
+    phase = position.phase;
+    mag = position.magnitude;
     // Convert RA/Dec to Azimuth/Altitude for field of view calculations
     m_controller->m_astronomyCalculator.equatorialToHorizontal(ra/15.0, dec, &az, &alt);
     if (jd > prev[ix])
       {
 	prev[ix] = jd + 0.001;
-	qDebug() << bodyName << ra << dec << alt << az << distance;
+	qDebug() << planetName << ra << dec << alt << az << distance;
       }
 }
@@ -8,6 +8,7 @@
 #include <QMap>
 #include <QUrl>
 #include "GeoCoordinate.h"
+#include "EphemerisSession.h"
 
 // Forward declarations
 class SkyViewController;
@@ -36,7 +37,11 @@ public:
     void calculateCurrentPositions();
 
     /**
-     * @brief Initialize the solar system objects
+     * @brief Initialize the solar system objects, and the ephemeris session which computes them
+     *
+     * Objects the ephemeris engine does not recognise are logged and dropped. The object list must not change
+     * afterwards except by calling initialize() again, since updatePositions() matches objects to the session's
+     * results by index.
      */
     void initialize();
 
@@ -60,7 +65,7 @@ public:
     void setFieldOfView(double fov);
     // Add this method to your SolarSystemCalculator class
     void debugMarsJ2000Position();
-    void calculateAccuratePlanetPosition(int ix, const QString&, double, const GeoCoordinate&,
+    void calculateAccuratePlanetPosition(int ix, const QString&, double, const EphemerisPosition&,
 					 double&, double&, double &nce, double &, double&, double&, double&);
     double calculateJulianDate(const QDateTime& dateTime);
 
@@ -71,6 +76,7 @@ private:
     SolarSystemObject m_moonObject;
     QVariantList m_visibleObjects;
     double m_fieldOfView;
+    EphemerisSession m_ephemeris;
 
     /**
      * @brief Calculate the position of a solar system object at a given time
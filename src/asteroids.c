@@ -44,6 +44,7 @@
 #include "ephemCalc/constellations.h"
 #include "ephemCalc/jpl.h"
 #include "ephemCalc/magnitudeEstimate.h"
+#include "ephemCalc/observerState.h"
 #include "ephemCalc/orbitalElements.h"
 
 #include "listTools/ltMemory.h"
@@ -110,7 +111,12 @@ void scan_for_oppositions(settings *s, double jd_min, double jd_max, double jd_s
     for (jd = jd_min, loop_iter = 0; jd <= jd_max; jd += jd_step, loop_iter++) {
         //if (DEBUG) {
         // snprintf(temp_err_string, FNAME_LENGTH, "Starting work on day %.1f",jd); ephem_log(temp_err_string); }
-#pragma omp parallel for shared(jd, loop_iter, max_iters, so_count) private(j)
+
+        // The positions of the Earth and Sun are the same for every asteroid on this day
+        observerState observer;
+        observerState_compute(&observer, jd, 0, 0, 0);
+
+#pragma omp parallel for shared(jd, loop_iter, max_iters, so_count, observer) private(j)
         for (j = 0; j < max_iters; j++) {
             int i;
             if (selected_in == NULL) { i = j + 1; }
@@ -122,12 +128,11 @@ void scan_for_oppositions(settings *s, double jd_min, double jd_max, double jd_s
                 double earth_dist = 0, sun_ang_dist = 0, theta_eso = 0;
                 double ecliptic_longitude = 0, ecliptic_latitude = 0, ecliptic_distance = 0;
 
-                orbitalElements_computeEphemeris(10000000 + i, jd, &x, &y, &z, &ra, &dec, &mag, &phase, &ang_size,
-                                                 &phy_size,
+                orbitalElements_computeEphemeris(10000000 + i, &observer, &x, &y, &z, NULL, NULL, NULL, &ra, &dec,
+                                                 &mag, &phase, &ang_size, &phy_size,
                                                  &albedo, &sun_dist, &earth_dist, &sun_ang_dist, &theta_eso,
                                                  &ecliptic_longitude, &ecliptic_latitude,
-                                                 &ecliptic_distance, s->ra_dec_epoch,
-                                                 0, 0, 0);
+                                                 &ecliptic_distance, s->ra_dec_epoch);
 
                 // Check if asteroid is both bright, also at opposition
                 if ((mag < mag_limit) && (loop_iter > 2)) {
@@ -144,13 +149,13 @@ void scan_for_oppositions(settings *s, double jd_min, double jd_max, double jd_s
                         }
                     }
                     if ((sun_ang_dist_1[i] > sun_ang_dist) && (sun_ang_dist_1[i] > sun_ang_dist_2[i]))
-                        file_event(report, i, asteroid_database[i].name, "Opposition", jd - jd_step, mag, earth_dist,
+                        file_event(report, i, asteroid_names[i].name, "Opposition", jd - jd_step, mag, earth_dist,
                                    ra, dec);
                     if ((earth_dist_1[i] < earth_dist) && (earth_dist_1[i] < earth_dist_2[i]))
-                        file_event(report, i, asteroid_database[i].name, "Apogee    ", jd - jd_step, mag, earth_dist,
+                        file_event(report, i, asteroid_names[i].name, "Apogee    ", jd - jd_step, mag, earth_dist,
                                    ra, dec);
                     if ((mag1[i] < mag) && (mag1[i] < mag2[i]))
-                        file_event(report, i, asteroid_database[i].name, "PeakMag   ", jd - jd_step, mag, earth_dist,
+                        file_event(report, i, asteroid_names[i].name, "PeakMag   ", jd - jd_step, mag, earth_dist,
                                    ra, dec);
                 }
 
@@ -277,10 +282,8 @@ int asteroids_main(int argc, char **argv) {
     }
 
     // Read contents of the asteroid database
-    fseek(asteroid_database_file, asteroid_database_offset, SEEK_SET);
-    dcf_fread((void *) asteroid_database, sizeof(orbitalElements), asteroid_count, asteroid_database_file,
-              asteroid_database_filename, __FILE__, __LINE__);
-    memset(asteroid_database_items_loaded, 1, asteroid_count);
+    record_cache_load_all(&asteroid_database_records);
+    record_cache_load_all(&asteroid_names_records);
 
     // Malloc arrays for keeping track of solar distance of asteroids
     sun_ang_dist_1 = (double *) lt_malloc(asteroid_count * sizeof(double));
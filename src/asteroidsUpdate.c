@@ -0,0 +1,67 @@
+// asteroidsUpdate.c
+// Dominic Ford
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+
+// This is a simple tool for bringing the binary file <data/dcfbinary.ast> up to date with a newer copy of astorb.dat,
+// without rebuilding it from scratch. If any asteroid has changed, the updated table is written to a new file, which
+// is renamed over the old one, and the revision number stored in the file is incremented.
+
+// On the command line, you need to specify:
+// * The filename of the new copy of astorb.dat
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coreUtils/strConstants.h"
+#include "coreUtils/errorReport.h"
+
+#include "ephemCalc/orbitalElements.h"
+
+#include "listTools/ltMemory.h"
+
+int asteroidsUpdate_main(int argc, char **argv) {
+    int changed_count, appended_count;
+    unsigned int revision;
+
+    // Initialise sub-modules
+    lt_memoryInit(&ephem_error, &ephem_log);
+
+    if (argc != 2) {
+        ephem_error("Usage: asteroidsUpdate.bin <astorb.dat filename>");
+        return 1;
+    }
+
+    if (orbitalElements_asteroids_applyUpdate(argv[1], &changed_count, &appended_count, &revision) != 0) {
+        ephem_error("Could not update binary file <data/dcfbinary.ast>. If it does not exist, it is built from "
+                    "astorb.dat the first time that asteroids are used.");
+        return 1;
+    }
+
+    snprintf(temp_err_string, FNAME_LENGTH, "Updated %d asteroids and added %d. File is now at revision %u.",
+             changed_count, appended_count, revision);
+    ephem_report(temp_err_string);
+
+    lt_freeAll(0);
+    lt_memoryStop();
+    return 0;
+}
@@ -0,0 +1,467 @@
+// benchmarks.c
+// Dominic Ford
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+// This is a simple tool for timing the numerical kernels which dominate the run time of long ephemerides. It also
+// checks that the batch and universal-variable Kepler solvers agree with the scalar code, and exits with a non-zero
+// status if they do not.
+
+// On the command line, you may optionally specify:
+// * The number of evaluations to time for each kernel (default 2000000)
+// * The Julian day at which to start timing DE430 lookups (default 2451545.0)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <gsl/gsl_math.h>
+
+#include "coreUtils/asciiDouble.h"
+#include "coreUtils/strConstants.h"
+#include "coreUtils/errorReport.h"
+#include "coreUtils/outputBuffer.h"
+
+#include "ephemCalc/jpl.h"
+#include "ephemCalc/keplerBatch.h"
+#include "ephemCalc/orbitalElements.h"
+#include "ephemCalc/universalKepler.h"
+
+#include "listTools/ltMemory.h"
+
+#include "mathsTools/chebyshev.h"
+
+// The lengths of the Chebyshev series used for the bodies in DE430
+static const int chebyshev_lengths[] = {6, 7, 8, 10, 11, 13, 14};
+
+//! The largest difference allowed between the positions computed by different Kepler solvers; AU
+#define BENCHMARK_KEPLER_TOLERANCE 1e-9
+
+//! benchmark_time - Return a monotonic wall-clock time, in seconds
+//! \return - Time in seconds
+
+static double benchmark_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+//! benchmark_chebyshev - Compare the time taken to evaluate the x, y and z coordinates of a body using three calls to
+//! <chebyshev>, against a single call to the vectorised kernel <chebyshev3>. Also check that they agree exactly.
+//! \param [in] Ncoeff - The number of coefficients in each Chebyshev series
+//! \param [in] evaluations - The number of evaluations to time
+
+static void benchmark_chebyshev(int Ncoeff, long evaluations) {
+    const int Nsets = 64;
+    double *coeffs = (double *) malloc(Nsets * 3 * Ncoeff * sizeof(double));
+    double sum_scalar = 0, sum_vector = 0, sum_derivative = 0;
+    long i, mismatches = 0;
+
+    if (coeffs == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+
+    // Make random coefficients which fall off with order, like those in DE430
+    srand(Ncoeff);
+    for (i = 0; i < Nsets * 3 * Ncoeff; i++) {
+        coeffs[i] = (2. * rand() / RAND_MAX - 1) * 1e8 / pow(10, i % Ncoeff);
+    }
+
+    // Time the scalar function
+    double t0 = benchmark_time();
+    for (i = 0; i < evaluations; i++) {
+        const double *c = coeffs + (i % Nsets) * 3 * Ncoeff;
+        const double x = -1 + 2 * ((i * 7919) % 100003) / 100003.;
+        sum_scalar += chebyshev(c, Ncoeff, x) + chebyshev(c + Ncoeff, Ncoeff, x) +
+                      chebyshev(c + 2 * Ncoeff, Ncoeff, x);
+    }
+    double t1 = benchmark_time();
+
+    // Time the vectorised kernel
+    for (i = 0; i < evaluations; i++) {
+        const double *c = coeffs + (i % Nsets) * 3 * Ncoeff;
+        const double x = -1 + 2 * ((i * 7919) % 100003) / 100003.;
+        double out[3];
+        chebyshev3(c, Ncoeff, x, out, NULL);
+        sum_vector += out[0] + out[1] + out[2];
+    }
+    double t2 = benchmark_time();
+
+    // Time the vectorised kernel with derivatives
+    for (i = 0; i < evaluations; i++) {
+        const double *c = coeffs + (i % Nsets) * 3 * Ncoeff;
+        const double x = -1 + 2 * ((i * 7919) % 100003) / 100003.;
+        double out[3], out_dot[3];
+        chebyshev3(c, Ncoeff, x, out, out_dot);
+        sum_derivative += out[0] + out[1] + out[2] + out_dot[0];
+    }
+    double t3 = benchmark_time();
+
+    // Check that the two agree exactly
+    for (i = 0; i < 100003; i++) {
+        const double *c = coeffs + (i % Nsets) * 3 * Ncoeff;
+        const double x = -1 + 2 * i / 100003.;
+        double out[3];
+        chebyshev3(c, Ncoeff, x, out, NULL);
+        if ((out[0] != chebyshev(c, Ncoeff, x)) || (out[1] != chebyshev(c + Ncoeff, Ncoeff, x)) ||
+            (out[2] != chebyshev(c + 2 * Ncoeff, Ncoeff, x)))
+            mismatches++;
+    }
+
+    printf("chebyshev  n=%2d  3 x chebyshev %7.2f ns  chebyshev3 %7.2f ns (%.2fx)  with derivatives %7.2f ns  "
+           "mismatches %ld  [%g]\n",
+           Ncoeff, 1e9 * (t1 - t0) / evaluations, 1e9 * (t2 - t1) / evaluations, (t1 - t0) / (t2 - t1),
+           1e9 * (t3 - t2) / evaluations, mismatches, sum_scalar - sum_vector + 0 * sum_derivative);
+
+    free(coeffs);
+}
+
+//! benchmark_jpl_batch - Compare the time taken to evaluate the position of a DE430 body on a dense grid of times
+//! using one call to <jpl_computeXYZ> per time, against a single call to <jpl_computeXYZ_batch>.
+//! \param [in] body_id - The body's index within DE430
+//! \param [in] jd_min - The Julian day at which the grid of times starts
+//! \param [in] count - The number of one-minute steps in the grid of times
+
+static void benchmark_jpl_batch(int body_id, double jd_min, int count) {
+    double *jd = (double *) malloc(count * sizeof(double));
+    double *xyz = (double *) malloc(6 * count * sizeof(double));
+    long i, mismatches = 0;
+
+    if ((jd == NULL) || (xyz == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    double *x = xyz, *y = xyz + count, *z = xyz + 2 * count;
+    double *xb = xyz + 3 * count, *yb = xyz + 4 * count, *zb = xyz + 5 * count;
+
+    for (i = 0; i < count; i++) jd[i] = jd_min + i / 1440.;
+
+    // Make sure that DE430 is loaded before we start the clock, and that records are in memory
+    jpl_computeXYZ_batch(body_id, jd, count, xb, yb, zb);
+
+    double t0 = benchmark_time();
+    for (i = 0; i < count; i++) jpl_computeXYZ(body_id, jd[i], x + i, y + i, z + i);
+    double t1 = benchmark_time();
+    jpl_computeXYZ_batch(body_id, jd, count, xb, yb, zb);
+    double t2 = benchmark_time();
+
+    for (i = 0; i < count; i++) {
+        if ((x[i] != xb[i]) || (y[i] != yb[i]) || (z[i] != zb[i])) mismatches++;
+    }
+
+    printf("jpl_batch  body=%2d  %d epochs  jpl_computeXYZ %7.2f ns  jpl_computeXYZ_batch %7.2f ns (%.2fx)  "
+           "mismatches %ld\n",
+           body_id, count, 1e9 * (t1 - t0) / count, 1e9 * (t2 - t1) / count, (t1 - t0) / (t2 - t1), mismatches);
+
+    free(jd);
+    free(xyz);
+}
+
+//! benchmark_text_output - Compare the time taken to format a text ephemeris of a DE430 body, with a JD column and
+//! x, y, z columns as written by <ephem_context_compute>, using <output_buffer_printf> against <output_buffer_fixed>.
+//! The ephemeris is computed and formatted in blocks, so that memory use does not depend on its length.
+//! \param [in] body_id - The body's index within DE430
+//! \param [in] jd_min - The Julian day at which the ephemeris starts
+//! \param [in] count - The number of one-minute steps in the ephemeris
+
+static void benchmark_text_output(int body_id, double jd_min, int count) {
+    const int block_length = 65536;
+    double *jd = (double *) malloc(4 * block_length * sizeof(double));
+    long i, mismatches = 0;
+    double time_printf = 0, time_fixed = 0;
+    output_buffer text_printf, text_fixed;
+
+    if (jd == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    double *x = jd + block_length, *y = jd + 2 * block_length, *z = jd + 3 * block_length;
+    output_buffer_init(&text_printf);
+    output_buffer_init(&text_fixed);
+
+    for (long first = 0; first < count; first += block_length) {
+        const int length = (int) (((count - first) < block_length) ? (count - first) : block_length);
+        for (i = 0; i < length; i++) jd[i] = jd_min + (first + i) / 1440.;
+        jpl_computeXYZ_batch(body_id, jd, length, x, y, z);
+        text_printf.length = text_fixed.length = 0;
+
+        double t0 = benchmark_time();
+        for (i = 0; i < length; i++) {
+            output_buffer_printf(&text_printf, "%.12f   ", jd[i]);
+            output_buffer_printf(&text_printf, "%12.9f %12.9f %12.9f   ", x[i], y[i], z[i]);
+            output_buffer_printf(&text_printf, "\n");
+        }
+        double t1 = benchmark_time();
+        for (i = 0; i < length; i++) {
+            output_buffer_fixed(&text_fixed, jd[i], 0, 12, "   ");
+            output_buffer_fixed(&text_fixed, x[i], 12, 9, " ");
+            output_buffer_fixed(&text_fixed, y[i], 12, 9, " ");
+            output_buffer_fixed(&text_fixed, z[i], 12, 9, "   ");
+            output_buffer_write(&text_fixed, "\n", 1);
+        }
+        double t2 = benchmark_time();
+
+        time_printf += t1 - t0;
+        time_fixed += t2 - t1;
+        if ((text_printf.length != text_fixed.length) ||
+            (memcmp(text_printf.data, text_fixed.data, text_fixed.length) != 0)) {
+            mismatches++;
+        }
+    }
+
+    printf("text_output  body=%2d  %d one-minute steps  printf %7.2f ns  fixed %7.2f ns per value (%.2fx)  "
+           "mismatched blocks %ld\n",
+           body_id, count, 1e9 * time_printf / count / 4, 1e9 * time_fixed / count / 4, time_printf / time_fixed,
+           mismatches);
+
+    output_buffer_free(&text_printf);
+    output_buffer_free(&text_fixed);
+    free(jd);
+}
+
+//! benchmark_kepler_batch - Compare the time taken to compute the positions of a catalogue of asteroids at one epoch
+//! using one call to <orbitalElements_propagate> per asteroid, against a single call to <keplerBatch_compute>. The
+//! asteroids have random elliptic orbits, spanning the range of eccentricities found in astorb.dat. Also check that
+//! the two agree to within <BENCHMARK_KEPLER_TOLERANCE>.
+//! \param [in] count - The number of asteroids in the catalogue
+//! \return - Zero if the two agree
+
+static int benchmark_kepler_batch(int count) {
+    orbitalElements *elements = (orbitalElements *) malloc(count * sizeof(orbitalElements));
+    double *xyz = (double *) malloc(6 * count * sizeof(double));
+    double largest_error = 0;
+    keplerBatch batch;
+    int i;
+
+    if ((elements == NULL) || (xyz == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    double *x = xyz, *y = xyz + count, *z = xyz + 2 * count;
+    double *xb = xyz + 3 * count, *yb = xyz + 4 * count, *zb = xyz + 5 * count;
+
+    srand(count);
+    for (i = 0; i < count; i++) {
+        orbitalElements *item = &elements[i];
+        memset(item, 0, sizeof(orbitalElements));
+        item->number = i;
+        item->secureOrbit = 1;
+        item->epochOsculation = 2460000.5;
+        item->epochPerihelion = GSL_NAN;
+        item->semiMajorAxis = 1.5 + 3.5 * rand() / RAND_MAX;
+        item->eccentricity = 0.97 * pow((double) rand() / RAND_MAX, 3);
+        item->perihelionDistance = item->semiMajorAxis * (1 - item->eccentricity);
+        item->inclination = M_PI / 3 * rand() / RAND_MAX;
+        item->longAscNode = 2 * M_PI * rand() / RAND_MAX;
+        item->argumentPerihelion = 2 * M_PI * rand() / RAND_MAX;
+        item->meanAnomaly = 2 * M_PI * rand() / RAND_MAX;
+    }
+
+    double t0 = benchmark_time();
+    keplerBatch_initFromElements(&batch, elements, count);
+    double t1 = benchmark_time();
+    for (i = 0; i < count; i++) orbitalElements_propagate(&elements[i], 2460400.5, x + i, y + i, z + i);
+    double t2 = benchmark_time();
+    keplerBatch_compute(&batch, 2460400.5, xb, yb, zb);
+    double t3 = benchmark_time();
+
+    for (i = 0; i < count; i++) {
+        const double error = gsl_hypot3(x[i] - xb[i], y[i] - yb[i], z[i] - zb[i]);
+        if (!(error <= largest_error)) largest_error = error;
+    }
+
+    printf("kepler_batch  %d asteroids  orbitalElements_propagate %7.2f ns  keplerBatch_compute %7.2f ns (%.2fx)  "
+           "setup %7.2f ns  largest difference %.2e AU\n",
+           count, 1e9 * (t2 - t1) / count, 1e9 * (t3 - t2) / count, (t2 - t1) / (t3 - t2), 1e9 * (t1 - t0) / count,
+           largest_error);
+
+    keplerBatch_free(&batch);
+    free(elements);
+    free(xyz);
+    return !(largest_error <= BENCHMARK_KEPLER_TOLERANCE);
+}
+
+//! benchmark_universal_kepler - Validate the universal-variable solver against Newton's method on the eccentric
+//! anomaly, which <orbitalElements_propagate> uses for elliptic orbits, for every elliptic comet in Soft00Cmt, at a
+//! series of dates around each comet's perihelion. Also check that <keplerBatch_compute>, which solves every comet in
+//! universal variables, agrees with <orbitalElements_propagate> for the whole catalogue. Both must agree to within
+//! <BENCHMARK_KEPLER_TOLERANCE>. We also time the two methods over the whole catalogue.
+//! \return - Zero if all of the checks pass
+
+static int benchmark_universal_kepler() {
+    const double offsets[] = {0, 10, 30, 100, 300, 1000, 3000};
+    const int offset_count = sizeof(offsets) / sizeof(offsets[0]);
+    double largest_error[sizeof(offsets) / sizeof(offsets[0])];
+    double largest_batch_error = 0;
+    int kind_count[3] = {0, 0, 0};
+    int nan_count = 0, status = 0;
+    keplerBatch batch;
+    int i, j, sign;
+
+    orbitalElements_comets_init();
+    const int count = comet_count;
+    int *body_ids = (int *) malloc(count * sizeof(int));
+    double *xyz = (double *) malloc(6 * count * sizeof(double));
+    if ((body_ids == NULL) || (xyz == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    double *x = xyz, *y = xyz + count, *z = xyz + 2 * count;
+    double *xb = xyz + 3 * count, *yb = xyz + 4 * count, *zb = xyz + 5 * count;
+
+    for (i = 0; i < count; i++) body_ids[i] = 20000000 + i;
+    for (j = 0; j < offset_count; j++) largest_error[j] = 0;
+
+    // Validation of elliptic orbits, at dates before and after each comet's perihelion
+    for (i = 0; i < count; i++) {
+        const orbitalElements *elements = orbitalElements_fetchBody(body_ids[i]);
+        const double e = elements->eccentricity;
+        const int kind = (e < 0.98) ? 0 : ((e > 1.02) ? 2 : 1);
+        int nan_mismatch = 0;
+        kind_count[kind]++;
+        if (kind != 0) continue;
+        for (j = 0; j < offset_count; j++)
+            for (sign = -1; sign <= 1; sign += 2) {
+                const double jd = elements->epochPerihelion + sign * offsets[j];
+                orbitalElements_propagate(elements, jd, x, y, z);
+                orbitalElements_propagateUniversal(elements, jd, xb, yb, zb);
+                const double error = gsl_hypot3(x[0] - xb[0], y[0] - yb[0], z[0] - zb[0]);
+                if (!gsl_finite(x[0])) nan_mismatch |= gsl_finite(xb[0]);
+                else if (!(error <= largest_error[j])) largest_error[j] = error;
+            }
+        nan_count += nan_mismatch;
+    }
+
+    printf("universal_kepler  %d comets (%d elliptic, %d near-parabolic, %d hyperbolic)  "
+           "%d only computed by orbitalElements_propagateUniversal\n",
+           count, kind_count[0], kind_count[1], kind_count[2], nan_count);
+    for (j = 0; j < offset_count; j++) {
+        printf("universal_kepler  %6.0f days from perihelion  largest difference from Newton's method  %.2e AU\n",
+               offsets[j], largest_error[j]);
+        if (!(largest_error[j] <= BENCHMARK_KEPLER_TOLERANCE)) status = 1;
+    }
+
+    // Timing, over all the comets at a series of dates
+    const int repeats = 200;
+    keplerBatch_init(&batch, body_ids, count);
+    double t0 = benchmark_time();
+    for (j = 0; j < repeats; j++)
+        for (i = 0; i < count; i++) {
+            orbitalElements_propagate(orbitalElements_fetchBody(body_ids[i]), 2460400.5 + j, x + i, y + i, z + i);
+        }
+    double t1 = benchmark_time();
+    for (j = 0; j < repeats; j++) keplerBatch_compute(&batch, 2460400.5 + j, xb, yb, zb);
+    double t2 = benchmark_time();
+
+    // The batch against the scalar code, at the last of those dates
+    for (i = 0; i < count; i++) {
+        const double error = gsl_hypot3(x[i] - xb[i], y[i] - yb[i], z[i] - zb[i]);
+        if (gsl_finite(x[i]) != gsl_finite(xb[i])) largest_batch_error = INFINITY;
+        else if (gsl_finite(x[i]) && !(error <= largest_batch_error)) largest_batch_error = error;
+    }
+    if (!(largest_batch_error <= BENCHMARK_KEPLER_TOLERANCE)) status = 1;
+
+    printf("universal_kepler  orbitalElements_propagate %7.2f ns  keplerBatch_compute %7.2f ns (%.2fx)  "
+           "%d universal, %d other  largest difference %.2e AU\n",
+           1e9 * (t1 - t0) / count / repeats, 1e9 * (t2 - t1) / count / repeats, (t1 - t0) / (t2 - t1),
+           batch.universal_count, batch.other_count, largest_batch_error);
+
+    keplerBatch_free(&batch);
+    free(body_ids);
+    free(xyz);
+    return status || (nan_count > 0);
+}
+
+//! benchmark_name_lookup - Time the resolution of object names into body IDs with <orbitalElements_findBody>, as is
+//! done for every object requested, using the names and designations of every comet in Soft00Cmt
+//! \param [in] repeats - The number of times to look up each name
+
+static void benchmark_name_lookup(int repeats) {
+    int i, j, found = 0, lookups = 0;
+
+    orbitalElements_comets_init();
+    double t0 = benchmark_time();
+    for (j = 0; j < repeats; j++)
+        for (i = 0; i < comet_count; i++) {
+            const orbitalElementsNames *names = orbitalElements_comets_fetchNames(i);
+            found += (orbitalElements_findBody(names->name) >= 0) + (orbitalElements_findBody(names->name2) >= 0);
+            lookups += 2;
+        }
+    double t1 = benchmark_time();
+
+    printf("name_lookup  %d lookups  orbitalElements_findBody %7.2f ns  %d found\n",
+           lookups, 1e9 * (t1 - t0) / lookups, found);
+}
+
+int benchmarks_main(int argc, char **argv) {
+    long evaluations = 2000000;
+    double jd_min = 2451545.0;
+    int i, status = 0;
+
+    // Initialise sub-modules
+    lt_memoryInit(&ephem_error, &ephem_log);
+
+    if (argc > 1) {
+        if (!valid_float(argv[1], NULL)) {
+            snprintf(temp_err_string, FNAME_LENGTH,
+                     "benchmarks.bin should be provided the number of evaluations to time. Received <%s>.", argv[1]);
+            ephem_error(temp_err_string);
+            return 1;
+        }
+        evaluations = (long) get_float(argv[1], NULL);
+    }
+    if (argc > 2) {
+        if (!valid_float(argv[2], NULL)) {
+            snprintf(temp_err_string, FNAME_LENGTH,
+                     "benchmarks.bin should be provided a Julian day as its second argument. Received <%s>.",
+                     argv[2]);
+            ephem_error(temp_err_string);
+            return 1;
+        }
+        jd_min = get_float(argv[2], NULL);
+    }
+
+    printf("Chebyshev kernel: %s\n", chebyshev3_kernel_name());
+    for (i = 0; i < (int) (sizeof(chebyshev_lengths) / sizeof(chebyshev_lengths[0])); i++) {
+        benchmark_chebyshev(chebyshev_lengths[i], evaluations);
+    }
+
+    // Time DE430 lookups for one year at one-minute steps, for the Earth-Moon barycentre, the Moon and the Sun
+    benchmark_jpl_batch(2, jd_min, 525960);
+    benchmark_jpl_batch(9, jd_min, 525960);
+    benchmark_jpl_batch(10, jd_min, 525960);
+
+    // Time the formatting of a ten-year text ephemeris of Jupiter at one-minute steps
+    benchmark_text_output(4, jd_min, 5259600);
+
+    // Time the positions of a catalogue the size of astorb.dat at a single epoch
+    if (benchmark_kepler_batch(1500000) != 0) status = 1;
+    if (benchmark_universal_kepler() != 0) status = 1;
+    benchmark_name_lookup(100);
+
+    if (status != 0) ephem_error("The Kepler solvers disagree by more than BENCHMARK_KEPLER_TOLERANCE.");
+
+    lt_freeAll(0);
+    lt_memoryStop();
+    return status;
+}
@@ -26,6 +26,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "strConstants.h"
+
 //! get_digit - Turn a numeric character into an int
 //! \param [in] c The character to convert
 //! \return The integer represented by the character
@@ -126,9 +128,10 @@ int valid_float(const char *str, int *end) {
 //! \param SigFig The number of significant figures to display
 //! \param latex Boolean flag indicating whether we should produce LaTeX output (true) or human-readable output (false)
 //! \return String-representation, contained in a static char buffer which may be overwritten by subsequent calls
+//! from the same thread
 
 char *numeric_display(double in, int N, int sig_fig, int latex) {
-    static char format[16], output_a[128], output_b[128], output_c[128], output_d[128];
+    static EPHEM_THREAD_LOCAL char format[16], output_a[128], output_b[128], output_c[128], output_d[128];
     double x, AccLevel;
     char *output;
     int decimal_level, dp_max, i, j, k, l;
@@ -241,13 +244,19 @@ const char *next_word(const char *in) {
 }
 
 //! friendly_time_string - Return pointer to time string in standard format, stored in a static string buffer which will
-//! by overwritten by subsequent function calls.
+//! by overwritten by subsequent function calls from the same thread.
 //! \return A time string
 
 char *friendly_time_string() {
+    static EPHEM_THREAD_LOCAL char output[32];
     time_t timenow;
     timenow = time(NULL);
-    return (ctime(&timenow));
+#if defined(_WIN32)
+    ctime_s(output, sizeof(output), &timenow);
+#else
+    ctime_r(&timenow, output);
+#endif
+    return output;
 }
 
 //! str_strip - Strip whitespace from both ends of a string and copy to a new character array
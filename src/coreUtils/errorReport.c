@@ -29,9 +29,10 @@
 
 #include "errorReport.h"
 
-// Buffers used for preparing logging messages. Note that this is not at all thread-safe.
-static char temp_stringA[LSTR_LENGTH], temp_stringB[LSTR_LENGTH], temp_stringC[LSTR_LENGTH], temp_stringD[LSTR_LENGTH], temp_stringE[LSTR_LENGTH];
-char temp_err_string[FNAME_LENGTH];
+// Buffers used for preparing logging messages. Each thread has its own, so that threads may report messages at once.
+static EPHEM_THREAD_LOCAL char temp_stringA[LSTR_LENGTH], temp_stringB[LSTR_LENGTH], temp_stringC[LSTR_LENGTH],
+        temp_stringD[LSTR_LENGTH], temp_stringE[LSTR_LENGTH];
+EPHEM_THREAD_LOCAL char temp_err_string[FNAME_LENGTH];
 
 //! ephem_error - Output an error log message to stderr
 //! \param [in] msg - Message to output
@@ -25,8 +25,9 @@
 #define ERRORREPORT_H 1
 
 #include "partial_file.h"
+#include "coreUtils/strConstants.h"
 
-extern char temp_err_string[];
+extern EPHEM_THREAD_LOCAL char temp_err_string[];
 
 void ephem_error(char *msg);
 
@@ -0,0 +1,111 @@
+// mappedFile.c
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Memory mapping is not available when compiling to WebAssembly, where file access goes via <partial_file.h>
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+#define MAPPED_FILE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define MAPPED_FILE_MMAP 0
+#endif
+
+#include "mappedFile.h"
+
+//! mapped_file_available - Report whether this platform is able to memory-map files
+//! \return Boolean flag indicating whether <mapped_file_open> can ever succeed
+
+int mapped_file_available() {
+    return MAPPED_FILE_MMAP;
+}
+
+//! mapped_file_open - Map the whole of a file into memory, read-only. Pages are loaded lazily by the operating system
+//! as they are first touched, and are shared between all threads (and all processes) which map the same file.
+//! \param [in] filename - The filename of the file to map
+//! \param [out] out - The mapping. On failure, out->data is set to NULL.
+//! \return - Zero on success
+
+int mapped_file_open(const char *filename, mapped_file *out) {
+    out->data = NULL;
+    out->length = 0;
+#if MAPPED_FILE_MMAP
+    struct stat file_status;
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 1;
+
+    if ((fstat(fd, &file_status) != 0) || (file_status.st_size <= 0)) {
+        close(fd);
+        return 1;
+    }
+
+    void *data = mmap(NULL, (size_t) file_status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping holds its own reference to the file, so we can close the descriptor straight away
+    close(fd);
+    if (data == MAP_FAILED) return 1;
+
+    out->data = (const unsigned char *) data;
+    out->length = (size_t) file_status.st_size;
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+//! mapped_file_close - Release a mapping created by <mapped_file_open>
+//! \param [in] mapping - The mapping to release
+
+void mapped_file_close(mapped_file *mapping) {
+#if MAPPED_FILE_MMAP
+    if (mapping->data != NULL) munmap((void *) mapping->data, mapping->length);
+#endif
+    mapping->data = NULL;
+    mapping->length = 0;
+}
+
+//! mapped_file_prefetch - Load part of a mapped file into memory, so that later accesses to it do not stall on disk
+//! I/O. This blocks until the pages are resident, so it is best called from a background thread.
+//! \param [in] mapping - The mapping to load pages of
+//! \param [in] offset - The offset of the first byte to load
+//! \param [in] length - The number of bytes to load
+
+void mapped_file_prefetch(const mapped_file *mapping, size_t offset, size_t length) {
+#if MAPPED_FILE_MMAP
+    if ((mapping->data == NULL) || (offset >= mapping->length)) return;
+    if (length > mapping->length - offset) length = mapping->length - offset;
+
+    // Ask the kernel to start reading the whole range at once, which is much faster than faulting in each page
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t start = offset - (offset % page_size);
+    madvise((void *) (mapping->data + start), offset + length - start, MADV_WILLNEED);
+
+    // Then touch each page, which waits until it has arrived
+    volatile unsigned char sink = 0;
+    for (size_t position = start; position < offset + length; position += page_size) sink ^= mapping->data[position];
+    (void) sink;
+#endif
+}
@@ -0,0 +1,43 @@
+// mappedFile.h
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H 1
+
+#include <stddef.h>
+
+//! mapped_file - A read-only memory mapping of an entire file on disk
+
+typedef struct {
+    const unsigned char *data;  // Start of the mapping; NULL if the file is not mapped
+    size_t length;  // Length of the mapping, in bytes (equal to the size of the file)
+} mapped_file;
+
+int mapped_file_available();
+
+int mapped_file_open(const char *filename, mapped_file *out);
+
+void mapped_file_close(mapped_file *mapping);
+
+void mapped_file_prefetch(const mapped_file *mapping, size_t offset, size_t length);
+
+#endif
+
@@ -0,0 +1,209 @@
+// outputBuffer.c
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "coreUtils/errorReport.h"
+
+#include "outputBuffer.h"
+
+//! output_buffer_init - Prepare an empty output buffer
+//! \param [out] buffer - The buffer to prepare
+
+void output_buffer_init(output_buffer *buffer) {
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+//! output_buffer_free - Release the memory held by an output buffer, discarding any output it holds
+//! \param [in] buffer - The buffer to release
+
+void output_buffer_free(output_buffer *buffer) {
+    free(buffer->data);
+    output_buffer_init(buffer);
+}
+
+//! output_buffer_reserve - Make sure that an output buffer has room for more output, growing it if necessary
+//! \param [in,out] buffer - The buffer to grow
+//! \param [in] length - The number of bytes of output which are about to be added
+
+void output_buffer_reserve(output_buffer *buffer, size_t length) {
+    if (buffer->length + length <= buffer->capacity) return;
+
+    // Grow by doubling, so that adding output takes constant time on average
+    size_t capacity = (buffer->capacity > 0) ? buffer->capacity : 4096;
+    while (capacity < buffer->length + length) capacity *= 2;
+
+    char *grown = (char *) realloc(buffer->data, capacity);
+    if (grown == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+}
+
+//! output_buffer_write - Append bytes to an output buffer
+//! \param [in,out] buffer - The buffer to append to
+//! \param [in] data - The bytes to append
+//! \param [in] length - The number of bytes to append
+
+void output_buffer_write(output_buffer *buffer, const void *data, size_t length) {
+    output_buffer_reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+//! output_buffer_printf - Append formatted text to an output buffer, in the manner of <fprintf>
+//! \param [in,out] buffer - The buffer to append to
+//! \param [in] format - The format string
+
+void output_buffer_printf(output_buffer *buffer, const char *format, ...) {
+    va_list args;
+
+    // Try formatting into the space we already have, which is usually enough
+    output_buffer_reserve(buffer, 256);
+    va_start(args, format);
+    int length = vsnprintf(buffer->data + buffer->length, buffer->capacity - buffer->length, format, args);
+    va_end(args);
+    if (length < 0) return;
+
+    // If the text didn't fit, then grow the buffer and format it again
+    if ((size_t) length >= buffer->capacity - buffer->length) {
+        output_buffer_reserve(buffer, (size_t) length + 1);
+        va_start(args, format);
+        vsnprintf(buffer->data + buffer->length, buffer->capacity - buffer->length, format, args);
+        va_end(args);
+    }
+    buffer->length += (size_t) length;
+}
+
+#ifdef __SIZEOF_INT128__
+// Powers of ten which fit in 64 bits
+static const uint64_t output_buffer_powers10[20] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+        10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+        1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+        10000000000000000000ULL
+};
+#endif
+
+//! output_buffer_fixed - Append a number to an output buffer in fixed-point notation, producing exactly the same
+//! text as <printf> does with the format %<width>.<precision>f, followed by a suffix. Unlike <printf>, this does not
+//! need to parse a format string, and it converts the number to decimal using integer arithmetic. The result is
+//! rounded from the exact binary value of the number, with ties going to even, as glibc does.
+//! \param [in,out] buffer - The buffer to append to
+//! \param [in] value - The number to write
+//! \param [in] width - The minimum width of the field; the number is padded on the left with spaces
+//! \param [in] precision - The number of decimal places to show (0-18)
+//! \param [in] suffix - Text to append after the number, e.g. column separators
+
+void output_buffer_fixed(output_buffer *buffer, double value, int width, int precision, const char *suffix) {
+#ifdef __SIZEOF_INT128__
+    // Numbers whose integer part is too large for the fast path, and NaNs and infinities, go to <printf>
+    if ((precision >= 0) && (precision <= 18) && (fabs(value) < 1e15)) {
+        char digits[48];
+        char *end = digits + sizeof(digits);
+        char *start = end;
+        const double magnitude = fabs(value);
+        const double integer_part = floor(magnitude);
+        uint64_t integer = (uint64_t) integer_part;
+        uint64_t fraction = 0;
+
+        // The fractional part is exactly <mantissa> * 2^-<shift>. Multiply it by 10^<precision> and shift it right,
+        // rounding the bits which are shifted out to nearest, with ties to even.
+        const double fraction_part = magnitude - integer_part;
+        if (fraction_part > 0) {
+            uint64_t bits;
+            memcpy(&bits, &fraction_part, sizeof(bits));
+            const int exponent = (int) ((bits >> 52) & 0x7ff);
+            const uint64_t mantissa = (bits & 0xfffffffffffffULL) | ((exponent > 0) ? (1ULL << 52) : 0);
+            const int shift = (exponent > 0) ? (1075 - exponent) : 1074;
+
+            if (shift < 128) {
+                const unsigned __int128 product = (unsigned __int128) mantissa * output_buffer_powers10[precision];
+                const unsigned __int128 remainder = product & ((((unsigned __int128) 1) << shift) - 1);
+                const unsigned __int128 half = ((unsigned __int128) 1) << (shift - 1);
+                fraction = (uint64_t) (product >> shift);
+
+                // The last digit shown is the last digit of <fraction>, or of <integer> if no decimals are shown
+                const uint64_t last_digit = (precision > 0) ? fraction : integer;
+                if ((remainder > half) || ((remainder == half) && (last_digit & 1))) fraction++;
+            }
+
+            // Rounding may carry into the integer part
+            if (fraction == output_buffer_powers10[precision]) {
+                fraction = 0;
+                integer++;
+            }
+        }
+
+        // Write the digits from right to left
+        for (int i = 0; i < precision; i++) {
+            *--start = (char) ('0' + fraction % 10);
+            fraction /= 10;
+        }
+        if (precision > 0) *--start = '.';
+        do {
+            *--start = (char) ('0' + integer % 10);
+            integer /= 10;
+        } while (integer > 0);
+        if (signbit(value)) *--start = '-';
+
+        const int length = (int) (end - start);
+        const size_t suffix_length = strlen(suffix);
+        const int padding = (width > length) ? (width - length) : 0;
+        output_buffer_reserve(buffer, padding + length + suffix_length);
+        memset(buffer->data + buffer->length, ' ', padding);
+        memcpy(buffer->data + buffer->length + padding, start, length);
+        memcpy(buffer->data + buffer->length + padding + length, suffix, suffix_length);
+        buffer->length += padding + length + suffix_length;
+        return;
+    }
+#endif
+
+    output_buffer_printf(buffer, "%*.*f%s", width, precision, value, suffix);
+}
+
+//! output_buffer_flush - Write the contents of an output buffer to a stream, and empty the buffer
+//! \param [in,out] buffer - The buffer to write out
+//! \param [in] output - The stream to write to
+
+void output_buffer_flush(output_buffer *buffer, FILE *output) {
+    if (buffer->length > 0) fwrite(buffer->data, 1, buffer->length, output);
+    buffer->length = 0;
+}
+
+//! output_buffer_flushIfFull - Write the contents of an output buffer to a stream, and empty the buffer, if it holds
+//! more than OUTPUT_BUFFER_FLUSH_LENGTH bytes. This keeps memory use bounded when a long output is produced serially.
+//! \param [in,out] buffer - The buffer to write out
+//! \param [in] output - The stream to write to
+
+void output_buffer_flushIfFull(output_buffer *buffer, FILE *output) {
+    if (buffer->length >= OUTPUT_BUFFER_FLUSH_LENGTH) output_buffer_flush(buffer, output);
+}
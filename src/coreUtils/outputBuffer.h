@@ -0,0 +1,57 @@
+// outputBuffer.h
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H 1
+
+#include <stddef.h>
+#include <stdio.h>
+
+//! The length above which <output_buffer_flushIfFull> writes a buffer out
+#define OUTPUT_BUFFER_FLUSH_LENGTH 65536
+
+//! output_buffer - A growable block of memory into which output is assembled before it is written to a stream. This
+//! lets output be prepared by several threads at once, and then written out in order.
+
+typedef struct {
+    char *data;  // The output assembled so far; not null-terminated
+    size_t length;  // The number of bytes of output in <data>
+    size_t capacity;  // The number of bytes allocated for <data>
+} output_buffer;
+
+void output_buffer_init(output_buffer *buffer);
+
+void output_buffer_free(output_buffer *buffer);
+
+void output_buffer_reserve(output_buffer *buffer, size_t length);
+
+void output_buffer_write(output_buffer *buffer, const void *data, size_t length);
+
+void output_buffer_printf(output_buffer *buffer, const char *format, ...);
+
+void output_buffer_fixed(output_buffer *buffer, double value, int width, int precision, const char *suffix);
+
+void output_buffer_flush(output_buffer *buffer, FILE *output);
+
+void output_buffer_flushIfFull(output_buffer *buffer, FILE *output);
+
+#endif
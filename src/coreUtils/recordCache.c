@@ -0,0 +1,343 @@
+// recordCache.c
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+// Positioned reads let many threads read the same file without sharing a file position. They are not available when
+// compiling to WebAssembly, where file access goes via <partial_file.h>.
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+#define RECORD_CACHE_PREAD 1
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define RECORD_CACHE_PREAD 0
+#endif
+
+#include "coreUtils/errorReport.h"
+
+#include "recordCache.h"
+
+//! record_cache_reset - Initialise all the fields of a record_cache structure to an empty state
+//! \param [out] cache - The record cache to initialise
+
+static void record_cache_reset(record_cache *cache) {
+    cache->filename[0] = '\0';
+    cache->offset = 0;
+    cache->record_size = 0;
+    cache->record_count = 0;
+    cache->data = NULL;
+    cache->map.data = NULL;
+    cache->map.length = 0;
+    cache->state = NULL;
+    cache->owns_data = 0;
+    cache->fd = -1;
+    cache->file = NULL;
+    pthread_mutex_init(&cache->file_lock, NULL);
+    cache->readahead_started = 0;
+    cache->readahead_stop = 0;
+    cache->readahead_first = 0;
+    cache->readahead_last = -1;
+    pthread_mutex_init(&cache->readahead_lock, NULL);
+    pthread_cond_init(&cache->readahead_wake, NULL);
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+}
+
+//! record_cache_open - Open a table of records stored in a binary file. If the file can be memory-mapped, and the
+//! records are suitably aligned, records are used in place. Otherwise, we allocate a buffer to hold the records, and
+//! read each one from disk the first time it is fetched.
+//! \param [out] cache - The record cache to initialise
+//! \param [in] filename - The binary file containing the records
+//! \param [in] offset - The offset of the first record from the start of the file
+//! \param [in] record_size - The size of each record, in bytes
+//! \param [in] record_count - The number of records in the table
+//! \return - Zero on success
+
+int record_cache_open(record_cache *cache, const char *filename, long offset, size_t record_size, int record_count) {
+    record_cache_reset(cache);
+    snprintf(cache->filename, FNAME_LENGTH, "%s", filename);
+    cache->offset = offset;
+    cache->record_size = record_size;
+    cache->record_count = record_count;
+
+    const size_t data_bytes = record_size * (size_t) record_count;
+
+    // Use the records in place if we can map the file into memory, and the records are aligned to 8-byte boundaries
+    if (((offset % sizeof(double)) == 0) && ((record_size % sizeof(double)) == 0) &&
+        (mapped_file_open(filename, &cache->map) == 0)) {
+        if (cache->map.length >= offset + data_bytes) {
+            cache->data = (unsigned char *) (cache->map.data + offset);
+            return 0;
+        }
+        mapped_file_close(&cache->map);
+    }
+
+    // Otherwise, allocate storage for records to be read as they are needed
+    cache->data = (unsigned char *) malloc(data_bytes);
+    cache->owns_data = 1;
+    cache->state = (atomic_uchar *) malloc(record_count * sizeof(atomic_uchar));
+    if ((cache->data == NULL) || (cache->state == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    for (int i = 0; i < record_count; i++) atomic_init(&cache->state[i], RECORD_ABSENT);
+
+#if RECORD_CACHE_PREAD
+    cache->fd = open(filename, O_RDONLY);
+    if (cache->fd < 0) {
+        record_cache_close(cache);
+        return 1;
+    }
+#else
+    cache->file = fopen(filename, "rb");
+    if (cache->file == NULL) {
+        record_cache_close(cache);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+//! record_cache_wrap - Make a record cache from a table of records which is already held in memory. The buffer remains
+//! the property of the caller, and must outlive the cache.
+//! \param [out] cache - The record cache to initialise
+//! \param [in] data - The table of records
+//! \param [in] record_size - The size of each record, in bytes
+//! \param [in] record_count - The number of records in the table
+
+void record_cache_wrap(record_cache *cache, void *data, size_t record_size, int record_count) {
+    record_cache_reset(cache);
+    cache->record_size = record_size;
+    cache->record_count = record_count;
+    cache->data = (unsigned char *) data;
+    cache->state = (atomic_uchar *) malloc(record_count * sizeof(atomic_uchar));
+    if (cache->state == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    for (int i = 0; i < record_count; i++) atomic_init(&cache->state[i], RECORD_READY);
+}
+
+//! record_cache_read - Read a single record from disk into the cache's storage
+//! \param [in] cache - The record cache
+//! \param [in] index - The index of the record to read
+
+static void record_cache_read(record_cache *cache, int index) {
+    unsigned char *destination = cache->data + (size_t) index * cache->record_size;
+    const long position = cache->offset + (long) index * (long) cache->record_size;
+
+#if RECORD_CACHE_PREAD
+    size_t bytes_read = 0;
+    while (bytes_read < cache->record_size) {
+        const ssize_t status = pread(cache->fd, destination + bytes_read, cache->record_size - bytes_read,
+                                     (off_t) (position + bytes_read));
+        if (status <= 0) {
+            char buffer[LSTR_LENGTH];
+            snprintf(buffer, LSTR_LENGTH, "Failure while trying to read record %d from file <%s>", index,
+                     cache->filename);
+            ephem_fatal(__FILE__, __LINE__, buffer);
+            exit(1);
+        }
+        bytes_read += (size_t) status;
+    }
+#else
+    pthread_mutex_lock(&cache->file_lock);
+    fseek(cache->file, position, SEEK_SET);
+    dcf_fread((void *) destination, cache->record_size, 1, cache->file, cache->filename, __FILE__, __LINE__);
+    pthread_mutex_unlock(&cache->file_lock);
+#endif
+}
+
+//! record_cache_load - Make sure that a record has been loaded from disk. If another thread is already loading the
+//! record, we wait for it to finish.
+//! \param [in] cache - The record cache, which must not be memory-mapped
+//! \param [in] index - The index of the record to load
+//! \return - Boolean flag indicating whether this call read the record from disk
+
+static int record_cache_load(record_cache *cache, int index) {
+    // Fast path: record has already been published
+    if (atomic_load_explicit(&cache->state[index], memory_order_acquire) == RECORD_READY) return 0;
+
+    // Try to claim the job of loading this record
+    unsigned char expected = RECORD_ABSENT;
+    if (atomic_compare_exchange_strong_explicit(&cache->state[index], &expected, RECORD_LOADING,
+                                                memory_order_acquire, memory_order_acquire)) {
+        record_cache_read(cache, index);
+        atomic_store_explicit(&cache->state[index], RECORD_READY, memory_order_release);
+        return 1;
+    }
+
+    // Another thread is loading this record; wait until it has been published
+    while (atomic_load_explicit(&cache->state[index], memory_order_acquire) != RECORD_READY) sched_yield();
+    return 0;
+}
+
+//! record_cache_fetch - Fetch a pointer to a record, loading it from disk if this is the first time it has been
+//! requested. If another thread is already loading the record, we wait for it to finish.
+//! \param [in] cache - The record cache
+//! \param [in] index - The index of the record to fetch
+//! \return - Pointer to the record, or NULL if the index is out of range
+
+const void *record_cache_fetch(record_cache *cache, int index) {
+    if ((index < 0) || (index >= cache->record_count)) return NULL;
+
+    const void *record = cache->data + (size_t) index * cache->record_size;
+
+    // Records in a memory-mapped file are always available
+    const int missed = (cache->state != NULL) && record_cache_load(cache, index);
+
+    // Fetches are only counted in debugging builds, which report the counts. Otherwise every thread would contend for
+    // the same counter on every fetch.
+    if (DEBUG) atomic_fetch_add_explicit(missed ? &cache->misses : &cache->hits, 1, memory_order_relaxed);
+    return record;
+}
+
+//! record_cache_load_all - Make sure that every record in the cache has been loaded from disk
+//! \param [in] cache - The record cache
+
+void record_cache_load_all(record_cache *cache) {
+    record_cache_preload(cache, 0, cache->record_count - 1);
+}
+
+//! record_cache_preload - Make sure that a range of records is held in memory, so that fetching them later does not
+//! wait for disk I/O. If the file is memory-mapped, this pulls its pages into the page cache. This does not count
+//! towards the cache's hit and miss statistics.
+//! \param [in] cache - The record cache
+//! \param [in] first - The index of the first record to load
+//! \param [in] last - The index of the last record to load (inclusive)
+
+void record_cache_preload(record_cache *cache, int first, int last) {
+    if (first < 0) first = 0;
+    if (last >= cache->record_count) last = cache->record_count - 1;
+    if (first > last) return;
+
+    if (cache->state == NULL) {
+        if (cache->map.data != NULL) {
+            mapped_file_prefetch(&cache->map, cache->offset + (size_t) first * cache->record_size,
+                                 (size_t) (last - first + 1) * cache->record_size);
+        }
+        return;
+    }
+
+    for (int i = first; i <= last; i++) record_cache_load(cache, i);
+}
+
+//! record_cache_readahead_thread - Body of the background thread which loads records requested via
+//! <record_cache_readahead>. It runs until <record_cache_close> asks it to stop.
+//! \param [in] arg - The record cache
+
+static void *record_cache_readahead_thread(void *arg) {
+    record_cache *cache = (record_cache *) arg;
+
+    pthread_mutex_lock(&cache->readahead_lock);
+    while (1) {
+        while (!cache->readahead_stop && (cache->readahead_first > cache->readahead_last)) {
+            pthread_cond_wait(&cache->readahead_wake, &cache->readahead_lock);
+        }
+        if (cache->readahead_stop) break;
+
+        // Take the pending request, and release the lock while we do the I/O
+        const int first = cache->readahead_first;
+        const int last = cache->readahead_last;
+        cache->readahead_first = 0;
+        cache->readahead_last = -1;
+        pthread_mutex_unlock(&cache->readahead_lock);
+        record_cache_preload(cache, first, last);
+        pthread_mutex_lock(&cache->readahead_lock);
+    }
+    pthread_mutex_unlock(&cache->readahead_lock);
+    return NULL;
+}
+
+//! record_cache_readahead - Ask a background thread to load a range of records, and return immediately. Only the most
+//! recent request is kept: if the thread is still busy, any earlier request which it has not yet started is replaced.
+//! The thread is started the first time this is called. If it cannot be started, the request is ignored, and records
+//! are loaded when they are fetched, as usual.
+//! \param [in] cache - The record cache
+//! \param [in] first - The index of the first record to load
+//! \param [in] last - The index of the last record to load (inclusive)
+
+void record_cache_readahead(record_cache *cache, int first, int last) {
+    // Records which are already in memory, and were never on disk, do not need reading ahead
+    if ((cache->map.data == NULL) && (cache->fd < 0) && (cache->file == NULL)) return;
+
+    pthread_mutex_lock(&cache->readahead_lock);
+    if (!cache->readahead_started) {
+        cache->readahead_stop = 0;
+        cache->readahead_started =
+                (pthread_create(&cache->readahead_thread, NULL, record_cache_readahead_thread, cache) == 0);
+    }
+    if (cache->readahead_started) {
+        cache->readahead_first = first;
+        cache->readahead_last = last;
+        pthread_cond_signal(&cache->readahead_wake);
+    }
+    pthread_mutex_unlock(&cache->readahead_lock);
+}
+
+//! record_cache_stats - Report how many fetches from a record cache were served from memory, and how many required a
+//! read from disk. Fetches are only counted if DEBUG is set; otherwise both counts are zero.
+//! \param [in] cache - The record cache
+//! \param [out] hits - The number of fetches which found the record already loaded
+//! \param [out] misses - The number of fetches which read the record from disk
+
+void record_cache_stats(record_cache *cache, unsigned long *hits, unsigned long *misses) {
+    *hits = atomic_load_explicit(&cache->hits, memory_order_relaxed);
+    *misses = atomic_load_explicit(&cache->misses, memory_order_relaxed);
+}
+
+//! record_cache_close - Release all the resources held by a record cache
+//! \param [in] cache - The record cache
+
+void record_cache_close(record_cache *cache) {
+    // Stop the read-ahead thread before releasing the storage it writes into
+    pthread_mutex_lock(&cache->readahead_lock);
+    const int readahead_started = cache->readahead_started;
+    cache->readahead_stop = 1;
+    pthread_cond_signal(&cache->readahead_wake);
+    pthread_mutex_unlock(&cache->readahead_lock);
+    if (readahead_started) pthread_join(cache->readahead_thread, NULL);
+    cache->readahead_started = 0;
+
+    if (cache->map.data != NULL) {
+        mapped_file_close(&cache->map);
+    } else if (cache->owns_data && (cache->data != NULL)) {
+        free(cache->data);
+    }
+    if (cache->state != NULL) free(cache->state);
+#if RECORD_CACHE_PREAD
+    if (cache->fd >= 0) close(cache->fd);
+#else
+    if (cache->file != NULL) fclose(cache->file);
+#endif
+    pthread_mutex_destroy(&cache->file_lock);
+    pthread_mutex_destroy(&cache->readahead_lock);
+    pthread_cond_destroy(&cache->readahead_wake);
+    cache->data = NULL;
+    cache->state = NULL;
+    cache->owns_data = 0;
+    cache->fd = -1;
+    cache->file = NULL;
+    cache->record_count = 0;
+}
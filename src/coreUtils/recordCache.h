@@ -0,0 +1,84 @@
+// recordCache.h
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef RECORDCACHE_H
+#define RECORDCACHE_H 1
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "coreUtils/mappedFile.h"
+#include "coreUtils/strConstants.h"
+
+//! record_cache - A table of fixed-size records stored in a binary file, which are loaded on demand. Any number of
+//! threads may fetch records concurrently. Each record is loaded exactly once, by whichever thread first asks for it,
+//! and is then published to all other threads with release/acquire ordering, so no thread can ever see a record
+//! which is only partially written. Where possible, the file is memory-mapped and records are used in place.
+
+typedef struct {
+    char filename[FNAME_LENGTH];  // Filename of the binary file the records are read from
+    long offset;  // Offset of the first record from the start of the file
+    size_t record_size;  // Size of each record, in bytes
+    int record_count;  // Number of records in the table
+
+    unsigned char *data;  // Storage for the records (points into <map> if the file is memory-mapped)
+    mapped_file map;  // Read-only memory mapping of the file, if available
+    atomic_uchar *state;  // The state of each record: RECORD_ABSENT, RECORD_LOADING or RECORD_READY
+    int owns_data;  // Boolean flag indicating whether <data> was allocated by the cache, and should be freed by it
+
+    int fd;  // File descriptor used to read records, if the file is not memory-mapped
+    FILE *file;  // File handle used to read records on platforms without pread()
+    pthread_mutex_t file_lock;  // Lock on <file>, which has a shared file position
+
+    pthread_t readahead_thread;  // Background thread which loads records before they are needed
+    int readahead_started;  // Boolean flag indicating whether <readahead_thread> is running
+    int readahead_stop;  // Boolean flag asking <readahead_thread> to exit
+    int readahead_first, readahead_last;  // The range of records <readahead_thread> should load next (empty if first > last)
+    pthread_mutex_t readahead_lock;  // Lock on the fields above
+    pthread_cond_t readahead_wake;  // Signalled when there is new work for <readahead_thread>
+
+    atomic_ulong hits;  // Number of fetches which found the record already loaded; only counted if DEBUG is set
+    atomic_ulong misses;  // Number of fetches which had to load the record from disk; only counted if DEBUG is set
+} record_cache;
+
+#define RECORD_ABSENT  0
+#define RECORD_LOADING 1
+#define RECORD_READY   2
+
+int record_cache_open(record_cache *cache, const char *filename, long offset, size_t record_size, int record_count);
+
+void record_cache_wrap(record_cache *cache, void *data, size_t record_size, int record_count);
+
+const void *record_cache_fetch(record_cache *cache, int index);
+
+void record_cache_load_all(record_cache *cache);
+
+void record_cache_preload(record_cache *cache, int first, int last);
+
+void record_cache_readahead(record_cache *cache, int first, int last);
+
+void record_cache_stats(record_cache *cache, unsigned long *hits, unsigned long *misses);
+
+void record_cache_close(record_cache *cache);
+
+#endif
+
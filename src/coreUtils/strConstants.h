@@ -26,5 +26,15 @@
 #define FNAME_LENGTH  4096
 #define SSTR_LENGTH   2048
 
+//! EPHEM_THREAD_LOCAL - Storage class for string buffers which each thread needs its own copy of, so that many
+//! threads can prepare messages at the same time
+#if defined(__cplusplus)
+#define EPHEM_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define EPHEM_THREAD_LOCAL __declspec(thread)
+#else
+#define EPHEM_THREAD_LOCAL _Thread_local
+#endif
+
 #endif
 
@@ -0,0 +1,128 @@
+// textFile.c
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "coreUtils/errorReport.h"
+
+#include "textFile.h"
+
+//! text_file_open - Load a text file into memory. If possible, the file is memory-mapped, and read lazily by the
+//! operating system as its pages are touched. Files which cannot be mapped, or which do not end with a newline, are
+//! read into a buffer instead.
+//! \param [in] filename - The filename of the text file
+//! \param [out] out - The text file
+//! \return - Zero on success
+
+int text_file_open(const char *filename, text_file *out) {
+    memset(out, 0, sizeof(text_file));
+
+    if (mapped_file_open(filename, &out->map) == 0) {
+        if (out->map.data[out->map.length - 1] == '\n') {
+            out->data = (const char *) out->map.data;
+            out->length = out->map.length;
+            return 0;
+        }
+        mapped_file_close(&out->map);
+    }
+
+    FILE *input = fopen(filename, "rb");
+    if (input == NULL) return 1;
+    fseek(input, 0L, SEEK_END);
+    const size_t length = (size_t) ftell(input);
+    fseek(input, 0L, SEEK_SET);
+
+    // Leave room to add a newline at the end
+    out->buffer = (char *) malloc(length + 1);
+    if (out->buffer == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    if (fread(out->buffer, 1, length, input) != length) {
+        fclose(input);
+        text_file_close(out);
+        return 1;
+    }
+    fclose(input);
+
+    out->length = length;
+    if ((length == 0) || (out->buffer[length - 1] != '\n')) out->buffer[out->length++] = '\n';
+    out->data = out->buffer;
+    return 0;
+}
+
+//! text_file_close - Release a text file opened by <text_file_open>
+//! \param [in] file - The text file to release
+
+void text_file_close(text_file *file) {
+    mapped_file_close(&file->map);
+    free(file->buffer);
+    file->buffer = NULL;
+    file->data = NULL;
+    file->length = 0;
+}
+
+//! text_file_split - Divide a text file into chunks of roughly equal size, each of which begins at the start of a
+//! line, so that each chunk can be parsed by a separate thread. Chunks may be empty if the file has very long lines.
+//! \param [in] file - The text file to divide
+//! \param [in] chunk_count - The number of chunks to divide it into
+//! \param [out] chunk_starts - Array of <chunk_count + 1> offsets. Chunk <i> spans the bytes from <chunk_starts[i]> up
+//! to <chunk_starts[i + 1]>.
+
+void text_file_split(const text_file *file, int chunk_count, size_t *chunk_starts) {
+    chunk_starts[0] = 0;
+    for (int i = 1; i < chunk_count; i++) {
+        size_t position = file->length / chunk_count * i;
+        if (position < chunk_starts[i - 1]) position = chunk_starts[i - 1];
+
+        // Move forwards to the start of the next line, unless we are already at the start of one
+        if ((position == 0) || (file->data[position - 1] == '\n')) {
+            chunk_starts[i] = position;
+        } else {
+            const char *newline = (const char *) memchr(file->data + position, '\n', file->length - position);
+            chunk_starts[i] = (newline == NULL) ? file->length : (size_t) (newline - file->data) + 1;
+        }
+    }
+    chunk_starts[chunk_count] = file->length;
+}
+
+//! text_file_next_line - Fetch the next line of a text file, within a chunk
+//! \param [in] file - The text file
+//! \param [in,out] position - The offset of the start of the line to fetch. This is advanced to the start of the
+//! following line.
+//! \param [in] end - The offset of the end of the chunk
+//! \param [out] length - The length of the line, excluding its newline, and any carriage return which precedes it
+//! \return - Pointer to the start of the line, which is not null-terminated, or NULL at the end of the chunk
+
+const char *text_file_next_line(const text_file *file, size_t *position, size_t end, int *length) {
+    if (*position >= end) return NULL;
+
+    const char *line = file->data + *position;
+    const char *newline = (const char *) memchr(line, '\n', file->length - *position);
+    int line_length = (int) (newline - line);
+    *position += (size_t) line_length + 1;
+    if ((line_length > 0) && (line[line_length - 1] == '\r')) line_length--;
+    *length = line_length;
+    return line;
+}
@@ -0,0 +1,48 @@
+// textFile.h
+// 
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+
+#ifndef TEXTFILE_H
+#define TEXTFILE_H 1
+
+#include <stddef.h>
+
+#include "coreUtils/mappedFile.h"
+
+//! text_file - A whole text file held in memory, so that its lines can be parsed in place, by many threads at once.
+//! The contents always end with a newline, so a parser working along a line will always stop before the end.
+
+typedef struct {
+    mapped_file map;  // The file mapped into memory, if the platform allows it
+    char *buffer;  // Otherwise, a copy of the file read into memory
+    const char *data;  // The contents of the file
+    size_t length;  // The number of bytes in <data>
+} text_file;
+
+int text_file_open(const char *filename, text_file *out);
+
+void text_file_close(text_file *file);
+
+void text_file_split(const text_file *file, int chunk_count, size_t *chunk_starts);
+
+const char *text_file_next_line(const text_file *file, size_t *position, size_t end, int *length);
+
+#endif
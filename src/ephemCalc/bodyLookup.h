@@ -0,0 +1,42 @@
+// bodyLookup.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+// Looking up solar system objects by name. These functions are defined in orbitalElements.c, but are declared here
+// separately, because orbitalElements.h uses C11 atomics and so cannot be included from C++.
+
+#ifndef BODYLOOKUP_H
+#define BODYLOOKUP_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int orbitalElements_findBody(const char *name);
+
+const char *orbitalElements_bodyName(int body_id);
+
+int orbitalElements_findBodiesByPrefix(const char *prefix, int *body_ids, int max_count);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+// columnarOutput.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gsl/gsl_math.h>
+
+#include "coreUtils/errorReport.h"
+
+#include "columnarOutput.h"
+#include "ephemContext.h"
+#include "orbitalElements.h"
+
+//! columnarOutput_quantity - The name and units of one of the quantities computed by <ephem_context_computeObjects>
+
+typedef struct {
+    const char *name;
+    const char *unit;
+} columnarOutput_quantity;
+
+// The quantities which may be written, in the order that they appear in <ephem_context.results>
+static const columnarOutput_quantity columnarOutput_quantities[EPHEM_PARAMETERS] = {
+        {"x",            "AU"},
+        {"y",            "AU"},
+        {"z",            "AU"},
+        {"ra",           "rad"},
+        {"dec",          "rad"},
+        {"mag",          "mag"},
+        {"phase",        ""},
+        {"ang_size",     "arcsec"},
+        {"phy_size",     "m"},
+        {"albedo",       ""},
+        {"sun_dist",     "AU"},
+        {"earth_dist",   "AU"},
+        {"sun_ang_dist", "rad"},
+        {"theta_eso",    "rad"},
+        {"ecl_lng",      "rad"},
+        {"ecl_dist",     "rad"},
+        {"ecl_lat",      "rad"},
+        {"vx",           "AU/day"},
+        {"vy",           "AU/day"},
+        {"vz",           "AU/day"}
+};
+
+//! columnarOutput_align - Round a file offset up to the next multiple of COLUMNAR_OUTPUT_ALIGNMENT
+//! \param [in] offset - The offset to round up
+//! \return - The rounded offset
+
+static uint64_t columnarOutput_align(uint64_t offset) {
+    return (offset + COLUMNAR_OUTPUT_ALIGNMENT - 1) / COLUMNAR_OUTPUT_ALIGNMENT * COLUMNAR_OUTPUT_ALIGNMENT;
+}
+
+//! columnarOutput_pad - Write zeros to a columnar binary ephemeris, to bring a section which is <length> bytes long
+//! up to the next multiple of COLUMNAR_OUTPUT_ALIGNMENT bytes
+//! \param [in] writer - The ephemeris being written
+//! \param [in] length - The length of the section which has just been written
+
+static void columnarOutput_pad(columnarOutput *writer, uint64_t length) {
+    static const char zeros[COLUMNAR_OUTPUT_ALIGNMENT] = {0};
+    fwrite(zeros, 1, (size_t) (columnarOutput_align(length) - length), writer->output);
+}
+
+//! columnarOutput_open - Begin writing a columnar binary ephemeris, by writing everything which precedes the blocks
+//! of results. The columns written are those which <settings.output_format> and <settings.output_velocity> select.
+//! \param [out] writer - The ephemeris to begin writing
+//! \param [in] output - The stream to write to
+//! \param [in] s - The settings describing the ephemeris, which must already have been processed
+//! \param [in] step_count - The number of time steps in the ephemeris
+
+void columnarOutput_open(columnarOutput *writer, FILE *output, const settings *s, int step_count) {
+    columnarOutput_header *header = &writer->header;
+    memset(writer, 0, sizeof(columnarOutput));
+    writer->output = output;
+
+    // Select the same columns as the other output modes, in the same order
+    int column_count = 0;
+    for (int i = 0; i < EPHEM_PARAMETERS; i++) {
+        if ((i < 3) && (s->output_format == 1)) continue;
+        if ((i >= 3) && (i < 5) && (s->output_format < 1)) continue;
+        if ((i >= 5) && (i < 8) && (s->output_format < 2)) continue;
+        if ((i >= 8) && (i < 17) && (s->output_format < 3)) continue;
+        if ((i >= 17) && !s->output_velocity) continue;
+        writer->columns[column_count++] = i;
+    }
+
+    // Choose the shape of the blocks. Each block holds the objects a chunk at a time, as they are computed. If all
+    // the objects fit in one chunk, then several time steps are held together, so that each column of each block is
+    // a long contiguous run.
+    const int body_count = s->objects_count;
+    int block_bodies = (body_count < EPHEM_CHUNK_OBJECTS) ? body_count : EPHEM_CHUNK_OBJECTS;
+    if (block_bodies < 1) block_bodies = 1;
+    int block_steps = 1;
+    if (body_count <= EPHEM_CHUNK_OBJECTS) block_steps = COLUMNAR_OUTPUT_BLOCK_VALUES / block_bodies;
+    if (block_steps > step_count) block_steps = step_count;
+    if (block_steps < 1) block_steps = 1;
+    writer->block_columns = (body_count + block_bodies - 1) / block_bodies;
+    const int block_rows = (step_count + block_steps - 1) / block_steps;
+
+    memcpy(header->magic, COLUMNAR_OUTPUT_MAGIC, sizeof(header->magic));
+    header->version = COLUMNAR_OUTPUT_VERSION;
+    header->byte_order = COLUMNAR_OUTPUT_BYTE_ORDER;
+    header->column_count = (uint32_t) column_count;
+    header->body_count = (uint32_t) body_count;
+    header->step_count = (uint32_t) step_count;
+    header->block_steps = (uint32_t) block_steps;
+    header->block_bodies = (uint32_t) block_bodies;
+    header->ecliptic = (s->output_format < 0);
+    header->topocentric = s->enable_topocentric_correction;
+    header->use_orbital_elements = s->use_orbital_elements;
+    header->jd_min = s->jd_min;
+    header->jd_step = s->jd_step;
+    header->ra_dec_epoch = s->ra_dec_epoch;
+    header->latitude = s->latitude;
+    header->longitude = s->longitude;
+    header->column_stride = columnarOutput_align((uint64_t) block_steps * block_bodies * sizeof(double));
+    header->block_length = header->column_stride * column_count;
+    header->columns_offset = columnarOutput_align(sizeof(columnarOutput_header));
+    header->bodies_offset = header->columns_offset +
+                            columnarOutput_align(column_count * sizeof(columnarOutput_column));
+    header->times_offset = header->bodies_offset +
+                           columnarOutput_align((uint64_t) body_count * sizeof(columnarOutput_body));
+    header->blocks_offset = header->times_offset + columnarOutput_align((uint64_t) step_count * sizeof(double));
+    header->file_length = header->blocks_offset +
+                          header->block_length * (uint64_t) block_rows * (uint64_t) writer->block_columns;
+
+    // Start the first block with every slot empty
+    writer->block = (double *) malloc(header->block_length);
+    if (writer->block == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    for (size_t i = 0; i < header->block_length / sizeof(double); i++) writer->block[i] = GSL_NAN;
+
+    fwrite(header, sizeof(columnarOutput_header), 1, output);
+    columnarOutput_pad(writer, sizeof(columnarOutput_header));
+
+    // Write the descriptions of the columns
+    {
+        columnarOutput_column columns[EPHEM_PARAMETERS];
+        memset(columns, 0, sizeof(columns));
+        for (int i = 0; i < column_count; i++) {
+            const columnarOutput_quantity *quantity = &columnarOutput_quantities[writer->columns[i]];
+            snprintf(columns[i].name, sizeof(columns[i].name), "%s", quantity->name);
+            snprintf(columns[i].unit, sizeof(columns[i].unit), "%s", quantity->unit);
+        }
+        fwrite(columns, sizeof(columnarOutput_column), column_count, output);
+        columnarOutput_pad(writer, column_count * sizeof(columnarOutput_column));
+    }
+
+    // Write the descriptions of the objects, one at a time, so that no table is needed of every object at once
+    for (int i = 0; i < body_count; i++) {
+        columnarOutput_body body;
+        memset(&body, 0, sizeof(body));
+        body.body_id = s->body_id[i];
+        const char *name = orbitalElements_bodyName(s->body_id[i]);
+        if (name != NULL) snprintf(body.name, sizeof(body.name), "%s", name);
+        fwrite(&body, sizeof(body), 1, output);
+    }
+    columnarOutput_pad(writer, (uint64_t) body_count * sizeof(columnarOutput_body));
+
+    // Write the time steps, computed in the same way as <ephem_context_compute>
+    for (int i = 0; i < step_count; i++) {
+        const double jd = s->jd_min + i * s->jd_step;
+        fwrite(&jd, sizeof(double), 1, output);
+    }
+    columnarOutput_pad(writer, (uint64_t) step_count * sizeof(double));
+}
+
+//! columnarOutput_addChunk - Add the quantities computed for a chunk of objects at one time step to a columnar
+//! binary ephemeris, writing out the block they belong to once it is complete. Chunks must be added in the order
+//! that they are computed by <ephem_context_compute>.
+//! \param [in,out] writer - The ephemeris being written
+//! \param [in] step - The time step at which the chunk was computed
+//! \param [in] first - The position of the chunk's first object in the list of objects
+//! \param [in] count - The number of objects in the chunk
+//! \param [in] results - The quantities computed for the chunk, as left in <ephem_context.results>
+
+void columnarOutput_addChunk(columnarOutput *writer, int step, int first, int count, const double *results) {
+    const columnarOutput_header *header = &writer->header;
+    const size_t column_values = header->column_stride / sizeof(double);
+    const int row = step % (int) header->block_steps;
+    const int offset = row * (int) header->block_bodies + first % (int) header->block_bodies;
+
+    for (int c = 0; c < (int) header->column_count; c++) {
+        double *column = writer->block + c * column_values + offset;
+        const double *quantity = results + writer->columns[c];
+        for (int i = 0; i < count; i++) column[i] = quantity[i * EPHEM_PARAMETERS];
+    }
+
+    // Write out the block once its last time step is in place, and start the next block with every slot empty
+    if ((row == (int) header->block_steps - 1) || (step == (int) header->step_count - 1)) {
+        fwrite(writer->block, 1, header->block_length, writer->output);
+        for (size_t i = 0; i < header->block_length / sizeof(double); i++) writer->block[i] = GSL_NAN;
+    }
+}
+
+//! columnarOutput_close - Release the memory used while writing a columnar binary ephemeris
+//! \param [in] writer - The ephemeris which has been written
+
+void columnarOutput_close(columnarOutput *writer) {
+    free(writer->block);
+    writer->block = NULL;
+}
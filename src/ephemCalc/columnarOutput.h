@@ -0,0 +1,117 @@
+// columnarOutput.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef COLUMNAROUTPUT_H
+#define COLUMNAROUTPUT_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ephemCalc/ephemContext.h"
+#include "settings/settings.h"
+
+// Columnar binary ephemerides (output_binary = 2) are laid out as follows. All values are in the byte order of the
+// machine which wrote the file, which readers can check against <byte_order>. Every section starts on a multiple of
+// COLUMNAR_OUTPUT_ALIGNMENT bytes from the start of the file, and unused space is zero.
+//
+// * A <columnarOutput_header>.
+// * <column_count> <columnarOutput_column> entries, at <columns_offset>, naming each column and giving its units.
+// * <body_count> <columnarOutput_body> entries, at <bodies_offset>, in the order the objects were requested.
+// * <step_count> doubles, at <times_offset>, giving the Julian day number (TT) of each time step.
+// * A grid of blocks, at <blocks_offset>, each <block_length> bytes long. Each block holds <block_steps> time steps
+//   of <block_bodies> objects. Blocks are ordered by time, and then by object. Within each block, each column is a
+//   contiguous array of doubles, starting <column_stride> bytes after the previous one, in which the value for each
+//   object at each time step is at [step][object]. Slots beyond the last time step or the last object are NaN.
+//
+// The value of column <c> for object <b> at time step <t> is therefore the double at byte offset
+//   blocks_offset + ((t / block_steps) * block_columns + (b / block_bodies)) * block_length + c * column_stride
+//   + ((t % block_steps) * block_bodies + (b % block_bodies)) * 8
+// where block_columns = ceil(body_count / block_bodies) is the number of blocks spanning all the objects.
+
+#define COLUMNAR_OUTPUT_MAGIC "EPHEMCOL"
+#define COLUMNAR_OUTPUT_VERSION 1
+#define COLUMNAR_OUTPUT_BYTE_ORDER 0x01020304
+
+//! The alignment, in bytes, of every section of the file, and of every column within each block
+#define COLUMNAR_OUTPUT_ALIGNMENT 64
+
+//! The number of values which each column of a block holds, when there are few enough objects to fit several time
+//! steps into each block
+#define COLUMNAR_OUTPUT_BLOCK_VALUES 8192
+
+//! columnarOutput_header - The header at the start of a columnar binary ephemeris
+
+typedef struct {
+    char magic[8];  // Always COLUMNAR_OUTPUT_MAGIC
+    uint32_t version;  // COLUMNAR_OUTPUT_VERSION
+    uint32_t byte_order;  // COLUMNAR_OUTPUT_BYTE_ORDER, as stored by the machine which wrote the file
+    uint32_t column_count;  // The number of quantities computed for each object
+    uint32_t body_count;  // The number of objects
+    uint32_t step_count;  // The number of time steps
+    uint32_t block_steps;  // The number of time steps in each block
+    uint32_t block_bodies;  // The number of objects in each block
+    int32_t ecliptic;  // Boolean; positions and velocities are in ecliptic, not equatorial, coordinates
+    int32_t topocentric;  // Boolean; RA and Dec are topocentric, for the site at <latitude>, <longitude>
+    int32_t use_orbital_elements;  // Boolean; objects were computed from orbital elements, not DE430
+    double jd_min, jd_step;  // The time grid; TT
+    double ra_dec_epoch;  // The epoch of the RA/Dec coordinate system; TT
+    double latitude, longitude;  // The observing site, in degrees
+    uint64_t block_length;  // The length of each block; bytes
+    uint64_t column_stride;  // The offset between the starts of successive columns within a block; bytes
+    uint64_t columns_offset;  // The offset of the table of <columnarOutput_column> from the start of the file
+    uint64_t bodies_offset;  // The offset of the table of <columnarOutput_body> from the start of the file
+    uint64_t times_offset;  // The offset of the table of time steps from the start of the file
+    uint64_t blocks_offset;  // The offset of the first block from the start of the file
+    uint64_t file_length;  // The total length of the file, which lets readers detect truncated files
+} columnarOutput_header;
+
+//! columnarOutput_column - The description of one column of a columnar binary ephemeris
+
+typedef struct {
+    char name[16];  // The name of the quantity, e.g. "ra"
+    char unit[16];  // The units of the quantity, e.g. "rad"; empty if dimensionless
+} columnarOutput_column;
+
+//! columnarOutput_body - The description of one object in a columnar binary ephemeris
+
+typedef struct {
+    int32_t body_id;  // The object's ID, as returned by <orbitalElements_findBody>
+    int32_t reserved;
+    char name[24];  // The object's name
+} columnarOutput_body;
+
+//! columnarOutput - A columnar binary ephemeris which is being written
+
+typedef struct {
+    FILE *output;  // The stream being written to
+    columnarOutput_header header;
+    int columns[EPHEM_PARAMETERS];  // The index within the ephemeris context's results of the quantity in each column
+    int block_columns;  // The number of blocks spanning all the objects
+    double *block;  // The block being filled
+} columnarOutput;
+
+void columnarOutput_open(columnarOutput *writer, FILE *output, const settings *s, int step_count);
+
+void columnarOutput_addChunk(columnarOutput *writer, int step, int first, int count, const double *results);
+
+void columnarOutput_close(columnarOutput *writer);
+
+#endif
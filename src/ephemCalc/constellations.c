@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <gsl/gsl_math.h>
 
@@ -65,6 +66,10 @@ static constel_desc constel_data[MAX_CONSTELLATIONS];
 //! Nconstel - A counter for the number of constellations we have loaded so far
 static int Nconstel = 0;
 
+//! constellations_initialised - Make sure that the constellation boundaries are only loaded once, however many
+//! threads ask for them
+static pthread_once_t constellations_initialised = PTHREAD_ONCE_INIT;
+
 //! dWind - Work out the change in azimuth winding number along the line segment (RA0, Dec0) to (RA1, Dec1), as seen
 //! from (RA, Dec).
 //! \param RA - The right ascension of the point whose constellation we are determining (radians)
@@ -107,9 +112,9 @@ static double dWind(double RA, double Dec, double RA0, double Dec0, double RA1,
     return dW;
 }
 
-//! constellations_init - Initialise the constellations module. Load the constellation boundaries from disk.
+//! constellations_readData - Load the constellation boundaries from disk.
 
-void constellations_init() {
+static void constellations_readData() {
     FILE *file;
     char line[FNAME_LENGTH], *scan;
     char constellation[6] = "@@@"; // Name of constellation we're currently reading in
@@ -235,6 +240,13 @@ void constellations_init() {
     fclose(file);
 }
 
+//! constellations_init - Initialise the constellations module, in thread-safe fashion. Once this has returned, the
+//! constellation boundaries are never modified, so any number of threads may call <constellations_fetch> at once.
+
+void constellations_init() {
+    pthread_once(&constellations_initialised, constellations_readData);
+}
+
 //! constellations_fetch - Determine which constellation a point lies within
 //! \param ra - The right ascension of the point whose constellation we are determining (radians)
 //! \param dec - The declination of the point whose constellation we are determining (radians)
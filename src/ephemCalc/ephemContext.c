@@ -0,0 +1,848 @@
+// ephemContext.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <gsl/gsl_math.h>
+
+#include "coreUtils/strConstants.h"
+#include "coreUtils/errorReport.h"
+#include "coreUtils/outputBuffer.h"
+
+#include "mathsTools/chebyshev.h"
+#include "mathsTools/precess_equinoxes.h"
+
+#include "settings/settings.h"
+
+#include "columnarOutput.h"
+#include "ephemContext.h"
+#include "jpl.h"
+#include "magnitudeEstimate.h"
+#include "observerState.h"
+#include "orbitalElements.h"
+
+//! ephem_context_init - Prepare a context to compute the ephemeris described by a settings structure
+//! \param [out] context - The context to prepare
+//! \param [in] s - The settings describing the ephemeris, whose lists of objects and sites have been built by
+//! <settings_process>. These must stay in place while the context is in use.
+
+void ephem_context_init(ephem_context *context, settings *s) {
+    context->settings = s;
+    context->jd = 0;
+}
+
+//! ephem_context_beginStep - Start computing a new time step, by computing the positions of the Earth and Sun, which
+//! are needed by every object. If the settings list several sites, the observer is placed at the geocentre, and the
+//! offset of each site is applied afterwards by <ephem_context_applySite>.
+//! \param [in,out] context - The context to compute the time step in
+//! \param [in] jd - The Julian day number of the time step; TT
+
+void ephem_context_beginStep(ephem_context *context, double jd) {
+    const settings *s = context->settings;
+    const int topocentric = s->enable_topocentric_correction && (s->sites_count == 0);
+    context->jd = jd;
+    observerState_compute(&context->observer, jd, topocentric, s->latitude, s->longitude);
+}
+
+//! ephem_context_storeSkyPosition - Store the quantities which describe where an object appears on the sky in the
+//! array of quantities computed for it, converting its ecliptic coordinates to the epoch of observation
+//! \param [out] result - The quantities computed for the object, laid out as in <ephem_context.results>
+//! \param [in] jd - The Julian day number of the time step; TT
+//! \param [in] ra - The right ascension of the object; radians
+//! \param [in] dec - The declination of the object; radians
+//! \param [in] theta_eso - The angular distance of the object from the Earth, as seen from the Sun; radians
+//! \param [in] ecliptic_longitude - The ecliptic longitude of the object, J2000.0; radians
+//! \param [in] ecliptic_latitude - The ecliptic latitude of the object, J2000.0; radians
+//! \param [in] ecliptic_distance - The separation of the object from the Sun, in ecliptic longitude; radians
+
+static void ephem_context_storeSkyPosition(double *result, double jd, double ra, double dec, double theta_eso,
+                                           double ecliptic_longitude, double ecliptic_latitude,
+                                           double ecliptic_distance) {
+    // Convert ecliptic longitude we output to epoch of observation
+    double eclTo_lat, eclTo_lng;
+    precess(2451545.0, jd, ecliptic_longitude, ecliptic_latitude, &eclTo_lng, &eclTo_lat);
+
+    result[3] = ra;
+    result[4] = dec;
+    result[13] = theta_eso;
+    result[14] = eclTo_lng; // ecliptic longitude in epoch of jd, not J2000.0
+    result[15] = ecliptic_distance;
+    result[16] = eclTo_lat;
+
+    // fix ecliptic longitude for precession of the equinoxes
+    if (result[14] > M_PI) result[14] -= 2 * M_PI;
+    if (result[14] < -M_PI) result[14] += 2 * M_PI;
+}
+
+//! ephem_context_computeBodies - Compute the quantities for a list of objects at the time step started by
+//! <ephem_context_beginStep>
+//! \param [in] context - The context to compute the objects in
+//! \param [in] body_id - The IDs of the objects to compute
+//! \param [in] count - The number of objects to compute
+//! \param [out] results - Array of <EPHEM_PARAMETERS * count> values, laid out as in <ephem_context.results>,
+//! populated with the quantities computed for each object
+//! \param [out] positions - If not NULL, array of <3 * count> values, populated with the x, y, z position of each
+//! object in J2000.0 equatorial coordinates, even if the results are in ecliptic coordinates
+
+static void ephem_context_computeBodies(const ephem_context *context, const int *body_id, int count, double *results,
+                                        double *positions) {
+    const settings *s = context->settings;
+    const observerState *observer = &context->observer;
+    const double jd = context->jd;
+
+    // Compute ephemeris
+    int i;
+#pragma omp parallel for shared(observer) private(i)
+    for (i = 0; i < count; i++) {
+        const int o = i * EPHEM_PARAMETERS;
+        double ra = 0, dec = 0, x = 0, y = 0, z = 0, vx = 0, vy = 0, vz = 0;
+        double mag = 0, phase = 0, ang_size = 0, phy_size = 0, albedo = 0;
+        double sun_dist = 0, earth_dist = 0, sun_ang_dist = 0, theta_eso = 0;
+        double ecliptic_longitude = 0, ecliptic_latitude = 0, ecliptic_distance = 0;
+
+        // Velocities are only computed if they are to be output
+        double *vx_out = s->output_velocity ? &vx : NULL;
+        double *vy_out = s->output_velocity ? &vy : NULL;
+        double *vz_out = s->output_velocity ? &vz : NULL;
+
+        // If the <use_orbital_elements> is 0, we use DE430
+        if (s->use_orbital_elements == 0)
+            jpl_computeEphemeris(body_id[i], observer, &x, &y, &z, vx_out, vy_out, vz_out, &ra, &dec, &mag, &phase,
+                                 &ang_size, &phy_size, &albedo,
+                                 &sun_dist, &earth_dist, &sun_ang_dist, &theta_eso, &ecliptic_longitude,
+                                 &ecliptic_latitude, &ecliptic_distance, s->ra_dec_epoch);
+
+            // If the <use_orbital_elements> is 1, we use orbital elements
+        else if (s->use_orbital_elements == 1)
+            orbitalElements_computeEphemeris(body_id[i], observer, &x, &y, &z, vx_out, vy_out, vz_out, &ra, &dec,
+                                             &mag, &phase, &ang_size, &phy_size,
+                                             &albedo, &sun_dist, &earth_dist, &sun_ang_dist, &theta_eso,
+                                             &ecliptic_longitude, &ecliptic_latitude,
+                                             &ecliptic_distance, s->ra_dec_epoch);
+
+        if (positions != NULL) {
+            positions[3 * i + 0] = x;
+            positions[3 * i + 1] = y;
+            positions[3 * i + 2] = z;
+        }
+
+        // Negative output formats use ecliptic coordinates, not RA and Declination
+        if (s->output_format < 0) {
+            double x2, y2, z2;
+            double epsilon = (23. + 26. / 60. + 21.448 / 3600.) / 180. * M_PI; // Meeus (22.2)
+
+            // negative x-axis points to the vernal equinox; (y,z) get tipped up by 23.5 degrees from (ra,dec)
+            // to equatorial coordinates
+            x2 = x;
+            y2 = cos(epsilon) * y + sin(epsilon) * z;
+            z2 = -sin(epsilon) * y + cos(epsilon) * z;
+            x = x2;
+            y = y2;
+            z = z2;
+
+            // Velocities are rotated in the same way
+            x2 = vx;
+            y2 = cos(epsilon) * vy + sin(epsilon) * vz;
+            z2 = -sin(epsilon) * vy + cos(epsilon) * vz;
+            vx = x2;
+            vy = y2;
+            vz = z2;
+        }
+
+        results[o + 0] = x;
+        results[o + 1] = y;
+        results[o + 2] = z;
+        results[o + 5] = mag;
+        results[o + 6] = phase;
+        results[o + 7] = ang_size;
+        results[o + 8] = phy_size;
+        results[o + 9] = albedo;
+        results[o + 10] = sun_dist;
+        results[o + 11] = earth_dist;
+        results[o + 12] = sun_ang_dist;
+        results[o + 17] = vx;
+        results[o + 18] = vy;
+        results[o + 19] = vz;
+        ephem_context_storeSkyPosition(results + o, jd, ra, dec, theta_eso, ecliptic_longitude, ecliptic_latitude,
+                                       ecliptic_distance);
+    }
+}
+
+//! ephem_context_computeObjects - Compute the quantities for a chunk of objects at the time step started by
+//! <ephem_context_beginStep>, leaving them in <context->results>
+//! \param [in,out] context - The context to compute the objects in
+//! \param [in] body_id - The IDs of the objects to compute
+//! \param [in] count - The number of objects to compute; no more than EPHEM_CHUNK_OBJECTS
+
+void ephem_context_computeObjects(ephem_context *context, const int *body_id, int count) {
+    if (count > EPHEM_CHUNK_OBJECTS) {
+        ephem_fatal(__FILE__, __LINE__, "Too many objects requested in one chunk.");
+        exit(1);
+    }
+
+    ephem_context_computeBodies(context, body_id, count, context->results, NULL);
+}
+
+//! ephem_context_applySite - Produce the quantities for a chunk of objects as seen from one site of a multi-site
+//! ephemeris, leaving them in <context->results>. Only the RA and Dec, and the ecliptic coordinates, depend on where
+//! the observer is, so everything else is copied from the quantities computed once for the geocentre.
+//! \param [in,out] context - The context holding the time step started by <ephem_context_beginStep>
+//! \param [in] geocentric - The quantities computed for the objects by <ephem_context_computeBodies>
+//! \param [in] positions - The J2000.0 equatorial positions of the objects, from <ephem_context_computeBodies>
+//! \param [in] offset - The offset of the site from the geocentre, from <observerState_siteOffsets>; AU
+//! \param [in] count - The number of objects in the chunk; no more than EPHEM_CHUNK_OBJECTS
+
+static void ephem_context_applySite(ephem_context *context, const double *geocentric, const double *positions,
+                                    const double *offset, int count) {
+    const settings *s = context->settings;
+    const observerState *observer = &context->observer;
+    const double jd = context->jd;
+    double *results = context->results;
+
+    memcpy(results, geocentric, count * EPHEM_PARAMETERS * sizeof(double));
+
+    int i;
+#pragma omp parallel for shared(observer) private(i)
+    for (i = 0; i < count; i++) {
+        const int o = i * EPHEM_PARAMETERS;
+        const double *position = positions + 3 * i;
+        double ra, dec, ecliptic_longitude, ecliptic_latitude, ecliptic_distance;
+
+        // Objects which could not be computed have no position to observe from a different site
+        if (!gsl_finite(position[0])) continue;
+
+        // theta_ESO is signed according to which side of the Sun the object lies, which may differ between sites
+        double theta_eso = fabs(geocentric[o + 13]);
+
+        magnitudeEstimate_apparentPosition(position[0], position[1], position[2], observer, offset, &ra, &dec,
+                                           &theta_eso, &ecliptic_longitude, &ecliptic_latitude, &ecliptic_distance,
+                                           s->ra_dec_epoch);
+        ephem_context_storeSkyPosition(results + o, jd, ra, dec, theta_eso, ecliptic_longitude, ecliptic_latitude,
+                                       ecliptic_distance);
+    }
+}
+
+//! ephem_context_writeObjects - Write the quantities computed for a chunk of objects by
+//! <ephem_context_computeObjects> to an output buffer, in the format requested by the context's settings
+//! \param [in] context - The context holding the quantities to write
+//! \param [in,out] output - The buffer to write to
+//! \param [in] count - The number of objects in the chunk
+
+static void ephem_context_writeObjects(const ephem_context *context, output_buffer *output, int count) {
+    const settings *s = context->settings;
+    const double *results = context->results;
+
+    // Produce output to file -- loop over objects producing a set of columns for each
+    for (int i = 0; i < count; i++) {
+        const int o = i * EPHEM_PARAMETERS;
+
+        // Produce text-based output
+        if (!s->output_binary) {
+            //-1 - x y z   (ecliptic)
+            // 0 - x y z   (J2000)
+            // 1 - ra dec  (degrees)
+            // 2 - x y z ra dec mag phase AngSize
+            // 3 - x y z ra dec mag phase AngSize physical_size albedo
+
+            // Write XYZ coordinates (in all modes but 1)
+            if (s->output_format != 1) {
+                output_buffer_fixed(output, results[o + 0], 12, 9, " ");
+                output_buffer_fixed(output, results[o + 1], 12, 9, " ");
+                output_buffer_fixed(output, results[o + 2], 12, 9, "   ");
+            }
+
+            // Write RA and Dec in modes 1,2,3
+            if (s->output_format >= 1) {
+                output_buffer_fixed(output, results[o + 3]*180/M_PI, 12, 9, " ");
+                output_buffer_fixed(output, results[o + 4]*180/M_PI, 12, 9, "   ");
+            }
+
+            // Write magnitude, phase and angular size in modes 2,3
+            if (s->output_format >= 2) {
+                output_buffer_fixed(output, results[o + 5], 6, 3, " ");
+                output_buffer_fixed(output, results[o + 6], 7, 4, " ");
+                output_buffer_fixed(output, results[o + 7], 12, 9, "   ");
+            }
+
+            // Write physical size, albedo, sun_dist, earth_dist, sun_ang_dist, theta_edo, eclLng, eclDist, eclLat
+            if (s->output_format >= 3) {
+                output_buffer_printf(output, "%12.6e ", results[o + 8]);
+                output_buffer_fixed(output, results[o + 9], 8, 5, " ");
+                for (int j = 10; j < 16; j++) output_buffer_fixed(output, results[o + j], 12, 9, " ");
+                output_buffer_fixed(output, results[o + 16], 12, 9, "  ");
+            }
+
+            // Write velocity, if requested
+            if (s->output_velocity) {
+                output_buffer_fixed(output, results[o + 17], 12, 9, " ");
+                output_buffer_fixed(output, results[o + 18], 12, 9, " ");
+                output_buffer_fixed(output, results[o + 19], 12, 9, "   ");
+            }
+        }
+
+            // Produce binary output
+        else {
+            if (s->output_format != 1) output_buffer_write(output, results + o + 0, 3 * sizeof(double));
+            if (s->output_format >= 1) output_buffer_write(output, results + o + 3, 2 * sizeof(double));
+            if (s->output_format >= 2) output_buffer_write(output, results + o + 5, 3 * sizeof(double));
+            if (s->output_format >= 3) output_buffer_write(output, results + o + 8, 9 * sizeof(double));
+            if (s->output_velocity) output_buffer_write(output, results + o + 17, 3 * sizeof(double));
+        }
+    }
+}
+
+//! ephem_context_writeChunk - Add the quantities computed for a chunk of objects, as left in <context->results>, to
+//! the output
+//! \param [in] context - The context holding the quantities to write
+//! \param [in] step - The time step at which the chunk was computed
+//! \param [in] first - The position of the chunk's first object in the list of objects
+//! \param [in] count - The number of objects in the chunk
+//! \param [in,out] buffer - The buffer to add the output to, or NULL, as for <ephem_context_computeSteps>
+//! \param [in,out] writer - If not NULL, the columnar binary ephemeris to add the chunk to
+
+static void ephem_context_writeChunk(const ephem_context *context, int step, int first, int count,
+                                     output_buffer *buffer, columnarOutput *writer) {
+    const settings *s = context->settings;
+
+    // When no buffer is given, the caller only wants the contents of <context->results>
+    if (writer != NULL) columnarOutput_addChunk(writer, step, first, count, context->results);
+    else if (buffer == NULL) return;
+    else if (s->output_binary == 2)
+        output_buffer_write(buffer, context->results, count * EPHEM_PARAMETERS * sizeof(double));
+    else ephem_context_writeObjects(context, buffer, count);
+}
+
+//! ephem_context_writeStep - Add the quantities computed for every object at one time step to the output. If the
+//! settings list several sites, these are the quantities computed for the geocentre, and they are adjusted for each
+//! site in turn, writing one line for each site.
+//! \param [in,out] context - The context holding the time step started by <ephem_context_beginStep>
+//! \param [in] step - The time step
+//! \param [in] results - The quantities computed for every object, laid out as in <ephem_context.results>
+//! \param [in] positions - If there are several sites, the J2000.0 equatorial positions of the objects, in the frame
+//! of the context's observer state
+//! \param [in] offsets - If there are several sites, the offset of each site, from <observerState_siteOffsets>
+//! \param [in,out] buffer - The buffer to add the output to, or NULL, as for <ephem_context_computeSteps>
+//! \param [in,out] writer - If not NULL, the columnar binary ephemeris to add the objects to
+
+static void ephem_context_writeStep(ephem_context *context, int step, const double *results, const double *positions,
+                                    const double *offsets, output_buffer *buffer, columnarOutput *writer) {
+    const settings *s = context->settings;
+    const double jd = s->jd_min + step * s->jd_step;  // TT
+    const int text = (buffer != NULL) && !s->output_binary;
+    const int lines = (s->sites_count > 0) ? s->sites_count : 1;
+
+    for (int site = 0; site < lines; site++) {
+        // When producing a text-based ephemeris, the first column in Julian day number (TT), followed by the site's
+        // latitude and longitude if there are several sites. Binary ephemerides have no JD column to save space.
+        if (text) {
+            output_buffer_fixed(buffer, jd, 0, 12, "   ");
+            if (s->sites_count > 0) {
+                output_buffer_fixed(buffer, s->site_latitude[site], 10, 5, " ");
+                output_buffer_fixed(buffer, s->site_longitude[site], 10, 5, "   ");
+            }
+        }
+
+        for (int first = 0; first < s->objects_count; first += EPHEM_CHUNK_OBJECTS) {
+            const int remaining = s->objects_count - first;
+            const int count = (remaining < EPHEM_CHUNK_OBJECTS) ? remaining : EPHEM_CHUNK_OBJECTS;
+            if (s->sites_count > 0) {
+                ephem_context_applySite(context, results + first * EPHEM_PARAMETERS, positions + 3 * first,
+                                        offsets + 3 * site, count);
+            } else {
+                memcpy(context->results, results + first * EPHEM_PARAMETERS,
+                       count * EPHEM_PARAMETERS * sizeof(double));
+            }
+            ephem_context_writeChunk(context, step, first, count, buffer, writer);
+        }
+
+        if (text) output_buffer_write(buffer, "\n", 1);
+    }
+}
+
+// The quantities in <ephem_context.results> which are angles that wrap around, and must be unwrapped before they can
+// be interpolated: RA, theta_ESO, ecliptic longitude and ecliptic distance
+static const int ephem_context_wrappingAngles[] = {3, 13, 14, 15};
+
+//! ephem_context_stateLength - Return the number of values which describe every object at one time step of an
+//! interpolated ephemeris. These are the quantities in <ephem_context.results> for each object. If there are several
+//! sites, they are followed by the position of each object, and then of the Sun, relative to the geocentre. These
+//! vary smoothly, whereas positions relative to the solar system barycentre would need to be interpolated much more
+//! accurately for nearby objects, for the difference between them and the Earth's position to be accurate.
+//! \param [in] s - The settings describing the ephemeris
+//! \return - The number of values
+
+static int ephem_context_stateLength(const settings *s) {
+    const int n = s->objects_count;
+    return n * EPHEM_PARAMETERS + ((s->sites_count > 0) ? (3 * n + 3) : 0);
+}
+
+//! ephem_context_computeState - Compute everything which describes every object at one time of an interpolated
+//! ephemeris in full, as laid out by <ephem_context_stateLength>
+//! \param [in,out] context - The context to compute the time in
+//! \param [in] jd - The Julian day number to compute; TT. This need not be one of the time steps.
+//! \param [out] state - The values computed
+
+static void ephem_context_computeState(ephem_context *context, double jd, double *state) {
+    const settings *s = context->settings;
+    const int n = s->objects_count;
+
+    ephem_context_beginStep(context, jd);
+    if (s->sites_count == 0) {
+        ephem_context_computeBodies(context, s->body_id, n, state, NULL);
+        return;
+    }
+
+    double *positions = state + n * EPHEM_PARAMETERS;
+    double *sun = positions + 3 * n;
+    const double *earth_pos = context->observer.earth_pos;
+    ephem_context_computeBodies(context, s->body_id, n, state, positions);
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) positions[3 * i + k] -= earth_pos[k];
+    }
+    for (int k = 0; k < 3; k++) sun[k] = context->observer.sun_pos[k] - earth_pos[k];
+}
+
+//! ephem_context_evaluateState - Evaluate the Chebyshev series fitted to a segment of an interpolated ephemeris
+//! \param [in] s - The settings describing the ephemeris
+//! \param [in] coeffs - The series fitted by <ephem_context_fitSegment>
+//! \param [in] u - The time at which to evaluate them, scaled to run from -1 to 1 across the segment
+//! \param [out] state - The interpolated values, laid out as by <ephem_context_stateLength>
+
+static void ephem_context_evaluateState(const settings *s, const double *coeffs, double u, double *state) {
+    const int length = ephem_context_stateLength(s);
+
+    for (int v = 0; v < length; v++) {
+        state[v] = chebyshev(coeffs + v * EPHEM_INTERPOLATION_COEFFS, EPHEM_INTERPOLATION_COEFFS, u);
+    }
+
+    // Wrap the unwrapped angles back into the ranges used by <ephem_context_storeSkyPosition>
+    for (int i = 0; i < s->objects_count; i++) {
+        double *result = state + i * EPHEM_PARAMETERS;
+        result[3] = fmod(result[3], 2 * M_PI);
+        if (result[3] < 0) result[3] += 2 * M_PI;
+        for (int j = 1; j < 4; j++) {
+            const int q = ephem_context_wrappingAngles[j];
+            result[q] = remainder(result[q], 2 * M_PI);
+        }
+    }
+}
+
+//! ephem_context_stateError - Measure how far the quantities interpolated at one time step depart from those computed
+//! in full. Only the quantities which are written out are compared. Angles are compared directly; positions are
+//! compared by the angle that their error subtends at the Earth; distances, angular sizes and velocities by their
+//! fractional error; magnitudes by the fractional error in brightness they imply; and illuminated fractions directly.
+//! \param [in] s - The settings describing the ephemeris
+//! \param [in] exact - The values computed in full, laid out as by <ephem_context_stateLength>
+//! \param [in] interpolated - The values interpolated
+//! \return - The largest error; radians. Infinite if a value is NaN in one but not the other.
+
+static double ephem_context_stateError(const settings *s, const double *exact, const double *interpolated) {
+    const int length = ephem_context_stateLength(s);
+    const int n = s->objects_count;
+    double error = 0;
+
+    for (int v = 0; v < length; v++) {
+        if (isnan(exact[v]) != isnan(interpolated[v])) return INFINITY;
+    }
+
+    for (int i = 0; i < n; i++) {
+        const double *a = exact + i * EPHEM_PARAMETERS;
+        const double *b = interpolated + i * EPHEM_PARAMETERS;
+        double e[6] = {0, 0, 0, 0, 0, 0};
+
+        // Positions, by the angle that their error subtends at the Earth (or, for the Earth, at the Sun)
+        const double distance = (a[11] > 0) ? a[11] : a[10];
+        if (s->output_format != 1) e[0] = gsl_hypot3(a[0] - b[0], a[1] - b[1], a[2] - b[2]) / distance;
+
+        // RA and Dec, unless there are several sites, in which case they are computed from the positions below
+        if ((s->output_format >= 1) && (s->sites_count == 0)) {
+            e[1] = fmax(fabs(remainder(a[3] - b[3], 2 * M_PI)), fabs(a[4] - b[4]));
+        }
+
+        // Magnitude, illuminated fraction and angular size (in arcseconds), which are the same for every site
+        if (s->output_format >= 2) {
+            e[5] = fmax(fabs(a[5] - b[5]) * M_LN10 / 2.5, fabs(a[6] - b[6]));
+            if (a[7] != b[7]) e[5] = fmax(e[5], fabs(a[7] - b[7]) / fabs(a[7]));
+        }
+
+        // Distances and angles
+        if (s->output_format >= 3) {
+            e[2] = fmax(fabs(a[10] - b[10]) / a[10], fabs(a[11] - b[11]) / a[11]);
+            for (int q = 12; q < 17; q++) {
+                if ((s->sites_count > 0) && (q != 12)) continue;
+                e[3] = fmax(e[3], fabs(remainder(a[q] - b[q], 2 * M_PI)));
+            }
+        }
+
+        // Velocities
+        if (s->output_velocity) {
+            e[4] = gsl_hypot3(a[17] - b[17], a[18] - b[18], a[19] - b[19]) / gsl_hypot3(a[17], a[18], a[19]);
+        }
+
+        for (int j = 0; j < 6; j++) if (e[j] > error) error = e[j];
+    }
+
+    // Positions of each object and the Sun relative to the geocentre, from which each site's RA and Dec are computed
+    if (s->sites_count > 0) {
+        for (int i = 0; i <= n; i++) {
+            const double *a = exact + n * EPHEM_PARAMETERS + 3 * i;
+            const double *b = interpolated + n * EPHEM_PARAMETERS + 3 * i;
+            const double e = gsl_hypot3(a[0] - b[0], a[1] - b[1], a[2] - b[2]) / gsl_hypot3(a[0], a[1], a[2]);
+            if (e > error) error = e;
+        }
+    }
+    return error;
+}
+
+//! ephem_context_fitSegment - Fit Chebyshev series to every quantity over a segment of time steps of an interpolated
+//! ephemeris, and check them against the ephemeris computed in full at the first, middle and last time steps. These
+//! are where the error of a series fitted at the zeros of T_n peaks.
+//! \param [in,out] context - The context to compute the segment in
+//! \param [in] step - The first time step in the segment
+//! \param [in] segment_steps - The number of time steps in the segment
+//! \param [out] samples - Workspace for <EPHEM_INTERPOLATION_COEFFS> states
+//! \param [out] coeffs - The fitted series; <EPHEM_INTERPOLATION_COEFFS> coefficients for each value in the state
+//! \param [out] exact - Workspace for one state
+//! \param [out] interpolated - Workspace for one state
+//! \return - The largest error found by the checks; radians
+
+static double ephem_context_fitSegment(ephem_context *context, int step, int segment_steps, double *samples,
+                                       double *coeffs, double *exact, double *interpolated) {
+    const settings *s = context->settings;
+    const int length = ephem_context_stateLength(s);
+    const double jd_first = s->jd_min + step * s->jd_step;
+    const double jd_last = s->jd_min + (step + segment_steps - 1) * s->jd_step;
+    const double jd_mid = (jd_first + jd_last) / 2, jd_half = (jd_last - jd_first) / 2;
+
+    for (int j = 0; j < EPHEM_INTERPOLATION_COEFFS; j++) {
+        ephem_context_computeState(context, jd_mid + jd_half * chebyshev_node(j, EPHEM_INTERPOLATION_COEFFS),
+                                   samples + j * length);
+    }
+
+    // Unwrap angles, so that each varies smoothly from one sample to the next
+    for (int i = 0; i < s->objects_count; i++) {
+        for (int j = 1; j < EPHEM_INTERPOLATION_COEFFS; j++) {
+            for (int k = 0; k < 4; k++) {
+                const int v = i * EPHEM_PARAMETERS + ephem_context_wrappingAngles[k];
+                const double previous = samples[(j - 1) * length + v];
+                double *sample = &samples[j * length + v];
+                if (gsl_finite(previous) && gsl_finite(*sample)) {
+                    *sample -= 2 * M_PI * round((*sample - previous) / (2 * M_PI));
+                }
+            }
+        }
+    }
+
+    chebyshev_fit(samples, length, EPHEM_INTERPOLATION_COEFFS, coeffs);
+
+    const int checks[3] = {step, step + segment_steps / 2, step + segment_steps - 1};
+    double error = 0;
+    for (int c = 0; c < 3; c++) {
+        const double jd = s->jd_min + checks[c] * s->jd_step;
+        ephem_context_computeState(context, jd, exact);
+        ephem_context_evaluateState(s, coeffs, (jd - jd_mid) / jd_half, interpolated);
+        const double e = ephem_context_stateError(s, exact, interpolated);
+        if (!(e <= error)) error = e;
+    }
+    return error;
+}
+
+//! ephem_context_writeState - Add one time step of an interpolated ephemeris to the output
+//! \param [in,out] context - The context to use
+//! \param [in] step - The time step
+//! \param [in] state - The values computed or interpolated at the time step, laid out as by
+//! <ephem_context_stateLength>
+//! \param [out] offsets - Workspace for the offsets of the sites, if there are several
+//! \param [in,out] buffer - The buffer to add the output to, or NULL, as for <ephem_context_computeSteps>
+//! \param [in,out] writer - If not NULL, the columnar binary ephemeris to add the objects to
+
+static void ephem_context_writeState(ephem_context *context, int step, const double *state, double *offsets,
+                                     output_buffer *buffer, columnarOutput *writer) {
+    const settings *s = context->settings;
+    const int n = s->objects_count;
+
+    if (s->sites_count == 0) {
+        ephem_context_writeStep(context, step, state, NULL, NULL, buffer, writer);
+        return;
+    }
+
+    // The positions of the objects and the Sun are relative to the geocentre, so place the geocentre at the origin
+    const double jd = s->jd_min + step * s->jd_step;
+    const double *positions = state + n * EPHEM_PARAMETERS;
+    const double *sun = positions + 3 * n;
+    context->jd = jd;
+    for (int k = 0; k < 3; k++) {
+        context->observer.earth_pos[k] = 0;
+        context->observer.sun_pos[k] = sun[k];
+    }
+    observerState_siteOffsets(jd, s->sites_count, s->site_latitude, s->site_longitude, offsets);
+    ephem_context_writeStep(context, step, state, positions, offsets, buffer, writer);
+}
+
+//! ephem_context_interpolateSteps - Compute a run of time steps of an ephemeris by interpolation. The run is divided
+//! into segments, over each of which a Chebyshev series is fitted to every quantity, and checked against the
+//! ephemeris computed in full (see <ephem_context_fitSegment>). Segments which fail the checks are halved until they
+//! pass. Segments which would contain too few time steps for interpolation to save time are computed in full.
+//! \param [in,out] context - The context to compute the time steps in
+//! \param [in] step_first - The first time step to compute
+//! \param [in] step_end - The time step after the last one to compute
+//! \param [in,out] buffer - The buffer to add the output to, or NULL, as for <ephem_context_computeSteps>
+//! \param [in] output - If not NULL, the buffer is written out to this stream whenever it grows large
+//! \param [in,out] writer - If not NULL, the columnar binary ephemeris to add each time step to
+
+static void ephem_context_interpolateSteps(ephem_context *context, int step_first, int step_end,
+                                           output_buffer *buffer, FILE *output, columnarOutput *writer) {
+    const settings *s = context->settings;
+    const int length = ephem_context_stateLength(s);
+    const double tolerance = s->interpolation_tolerance / 3600 * M_PI / 180;  // radians
+
+    // Interpolating a segment needs EPHEM_INTERPOLATION_COEFFS + 3 full computations, so it saves time only if the
+    // segment has several times more time steps than that
+    const int min_steps = 4 * (EPHEM_INTERPOLATION_COEFFS + 3);
+
+    double *samples = (double *) malloc(EPHEM_INTERPOLATION_COEFFS * length * sizeof(double));
+    double *coeffs = (double *) malloc(EPHEM_INTERPOLATION_COEFFS * length * sizeof(double));
+    double *exact = (double *) malloc(length * sizeof(double));
+    double *interpolated = (double *) malloc(length * sizeof(double));
+    double *offsets = (double *) malloc(((s->sites_count > 0) ? s->sites_count : 1) * 3 * sizeof(double));
+    if ((samples == NULL) || (coeffs == NULL) || (exact == NULL) || (interpolated == NULL) || (offsets == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+
+    double span = EPHEM_INTERPOLATION_MAX_SPAN;  // days
+    int step = step_first;
+    while (step < step_end) {
+        const double span_steps = floor(span / s->jd_step) + 1;
+        const int remaining = step_end - step;
+        const int segment_steps = (span_steps < remaining) ? (int) span_steps : remaining;
+
+        // Compute short segments in full, and then try a longer segment again
+        if (segment_steps < min_steps) {
+            const int direct_end = (remaining < min_steps) ? step_end : (step + min_steps);
+            for (; step < direct_end; step++) {
+                ephem_context_computeState(context, s->jd_min + step * s->jd_step, exact);
+                ephem_context_writeState(context, step, exact, offsets, buffer, writer);
+                if ((buffer != NULL) && (output != NULL)) output_buffer_flushIfFull(buffer, output);
+            }
+            span = fmin(2 * span, EPHEM_INTERPOLATION_MAX_SPAN);
+            continue;
+        }
+
+        const double error = ephem_context_fitSegment(context, step, segment_steps, samples, coeffs, exact,
+                                                      interpolated);
+        if (!(error <= tolerance)) {
+            span /= 2;
+            continue;
+        }
+
+        const double jd_first = s->jd_min + step * s->jd_step;
+        const double jd_last = s->jd_min + (step + segment_steps - 1) * s->jd_step;
+        const double jd_mid = (jd_first + jd_last) / 2, jd_half = (jd_last - jd_first) / 2;
+        for (const int segment_end = step + segment_steps; step < segment_end; step++) {
+            const double jd = s->jd_min + step * s->jd_step;
+            ephem_context_evaluateState(s, coeffs, (jd - jd_mid) / jd_half, interpolated);
+            ephem_context_writeState(context, step, interpolated, offsets, buffer, writer);
+            if ((buffer != NULL) && (output != NULL)) output_buffer_flushIfFull(buffer, output);
+        }
+
+        // The error of the series grows as the length of the segment to the power of the number of coefficients, so
+        // lengthen the next segment if the checks show that it would still meet the tolerance
+        if (ldexp(error, EPHEM_INTERPOLATION_COEFFS) <= tolerance) span = fmin(2 * span, EPHEM_INTERPOLATION_MAX_SPAN);
+    }
+
+    free(samples);
+    free(coeffs);
+    free(exact);
+    free(interpolated);
+    free(offsets);
+}
+
+//! ephem_context_computeSteps - Compute a run of time steps of the ephemeris described by a context's settings,
+//! adding the output for each step to a buffer
+//! \param [in,out] context - The context to compute the time steps in
+//! \param [in] step_first - The first time step to compute
+//! \param [in] step_end - The time step after the last one to compute
+//! \param [in,out] buffer - The buffer to add the output to, or NULL to produce no output. In columnar binary mode,
+//! when no <writer> is given, the raw quantities computed for each object at each time step are added instead, to be
+//! passed to the writer later.
+//! \param [in] output - If not NULL, the buffer is written out to this stream whenever it grows large
+//! \param [in,out] writer - If not NULL, the columnar binary ephemeris to add each chunk of objects to
+
+static void ephem_context_computeSteps(ephem_context *context, int step_first, int step_end, output_buffer *buffer,
+                                       FILE *output, columnarOutput *writer) {
+    const settings *s = context->settings;
+    const int sites_count = s->sites_count;
+
+    if (s->interpolation_tolerance > 0) {
+        ephem_context_interpolateSteps(context, step_first, step_end, buffer, output, writer);
+        return;
+    }
+
+    // If there are several sites, then everything about each object except where it appears on the sky is the same
+    // for every site. This is computed once per time step, for all the objects, and held while each site is written.
+    double *geocentric = NULL, *positions = NULL, *offsets = NULL;
+    if (sites_count > 0) {
+        geocentric = (double *) malloc(s->objects_count * EPHEM_PARAMETERS * sizeof(double));
+        positions = (double *) malloc(s->objects_count * 3 * sizeof(double));
+        offsets = (double *) malloc(sites_count * 3 * sizeof(double));
+        if ((offsets == NULL) || (((geocentric == NULL) || (positions == NULL)) && (s->objects_count > 0))) {
+            ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+            exit(1);
+        }
+    }
+
+    for (int step = step_first; step < step_end; step++) {
+        const double jd = s->jd_min + step * s->jd_step;  // TT
+        ephem_context_beginStep(context, jd);
+
+        if (sites_count == 0) {
+            // When producing a text-based ephemeris, the first column in Julian day number (TT)
+            // Binary ephemerides have no JD column to save space.
+            if ((buffer != NULL) && !s->output_binary) output_buffer_fixed(buffer, jd, 0, 12, "   ");
+
+            // Compute the quantities for the objects a chunk at a time, writing each chunk out before computing the
+            // next, so that memory use does not grow with the number of objects
+            for (int first = 0; first < s->objects_count; first += EPHEM_CHUNK_OBJECTS) {
+                const int remaining = s->objects_count - first;
+                const int count = (remaining < EPHEM_CHUNK_OBJECTS) ? remaining : EPHEM_CHUNK_OBJECTS;
+                ephem_context_computeObjects(context, s->body_id + first, count);
+                ephem_context_writeChunk(context, step, first, count, buffer, writer);
+            }
+
+            if ((buffer != NULL) && !s->output_binary) output_buffer_write(buffer, "\n", 1);
+        } else {
+            // Compute the site-independent quantities for every object, and the offset of every site, then write one
+            // line for each site in turn
+            ephem_context_computeBodies(context, s->body_id, s->objects_count, geocentric, positions);
+            observerState_siteOffsets(jd, sites_count, s->site_latitude, s->site_longitude, offsets);
+            ephem_context_writeStep(context, step, geocentric, positions, offsets, buffer, writer);
+        }
+
+        if ((buffer != NULL) && (output != NULL)) output_buffer_flushIfFull(buffer, output);
+    }
+
+    free(geocentric);
+    free(positions);
+    free(offsets);
+}
+
+//! ephem_context_compute - Compute the ephemeris described by a context's settings. This only touches the context
+//! and the shared, read-only ephemeris data, so it may be called from many threads at once with different contexts.
+//! The lists of objects and sites in the context's settings must already have been built, by <settings_process> or
+//! by <settings_resolveObjects> and <settings_resolveSites>.
+//! \param [in,out] context - The context describing the ephemeris to compute
+//! \param [in] output - The stream to write the ephemeris to, or NULL to write nothing. Either way, the quantities
+//! computed for the last chunk of objects at the final time step are left in <context->results>.
+
+void ephem_context_compute(ephem_context *context, FILE *output) {
+    settings *s = context->settings;
+
+    // Load the DE430 records spanning the whole ephemeris up front, in one pass over the file
+    jpl_setActiveWindow(s->jd_min, s->jd_max);
+
+    // Loop over all the time points in the ephemeris
+    const int steps_total = (int) ceil((s->jd_max - s->jd_min) / s->jd_step);
+
+    // Columnar binary output is gathered into blocks, which are written out once they are complete
+    const int columnar = (output != NULL) && (s->output_binary == 2);
+    columnarOutput writer;
+    if (columnar) columnarOutput_open(&writer, output, s, steps_total);
+
+    // Split the time steps into runs which can be computed independently. If there are few objects and sites, then
+    // computing each time step is too little work to share between threads, so instead each thread computes a
+    // different run of time steps into its own buffer. The buffers are written out in order, so the output is the
+    // same as if the time steps were computed one by one.
+    const int objects_count = (s->objects_count > 0) ? s->objects_count : 1;
+    const int step_values = objects_count * ((s->sites_count > 0) ? s->sites_count : 1);
+    const int run_values = (s->interpolation_tolerance > 0) ? EPHEM_INTERPOLATION_RUN_VALUES : EPHEM_TIME_CHUNK_VALUES;
+    const int run_steps = (step_values < run_values) ? (run_values / step_values) : 1;
+    const int run_count = (steps_total + run_steps - 1) / run_steps;
+    const int time_parallel = (output != NULL) && (s->objects_count <= EPHEM_CHUNK_OBJECTS) && (run_count > 1);
+
+    if (!time_parallel) {
+        // Compute the time steps one by one, sharing the objects at each time step between threads
+        output_buffer buffer;
+        output_buffer_init(&buffer);
+        ephem_context_computeSteps(context, 0, steps_total, (output != NULL) ? &buffer : NULL, output,
+                                   columnar ? &writer : NULL);
+        if (output != NULL) output_buffer_flush(&buffer, output);
+        output_buffer_free(&buffer);
+    } else {
+        int run;
+#pragma omp parallel for ordered schedule(dynamic, 1) private(run)
+        for (run = 0; run < run_count; run++) {
+            const int step_first = run * run_steps;
+            const int step_end = (step_first + run_steps < steps_total) ? (step_first + run_steps) : steps_total;
+
+            // Each run has a context of its own, to hold the positions of the Earth and Sun and the results
+            ephem_context *worker = (ephem_context *) malloc(sizeof(ephem_context));
+            if (worker == NULL) {
+                ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+                exit(1);
+            }
+            ephem_context_init(worker, s);
+
+            output_buffer buffer;
+            output_buffer_init(&buffer);
+            ephem_context_computeSteps(worker, step_first, step_end, &buffer, NULL, NULL);
+
+            // Write out the runs in order
+#pragma omp ordered
+            {
+                if (columnar) {
+                    const double *results = (const double *) buffer.data;
+                    for (int step = step_first; step < step_end; step++) {
+                        columnarOutput_addChunk(&writer, step, 0, s->objects_count,
+                                                results + (step - step_first) * s->objects_count * EPHEM_PARAMETERS);
+                    }
+                } else {
+                    output_buffer_flush(&buffer, output);
+                }
+
+                // Leave the results of the final time step in the caller's context
+                if (step_end == steps_total) memcpy(context->results, worker->results, sizeof(context->results));
+            }
+
+            output_buffer_free(&buffer);
+            free(worker);
+        }
+    }
+
+    if (columnar) columnarOutput_close(&writer);
+
+    if (DEBUG) {
+        char line[FNAME_LENGTH];
+        strcpy(line, "Finished computing ephemeris.");
+        ephem_log(line);
+
+        unsigned long hits, misses;
+        jpl_cacheStats(&hits, &misses);
+        snprintf(line, FNAME_LENGTH, "DE430 record cache: %lu hits, %lu misses.", hits, misses);
+        ephem_log(line);
+        orbitalElements_cacheStats(&hits, &misses);
+        snprintf(line, FNAME_LENGTH, "Orbital elements cache: %lu hits, %lu misses.", hits, misses);
+        ephem_log(line);
+    }
+}
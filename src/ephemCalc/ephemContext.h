@@ -0,0 +1,85 @@
+// ephemContext.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+
+#ifndef EPHEMCONTEXT_H
+#define EPHEMCONTEXT_H 1
+
+#include <stdio.h>
+
+#include "ephemCalc/observerState.h"
+#include "settings/settings.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! The number of quantities computed for each object at each time step, and stored in <ephem_context.results>
+#define EPHEM_PARAMETERS 20
+
+//! The number of objects which are computed together, and whose quantities are held in <ephem_context.results> at
+//! once. Longer lists of objects are computed, and written out, a chunk at a time.
+#define EPHEM_CHUNK_OBJECTS 512
+
+//! The number of object-time steps which each thread computes together when an ephemeris has few objects. Such
+//! ephemerides are computed in runs of time steps, with each thread computing a different run.
+#define EPHEM_TIME_CHUNK_VALUES 4096
+
+//! The number of Chebyshev coefficients fitted to each quantity over each segment of an interpolated ephemeris (see
+//! <settings.interpolation_tolerance>). This is also the number of times in each segment at which the ephemeris is
+//! computed in full.
+#define EPHEM_INTERPOLATION_COEFFS 12
+
+//! The longest segment of time over which an interpolated ephemeris fits each series; days
+#define EPHEM_INTERPOLATION_MAX_SPAN 16
+
+//! The number of object-time steps which each thread computes together when an ephemeris is interpolated. These are
+//! much cheaper to compute, so each thread takes a longer run of time steps.
+#define EPHEM_INTERPOLATION_RUN_VALUES 131072
+
+//! ephem_context - Everything which is needed to compute one ephemeris. The ephemerides and orbital elements
+//! themselves are loaded once per process, and are never modified once loaded, so they are shared by all contexts.
+//! Everything which changes while an ephemeris is being computed lives here instead, so any number of threads may
+//! each compute an ephemeris at once, provided that each uses its own context.
+
+typedef struct {
+    settings *settings;  // The settings describing the ephemeris to compute
+    double jd;  // The time step currently being computed; TT
+    observerState observer;  // The positions of the Earth and Sun at <jd>
+    double results[EPHEM_PARAMETERS * EPHEM_CHUNK_OBJECTS];  // The quantities computed for each object in the most
+    // recent chunk: x, y, z, ra, dec, mag, phase, angular size, physical size, albedo, distance from the Sun, distance
+    // from the Earth, angular distance from the Sun, theta_ESO, ecliptic longitude, ecliptic distance, ecliptic
+    // latitude, vx, vy, vz
+} ephem_context;
+
+void ephem_context_init(ephem_context *context, settings *s);
+
+void ephem_context_beginStep(ephem_context *context, double jd);
+
+void ephem_context_computeObjects(ephem_context *context, const int *body_id, int count);
+
+void ephem_context_compute(ephem_context *context, FILE *output);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -23,19 +23,25 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_const_mksa.h>
 
 #include "coreUtils/asciiDouble.h"
 #include "coreUtils/errorReport.h"
+#include "coreUtils/mappedFile.h"
+#include "coreUtils/recordCache.h"
 #include "coreUtils/strConstants.h"
 
 #include "listTools/ltDict.h"
 #include "listTools/ltMemory.h"
 
+#include "mathsTools/chebyshev.h"
+
 #include "jpl.h"
 #include "orbitalElements.h"
+#include "spk.h"
 #include "magnitudeEstimate.h"
 
 #include "settings/settings.h"
@@ -62,24 +68,45 @@ static dict *JPL_EphemVars = NULL; // The metadata variables about the ephemeris
 static int JPL_EphemArrayRecords = 0; // The number of blocks needed to go from EphemStart to EphemEnd at step size EphemStep
 
 static int JPL_EphemData_offset = -1; // The offset of the start of the ephmeris binary data from the start of the binary file
-static FILE *JPL_EphemFile = NULL; // File pointer used to read binary data from DE430 (we don't read whole binary ephemeris into memory)
-static char jpl_ephem_filename[FNAME_LENGTH];  // File name of binary ephemeris file
+static FILE *JPL_EphemFile = NULL; // File pointer used to read the header of the binary ephemeris file
+
+static double *JPL_EphemData = NULL; // Buffer to hold the ephemeris data while we parse the ASCII files
+
+static record_cache JPL_EphemRecords; // The records of Chebyshev coefficients, loaded on demand from the binary file
+static atomic_int JPL_EphemReady = 0; // Boolean flag indicating whether the binary ephemeris has been opened
+static pthread_once_t JPL_EphemInit = PTHREAD_ONCE_INIT; // Makes sure we only try to load DE430 once
+static atomic_int JPL_LastRecord = -1; // The record most recently fetched, used to trigger reading ahead
 
-static double *JPL_EphemData = NULL; // Buffer to hold the ephemeris data, as we load it
-static unsigned char *JPL_EphemData_items_loaded = NULL; // Record of which ephemeris data records we have loaded
+//! The number of records beyond the one in use which are read ahead in the background
+#define JPL_READAHEAD_RECORDS 2
+
+//! Padding after the shape array in the binary file, which aligns the Chebyshev coefficients to 8-byte boundaries
+#define JPL_BINARY_PADDING 4
 
 static double JPL_AU = 0.0; // astronomical unit, measured in km
 
+//! SPK files which, if present in the data directory, are used in preference to the DE430 ASCII files
+static const char *const JPL_SpkFilenames[] = {"de440.bsp", "de440s.bsp", "de430.bsp", NULL};
+
+//! The NAIF IDs of the bodies in the SPK file which correspond to each DE430 body ID (the Moon is handled separately)
+static const int JPL_SpkTargets[11] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 301, 10};
+
+//! The astronomical unit, measured in km, used when reading SPK files (IAU 2012 Resolution B2)
+#define JPL_SPK_AU 149597870.7
+
+static spk_file JPL_Spk; // The SPK file we are reading positions from, if any
+static int JPL_UseSpk = 0; // Boolean flag indicating whether positions come from <JPL_Spk> rather than DE430
+
 
 //! JPL_ReadBinaryData - restore DE430 from a binary dump of the data in <data/dcfbinary.430>, to save parsing
-//! original files every time we are run.
+//! original files every time we are run. Where the platform allows, the file is memory-mapped and records are used in
+//! place; otherwise records are read from disk on demand as they are needed.
 
 int JPL_ReadBinaryData() {
     char fname[FNAME_LENGTH];
 
     // Work out the filename of the binary file that we are to open
     snprintf(fname, FNAME_LENGTH, "%s/dcfbinary.%d", DATADIR, JPL_EphemNumber);
-    snprintf(jpl_ephem_filename, FNAME_LENGTH, "%s", fname);
     if (DEBUG) {
         snprintf(temp_err_string, FNAME_LENGTH, "Trying to fetch binary data from file <%s>.", fname);
         ephem_log(temp_err_string);
@@ -134,15 +161,30 @@ int JPL_ReadBinaryData() {
     // take time. Instead, store a pointer to the offset of the start of the ephemeris from the beginning of file.
     JPL_EphemData_offset = (int) ftell(JPL_EphemFile);
 
-    // Allocate memory to use to store ephemeris, as we load it
-    JPL_EphemData = (double *) lt_malloc(JPL_EphemArrayLen * JPL_EphemArrayRecords * sizeof(double));
+    // Binary files written by older versions of this code have no padding after the shape array, which leaves the
+    // Chebyshev coefficients misaligned. We can tell the two layouts apart from the size of the file.
+    const long data_bytes = (long) JPL_EphemArrayLen * JPL_EphemArrayRecords * (long) sizeof(double);
+    fseek(JPL_EphemFile, 0L, SEEK_END);
+    const long file_size = ftell(JPL_EphemFile);
+    if (file_size == JPL_EphemData_offset + JPL_BINARY_PADDING + data_bytes) {
+        JPL_EphemData_offset += JPL_BINARY_PADDING;
+    }
+
+    // We have finished reading the header
+    fclose(JPL_EphemFile);
+    JPL_EphemFile = NULL;
 
-    // Allocate array to record which blocks we have already loaded from disk
-    JPL_EphemData_items_loaded = (unsigned char *) lt_malloc(JPL_EphemArrayRecords * sizeof(unsigned char));
-    memset(JPL_EphemData_items_loaded, 0, JPL_EphemArrayRecords);
+    // Open the table of Chebyshev coefficients. If possible, the file is memory-mapped and records are used in place.
+    // Otherwise, each 32-day record is loaded from disk the first time it is needed.
+    if (record_cache_open(&JPL_EphemRecords, fname, JPL_EphemData_offset, JPL_EphemArrayLen * sizeof(double),
+                          JPL_EphemArrayRecords) != 0) {
+        return 1;
+    }
+    atomic_store_explicit(&JPL_EphemReady, 1, memory_order_release);
 
     if (DEBUG) {
-        snprintf(temp_err_string, FNAME_LENGTH, "Data file successfully opened.");
+        snprintf(temp_err_string, FNAME_LENGTH, "Data file successfully opened%s.",
+                 (JPL_EphemRecords.map.data != NULL) ? " and mapped into memory" : "");
         ephem_log(temp_err_string);
     }
 
@@ -152,18 +194,19 @@ int JPL_ReadBinaryData() {
 
 //! JPL_DumpBinaryData - dump contents of DE430 to a binary dump in <data/dcfbinary.430>, to save parsing
 //! original files every time we are run.
+//! \param [in] fname - The filename of the binary dump to write
+//! \return - Zero on success
 
-void JPL_DumpBinaryData() {
+int JPL_DumpBinaryData(const char *fname) {
     FILE *output;
-    char fname[FNAME_LENGTH];
+    const char padding[JPL_BINARY_PADDING] = {0};
 
-    snprintf(fname, FNAME_LENGTH, "%s/dcfbinary.%d", DATADIR, JPL_EphemNumber);
     if (DEBUG) {
         sprintf(temp_err_string, "Dumping binary data to file <%s>.", fname);
         ephem_log(temp_err_string);
     }
     output = fopen(fname, "w");
-    if (output == NULL) return; // FAIL
+    if (output == NULL) return 1; // FAIL
     fwrite((void *) &JPL_EphemStart, sizeof(double), 1, output);
     fwrite((void *) &JPL_EphemEnd, sizeof(double), 1, output);
     fwrite((void *) &JPL_EphemStep, sizeof(double), 1, output);
@@ -171,17 +214,21 @@ void JPL_DumpBinaryData() {
     fwrite((void *) &JPL_EphemArrayLen, sizeof(int), 1, output);
     fwrite((void *) &JPL_EphemArrayRecords, sizeof(int), 1, output);
     fwrite((void *) JPL_ShapeData, sizeof(int), 13 * 3, output);
+    fwrite((void *) padding, 1, JPL_BINARY_PADDING, output);
     fwrite((void *) JPL_EphemData, sizeof(double), JPL_EphemArrayLen * JPL_EphemArrayRecords, output);
     fclose(output);
     if (DEBUG) {
         snprintf(temp_err_string, FNAME_LENGTH, "Data successfully dumped.");
         ephem_log(temp_err_string);
     }
+    return 0;
 }
 
-//! jpl_readData - Read the data contained in the original DE430 files
+//! jpl_readAsciiFiles - Read the data contained in the original DE430 files into <JPL_EphemData>
+//! \param [in] header_only - Boolean flag indicating that we should stop after reading <data/header.430>. This sets
+//! up the metadata about the ephemeris, and allocates <JPL_EphemData>, but reads none of the Chebyshev coefficients.
 
-void jpl_readAsciiData() {
+static void jpl_readAsciiFiles(int header_only) {
     char fname[FNAME_LENGTH], line[FNAME_LENGTH], key[FNAME_LENGTH];
     const char *line_ptr;
 
@@ -199,10 +246,6 @@ void jpl_readAsciiData() {
     double *var_val = NULL; // Array of doubles for holding the values of the metadata variables in GROUP 1040/1041
     double jd_min = 0;  // The Julian Day number at the start of the current ephemeris block
 
-    // Try and read the ephemeris from binary files. Only proceed with parsing the original files if binary files
-    // don't exist.
-    if (JPL_ReadBinaryData() == 0) return;
-
     // Logging message to report that we are parsing the DE430 files
     if (DEBUG) {
         snprintf(temp_err_string, FNAME_LENGTH, "Beginning to read JPL ephemeris DE%d.", JPL_EphemNumber);
@@ -218,6 +261,9 @@ void jpl_readAsciiData() {
             // If we already have an ephemeris file open, close it
             if (input != NULL) fclose(input);
 
+            // If we were only asked for the header, then we're finished once we've read it
+            if (header_only && (input != NULL)) break;
+
             // If we've reached the end of the time span of DE430, we're finished
             if (year >= JPL_ASCII_last) break;
 
@@ -314,8 +360,9 @@ void jpl_readAsciiData() {
                 // Work out how many bytes of storage we need
                 malloced_data_len = JPL_EphemArrayLen * JPL_EphemArrayRecords;
 
-                // Allocate storage for the ephemeris data
-                JPL_EphemData = (double *) malloc(malloced_data_len * sizeof(double));
+                // Allocate storage for the ephemeris data. This is zeroed, so that any records which the ASCII
+                // files don't cover are written to the binary dump in the same way every time.
+                JPL_EphemData = (double *) calloc(malloced_data_len, sizeof(double));
                 if (JPL_EphemData == NULL) {
                     ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
                     exit(1);
@@ -498,85 +545,458 @@ void jpl_readAsciiData() {
         snprintf(temp_err_string, FNAME_LENGTH, "Finished reading JPL epemeris DE%d.", JPL_EphemNumber);
         ephem_log(temp_err_string);
     }
+}
+
+//! jpl_openSpk - Look for an SPK file (e.g. <data/de440.bsp>) in the data directory, and if we find one, use it in
+//! place of DE430
+//! \return - Zero if an SPK file was opened
+
+static int jpl_openSpk() {
+    char fname[FNAME_LENGTH];
+    int i;
+
+    for (i = 0; JPL_SpkFilenames[i] != NULL; i++) {
+        double et_start, et_end;
+        snprintf(fname, FNAME_LENGTH, "%s/%s", DATADIR, JPL_SpkFilenames[i]);
+        if (spk_open(fname, &JPL_Spk) != 0) continue;
+
+        // Use the time span covered by the Sun as the time span of the ephemeris
+        if (spk_coverage(&JPL_Spk, 10, &et_start, &et_end) != 0) {
+            snprintf(temp_err_string, FNAME_LENGTH, "SPK file <%.*s> has no position for the Sun.",
+                     FNAME_LENGTH - 64, fname);
+            ephem_error(temp_err_string);
+            spk_close(&JPL_Spk);
+            continue;
+        }
+
+        JPL_EphemStart = 2451545.0 + et_start / 86400;
+        JPL_EphemEnd = 2451545.0 + et_end / 86400;
+        JPL_AU = JPL_SPK_AU;
+        JPL_UseSpk = 1;
+        atomic_store_explicit(&JPL_EphemReady, 1, memory_order_release);
+
+        if (DEBUG) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Using SPK file <%s>, spanning %.1f to %.1f.", fname,
+                     JPL_EphemStart, JPL_EphemEnd);
+            ephem_log(temp_err_string);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+//! jpl_spkState - Evaluate the 3D position, and optionally the velocity, of a DE430 body using an SPK file
+//! \param [in] body_id - The body's index within DE430 (0 Mercury - 10 Sun)
+//! \param [in] jd - Julian day number; TDB
+//! \param [out] x - Cartesian position of body (AU).
+//! \param [out] y - Cartesian position of body (AU).
+//! \param [out] z - Cartesian position of body (AU).
+//! \param [out] velocity - Cartesian velocity of body (AU/day), as a 3-element array. May be NULL if not wanted.
+
+static void jpl_spkState(int body_id, double jd, double *x, double *y, double *z, double *velocity) {
+    const double et = (jd - 2451545.0) * 86400;
+    double position[3], velocity_km[3];
+    int i, fail;
+
+    // Nutations and librations are not in SPK files
+    if ((body_id < 0) || (body_id > 10)) {
+        fail = 1;
+    } else if (body_id == 9) {
+        // DE430 gives the Moon's position relative to the Earth, whereas SPK files give the Moon (301) and Earth (399)
+        // separately relative to the Earth-Moon barycentre
+        double earth_position[3], earth_velocity[3];
+        fail = spk_computeState(&JPL_Spk, 301, et, position, (velocity != NULL) ? velocity_km : NULL) ||
+               spk_computeState(&JPL_Spk, 399, et, earth_position, (velocity != NULL) ? earth_velocity : NULL);
+        for (i = 0; (i < 3) && !fail; i++) {
+            position[i] -= earth_position[i];
+            if (velocity != NULL) velocity_km[i] -= earth_velocity[i];
+        }
+    } else {
+        fail = spk_computeState(&JPL_Spk, JPL_SpkTargets[body_id], et, position,
+                                (velocity != NULL) ? velocity_km : NULL);
+    }
+
+    if (fail) {
+        *x = *y = *z = GSL_NAN;
+        if (velocity != NULL) velocity[0] = velocity[1] = velocity[2] = GSL_NAN;
+        return;
+    }
+
+    *x = position[0] / JPL_AU;
+    *y = position[1] / JPL_AU;
+    *z = position[2] / JPL_AU;
+    if (velocity != NULL) {
+        for (i = 0; i < 3; i++) velocity[i] = velocity_km[i] * 86400 / JPL_AU;
+    }
+}
+
+//! jpl_readAsciiData - Load DE430 from the binary dump in <data/dcfbinary.430> if it exists. Otherwise, parse the
+//! original ASCII files, and write the binary dump for next time.
+
+void jpl_readAsciiData() {
+    char fname[FNAME_LENGTH];
+
+    // If we've been given an SPK file, use that rather than DE430
+    if (jpl_openSpk() == 0) return;
+
+    // Try and read the ephemeris from binary files. Only proceed with parsing the original files if binary files
+    // don't exist.
+    if (JPL_ReadBinaryData() == 0) return;
+
+    // Parse the text-based DE430 files that we downloaded
+    jpl_readAsciiFiles(0);
 
     // Now that we've parsed the text-based DE430 files that we downloaded, we dump the data in binary format
-    JPL_DumpBinaryData();
+    snprintf(fname, FNAME_LENGTH, "%s/dcfbinary.%d", DATADIR, JPL_EphemNumber);
+    JPL_DumpBinaryData(fname);
+
+    // Open the version on disk. If we could not write it, we serve records from our local copy instead.
+    if (JPL_ReadBinaryData() == 0) {
+        free(JPL_EphemData);
+    } else {
+        record_cache_wrap(&JPL_EphemRecords, JPL_EphemData, JPL_EphemArrayLen * sizeof(double),
+                          JPL_EphemArrayRecords);
+        atomic_store_explicit(&JPL_EphemReady, 1, memory_order_release);
+    }
+    JPL_EphemData = NULL;
+}
 
-    // Make table indicating that we have loaded all of the ephemeris data
-    JPL_EphemData_items_loaded = (unsigned char *) lt_malloc(JPL_EphemArrayRecords * sizeof(unsigned char));
-    memset(JPL_EphemData_items_loaded, 1, JPL_EphemArrayRecords);
+//! jpl_ingestRun - A run of lines in one of the DE430 ASCII files which contains a single record of Chebyshev
+//! coefficients, delimited by the short "1 1018" lines which start each record
+
+typedef struct {
+    const char *start;  // The first character of the first line of the record
+    const char *end;  // One past the last character of the last line of the record
+    int destination;  // The index of the record within <JPL_EphemData>, or -1 if it repeats data we already have
+} jpl_ingestRun;
+
+//! jpl_ingestParseFloat - Parse a Fortran-format floating point number, such as <0.2433264500D+07>. This performs
+//! exactly the same arithmetic as <get_float>, so the results are bit-for-bit identical, but it stops at <end>
+//! rather than relying on a null terminator, so that it can be used directly on memory-mapped files.
+//! \param [in] in - The first character of the number
+//! \param [in] end - The end of the buffer containing the number
+//! \param [out] next - Returns a pointer to the character after the end of the number
+//! \return - The floating point value extracted
+
+static double jpl_ingestParseFloat(const char *in, const char *end, const char **next) {
+    double accumulator = 0;
+    int decimals = 0, past_decimal_point = 0, negative = 0;
+
+    if ((in < end) && (*in == '-')) {
+        negative = 1;
+        in++;
+    } else if ((in < end) && (*in == '+')) {
+        in++;
+    }
 
-    // Free storage for local copy
-    free(JPL_EphemData);
+    while ((in < end) && (((*in >= '0') && (*in <= '9')) || (*in == '.'))) {
+        if (*in == '.') {
+            past_decimal_point = 1;
+        } else {
+            accumulator = ((10 * accumulator) + (*in - '0'));
+            if (past_decimal_point) decimals++;
+        }
+        in++;
+    }
+
+    while (decimals != 0) {
+        decimals--;
+        accumulator /= 10;
+    }
 
-    // Open file pointer to version on disk
-    JPL_ReadBinaryData();
+    if (negative) accumulator *= -1;
+
+    // DE430 uses Fortran-style exponents, which are always integers
+    if ((in < end) && ((*in == 'e') || (*in == 'E') || (*in == 'd') || (*in == 'D'))) {
+        double exponent = 0;
+        int exponent_negative = 0;
+        in++;
+        if ((in < end) && (*in == '-')) {
+            exponent_negative = 1;
+            in++;
+        } else if ((in < end) && (*in == '+')) {
+            in++;
+        }
+        while ((in < end) && (*in >= '0') && (*in <= '9')) {
+            exponent = (10 * exponent) + (*in - '0');
+            in++;
+        }
+        if (exponent_negative) exponent *= -1;
+        accumulator *= pow(10.0, exponent);
+    }
+
+    *next = in;
+    return accumulator;
 }
 
-//! chebyshev - Evaluate a Chebyshev polynomial
-//! \param coeffs - The coefficients of the Chebyshev polynomial
-//! \param Ncoeff - The number of coefficients
-//! \param x - The point at which to evaluate the Chebyshev polynomial
-//! \return The value of the Chebyshev polynomial
+//! jpl_ingestParseRun - Parse all of the floating point numbers in a record of Chebyshev coefficients
+//! \param [in] start - The first character of the record
+//! \param [in] end - One past the last character of the record
+//! \param [out] out - The array into which to write the numbers
+//! \param [in] max_count - The maximum number of numbers to write to <out>
+//! \return - The number of numbers found in the record, or <max_count + 1> if there were more than <max_count>
 
-double chebyshev(double *coeffs, int Ncoeff, double x) {
-    double x2 = 2 * x;
-    double d = 0, dd = 0, ddd = 0;
-    int k = Ncoeff - 1;
+static int jpl_ingestParseRun(const char *start, const char *end, double *out, int max_count) {
+    const char *in = start;
+    int count = 0;
 
-    while (k > 0) {
-        ddd = dd;
-        dd = d;
-        d = x2 * dd - ddd + coeffs[k];
-        k--;
+    while (1) {
+        // Fast-forward over whitespace
+        while ((in < end) && (*in <= ' ') && (*in > '\0')) in++;
+        if (in >= end) break;
+
+        // Parse one number, and then skip over anything else in the same word
+        if (count >= max_count) return count + 1;
+        out[count++] = jpl_ingestParseFloat(in, end, &in);
+        while ((in < end) && ((*in > ' ') || (*in < '\0'))) in++;
     }
-    return x * d - dd + coeffs[0];
+    return count;
 }
 
-//! jpl_computeXYZ - Evaluate the 3D position of a solar system body at Julian date JD (in ICRF v2 as used by DE430)
-//! \param [in] body_id - The body's index within DE430 (0 Sun - 12 Pluto)
-//! \param [in] jd - Julian day number; TT
-//! \param [out] x - Cartesian position of body (AU). This axis points away from RA=0.
-//! \param [out] y - Cartesian position of body (AU).
-//! \param [out] z - Cartesian position of body (AU). This axis points towards J2000.0 north celestial pole
+//! jpl_ingestAsciiData - Convert the original DE430 ASCII files into the binary dump that <JPL_ReadBinaryData> reads.
+//! The output is byte-for-byte identical to that written by <jpl_readAsciiData>, but the files are memory-mapped and
+//! their records are parsed in parallel. On platforms without memory-mapping, we fall back to the serial parser.
+//! \param [in] out_filename - The filename of the binary dump to write
+//! \return - Zero on success
+
+int jpl_ingestAsciiData(const char *out_filename) {
+    // The ephemeris files <data/ascp????.430> are named after their start years, and the last ends at JPL_ASCII_last
+    const int file_count = (JPL_ASCII_last - JPL_ASCII_first + JPL_ASCII_step - 1) / JPL_ASCII_step;
+    mapped_file *files = NULL;
+    jpl_ingestRun *runs = NULL;
+    int run_count = 0, runs_allocated = 0;
+    int record_count = 0;  // The number of records that we will keep, after discarding repeats
+    int failed_run = -1;  // The index of a run which didn't contain a whole record, if any
+    double jd_min = 0;  // The end of the time span covered by the last record we are keeping
+    int i;
+
+    // Without memory-mapping, just use the serial parser
+    if (!mapped_file_available()) {
+        jpl_readAsciiFiles(0);
+        const int status = JPL_DumpBinaryData(out_filename);
+        free(JPL_EphemData);
+        JPL_EphemData = NULL;
+        return status;
+    }
 
-void jpl_computeXYZ(int body_id, double jd, double *x, double *y, double *z) {
-    int record_index, i;
-    double dt, tc;
+    // Read the metadata in <data/header.430>, which tells us the size of each record
+    jpl_readAsciiFiles(1);
+    if (JPL_EphemData == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "DE430 header file contained no GROUP 1070.");
+        exit(1);
+    }
 
-#pragma omp critical (jpl_init)
-    {
-        // If we haven't already loaded DE430 data, make sure we have done so now
-        if (JPL_EphemFile == NULL) jpl_readAsciiData();
+    files = (mapped_file *) malloc(file_count * sizeof(mapped_file));
+    if (files == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
     }
 
-    // If this query falls outside the time span of DE430, then reject the query
-    if ((JPL_EphemFile == NULL) || (jd < JPL_EphemStart) || (jd > JPL_EphemEnd)) {
-        *x = *y = *z = GSL_NAN;
-        return;
+    // Map each of the files <data/ascp????.430> in turn, and split them into runs of lines at the short lines which
+    // start each record
+    for (i = 0; i < file_count; i++) {
+        char fname[FNAME_LENGTH];
+        snprintf(fname, FNAME_LENGTH, "%s/ascp%d.%d", DATADIR, JPL_ASCII_first + i * JPL_ASCII_step,
+                 JPL_EphemNumber);
+        if (DEBUG) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Mapping file <%s>", fname);
+            ephem_log(temp_err_string);
+        }
+        if (mapped_file_open(fname, &files[i]) != 0) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Failed opening file <%.*s>", FNAME_LENGTH - 64, fname);
+            ephem_fatal(__FILE__, __LINE__, temp_err_string);
+            exit(1);
+        }
+
+        const char *line = (const char *) files[i].data;
+        const char *const file_end = line + files[i].length;
+        const char *run_start = NULL;
+
+        while (1) {
+            const char *line_end = file_end;
+            int short_line = 1;
+
+            if (line < file_end) {
+                line_end = (const char *) memchr(line, '\n', file_end - line);
+                if (line_end == NULL) line_end = file_end;
+
+                // Measure the length of the line, with whitespace stripped from both ends, as <str_strip> would.
+                // The serial parser ignores lines shorter than 40 characters, which start each record.
+                const char *a = line, *b = line_end;
+                while ((a < b) && (*a <= ' ') && (*a > '\0')) a++;
+                while ((b > a) && (b[-1] <= ' ') && (b[-1] > '\0')) b--;
+                short_line = (b - a < 40);
+            }
+
+            if (short_line && (run_start != NULL)) {
+                // A short line, or the end of the file, closes the current run
+                if (run_count >= runs_allocated) {
+                    runs_allocated = (runs_allocated > 0) ? 2 * runs_allocated : 4096;
+                    runs = (jpl_ingestRun *) realloc(runs, runs_allocated * sizeof(jpl_ingestRun));
+                    if (runs == NULL) {
+                        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+                        exit(1);
+                    }
+                }
+                runs[run_count].start = run_start;
+                runs[run_count].end = (line < file_end) ? line : file_end;
+                run_count++;
+                run_start = NULL;
+            } else if (!short_line && (run_start == NULL)) {
+                run_start = line;
+            }
+
+            if (line >= file_end) break;
+            line = line_end + 1;
+        }
+    }
+
+    // Decide which records to keep, using only the first two numbers in each, which are its start and end JD.
+    // Like the serial parser, we discard any record which repeats a time span that we've already passed.
+    for (i = 0; i < run_count; i++) {
+        double jd_span[2];
+        if (jpl_ingestParseRun(runs[i].start, runs[i].end, jd_span, 2) < 2) {
+            failed_run = i;
+            break;
+        }
+        if ((i > 0) && (jd_span[0] < jd_min - 0.1)) {
+            if (DEBUG) {
+                snprintf(temp_err_string, FNAME_LENGTH, "Repeat record detected at %.1f (expecting %.1f).",
+                         jd_span[0], jd_min);
+                ephem_log(temp_err_string);
+            }
+            runs[i].destination = -1;
+            continue;
+        }
+        if (record_count >= JPL_EphemArrayRecords) {
+            ephem_fatal(__FILE__, __LINE__, "Data array overflow.");
+            exit(1);
+        }
+        jd_min = jd_span[1];
+        runs[i].destination = record_count++;
+    }
+
+    // Parse the records we're keeping, in parallel, straight into their final place in <JPL_EphemData>
+    if (failed_run < 0) {
+#pragma omp parallel for schedule(dynamic, 16) shared(runs, failed_run) private(i)
+        for (i = 0; i < run_count; i++) {
+            if (runs[i].destination < 0) continue;
+            double *out = JPL_EphemData + (long) runs[i].destination * JPL_EphemArrayLen;
+            if (jpl_ingestParseRun(runs[i].start, runs[i].end, out, JPL_EphemArrayLen) != JPL_EphemArrayLen) {
+#pragma omp critical (jpl_ingest_failure)
+                failed_run = i;
+            }
+        }
+    }
+
+    if (failed_run >= 0) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Record %d of the DE430 ASCII files does not contain %d numbers.",
+                 failed_run, JPL_EphemArrayLen);
+        ephem_fatal(__FILE__, __LINE__, temp_err_string);
+        exit(1);
+    }
+
+    if (DEBUG) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Read %d records into a data array of %d records.", record_count,
+                 JPL_EphemArrayRecords);
+        ephem_log(temp_err_string);
     }
 
+    for (i = 0; i < file_count; i++) mapped_file_close(&files[i]);
+    free(files);
+    free(runs);
+
+    // Write the binary dump
+    const int status = JPL_DumpBinaryData(out_filename);
+    free(JPL_EphemData);
+    JPL_EphemData = NULL;
+    return status;
+}
+
+//! jpl_cacheStats - Report how many DE430 record fetches were served from memory, and how many needed a read from disk
+//! \param [out] hits - The number of fetches which found the record already loaded
+//! \param [out] misses - The number of fetches which read the record from disk
+
+void jpl_cacheStats(unsigned long *hits, unsigned long *misses) {
+    record_cache_stats(&JPL_EphemRecords, hits, misses);
+}
+
+//! jpl_recordIndex - Work out which record within DE430 contains a particular Julian date
+//! \param [in] jd - Julian day number; TT
+//! \return - The index of the record, clipped to the range of records available
+
+static int jpl_recordIndex(double jd) {
     // Work out which block within DE430 this query falls within
-    record_index = floor((jd - JPL_EphemStart) / JPL_EphemStep);
+    int record_index = (int) floor((jd - JPL_EphemStart) / JPL_EphemStep);
 
     // Clip block number within allowed range
     if (record_index < 0) record_index = 0;
     if (record_index >= JPL_EphemArrayRecords) record_index = JPL_EphemArrayRecords - 1;
+    return record_index;
+}
 
-    if (!JPL_EphemData_items_loaded[record_index]) {
-        // Create a pointer to the block that we need to query
-        long data_position_needed = JPL_EphemData_offset + record_index * JPL_EphemArrayLen * sizeof(double);
-
-#pragma omp critical (jpl_fetch)
-        {
-            fseek(JPL_EphemFile, data_position_needed, SEEK_SET);
-            dcf_fread((void *) &JPL_EphemData[record_index * JPL_EphemArrayLen],
-                      sizeof(double), JPL_EphemArrayLen, JPL_EphemFile,
-                      jpl_ephem_filename, __FILE__, __LINE__);
-            JPL_EphemData_items_loaded[record_index] = 1;
-        }
+//! jpl_fetchRecord - Fetch a DE430 record, loading it from disk if this is the first time it has been needed. When
+//! queries move into a new record, its neighbours are read ahead in the background, so that a clock which steps
+//! forwards or backwards through time does not wait on disk I/O as it crosses into the next record.
+//! \param [in] record_index - The index of the record to fetch
+//! \return - Pointer to the record
+
+static const double *jpl_fetchRecord(int record_index) {
+    const double *data = (const double *) record_cache_fetch(&JPL_EphemRecords, record_index);
+
+    // Check with a plain load first, so that threads working within the same record do not contend for a cache line
+    if ((atomic_load_explicit(&JPL_LastRecord, memory_order_relaxed) != record_index) &&
+        (atomic_exchange_explicit(&JPL_LastRecord, record_index, memory_order_relaxed) != record_index)) {
+        record_cache_readahead(&JPL_EphemRecords, record_index - 1, record_index + JPL_READAHEAD_RECORDS);
+    }
+    return data;
+}
+
+//! jpl_setActiveWindow - Declare the span of time over which ephemerides are about to be computed. The records
+//! covering this window are loaded into memory before this returns, so that no query within it waits on disk I/O.
+//! Queries outside the window still work, loading records on demand as usual.
+//! \param [in] jd_min - The Julian day number of the start of the window; TT
+//! \param [in] jd_max - The Julian day number of the end of the window; TT
+
+void jpl_setActiveWindow(double jd_min, double jd_max) {
+    // If we haven't already loaded DE430 data, make sure we have done so now
+    pthread_once(&JPL_EphemInit, jpl_readAsciiData);
+    if (!atomic_load_explicit(&JPL_EphemReady, memory_order_acquire)) return;
+
+    if (jd_max < jd_min) {
+        const double tmp = jd_min;
+        jd_min = jd_max;
+        jd_max = tmp;
+    }
+
+    if (JPL_UseSpk) {
+        spk_prefetch(&JPL_Spk, (jd_min - 2451545.0) * 86400, (jd_max - 2451545.0) * 86400);
+        return;
     }
-    double *data = &JPL_EphemData[record_index * JPL_EphemArrayLen];
+
+    record_cache_preload(&JPL_EphemRecords, jpl_recordIndex(jd_min), jpl_recordIndex(jd_max));
+
+    if (DEBUG) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Preloaded DE430 records %d to %d.",
+                 jpl_recordIndex(jd_min), jpl_recordIndex(jd_max));
+        ephem_log(temp_err_string);
+    }
+}
+
+//! jpl_evaluateRecord - Evaluate the 3D position, and optionally the velocity, of a solar system body from the DE430
+//! record which contains JD
+//! \param [in] data - The DE430 record containing <jd>
+//! \param [in] body_id - The body's index within DE430 (0 Sun - 12 Pluto)
+//! \param [in] jd - Julian day number; TT
+//! \param [out] x - Cartesian position of body (AU).
+//! \param [out] y - Cartesian position of body (AU).
+//! \param [out] z - Cartesian position of body (AU).
+//! \param [out] velocity - Cartesian velocity of body (AU/day), as a 3-element array. May be NULL if not wanted.
+
+static void jpl_evaluateRecord(const double *data, int body_id, double jd, double *x, double *y, double *z,
+                               double *velocity) {
+    int i;
+    double dt, tc;
 
     double t0 = data[0]; // First JD of time step
     //double t1 = data[1]; // Last JD of time step
@@ -592,6 +1012,13 @@ void jpl_computeXYZ(int body_id, double jd, double *x, double *y, double *z) {
     // Number of sub-steps within time step
     int g = JPL_ShapeData[body_id * 3 + 2];
 
+    // Ephemerides written by <jpl_writeSlice> may omit some bodies altogether
+    if (n == 0) {
+        *x = *y = *z = GSL_NAN;
+        if (velocity != NULL) velocity[0] = velocity[1] = velocity[2] = GSL_NAN;
+        return;
+    }
+
     if (g == 1) {
         // If the time step is not subdivided, then life is very easy...
         dt = JPL_EphemStep;  // size of whole time step
@@ -615,29 +1042,301 @@ void jpl_computeXYZ(int body_id, double jd, double *x, double *y, double *z) {
     }
 
     // Offset within block of coefficients uses FORTRAN numbering
-    double *data_scan = data + (c - 1);
-
-    // Evaluate the Chebyshev polynomial
-    *x = chebyshev(data_scan, n, tc) / JPL_AU;
-    *y = chebyshev(data_scan + 1 * n, n, tc) / JPL_AU;
-    *z = chebyshev(data_scan + 2 * n, n, tc) / JPL_AU;
-
-    // For diagnostics, it may be useful to print internal state
-    // if (DEBUG) {
-    //   snprintf(temp_err_string, FNAME_LENGTH,
-    //            "t0 = %.1f ; t1 = %.1f ; JD = %.1f ; C = %d ; N = %d ; G = %d ; dt = %.1f ; Tc = %.1f ; "
-    //            "x = %.1f ; y = %.1f ; z = %.1f", t0,t1,JD,C,N,G,dt,Tc,*x,*y,*z);
-    //   ephem_log(temp_err_string);
-    // }
+    const double *data_scan = data + (c - 1);
+
+    // Evaluate the Chebyshev polynomials for all three axes together
+    double position[3], position_dot[3];
+    chebyshev3(data_scan, n, tc, position, (velocity != NULL) ? position_dot : NULL);
+    *x = position[0] / JPL_AU;
+    *y = position[1] / JPL_AU;
+    *z = position[2] / JPL_AU;
+
+    // The derivatives are with respect to <tc>, which advances by 2 over each sub-interval of length <dt> days
+    if (velocity != NULL) {
+        const double scale = 2 / dt / JPL_AU;
+        velocity[0] = position_dot[0] * scale;
+        velocity[1] = position_dot[1] * scale;
+        velocity[2] = position_dot[2] * scale;
+    }
+}
+
+//! jpl_computeXYZ - Evaluate the 3D position of a solar system body at Julian date JD (in ICRF v2 as used by DE430)
+//! \param [in] body_id - The body's index within DE430 (0 Sun - 12 Pluto)
+//! \param [in] jd - Julian day number; TT
+//! \param [out] x - Cartesian position of body (AU). This axis points away from RA=0.
+//! \param [out] y - Cartesian position of body (AU).
+//! \param [out] z - Cartesian position of body (AU). This axis points towards J2000.0 north celestial pole
+
+void jpl_computeXYZ(int body_id, double jd, double *x, double *y, double *z) {
+    // If we haven't already loaded DE430 data, make sure we have done so now
+    pthread_once(&JPL_EphemInit, jpl_readAsciiData);
+
+    // If this query falls outside the time span of DE430, then reject the query
+    if ((!atomic_load_explicit(&JPL_EphemReady, memory_order_acquire)) ||
+        (jd < JPL_EphemStart) || (jd > JPL_EphemEnd)) {
+        *x = *y = *z = GSL_NAN;
+        return;
+    }
+
+    if (JPL_UseSpk) {
+        jpl_spkState(body_id, jd, x, y, z, NULL);
+        return;
+    }
+
+    // Fetch the block, loading it from disk if this is the first time it has been needed
+    const double *data = jpl_fetchRecord(jpl_recordIndex(jd));
+
+    jpl_evaluateRecord(data, body_id, jd, x, y, z, NULL);
+}
+
+//! jpl_computeState - Evaluate the 3D position and velocity of a solar system body at Julian date JD (in ICRF v2 as
+//! used by DE430). The velocity is obtained by differentiating the same Chebyshev series as the position.
+//! \param [in] body_id - The body's index within DE430 (0 Sun - 12 Pluto)
+//! \param [in] jd - Julian day number; TT
+//! \param [out] x - Cartesian position of body (AU). This axis points away from RA=0.
+//! \param [out] y - Cartesian position of body (AU).
+//! \param [out] z - Cartesian position of body (AU). This axis points towards J2000.0 north celestial pole
+//! \param [out] vx - Cartesian velocity of body (AU/day).
+//! \param [out] vy - Cartesian velocity of body (AU/day).
+//! \param [out] vz - Cartesian velocity of body (AU/day).
+
+void jpl_computeState(int body_id, double jd, double *x, double *y, double *z, double *vx, double *vy, double *vz) {
+    double velocity[3];
+
+    // If we haven't already loaded DE430 data, make sure we have done so now
+    pthread_once(&JPL_EphemInit, jpl_readAsciiData);
+
+    // If this query falls outside the time span of DE430, then reject the query
+    if ((!atomic_load_explicit(&JPL_EphemReady, memory_order_acquire)) ||
+        (jd < JPL_EphemStart) || (jd > JPL_EphemEnd)) {
+        *x = *y = *z = *vx = *vy = *vz = GSL_NAN;
+        return;
+    }
+
+    if (JPL_UseSpk) {
+        jpl_spkState(body_id, jd, x, y, z, velocity);
+    } else {
+        // Fetch the block, loading it from disk if this is the first time it has been needed
+        const double *data = jpl_fetchRecord(jpl_recordIndex(jd));
+
+        jpl_evaluateRecord(data, body_id, jd, x, y, z, velocity);
+    }
+    *vx = velocity[0];
+    *vy = velocity[1];
+    *vz = velocity[2];
+}
+
+//! jpl_computeXYZ_batch - Evaluate the 3D position of a solar system body at many Julian dates. The results are
+//! identical to calling <jpl_computeXYZ> for each date, but the DE430 record is only looked up when the date moves
+//! into a new record, so runs of consecutive dates are evaluated in a tight loop. The dates need not be sorted, but
+//! this is fastest if they are.
+//! \param [in] body_id - The body's index within DE430 (0 Sun - 12 Pluto)
+//! \param [in] jd - Array of Julian day numbers; TT
+//! \param [in] count - The number of Julian day numbers in <jd>
+//! \param [out] x - Array of <count> cartesian x positions (AU). This axis points away from RA=0.
+//! \param [out] y - Array of <count> cartesian y positions (AU).
+//! \param [out] z - Array of <count> cartesian z positions (AU). This axis points towards J2000.0 north celestial pole
+
+void jpl_computeXYZ_batch(int body_id, const double *jd, int count, double *x, double *y, double *z) {
+    const double *data = NULL;
+    int i, current_record = -1;
+
+    // If we haven't already loaded DE430 data, make sure we have done so now
+    pthread_once(&JPL_EphemInit, jpl_readAsciiData);
+    const int ready = atomic_load_explicit(&JPL_EphemReady, memory_order_acquire);
+
+    for (i = 0; i < count; i++) {
+        // If this query falls outside the time span of DE430, then reject the query
+        if ((!ready) || (jd[i] < JPL_EphemStart) || (jd[i] > JPL_EphemEnd)) {
+            x[i] = y[i] = z[i] = GSL_NAN;
+            continue;
+        }
+
+        if (JPL_UseSpk) {
+            jpl_spkState(body_id, jd[i], x + i, y + i, z + i, NULL);
+            continue;
+        }
+
+        // Only fetch a new block when this date falls outside the one we used last time
+        const int record_index = jpl_recordIndex(jd[i]);
+        if (record_index != current_record) {
+            data = jpl_fetchRecord(record_index);
+            current_record = record_index;
+        }
+
+        jpl_evaluateRecord(data, body_id, jd[i], x + i, y + i, z + i, NULL);
+    }
+}
+
+//! jpl_writeSlice - Write a compact binary ephemeris, in the same format as <data/dcfbinary.430>, which contains only
+//! the records spanning a given range of Julian dates, and only a chosen subset of the series in DE430. Optionally,
+//! each series may also be truncated to fewer Chebyshev coefficients, provided the truncation changes no position by
+//! more than a given tolerance. <JPL_ReadBinaryData> reads the result in exactly the same way as the full ephemeris.
+//! The slice is written to <out_filename>.new, and only renamed to <out_filename> once it has been written
+//! completely. The old file is never modified in place, so it may be replaced while it is mapped into memory, even by
+//! this process.
+//! \param [in] out_filename - The filename of the binary ephemeris to write
+//! \param [in] jd_min - The earliest Julian date (TT) which the slice needs to cover
+//! \param [in] jd_max - The latest Julian date (TT) which the slice needs to cover
+//! \param [in] series - Array of the series within DE430 to include (0 Mercury - 10 Sun, 11 nutations, 12 librations)
+//! \param [in] series_count - The number of entries in <series>
+//! \param [in] tolerance - The largest position error (km) which truncating the Chebyshev series may introduce. Set
+//! to zero to keep all of the coefficients. Nutations and librations are never truncated.
+//! \return - Zero on success
+
+int jpl_writeSlice(const char *out_filename, double jd_min, double jd_max, const int *series, int series_count,
+                   double tolerance) {
+    const char padding[JPL_BINARY_PADDING] = {0};
+    int include[13] = {0};  // Boolean flags indicating which series to write
+    int shape[13 * 3] = {0};  // The shape array of the slice
+    char new_filename[FNAME_LENGTH];
+    int i, j, k, record, status = 0;
+
+    if (!(jd_min <= jd_max)) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Cannot write a slice from JD %.1f to an earlier JD %.1f.",
+                 jd_min, jd_max);
+        ephem_error(temp_err_string);
+        return 1;
+    }
+    if (strlen(out_filename) + 5 > FNAME_LENGTH) {
+        ephem_error("Filename of slice is too long.");
+        return 1;
+    }
+    snprintf(new_filename, FNAME_LENGTH, "%s.new", out_filename);
+
+    // If we haven't already loaded DE430 data, make sure we have done so now
+    pthread_once(&JPL_EphemInit, jpl_readAsciiData);
+    if (!atomic_load_explicit(&JPL_EphemReady, memory_order_acquire)) return 1;
+
+    // Slices can only be cut from DE430, not from SPK files
+    if (JPL_UseSpk) {
+        ephem_error("Cannot write a slice of an ephemeris which is being read from an SPK file.");
+        return 1;
+    }
+
+    // Every ephemeris needs the positions of the Earth-Moon barycentre, the Moon and the Sun
+    include[2] = include[9] = include[10] = 1;
+    for (i = 0; i < series_count; i++) {
+        if ((series[i] < 0) || (series[i] >= 13)) {
+            snprintf(temp_err_string, FNAME_LENGTH, "DE430 has no series number %d.", series[i]);
+            ephem_error(temp_err_string);
+            return 1;
+        }
+        include[series[i]] = 1;
+    }
+
+    // Work out which records span the requested range of dates
+    const int record_first = jpl_recordIndex(jd_min);
+    const int record_last = jpl_recordIndex(jd_max);
+    const int record_count = record_last - record_first + 1;
+    const double slice_start = JPL_EphemStart + record_first * JPL_EphemStep;
+    const double slice_end = (record_last == JPL_EphemArrayRecords - 1) ? JPL_EphemEnd :
+                             slice_start + record_count * JPL_EphemStep;
+
+    // Work out how many coefficients to keep for each series, and lay the series out one after another
+    int slice_length = 2;  // Each record starts with the JD span it covers
+    for (i = 0; i < 13; i++) {
+        if (!include[i]) continue;
+        const int n = JPL_ShapeData[i * 3 + 1], g = JPL_ShapeData[i * 3 + 2];
+        const int components = (i == 11) ? 2 : 3;  // Nutations have only two components
+        int n_keep = ((tolerance > 0) && (i <= 10)) ? 1 : n;
+
+        // Find the fewest coefficients for which the sum of the magnitudes of those we discard, which bounds the
+        // error introduced, is within tolerance for every sub-interval of every record
+        for (record = record_first; (record <= record_last) && (n_keep < n); record++) {
+            const double *data = (const double *) record_cache_fetch(&JPL_EphemRecords, record);
+            for (j = 0; j < g * components; j++) {
+                const double *coeffs = data + (JPL_ShapeData[i * 3] - 1) + j * n;
+                double tail = 0;
+                for (k = n - 1; k >= n_keep; k--) {
+                    tail += fabs(coeffs[k]);
+                    if (tail > tolerance) {
+                        n_keep = k + 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        shape[i * 3 + 0] = slice_length + 1;  // FORTRAN numbering starts at 1
+        shape[i * 3 + 1] = n_keep;
+        shape[i * 3 + 2] = g;
+        slice_length += components * n_keep * g;
+
+        if (DEBUG) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Series %2d: keeping %2d of %2d coefficients.", i, n_keep, n);
+            ephem_log(temp_err_string);
+        }
+    }
+
+    double *buffer = (double *) malloc(slice_length * sizeof(double));
+    if (buffer == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+
+    FILE *output = fopen(new_filename, "wb");
+    if (output == NULL) {
+        free(buffer);
+        return 1;
+    }
+
+    // Write the same header as <JPL_DumpBinaryData>, describing the slice
+    status |= (fwrite((void *) &slice_start, sizeof(double), 1, output) != 1);
+    status |= (fwrite((void *) &slice_end, sizeof(double), 1, output) != 1);
+    status |= (fwrite((void *) &JPL_EphemStep, sizeof(double), 1, output) != 1);
+    status |= (fwrite((void *) &JPL_AU, sizeof(double), 1, output) != 1);
+    status |= (fwrite((void *) &slice_length, sizeof(int), 1, output) != 1);
+    status |= (fwrite((void *) &record_count, sizeof(int), 1, output) != 1);
+    status |= (fwrite((void *) shape, sizeof(int), 13 * 3, output) != 13 * 3);
+    status |= (fwrite((void *) padding, 1, JPL_BINARY_PADDING, output) != JPL_BINARY_PADDING);
+
+    // Copy the leading coefficients of each series we're keeping from each record
+    for (record = record_first; (record <= record_last) && (status == 0); record++) {
+        const double *data = (const double *) record_cache_fetch(&JPL_EphemRecords, record);
+        int pos = 2;
+        buffer[0] = data[0];
+        buffer[1] = data[1];
+        for (i = 0; i < 13; i++) {
+            if (!include[i]) continue;
+            const int n = JPL_ShapeData[i * 3 + 1], g = JPL_ShapeData[i * 3 + 2];
+            const int components = (i == 11) ? 2 : 3;
+            for (j = 0; j < g * components; j++) {
+                memcpy(buffer + pos, data + (JPL_ShapeData[i * 3] - 1) + j * n, shape[i * 3 + 1] * sizeof(double));
+                pos += shape[i * 3 + 1];
+            }
+        }
+        status |= (fwrite((void *) buffer, sizeof(double), slice_length, output) != (size_t) slice_length);
+    }
+
+    // Only move the slice into place once all of it has been written successfully
+    status |= (fclose(output) != 0);
+    free(buffer);
+    if (status == 0) status = (rename(new_filename, out_filename) != 0);
+    if (status != 0) {
+        remove(new_filename);
+        return 1;
+    }
+
+    if (DEBUG) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Wrote %d records of %d floats to <%s>.", record_count, slice_length,
+                 out_filename);
+        ephem_log(temp_err_string);
+    }
+    return 0;
 }
 
 //! jpl_computeEphemeris - Main entry point for estimating the position, brightness, etc of an object at a particular
 //! time, using data from the DE430 ephemeris.
 //! \param [in] bodyId - The object ID number we want to query. 0=Mercury. 2=Earth/Moon barycentre. 9=Pluto. 10=Sun, etc
-//! \param [in] jd - The Julian date to query; TT
+//! \param [in] observer - The positions of the Earth and Sun at the Julian date to query, from <observerState_compute>
 //! \param [out] x - x,y,z position of body, in ICRF v2, in AU, relative to solar system barycentre.
 //! \param [out] y - x points to RA=0. y points to RA=6h.
 //! \param [out] z - z points to celestial north pole (i.e. J2000.0).
+//! \param [out] vx - x,y,z velocity of body, in ICRF v2, in AU/day, relative to solar system barycentre, at the
+//! time the light we see left it. May be NULL, along with <vy> and <vz>, if the velocity is not wanted.
+//! \param [out] vy - y component of velocity (AU/day)
+//! \param [out] vz - z component of velocity (AU/day)
 //! \param [out] ra - Right ascension of the object (J2000.0, radians, relative to geocentre)
 //! \param [out] dec - Declination of the object (J2000.0, radians, relative to geocentre)
 //! \param [out] mag - Estimated V-band magnitude of the object
@@ -653,37 +1352,23 @@ void jpl_computeXYZ(int body_id, double jd, double *x, double *y, double *z) {
 //! \param [out] eclipticLatitude - The ecliptic latitude of the object (J2000.0 radians)
 //! \param [out] eclipticDistance - The separation of the object from the Sun, in ecliptic longitude (radians)
 //! \param [in] ra_dec_epoch - The epoch of the RA/Dec coordinates to output. Supply 2451545.0 for J2000.0.
-//! \param [in] do_topocentric_correction - Boolean indicating whether to apply topocentric correction to (ra, dec)
-//! \param [in] topocentric_latitude - Latitude (deg) of observer on Earth, if topocentric correction is applied.
-//! \param [in] topocentric_longitude - Longitude (deg) of observer on Earth, if topocentric correction is applied.
-
-void jpl_computeEphemeris(int bodyId, double jd, double *x, double *y, double *z, double *ra, double *dec,
-                          double *mag, double *phase, double *angSize, double *phySize, double *albedo, double *sunDist,
-                          double *earthDist, double *sunAngDist, double *theta_ESO, double *eclipticLongitude,
-                          double *eclipticLatitude, double *eclipticDistance, double ra_dec_epoch,
-                          int do_topocentric_correction, double topocentric_latitude, double topocentric_longitude) {
-    // Position of the Sun relative to the solar system barycentre, J2000.0 equatorial coordinates, AU
-    double sun_pos_x, sun_pos_y, sun_pos_z;
-
-    // Position of the Earth-Moon barycentre, relative to the solar system barycentre, AU
-    double EMX, EMY, EMZ;
 
-    // Moon's position relative to the Earth-Moon barycentre, AU
-    double moon_pos_x, moon_pos_y, moon_pos_z;
+void jpl_computeEphemeris(int bodyId, const observerState *observer, double *x, double *y, double *z, double *vx,
+                          double *vy, double *vz, double *ra, double *dec, double *mag, double *phase, double *angSize,
+                          double *phySize, double *albedo, double *sunDist, double *earthDist, double *sunAngDist,
+                          double *theta_ESO, double *eclipticLongitude, double *eclipticLatitude,
+                          double *eclipticDistance, double ra_dec_epoch) {
+    const double jd = observer->jd;
 
-    // Earth's position relative to the solar system barycentre, J2000.0 equatorial coordinates, AU
-    double earth_pos_x, earth_pos_y, earth_pos_z;
+    // Positions of the Earth and Sun, relative to the solar system barycentre, J2000.0 equatorial coordinates, AU
+    const double *earth_pos = observer->earth_pos, *earth_vel = observer->earth_vel;
 
     // Boolean flags indicating whether this is the Earth, Sun or Moon (which need special treatment)
     int is_moon = 0, is_earth = 0, is_sun = 0;
 
-    double EMX_future, EMY_future, EMZ_future; // Position of the Earth-Moon centre of mass
-    double moon_pos_x_future, moon_pos_y_future, moon_pos_z_future;
-    double earth_pos_x_future, earth_pos_y_future, earth_pos_z_future;
-
     // Body 19 is the Earth.
     // DE430 gives us the Earth/Moon barycentre (body 2), from which we subtract a small fraction of the Moon's
-    // offset (body 9) to get the Earth's centre of mass
+    // offset (body 9) to get the Earth's centre of mass. This is done once per time step in <observerState_compute>.
     if (bodyId == 19) {
         bodyId = 2;
         is_earth = 1;
@@ -702,71 +1387,53 @@ void jpl_computeEphemeris(int bodyId, double jd, double *x, double *y, double *z
 
     // We give asteroids body numbers which start at 1e7 + 1 (Ceres). These aren't in DE430, so use orbital elements.
     if (bodyId > 10000000) {
-        orbitalElements_computeEphemeris(bodyId, jd, x, y, z, ra, dec, mag, phase, angSize, phySize, albedo, sunDist,
-                                         earthDist, sunAngDist, theta_ESO, eclipticLongitude, eclipticLatitude,
-                                         eclipticDistance, ra_dec_epoch,
-                                         do_topocentric_correction, topocentric_latitude, topocentric_longitude);
+        orbitalElements_computeEphemeris(bodyId, observer, x, y, z, vx, vy, vz, ra, dec, mag, phase, angSize,
+                                         phySize, albedo, sunDist, earthDist, sunAngDist, theta_ESO, eclipticLongitude,
+                                         eclipticLatitude, eclipticDistance, ra_dec_epoch);
         return;
     }
 
     // If we've got a query for a body which isn't in DE430, then we can't proceed
     if ((bodyId < 0) || (bodyId > 10)) {
         *x = *y = *z = *ra = *dec = GSL_NAN;
+        if (vx != NULL) *vx = *vy = *vz = GSL_NAN;
         return;
     }
 
-    // DE430 gives us XYZ coordinates relative to the solar system's centre of mass
-    // We need to know the Earth's position, in order to convert this to RA and Dec
-    // Below are values of GM3 and GMM from DE405. See
-    // <https://web.archive.org/web/20120220062549/http://iau-comm4.jpl.nasa.gov/de405iom/de405iom.pdf>
-    const double earth_mass = 0.8887692390113509e-9;
-    const double moon_mass = 0.1093189565989898e-10;
-    const double moon_earth_mass_ratio = moon_mass / (moon_mass + earth_mass);
-
-    // Look up the Earth-Moon centre of mass position
-    jpl_computeXYZ(2, jd, &EMX, &EMY, &EMZ);
-
-    // Look up the Moon's position relative to the E-M centre of mass
-    jpl_computeXYZ(9, jd, &moon_pos_x, &moon_pos_y, &moon_pos_z);
-
-    // Calculate the position of the Earth's centre of mass
-    earth_pos_x = EMX - moon_earth_mass_ratio * moon_pos_x;
-    earth_pos_y = EMY - moon_earth_mass_ratio * moon_pos_y;
-    earth_pos_z = EMZ - moon_earth_mass_ratio * moon_pos_z;
-
-    // Look up the Sun's position, taking light travel time into account
-    {
-        jpl_computeXYZ(10, jd, &sun_pos_x, &sun_pos_y, &sun_pos_z);
-
-        // Calculate light travel time
-        const double distance = gsl_hypot3(sun_pos_x - earth_pos_x,
-                                           sun_pos_y - earth_pos_y,
-                                           sun_pos_z - earth_pos_z);  // AU
-        const double light_travel_time = distance * GSL_CONST_MKSA_ASTRONOMICAL_UNIT / GSL_CONST_MKSA_SPEED_OF_LIGHT;
-
-        // Look up position of requested object at the time the light left the object
-        jpl_computeXYZ(10, jd - light_travel_time / 86400, &sun_pos_x, &sun_pos_y, &sun_pos_z);
-    }
-
     // If the user's query was about the Earth, we already know its position
     if (is_earth) {
-        *x = earth_pos_x;
-        *y = earth_pos_y;
-        *z = earth_pos_z;
+        *x = earth_pos[0];
+        *y = earth_pos[1];
+        *z = earth_pos[2];
+        if (vx != NULL) {
+            *vx = earth_vel[0];
+            *vy = earth_vel[1];
+            *vz = earth_vel[2];
+        }
     }
 
         // If the user's query was about the Sun, we already know that position too
     else if (is_sun) {
-        *x = sun_pos_x;
-        *y = sun_pos_y;
-        *z = sun_pos_z;
+        *x = observer->sun_pos[0];
+        *y = observer->sun_pos[1];
+        *z = observer->sun_pos[2];
+        if (vx != NULL) {
+            *vx = observer->sun_vel[0];
+            *vy = observer->sun_vel[1];
+            *vz = observer->sun_vel[2];
+        }
     }
 
         // If the user's query was about the Moon, we already know that position too
     else if (is_moon) {
-        *x = moon_pos_x + earth_pos_x;
-        *y = moon_pos_y + earth_pos_y;
-        *z = moon_pos_z + earth_pos_z;
+        *x = observer->moon_pos[0] + earth_pos[0];
+        *y = observer->moon_pos[1] + earth_pos[1];
+        *z = observer->moon_pos[2] + earth_pos[2];
+        if (vx != NULL) {
+            *vx = observer->moon_vel[0] + earth_vel[0];
+            *vy = observer->moon_vel[1] + earth_vel[1];
+            *vz = observer->moon_vel[2] + earth_vel[2];
+        }
     }
 
         // Otherwise we need to query DE430 for the particular object the user was looking for,
@@ -776,57 +1443,40 @@ void jpl_computeEphemeris(int bodyId, double jd, double *x, double *y, double *z
         jpl_computeXYZ(bodyId, jd, x, y, z);
 
         // Calculate light travel time
-        const double distance = gsl_hypot3(*x - earth_pos_x, *y - earth_pos_y, *z - earth_pos_z);  // AU
+        const double distance = gsl_hypot3(*x - earth_pos[0], *y - earth_pos[1], *z - earth_pos[2]);  // AU
         const double light_travel_time = distance * GSL_CONST_MKSA_ASTRONOMICAL_UNIT / GSL_CONST_MKSA_SPEED_OF_LIGHT;
 
         // Look up position of requested object at the time the light left the object
-        jpl_computeXYZ(bodyId, jd - light_travel_time / 86400, x, y, z);
+        if (vx != NULL) jpl_computeState(bodyId, jd - light_travel_time / 86400, x, y, z, vx, vy, vz);
+        else jpl_computeXYZ(bodyId, jd - light_travel_time / 86400, x, y, z);
     }
 
-    // Look up the Earth-Moon centre of mass position, a short time in the future
-    // We use this to calculate the Earth's velocity vector, which is needed to correct for aberration
+    // Equation (7.118) of the Explanatory Supplement - correct for aberration, using the Earth's velocity vector
     // (see eqn 7.119 of the Explanatory Supplement)
-    const double eb_dot_timestep = 1e-6; // days
-    const double eb_dot_timestep_sec = eb_dot_timestep * 86400;
-    jpl_computeXYZ(2, jd + eb_dot_timestep, &EMX_future, &EMY_future, &EMZ_future);
-    jpl_computeXYZ(9, jd + eb_dot_timestep, &moon_pos_x_future, &moon_pos_y_future, &moon_pos_z_future);
-    earth_pos_x_future = EMX_future - moon_earth_mass_ratio * moon_pos_x_future;
-    earth_pos_y_future = EMY_future - moon_earth_mass_ratio * moon_pos_y_future;
-    earth_pos_z_future = EMZ_future - moon_earth_mass_ratio * moon_pos_z_future;
-
-    // Equation (7.118) of the Explanatory Supplement - correct for aberration
     if (!is_earth) {
         const double u1[3] = {
-                *x - earth_pos_x,
-                *y - earth_pos_y,
-                *z - earth_pos_z
+                *x - earth_pos[0],
+                *y - earth_pos[1],
+                *z - earth_pos[2]
         };
         const double u1_mag = gsl_hypot3(u1[0], u1[1], u1[2]);
         const double u[3] = {u1[0] / u1_mag, u1[1] / u1_mag, u1[2] / u1_mag};
-        const double eb_dot[3] = {
-                earth_pos_x_future - earth_pos_x,
-                earth_pos_y_future - earth_pos_y,
-                earth_pos_z_future - earth_pos_z
-        };
 
-        // Speed of light in AU per time step
-        const double c = GSL_CONST_MKSA_SPEED_OF_LIGHT / GSL_CONST_MKSA_ASTRONOMICAL_UNIT * eb_dot_timestep_sec;
-        const double V[3] = {eb_dot[0] / c, eb_dot[1] / c, eb_dot[2] / c};
+        // Speed of light in AU per day
+        const double c = GSL_CONST_MKSA_SPEED_OF_LIGHT / GSL_CONST_MKSA_ASTRONOMICAL_UNIT * 86400;
+        const double V[3] = {earth_vel[0] / c, earth_vel[1] / c, earth_vel[2] / c};
         const double V_mag = gsl_hypot3(V[0], V[1], V[2]);
         const double beta = sqrt(1 - gsl_pow_2(V_mag));
         const double f1 = u[0] * V[0] + u[1] * V[1] + u[2] * V[2];
         const double f2 = 1 + f1 / (1 + beta);
 
         // Correct for aberration
-        *x = earth_pos_x + (beta * u1[0] + f2 * u1_mag * V[0]) / (1 + f1);
-        *y = earth_pos_y + (beta * u1[1] + f2 * u1_mag * V[1]) / (1 + f1);
-        *z = earth_pos_z + (beta * u1[2] + f2 * u1_mag * V[2]) / (1 + f1);
+        *x = earth_pos[0] + (beta * u1[0] + f2 * u1_mag * V[0]) / (1 + f1);
+        *y = earth_pos[1] + (beta * u1[1] + f2 * u1_mag * V[1]) / (1 + f1);
+        *z = earth_pos[2] + (beta * u1[2] + f2 * u1_mag * V[2]) / (1 + f1);
     }
 
     // Populate other quantities, like the brightness, RA and Dec of the object, based on its XYZ position
-    magnitudeEstimate(bodyId, *x, *y, *z, earth_pos_x, earth_pos_y, earth_pos_z, sun_pos_x, sun_pos_y, sun_pos_z, ra,
-                      dec, mag, phase, angSize, phySize,
-                      albedo, sunDist, earthDist, sunAngDist, theta_ESO, eclipticLongitude, eclipticLatitude,
-                      eclipticDistance, ra_dec_epoch, jd,
-                      do_topocentric_correction, topocentric_latitude, topocentric_longitude);
+    magnitudeEstimate(bodyId, *x, *y, *z, observer, ra, dec, mag, phase, angSize, phySize, albedo, sunDist, earthDist,
+                      sunAngDist, theta_ESO, eclipticLongitude, eclipticLatitude, eclipticDistance, ra_dec_epoch);
 }
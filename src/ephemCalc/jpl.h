@@ -22,6 +22,8 @@
 #ifndef JPL_H
 #define JPL_H 1
 
+#include "ephemCalc/observerState.h"
+
 extern char *datadir, *srcdir;
 
 #ifdef __cplusplus
@@ -33,11 +35,24 @@ double *ephem(const char *body, double jd, double latitude, double longitude);
 
 void jpl_computeXYZ(int body_id, double jd, double *x, double *y, double *z);
 
-void jpl_computeEphemeris(int bodyId, double jd, double *x, double *y, double *z, double *ra, double *dec,
-                          double *mag, double *phase, double *angSize, double *phySize, double *albedo, double *sunDist,
-                          double *earthDist, double *sunAngDist, double *theta_ESO, double *eclipticLongitude,
-                          double *eclipticLatitude, double *eclipticDistance, double ra_dec_epoch,
-                          int do_topocentric_correction, double topocentric_latitude, double topocentric_longitude);
+void jpl_computeState(int body_id, double jd, double *x, double *y, double *z, double *vx, double *vy, double *vz);
+
+void jpl_computeXYZ_batch(int body_id, const double *jd, int count, double *x, double *y, double *z);
+
+int jpl_ingestAsciiData(const char *out_filename);
+
+int jpl_writeSlice(const char *out_filename, double jd_min, double jd_max, const int *series, int series_count,
+                   double tolerance);
+
+void jpl_cacheStats(unsigned long *hits, unsigned long *misses);
+
+void jpl_setActiveWindow(double jd_min, double jd_max);
+
+void jpl_computeEphemeris(int bodyId, const observerState *observer, double *x, double *y, double *z, double *vx,
+                          double *vy, double *vz, double *ra, double *dec, double *mag, double *phase, double *angSize,
+                          double *phySize, double *albedo, double *sunDist, double *earthDist, double *sunAngDist,
+                          double *theta_ESO, double *eclipticLongitude, double *eclipticLatitude,
+                          double *eclipticDistance, double ra_dec_epoch);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,207 @@
+// keplerBatch.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <gsl/gsl_math.h>
+
+#include "coreUtils/errorReport.h"
+
+#include "keplerBatch.h"
+#include "orbitalElements.h"
+#include "universalKepler.h"
+
+//! The number of objects whose Kepler equations are solved together. Each block is iterated until every object in it
+//! has converged, so small blocks waste fewer iterations on objects which have already converged.
+#define KEPLER_BATCH_BLOCK 256
+
+//! keplerBatch_isFixed - Decide whether an object's orbital elements are fixed, rather than drifting with time
+//! \param [in] elements - The object's orbital elements
+//! \return - Boolean flag indicating whether the object's elements are fixed
+
+static int keplerBatch_isFixed(const orbitalElements *elements) {
+    return (elements->semiMajorAxis_dot == 0) && (elements->eccentricity_dot == 0) &&
+           (elements->longAscNode_dot == 0) && (elements->inclination_dot == 0) &&
+           (elements->argumentPerihelion_dot == 0);
+}
+
+//! keplerBatch_allocate - Allocate storage for a batch of objects
+//! \param [out] batch - The batch to allocate
+//! \param [in] count - The number of objects in the batch
+
+static void keplerBatch_allocate(keplerBatch *batch, int count) {
+    const size_t n = (count > 0) ? (size_t) count : 1;
+    int j;
+
+    batch->count = count;
+    batch->universal_count = 0;
+    batch->other_count = 0;
+    batch->universal_slot = (int *) malloc(n * sizeof(int));
+    batch->alpha = (double *) malloc(n * sizeof(double));
+    batch->perihelion_distance = (double *) malloc(n * sizeof(double));
+    batch->perihelion_time = (double *) malloc(n * sizeof(double));
+    for (j = 0; j < 3; j++) {
+        batch->perihelion_position[j] = (double *) malloc(n * sizeof(double));
+        batch->perihelion_velocity[j] = (double *) malloc(n * sizeof(double));
+    }
+    batch->other_slot = (int *) malloc(n * sizeof(int));
+    batch->other_elements = (orbitalElements *) malloc(n * sizeof(orbitalElements));
+
+    if ((batch->universal_slot == NULL) || (batch->alpha == NULL) || (batch->perihelion_distance == NULL) ||
+        (batch->perihelion_time == NULL) || (batch->perihelion_position[0] == NULL) ||
+        (batch->perihelion_position[1] == NULL) || (batch->perihelion_position[2] == NULL) ||
+        (batch->perihelion_velocity[0] == NULL) || (batch->perihelion_velocity[1] == NULL) ||
+        (batch->perihelion_velocity[2] == NULL) ||
+        (batch->other_slot == NULL) || (batch->other_elements == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+}
+
+//! keplerBatch_add - Add an object to a batch, working out all the quantities which do not depend on time
+//! \param [in,out] batch - The batch to add the object to
+//! \param [in] slot - The position of the object within the batch
+//! \param [in] elements - The object's orbital elements, or NULL if it is not in the catalogues
+
+static void keplerBatch_add(keplerBatch *batch, int slot, const orbitalElements *elements) {
+    // Objects with fixed elements go to the universal-variable solver, whatever their eccentricity, provided their
+    // elements make sense
+    if ((elements != NULL) && keplerBatch_isFixed(elements)) {
+        double alpha, q, perihelion_time, P[3], Q[3];
+        orbitalElements_universalSetup(elements, elements->epochOsculation, &alpha, &q, &perihelion_time, P, Q);
+        if (gsl_finite(alpha) && gsl_finite(q) && (q > 0) && gsl_finite(perihelion_time) &&
+            gsl_finite(P[0]) && gsl_finite(P[1]) && gsl_finite(P[2]) &&
+            gsl_finite(Q[0]) && gsl_finite(Q[1]) && gsl_finite(Q[2])) {
+            const int k = batch->universal_count++;
+            batch->universal_slot[k] = slot;
+            batch->alpha[k] = alpha;
+            batch->perihelion_distance[k] = q;
+            batch->perihelion_time[k] = perihelion_time;
+            for (int j = 0; j < 3; j++) {
+                batch->perihelion_position[j][k] = P[j];
+                batch->perihelion_velocity[j][k] = Q[j];
+            }
+            return;
+        }
+    }
+
+    // Objects we can't handle in bulk keep a copy of their elements. Those which are not in the catalogues get NaN
+    // elements, which yield NaN positions.
+    const int k = batch->other_count++;
+    batch->other_slot[k] = slot;
+    if (elements != NULL) {
+        batch->other_elements[k] = *elements;
+    } else {
+        orbitalElements *blank = &batch->other_elements[k];
+        blank->number = -1;
+        blank->secureOrbit = 0;
+        blank->epochOsculation = blank->epochPerihelion = blank->absoluteMag = GSL_NAN;
+        blank->meanAnomaly = blank->argumentPerihelion = blank->longAscNode = GSL_NAN;
+        blank->inclination = blank->eccentricity = blank->semiMajorAxis = blank->perihelionDistance = GSL_NAN;
+        blank->argumentPerihelion_dot = blank->longAscNode_dot = blank->inclination_dot = 0;
+        blank->eccentricity_dot = blank->semiMajorAxis_dot = 0;
+        blank->slopeParam_n = blank->slopeParam_G = GSL_NAN;
+    }
+}
+
+//! keplerBatch_init - Make a batch of objects from a list of body IDs, fetching their orbital elements from the
+//! planet, asteroid and comet catalogues.
+//! \param [out] batch - The batch to initialise. It should be released with <keplerBatch_free>.
+//! \param [in] body_ids - The body IDs of the objects, as used by <orbitalElements_computeXYZ>
+//! \param [in] count - The number of objects
+
+void keplerBatch_init(keplerBatch *batch, const int *body_ids, int count) {
+    keplerBatch_allocate(batch, count);
+    for (int i = 0; i < count; i++) keplerBatch_add(batch, i, orbitalElements_fetchBody(body_ids[i]));
+}
+
+//! keplerBatch_initFromElements - Make a batch of objects from a table of orbital elements, such as
+//! <asteroid_database>, which must already have been loaded.
+//! \param [out] batch - The batch to initialise. It should be released with <keplerBatch_free>.
+//! \param [in] elements - The table of orbital elements
+//! \param [in] count - The number of objects
+
+void keplerBatch_initFromElements(keplerBatch *batch, const orbitalElements *elements, int count) {
+    keplerBatch_allocate(batch, count);
+    for (int i = 0; i < count; i++) keplerBatch_add(batch, i, &elements[i]);
+}
+
+//! keplerBatch_compute - Compute the positions of all the objects in a batch at a single epoch, in ICRF, in AU,
+//! relative to the Sun. These agree with <orbitalElements_computeXYZ> to within rounding errors for near-parabolic and
+//! hyperbolic orbits, which it also solves in universal variables, and to within 1e-10 AU for elliptic orbits, which it
+//! solves by Newton's method on the eccentric anomaly.
+//! \param [in] batch - The batch of objects
+//! \param [in] jd - The Julian day number at which the positions are wanted; TT
+//! \param [out] x - Array of <batch->count> x positions (AU; ICRF; points to RA=0)
+//! \param [out] y - Array of <batch->count> y positions (AU; ICRF; points to RA=6h)
+//! \param [out] z - Array of <batch->count> z positions (AU; ICRF; points to NCP)
+
+void keplerBatch_compute(const keplerBatch *batch, double jd, double *x, double *y, double *z) {
+    int block, k;
+
+    // Objects handled by the universal-variable solver, a block at a time
+    const int universal_block_count = (batch->universal_count + KEPLER_BATCH_BLOCK - 1) / KEPLER_BATCH_BLOCK;
+#pragma omp parallel for schedule(static) private(block)
+    for (block = 0; block < universal_block_count; block++) {
+        const int first = block * KEPLER_BATCH_BLOCK;
+        const int remaining = batch->universal_count - first;
+        const int n = (remaining < KEPLER_BATCH_BLOCK) ? remaining : KEPLER_BATCH_BLOCK;
+        double dt[KEPLER_BATCH_BLOCK], f[KEPLER_BATCH_BLOCK], g[KEPLER_BATCH_BLOCK];
+        int i;
+
+        for (i = 0; i < n; i++) dt[i] = jd - batch->perihelion_time[first + i];
+        universalKepler_solveBatch(n, batch->alpha + first, batch->perihelion_distance + first, dt, f, g);
+
+        for (i = 0; i < n; i++) {
+            const int slot = batch->universal_slot[first + i];
+            x[slot] = f[i] * batch->perihelion_position[0][first + i] + g[i] * batch->perihelion_velocity[0][first + i];
+            y[slot] = f[i] * batch->perihelion_position[1][first + i] + g[i] * batch->perihelion_velocity[1][first + i];
+            z[slot] = f[i] * batch->perihelion_position[2][first + i] + g[i] * batch->perihelion_velocity[2][first + i];
+        }
+    }
+
+    // Objects which need the scalar code
+#pragma omp parallel for schedule(dynamic, 16) private(k)
+    for (k = 0; k < batch->other_count; k++) {
+        const int slot = batch->other_slot[k];
+        orbitalElements_propagate(&batch->other_elements[k], jd, x + slot, y + slot, z + slot);
+    }
+}
+
+//! keplerBatch_free - Release the storage held by a batch of objects
+//! \param [in] batch - The batch to release
+
+void keplerBatch_free(keplerBatch *batch) {
+    int j;
+    free(batch->universal_slot);
+    free(batch->alpha);
+    free(batch->perihelion_distance);
+    free(batch->perihelion_time);
+    for (j = 0; j < 3; j++) {
+        free(batch->perihelion_position[j]);
+        free(batch->perihelion_velocity[j]);
+    }
+    free(batch->other_slot);
+    free(batch->other_elements);
+    batch->count = batch->universal_count = batch->other_count = 0;
+}
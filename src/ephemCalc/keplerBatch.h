@@ -0,0 +1,60 @@
+// keplerBatch.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef KEPLERBATCH_H
+#define KEPLERBATCH_H 1
+
+#include "ephemCalc/orbitalElements.h"
+
+//! keplerBatch - The orbital elements of many objects, rearranged so that all their positions at a single epoch can be
+//! computed in one pass. Objects with fixed elements, which includes every asteroid and comet, are held as structures
+//! of arrays, together with the quantities derived from their elements which do not depend on time, and are all solved
+//! by the same vectorised solver in universal variables, whatever their eccentricity. A catalogue which mixes
+//! elliptic, near-parabolic and hyperbolic orbits is therefore not split between different solvers. Objects whose
+//! elements drift (i.e. planets) keep a copy of their elements and are computed one at a time.
+
+typedef struct {
+    int count;  // The number of objects in the batch
+
+    // Objects handled by the universal-variable solver
+    int universal_count;
+    int *universal_slot;  // The position of each object within the batch
+    double *alpha;  // The reciprocal of the semi-major axis; 1/AU
+    double *perihelion_distance;  // AU
+    double *perihelion_time;  // Julian date; TT
+    double *perihelion_position[3];  // Position at perihelion, in ICRF, relative to the Sun; AU
+    double *perihelion_velocity[3];  // Velocity at perihelion, in ICRF; AU/day
+
+    // Objects computed one at a time
+    int other_count;
+    int *other_slot;  // The position of each object within the batch
+    orbitalElements *other_elements;  // Their orbital elements; NaN for objects which are not in the catalogues
+} keplerBatch;
+
+void keplerBatch_init(keplerBatch *batch, const int *body_ids, int count);
+
+void keplerBatch_initFromElements(keplerBatch *batch, const orbitalElements *elements, int count);
+
+void keplerBatch_compute(const keplerBatch *batch, double jd, double *x, double *y, double *z);
+
+void keplerBatch_free(keplerBatch *batch);
+
+#endif
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_const_mksa.h>
@@ -45,6 +46,9 @@ double *albedo_array = NULL;
 // Array of the radii of objects, in metres
 double *phy_size_array = NULL;
 
+// Make sure that the tables above are only initialised once, however many threads ask for them
+static pthread_once_t magnitudeEstimate_initialised = PTHREAD_ONCE_INIT;
+
 //! magnitudeEstimate_init - Initialise tables of data we use to estimate the magnitudes of objects
 
 void magnitudeEstimate_init() {
@@ -113,12 +117,7 @@ void magnitudeEstimate_init() {
 //! \param [in] xo - x,y,z position of body, in AU relative to solar system barycentre.
 //! \param [in] yo - negative x points to vernal equinox. z points to celestial north pole (i.e. J2000.0).
 //! \param [in] zo
-//! \param [in] xe - x,y,z position of Earth
-//! \param [in] ye
-//! \param [in] ze
-//! \param [in] xs - x,y,z position of Sun
-//! \param [in] ys
-//! \param [in] zs
+//! \param [in] observer - The positions of the Earth and Sun, and the observer's topocentric offset
 //! \param [out] ra - Right ascension of the object
 //! \param [out] dec - Declination of the object
 //! \param [out] mag - Estimated V-band magnitude of the object
@@ -134,17 +133,16 @@ void magnitudeEstimate_init() {
 //! \param [out] eclipticLatitude - The ecliptic latitude of the object
 //! \param [out] eclipticDistance - The separation of the object from the Sun, in ecliptic longitude
 //! \param [in] ra_dec_epoch - The epoch of the RA/Dec coordinates to output. Supply 2451545.0 for J2000.0.
-//! \param [in] julian_date - The epoch of this data point, used to calculate the required topocentric correction.
-//! \param [in] do_topocentric_correction - Boolean indicating whether to apply topocentric correction to (ra, dec)
-//! \param [in] topocentric_latitude - Latitude (deg) of observer on Earth, if topocentric correction is applied.
-//! \param [in] topocentric_longitude - Longitude (deg) of observer on Earth, if topocentric correction is applied.
-
-void magnitudeEstimate(int body_id, double xo, double yo, double zo, double xe, double ye, double ze, double xs,
-                       double ys, double zs, double *ra, double *dec, double *mag, double *phase, double *angSize,
-                       double *phySize, double *albedoOut, double *sunDist, double *earthDist, double *sunAngDist,
-                       double *theta_eso, double *eclipticLongitude, double *eclipticLatitude,
-                       double *eclipticDistance, double ra_dec_epoch, double julian_date,
-                       int do_topocentric_correction, double topocentric_latitude, double topocentric_longitude) {
+
+void magnitudeEstimate(int body_id, double xo, double yo, double zo, const observerState *observer, double *ra,
+                       double *dec, double *mag, double *phase, double *angSize, double *phySize, double *albedoOut,
+                       double *sunDist, double *earthDist, double *sunAngDist, double *theta_eso,
+                       double *eclipticLongitude, double *eclipticLatitude, double *eclipticDistance,
+                       double ra_dec_epoch) {
+    // Positions of the Earth and Sun
+    const double xe = observer->earth_pos[0], ye = observer->earth_pos[1], ze = observer->earth_pos[2];
+    const double xs = observer->sun_pos[0], ys = observer->sun_pos[1], zs = observer->sun_pos[2];
+
     // Distance of object from Sun
     const double Dso = sqrt(gsl_pow_2(xs - xo) + gsl_pow_2(ys - yo) + gsl_pow_2(zs - zo));
 
@@ -165,11 +163,8 @@ void magnitudeEstimate(int body_id, double xo, double yo, double zo, double xe,
 
     // Body is a planet, the Moon or Sun
     if (body_id < MAX_BODYID) {
-#pragma omp critical (MagnitudeEstimate_init)
-        {
-            // Make sure that the array of albedos and radii of solar system objects had been initialised
-            if (albedo_array == NULL) magnitudeEstimate_init();
-        }
+        // Make sure that the array of albedos and radii of solar system objects had been initialised
+        pthread_once(&magnitudeEstimate_initialised, magnitudeEstimate_init);
 
         // Look up the albedo of this object, and its radius in AU
         albedo = albedo_array[body_id];
@@ -210,7 +205,7 @@ void magnitudeEstimate(int body_id, double xo, double yo, double zo, double xe,
 
         // Routine for estimating the magnitudes of asteroids and comets
     else if (body_id >= 1e7) {
-        orbitalElements *item;
+        const orbitalElements *item;
         int fail = 0;
         albedo = GSL_NAN;
         Ro = GSL_NAN;
@@ -281,16 +276,36 @@ void magnitudeEstimate(int body_id, double xo, double yo, double zo, double xe,
         *mag = GSL_NAN;
     }
 
-    // If requested, then apply topocentric correction to (xe, ye, ze), moving our frame of reference from the centre
-    // of the Earth to a point on the surface
-    double topocentric_offset[3] = {0, 0, 0};
-    if (do_topocentric_correction) {
-        const double utc = unix_from_jd(julian_date);
-        const double st = sidereal_time(utc) * 180 / 12; // degrees
-        const double pos_earth[3] = {0, 0, 0};
-        earthTopocentricPositionICRF(topocentric_offset, topocentric_latitude, topocentric_longitude,
-                                     1, pos_earth, julian_date, st);
-    }
+    // Compute the position of the object on the sky, as seen by the observer
+    magnitudeEstimate_apparentPosition(xo, yo, zo, observer, observer->topocentric_offset, ra, dec, theta_eso,
+                                       eclipticLongitude, eclipticLatitude, eclipticDistance, ra_dec_epoch);
+}
+
+//! magnitudeEstimate_apparentPosition - Compute the RA and Dec, and ecliptic coordinates, of an object as seen by an
+//! observer who may be displaced from the centre of the Earth. These are the only quantities which depend on where
+//! the observer is on the Earth's surface, so an ephemeris for many sites need only recompute these for each site.
+//! \param [in] xo - x,y,z position of body, in AU relative to solar system barycentre, J2000.0 coordinates
+//! \param [in] yo
+//! \param [in] zo
+//! \param [in] observer - The positions of the Earth and Sun
+//! \param [in] topocentric_offset - The offset of the observer from the geocentre (AU), e.g. as computed by
+//! <observerState_siteOffsets>. Zero for a geocentric observer.
+//! \param [out] ra - Right ascension of the object
+//! \param [out] dec - Declination of the object
+//! \param [in,out] theta_eso - Angular distance of the object from the Earth, as seen from the Sun. This is negated
+//! if the object lies to the west of the Sun.
+//! \param [out] eclipticLongitude - The ecliptic longitude of the object
+//! \param [out] eclipticLatitude - The ecliptic latitude of the object
+//! \param [out] eclipticDistance - The separation of the object from the Sun, in ecliptic longitude
+//! \param [in] ra_dec_epoch - The epoch of the RA/Dec coordinates to output. Supply 2451545.0 for J2000.0.
+
+void magnitudeEstimate_apparentPosition(double xo, double yo, double zo, const observerState *observer,
+                                        const double *topocentric_offset, double *ra, double *dec, double *theta_eso,
+                                        double *eclipticLongitude, double *eclipticLatitude, double *eclipticDistance,
+                                        double ra_dec_epoch) {
+    // Positions of the Earth and Sun
+    const double xe = observer->earth_pos[0], ye = observer->earth_pos[1], ze = observer->earth_pos[2];
+    const double xs = observer->sun_pos[0], ys = observer->sun_pos[1], zs = observer->sun_pos[2];
 
     // Compute RA and Dec from J2000.0 coordinates
     {
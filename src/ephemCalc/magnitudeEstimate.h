@@ -22,6 +22,8 @@
 #ifndef MAGNITUDEESTIMATE_H
 #define MAGNITUDEESTIMATE_H 1
 
+#include "ephemCalc/observerState.h"
+
 #ifndef MAGNITUDEESTIMATE_C
 extern double *albedo_array;
 extern double *phy_size_array;
@@ -29,12 +31,16 @@ extern double *phy_size_array;
 
 void magnitudeEstimate_init();
 
-void magnitudeEstimate(int body_id, double xo, double yo, double zo, double xe, double ye, double ze, double xs,
-                       double ys, double zs, double *ra, double *dec, double *mag, double *phase, double *angSize,
-                       double *phySize, double *albedoOut, double *sunDist, double *earthDist, double *sunAngDist,
-                       double *theta_eso, double *eclipticLongitude, double *eclipticLatitude,
-                       double *eclipticDistance, double ra_dec_epoch, double julian_date,
-                       int do_topocentric_correction, double topocentric_latitude, double topocentric_longitude);
+void magnitudeEstimate(int body_id, double xo, double yo, double zo, const observerState *observer, double *ra,
+                       double *dec, double *mag, double *phase, double *angSize, double *phySize, double *albedoOut,
+                       double *sunDist, double *earthDist, double *sunAngDist, double *theta_eso,
+                       double *eclipticLongitude, double *eclipticLatitude, double *eclipticDistance,
+                       double ra_dec_epoch);
+
+void magnitudeEstimate_apparentPosition(double xo, double yo, double zo, const observerState *observer,
+                                        const double *topocentric_offset, double *ra, double *dec, double *theta_eso,
+                                        double *eclipticLongitude, double *eclipticLatitude, double *eclipticDistance,
+                                        double ra_dec_epoch);
 
 void earthTopocentricPositionICRF(double *out, double lat, double lng, double radius_in_earth_radii,
                                   const double *pos_earth, double epoch, double sidereal_time);
@@ -0,0 +1,118 @@
+// observerState.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <gsl/gsl_const_mksa.h>
+#include <gsl/gsl_math.h>
+
+#include "mathsTools/julianDate.h"
+
+#include "jpl.h"
+#include "magnitudeEstimate.h"
+#include "observerState.h"
+
+//! observerState_compute - Compute the positions and velocities of the Earth, Moon and Sun at a particular time. These
+//! are the same for every body whose ephemeris we compute at that time, so callers should compute them once per time
+//! step and pass the result to <jpl_computeEphemeris> and <orbitalElements_computeEphemeris>.
+//! \param [out] out - The observer state to populate
+//! \param [in] jd - The Julian date to query; TT
+//! \param [in] do_topocentric_correction - Boolean indicating whether to apply topocentric correction to (ra, dec)
+//! \param [in] topocentric_latitude - Latitude (deg) of observer on Earth, if topocentric correction is applied.
+//! \param [in] topocentric_longitude - Longitude (deg) of observer on Earth, if topocentric correction is applied.
+
+void observerState_compute(observerState *out, double jd, int do_topocentric_correction,
+                           double topocentric_latitude, double topocentric_longitude) {
+    // Position and velocity of the Earth-Moon barycentre, relative to the solar system barycentre
+    double em_pos[3], em_vel[3];
+    int i;
+
+    out->jd = jd;
+    out->do_topocentric_correction = do_topocentric_correction;
+    out->topocentric_latitude = topocentric_latitude;
+    out->topocentric_longitude = topocentric_longitude;
+
+    // DE430 gives us the Earth/Moon barycentre (body 2), from which we subtract a small fraction of the Moon's
+    // offset (body 9) to get the Earth's centre of mass
+    // Below are values of GM3 and GMM from DE405. See
+    // <https://web.archive.org/web/20120220062549/http://iau-comm4.jpl.nasa.gov/de405iom/de405iom.pdf>
+    const double earth_mass = 0.8887692390113509e-9;
+    const double moon_mass = 0.1093189565989898e-10;
+    const double moon_earth_mass_ratio = moon_mass / (moon_mass + earth_mass);
+
+    // Look up the Earth-Moon centre of mass position and velocity
+    jpl_computeState(2, jd, &em_pos[0], &em_pos[1], &em_pos[2], &em_vel[0], &em_vel[1], &em_vel[2]);
+
+    // Look up the Moon's position and velocity relative to the E-M centre of mass
+    jpl_computeState(9, jd, &out->moon_pos[0], &out->moon_pos[1], &out->moon_pos[2],
+                     &out->moon_vel[0], &out->moon_vel[1], &out->moon_vel[2]);
+
+    // Calculate the position and velocity of the Earth's centre of mass
+    for (i = 0; i < 3; i++) {
+        out->earth_pos[i] = em_pos[i] - moon_earth_mass_ratio * out->moon_pos[i];
+        out->earth_vel[i] = em_vel[i] - moon_earth_mass_ratio * out->moon_vel[i];
+    }
+
+    // Look up the Sun's position, taking light travel time into account
+    {
+        double sun_pos[3];
+        jpl_computeXYZ(10, jd, &sun_pos[0], &sun_pos[1], &sun_pos[2]);
+
+        // Calculate light travel time
+        const double distance = gsl_hypot3(sun_pos[0] - out->earth_pos[0],
+                                           sun_pos[1] - out->earth_pos[1],
+                                           sun_pos[2] - out->earth_pos[2]);  // AU
+        const double light_travel_time = distance * GSL_CONST_MKSA_ASTRONOMICAL_UNIT / GSL_CONST_MKSA_SPEED_OF_LIGHT;
+
+        // Look up position of the Sun at the time the light left it
+        jpl_computeState(10, jd - light_travel_time / 86400, &out->sun_pos[0], &out->sun_pos[1], &out->sun_pos[2],
+                         &out->sun_vel[0], &out->sun_vel[1], &out->sun_vel[2]);
+    }
+
+    // If requested, then work out the offset of the observer from the centre of the Earth. This needs the sidereal
+    // time, and a precession of the observer's zenith into J2000.0, which are far too slow to do for every body.
+    out->topocentric_offset[0] = out->topocentric_offset[1] = out->topocentric_offset[2] = 0;
+    if (do_topocentric_correction) {
+        observerState_siteOffsets(jd, 1, &topocentric_latitude, &topocentric_longitude, out->topocentric_offset);
+    }
+}
+
+//! observerState_siteOffsets - Compute the offsets of a list of observing sites from the centre of the Earth at a
+//! particular time. The sidereal time is computed once and shared by all the sites.
+//! \param [in] jd - The Julian date to query; TT
+//! \param [in] site_count - The number of sites
+//! \param [in] latitude - The latitude (deg) of each site
+//! \param [in] longitude - The longitude (deg) of each site
+//! \param [out] offsets - Array of <3 * site_count> values, populated with the x, y, z offset of each site from the
+//! geocentre, in AU, in ICRF v2 coordinates
+
+void observerState_siteOffsets(double jd, int site_count, const double *latitude, const double *longitude,
+                               double *offsets) {
+    const double utc = unix_from_jd(jd);
+    const double st = sidereal_time(utc) * 180 / 12; // degrees
+    const double pos_earth[3] = {0, 0, 0};
+
+    for (int i = 0; i < site_count; i++) {
+        earthTopocentricPositionICRF(offsets + 3 * i, latitude[i], longitude[i], 1, pos_earth, jd, st);
+    }
+}
@@ -0,0 +1,60 @@
+// observerState.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef OBSERVERSTATE_H
+#define OBSERVERSTATE_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! The positions and velocities of the Earth, Moon and Sun at a single epoch, which are needed to compute the
+//! ephemeris of every body at that epoch. All positions are in ICRF v2, in AU, relative to the solar system
+//! barycentre; all velocities are in AU/day.
+typedef struct {
+    double jd;  // TT
+
+    // The Earth's centre of mass
+    double earth_pos[3], earth_vel[3];
+
+    // The Moon's position and velocity relative to the Earth-Moon barycentre
+    double moon_pos[3], moon_vel[3];
+
+    // The Sun, at the time the light we see left it
+    double sun_pos[3], sun_vel[3];
+
+    // The offset of the observer from the geocentre, if a topocentric correction is applied; otherwise zero
+    int do_topocentric_correction;
+    double topocentric_latitude, topocentric_longitude;  // degrees
+    double topocentric_offset[3];  // AU
+} observerState;
+
+void observerState_compute(observerState *out, double jd, int do_topocentric_correction,
+                           double topocentric_latitude, double topocentric_longitude);
+
+void observerState_siteOffsets(double jd, int site_count, const double *latitude, const double *longitude,
+                               double *offsets);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -25,12 +25,18 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <gsl/gsl_math.h>
 
 #include "coreUtils/asciiDouble.h"
 #include "coreUtils/errorReport.h"
+#include "coreUtils/recordCache.h"
 #include "coreUtils/strConstants.h"
+#include "coreUtils/textFile.h"
 
 #include "listTools/ltMemory.h"
 
@@ -39,36 +45,44 @@
 #include "jpl.h"
 #include "orbitalElements.h"
 #include "magnitudeEstimate.h"
+#include "universalKepler.h"
 
 // Numerical constants
 const static double ORBIT_CONST_SPEED_OF_LIGHT = 299792458.; // m/s
 const static double ORBIT_CONST_ASTRONOMICAL_UNIT = 149597870700.; // m
 const static double ORBIT_CONST_GM_SOLAR = 1.32712440041279419e20; // m^3 s^-2
 
-// Binary files containing the orbital elements of solar system objects
-FILE *planet_database_file = NULL;
-FILE *asteroid_database_file = NULL;
-FILE *comet_database_file = NULL;
-
-// Filenames of binary files
-char planet_database_filename[FNAME_LENGTH];
-char asteroid_database_filename[FNAME_LENGTH];
-char comet_database_filename[FNAME_LENGTH];
-
-// Blocks of memory used to hold the orbital elements
+// Caches of the orbital elements of solar system objects, which load records from the binary files on demand
+record_cache planet_database_records;
+record_cache asteroid_database_records;
+record_cache comet_database_records;
+
+// Caches of the names of solar system objects, and the indices of these names
+record_cache planet_names_records;
+record_cache asteroid_names_records;
+record_cache comet_names_records;
+record_cache planet_index_records;
+record_cache asteroid_index_records;
+record_cache comet_index_records;
+record_cache planet_hash_records;
+record_cache asteroid_hash_records;
+record_cache comet_hash_records;
+
+// Blocks of memory holding the orbital elements (these point into the caches above; entries are only valid once
+// they have been fetched)
 orbitalElements *planet_database = NULL;
 orbitalElements *asteroid_database = NULL;
 orbitalElements *comet_database = NULL;
 
-// Record of which entries we have loaded from each database
-unsigned char *planet_database_items_loaded = NULL;
-unsigned char *asteroid_database_items_loaded = NULL;
-unsigned char *comet_database_items_loaded = NULL;
+// Blocks of memory holding the names of objects (these point into the caches above)
+orbitalElementsNames *planet_names = NULL;
+orbitalElementsNames *asteroid_names = NULL;
+orbitalElementsNames *comet_names = NULL;
 
-// Pointers to the positions in the files where the orbitalElement structures begin
-int planet_database_offset = -1;
-int asteroid_database_offset = -1;
-int comet_database_offset = -1;
+// Make sure that each database is only opened once, however many threads ask for it
+static pthread_once_t planet_database_init = PTHREAD_ONCE_INIT;
+static pthread_once_t asteroid_database_init = PTHREAD_ONCE_INIT;
+static pthread_once_t comet_database_init = PTHREAD_ONCE_INIT;
 
 // Number of objects in each list
 int planet_count = 0;
@@ -80,27 +94,137 @@ int planet_secure_count = 0;
 int asteroid_secure_count = 0;
 int comet_secure_count = 0;
 
+//! Binary files of orbital elements, such as <data/dcfbinary.ast>, begin with an <orbitalElementsFileHeader>. This is
+//! followed by four sections, each starting on an 8-byte boundary: a table of <orbitalElements> records; a table of
+//! <orbitalElementsNames> records, in the same order; an optional index of objects' names, which is a table of
+//! <orbitalElementsIndexEntry> records sorted by case-folded name; and an optional hash table of the names in the
+//! index, which is a power-of-two sized table of <orbitalElementsHashEntry> records. Records are stored in the byte
+//! order of the machine which wrote the file, so that they can be used in place; files written on machines of the
+//! other byte order are rejected, and rebuilt from the original text files. The header carries a revision number,
+//! which counts the incremental updates applied by <orbitalElements_asteroids_applyUpdate>.
+#define ORBITAL_ELEMENTS_MAGIC "DCFORBEL"
+#define ORBITAL_ELEMENTS_VERSION 3
+#define ORBITAL_ELEMENTS_BYTE_ORDER 0x01020304
+
+//! The name we give to objects in the tables which have no name
+#define ORBITAL_ELEMENTS_NO_NAME "Undefined"
+
+typedef struct {
+    char magic[8];  // Always ORBITAL_ELEMENTS_MAGIC
+    uint32_t version;  // ORBITAL_ELEMENTS_VERSION
+    uint32_t byte_order;  // ORBITAL_ELEMENTS_BYTE_ORDER, as stored by the machine which wrote the file
+    uint32_t record_size;  // sizeof(orbitalElements)
+    uint32_t names_size;  // sizeof(orbitalElementsNames)
+    int32_t item_count;  // The number of objects in the file
+    int32_t item_secure_count;  // The number of objects with securely determined orbits
+    int32_t index_count;  // The number of entries in the index of names; zero if there is no index
+    int32_t hash_count;  // The number of slots in the hash table of names; zero if there is no hash table
+    uint32_t revision;  // The number of incremental updates applied since the file was built from the text files
+    uint32_t revision_time;  // The unix time at which the last incremental update was applied; zero if none
+    uint64_t records_offset;  // The offset of the table of <orbitalElements> from the start of the file
+    uint64_t names_offset;  // The offset of the table of <orbitalElementsNames> from the start of the file
+    uint64_t index_offset;  // The offset of the index of names from the start of the file
+    uint64_t hash_offset;  // The offset of the hash table of names from the start of the file
+    uint64_t file_length;  // The total length of the file, which lets us detect truncated files
+    uint32_t checksum;  // FNV-1a checksum of all the fields above
+    uint32_t padding;
+} orbitalElementsFileHeader;
+
+//! orbitalElements_headerChecksum - Compute the checksum of the header of a binary file of orbital elements
+//! \param [in] header - The header to checksum
+//! \return - FNV-1a checksum of all of the fields which precede <checksum>
+
+static uint32_t orbitalElements_headerChecksum(const orbitalElementsFileHeader *header) {
+    const unsigned char *bytes = (const unsigned char *) header;
+    uint32_t checksum = 2166136261u;
+    for (size_t i = 0; i < offsetof(orbitalElementsFileHeader, checksum); i++) {
+        checksum = (checksum ^ bytes[i]) * 16777619u;
+    }
+    return checksum;
+}
+
+//! orbitalElements_align - Round a file offset up to the next 8-byte boundary
+//! \param [in] offset - The offset to round
+//! \return - The rounded offset
+
+static uint64_t orbitalElements_align(uint64_t offset) {
+    return (offset + 7) & ~((uint64_t) 7);
+}
+
+//! orbitalElements_readHeader - Read the header of a binary file of orbital elements, and check that it describes a
+//! file which we can use
+//! \param [in] filename_with_path - The full path of the binary file
+//! \param [out] header - The header of the file
+//! \return - Zero if the file is usable
+
+static int orbitalElements_readHeader(const char *filename_with_path, orbitalElementsFileHeader *header) {
+    FILE *input;
+
+    // Open binary data file
+    input = fopen(filename_with_path, "rb");
+    if (input == NULL) return 1; // FAIL
+
+    // Read the header, and the length of the file
+    const size_t header_read = fread((void *) header, sizeof(orbitalElementsFileHeader), 1, input);
+    fseek(input, 0, SEEK_END);
+    const long file_length = ftell(input);
+    fclose(input);
+
+    // Check that the header is one we understand
+    if ((header_read != 1) || (memcmp(header->magic, ORBITAL_ELEMENTS_MAGIC, 8) != 0)) {
+        if (DEBUG) { ephem_log("Rejecting this as it is not a binary orbital elements file"); }
+        return 1;
+    }
+    if ((header->version != ORBITAL_ELEMENTS_VERSION) || (header->byte_order != ORBITAL_ELEMENTS_BYTE_ORDER) ||
+        (header->record_size != sizeof(orbitalElements)) || (header->names_size != sizeof(orbitalElementsNames))) {
+        if (DEBUG) { ephem_log("Rejecting this as it was written by an incompatible version or machine"); }
+        return 1;
+    }
+    if ((header->checksum != orbitalElements_headerChecksum(header)) ||
+        (header->file_length != (uint64_t) file_length)) {
+        if (DEBUG) { ephem_log("Rejecting this as it is corrupt or truncated"); }
+        return 1;
+    }
+
+    // Check that numbers are sensible
+    if ((header->item_count < 1) || (header->item_secure_count < 0) || (header->index_count < 0) ||
+        (header->hash_count < 0) || ((header->hash_count & (header->hash_count - 1)) != 0) ||
+        ((header->hash_count > 0) && (header->index_count == 0)) ||
+        (header->records_offset + (uint64_t) header->item_count * sizeof(orbitalElements) > header->file_length) ||
+        (header->names_offset + (uint64_t) header->item_count * sizeof(orbitalElementsNames) > header->file_length) ||
+        (header->index_offset + (uint64_t) header->index_count * sizeof(orbitalElementsIndexEntry) >
+         header->file_length) ||
+        (header->hash_offset + (uint64_t) header->hash_count * sizeof(orbitalElementsHashEntry) >
+         header->file_length)) {
+        if (DEBUG) { ephem_log("Rejecting this as implausible"); }
+        return 1;
+    }
+
+    return 0;
+}
+
 //! OrbitalElements_ReadBinaryData - restore orbital elements from a binary dump of the data in a file such as
 //! <data/dcfbinary.ast>. This saves time parsing original text file every time we are run. For further efficiency,
 //! we don't actually read the orbital elements from disk straight away, until they're actually needed. We merely
-//! malloc a buffer to hold them. This massively reduces the start-up time.
+//! open record caches, which map the file into memory or read each record the first time it is fetched. This
+//! massively reduces the start-up time.
 //!
 //! \param [in] filename - The filename of the binary data dump
-//! \param [out] file_pointer - Return a file handle for the binary data dump
-//! \param [out] elements_offset  - Return the offset of the start of the table of <orbitalElements> structures from the
-//! beginning of the file.
-//! \param [out] data_buffer - Return a malloced buffer which is big enough to contain the table of <orbitalElements>
-//! structures.
-//! \param [out] data_buffer_items_loaded - Return an array which we use to keep track of which orbital elements we have
-//! already loaded.
+//! \param [out] records - Return a record cache for the table of <orbitalElements> structures in the binary data dump
+//! \param [out] data_buffer - Return a pointer to the storage for the table of <orbitalElements> structures.
+//! \param [out] names - Return a record cache for the table of <orbitalElementsNames> structures
+//! \param [out] names_buffer - Return a pointer to the storage for the table of <orbitalElementsNames> structures.
+//! \param [out] index - Return a record cache for the index of names. This is left untouched if the file has no index.
+//! \param [out] hash - Return a record cache for the hash table of names. This is left untouched if the file has none.
 //! \param [out] item_count - Return the number of orbital elements in this binary file.
 //! \param [out] item_secure_count - Return the number of securely determined orbital elements in this binary file.
 //! \return - Zero on success
 
-int OrbitalElements_ReadBinaryData(const char *filename, FILE **file_pointer, int *elements_offset,
-                                   orbitalElements **data_buffer, unsigned char **data_buffer_items_loaded,
-                                   int *item_count, int *item_secure_count) {
+int OrbitalElements_ReadBinaryData(const char *filename, record_cache *records, orbitalElements **data_buffer,
+                                   record_cache *names, orbitalElementsNames **names_buffer, record_cache *index,
+                                   record_cache *hash, int *item_count, int *item_secure_count) {
     char filename_with_path[FNAME_LENGTH];
+    orbitalElementsFileHeader header;
 
     // Work out the full path of the binary data file we are to read
     sprintf(filename_with_path, "%s/%s", DATADIR, filename);
@@ -109,41 +233,45 @@ int OrbitalElements_ReadBinaryData(const char *filename, FILE **file_pointer, in
         ephem_log(temp_err_string);
     }
 
-    // Open binary data file
-    *file_pointer = fopen(filename_with_path, "rb");
-    if (*file_pointer == NULL) return 1; // FAIL
+    // Check that the file exists, and is one we understand. Files in any other format are rebuilt from the text files.
+    if (orbitalElements_readHeader(filename_with_path, &header) != 0) return 1;
 
-    // Read the number of objects with orbital elements in this file
-    dcf_fread((void *) item_count, sizeof(int), 1, *file_pointer, filename_with_path, __FILE__, __LINE__);
+    *item_count = header.item_count;
+    *item_secure_count = header.item_secure_count;
     if (DEBUG) {
         sprintf(temp_err_string, "Object count = %d", *item_count);
         ephem_log(temp_err_string);
-    }
-
-    // Read the number of secure orbits described in this file
-    dcf_fread((void *) item_secure_count, sizeof(int), 1, *file_pointer, filename_with_path, __FILE__, __LINE__);
-    if (DEBUG) {
         sprintf(temp_err_string, "Objects with secure orbits = %d", *item_secure_count);
         ephem_log(temp_err_string);
     }
 
-    // Check that numbers are sensible
-    if ((*item_count < 1) || (*item_count > 1e6)) {
-        if (DEBUG) { ephem_log("Rejecting this as implausible"); }
-        fclose(*file_pointer);
-        *file_pointer = NULL;
+    // Open caches which will load records as we need them
+    if (record_cache_open(records, filename_with_path, (long) header.records_offset, sizeof(orbitalElements),
+                          header.item_count) != 0) {
         return 1;
     }
-
-    // We have now reached the orbital elements. Store their offset from the start of the file.
-    *elements_offset = ftell(*file_pointer);
-
-    // Allocate memory to store records as we load them
-    *data_buffer = (orbitalElements *) lt_malloc((*item_count) * sizeof(orbitalElements));
-    *data_buffer_items_loaded = (unsigned char *) lt_malloc((*item_count) * sizeof(unsigned char));
-
-    // Zero array telling us which records we have read
-    memset(*data_buffer_items_loaded, 0, *item_count);
+    if (record_cache_open(names, filename_with_path, (long) header.names_offset, sizeof(orbitalElementsNames),
+                          header.item_count) != 0) {
+        record_cache_close(records);
+        return 1;
+    }
+    if ((header.index_count > 0) &&
+        (record_cache_open(index, filename_with_path, (long) header.index_offset, sizeof(orbitalElementsIndexEntry),
+                           header.index_count) != 0)) {
+        record_cache_close(records);
+        record_cache_close(names);
+        return 1;
+    }
+    if ((header.hash_count > 0) &&
+        (record_cache_open(hash, filename_with_path, (long) header.hash_offset, sizeof(orbitalElementsHashEntry),
+                           header.hash_count) != 0)) {
+        record_cache_close(records);
+        record_cache_close(names);
+        record_cache_close(index);
+        return 1;
+    }
+    *data_buffer = (orbitalElements *) records->data;
+    *names_buffer = (orbitalElementsNames *) names->data;
 
     if (DEBUG) {
         sprintf(temp_err_string, "Data file opened successfully.");
@@ -154,20 +282,157 @@ int OrbitalElements_ReadBinaryData(const char *filename, FILE **file_pointer, in
     return 0;
 }
 
+//! orbitalElements_indexName - Return the name which an entry in the index of names refers to
+//! \param [in] names - The table of names which the index refers to
+//! \param [in] entry - The index entry
+//! \return - The name
+
+static const char *orbitalElements_indexName(const orbitalElementsNames *names, const orbitalElementsIndexEntry *entry) {
+    return entry->field ? names[entry->record].name2 : names[entry->record].name;
+}
+
+//! orbitalElementsSortEntry - An entry in the index of names, together with the name it refers to, so that the
+//! index can be sorted without the comparison function needing to know which table of names it refers to
+
+typedef struct {
+    const char *name;
+    orbitalElementsIndexEntry entry;
+} orbitalElementsSortEntry;
+
+//! orbitalElements_indexCompare - Comparison function used to sort the index of names. Entries are sorted by
+//! case-folded name, and then by record number, so that when several objects share a name, a search finds the first.
+
+static int orbitalElements_indexCompare(const void *a, const void *b) {
+    const orbitalElementsSortEntry *sort_a = (const orbitalElementsSortEntry *) a;
+    const orbitalElementsSortEntry *sort_b = (const orbitalElementsSortEntry *) b;
+    const int name_order = str_cmp_no_case(sort_a->name, sort_b->name);
+    if (name_order != 0) return name_order;
+    if (sort_a->entry.record != sort_b->entry.record) return (sort_a->entry.record < sort_b->entry.record) ? -1 : 1;
+    return sort_a->entry.field - sort_b->entry.field;
+}
+
+//! orbitalElements_buildIndex - Build an index of the names of all the objects in a table, sorted by case-folded
+//! name. Objects without names are not indexed. The tables of planets, asteroids and comets may be initialised by
+//! different threads at the same time, so this keeps no state outside its arguments.
+//! \param [in] names - The table of names to index
+//! \param [in] item_count - The number of entries in <names>
+//! \param [out] index_count - Return the number of entries in the index
+//! \return - The index, allocated with <lt_malloc>
+
+static orbitalElementsIndexEntry *orbitalElements_buildIndex(const orbitalElementsNames *names, int item_count,
+                                                             int *index_count) {
+    orbitalElementsIndexEntry *index = (orbitalElementsIndexEntry *)
+            lt_malloc((2 * (size_t) item_count + 1) * sizeof(orbitalElementsIndexEntry));
+    orbitalElementsSortEntry *sort = (orbitalElementsSortEntry *)
+            malloc((2 * (size_t) item_count + 1) * sizeof(orbitalElementsSortEntry));
+    if ((index == NULL) || (sort == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+
+    *index_count = 0;
+    for (int i = 0; i < item_count; i++) {
+        for (int field = 0; field < 2; field++) {
+            const char *name = field ? names[i].name2 : names[i].name;
+            if ((name[0] == '\0') || (strcmp(name, ORBITAL_ELEMENTS_NO_NAME) == 0)) continue;
+            sort[*index_count].name = name;
+            sort[*index_count].entry.record = i;
+            sort[*index_count].entry.field = field;
+            (*index_count)++;
+        }
+    }
+
+    qsort(sort, *index_count, sizeof(orbitalElementsSortEntry), orbitalElements_indexCompare);
+    for (int i = 0; i < *index_count; i++) index[i] = sort[i].entry;
+    free(sort);
+    return index;
+}
+
+//! orbitalElements_hashName - Compute the FNV-1a hash of a name, folding lower case letters into upper case in the
+//! same way as <str_cmp_no_case>, so that names which compare equal have equal hashes
+//! \param [in] name - The name to hash
+//! \return - The hash
+
+unsigned int orbitalElements_hashName(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        const unsigned char c = ((*name >= 'a') && (*name <= 'z')) ? (*name - 'a' + 'A') : *name;
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+//! orbitalElements_buildHash - Build a hash table of the names in an index of names, so that names can be looked up
+//! without a binary search. Where several objects share a name, the table points to the first of them in the index.
+//! \param [in] names - The table of names which the index refers to
+//! \param [in] index - The index of names, as produced by <orbitalElements_buildIndex>
+//! \param [in] index_count - The number of entries in the index
+//! \param [out] hash_count - Return the number of slots in the hash table; zero if the index is empty
+//! \return - The hash table, allocated with <lt_malloc>, or NULL if the index is empty
+
+static orbitalElementsHashEntry *orbitalElements_buildHash(const orbitalElementsNames *names,
+                                                           const orbitalElementsIndexEntry *index, int index_count,
+                                                           int *hash_count) {
+    int i;
+
+    *hash_count = 0;
+    if (index_count < 1) return NULL;
+
+    // Keep the table no more than half full, so that probe sequences stay short
+    int slots = 1;
+    while (slots < 2 * index_count) slots *= 2;
+
+    orbitalElementsHashEntry *hash = (orbitalElementsHashEntry *) lt_malloc(slots * sizeof(orbitalElementsHashEntry));
+    if (hash == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    for (i = 0; i < slots; i++) {
+        hash[i].hash = 0;
+        hash[i].entry = -1;
+    }
+
+    for (i = 0; i < index_count; i++) {
+        const char *name = orbitalElements_indexName(names, &index[i]);
+
+        // Names which appear more than once are adjacent in the index; only the first is entered
+        if ((i > 0) && (str_cmp_no_case(name, orbitalElements_indexName(names, &index[i - 1])) == 0)) continue;
+
+        const uint32_t name_hash = orbitalElements_hashName(name);
+        int slot = (int) (name_hash & (uint32_t) (slots - 1));
+        while (hash[slot].entry >= 0) slot = (slot + 1) & (slots - 1);
+        hash[slot].hash = name_hash;
+        hash[slot].entry = i;
+    }
+
+    *hash_count = slots;
+    return hash;
+}
+
 //! OrbitalElements_DumpBinaryData - dump orbital elements to a binary dump such as <data/dcfbinary.ast>,
 //! to save parsing original text file every time we are run.
 //!
 //! \param [in] filename - The filename of the binary dump we are to produce
 //! \param [in] data - The table of orbitalElements structures to write
-//! \param [out] elements_offset  - Return the offset of the start of the table of <orbitalElements> structures from the
-//! beginning of the file.
+//! \param [in] names - The table of orbitalElementsNames structures to write
+//! \param [in] index - The index of names to write, as produced by <orbitalElements_buildIndex>
+//! \param [in] hash - The hash table of names to write, as produced by <orbitalElements_buildHash>
 //! \param [in] item_count - The number of orbital elements structures to write
 //! \param [in] item_secure_count - The number of objects in this table which have secure orbits
-
-void OrbitalElements_DumpBinaryData(const char *filename, const orbitalElements *data, int *elements_offset,
-                                    const int item_count, const int item_secure_count) {
+//! \param [in] index_count - The number of entries in <index>
+//! \param [in] hash_count - The number of slots in <hash>
+//! \param [in] revision - The number of incremental updates which have been applied to this table since it was read
+//! from the original text file
+
+void OrbitalElements_DumpBinaryData(const char *filename, const orbitalElements *data,
+                                    const orbitalElementsNames *names, const orbitalElementsIndexEntry *index,
+                                    const orbitalElementsHashEntry *hash, const int item_count,
+                                    const int item_secure_count, const int index_count, const int hash_count,
+                                    const unsigned int revision) {
     FILE *output;
     char filename_with_path[FNAME_LENGTH];
+    const unsigned char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    orbitalElementsFileHeader header;
 
     // Work out the full path of the binary data file we are to write
     sprintf(filename_with_path, "%s/%s", DATADIR, filename);
@@ -180,15 +445,43 @@ void OrbitalElements_DumpBinaryData(const char *filename, const orbitalElements
     output = fopen(filename_with_path, "wb");
     if (output == NULL) return; // FAIL
 
-    // Write the number of objects with orbital elements in this file
-    fwrite((void *) &item_count, sizeof(int), 1, output);
-    fwrite((void *) &item_secure_count, sizeof(int), 1, output);
-
-    // We have now reached the orbital elements. Store their offset from the start of the file.
-    *elements_offset = ftell(output);
-
-    // Write the orbital elements themselves
+    // Work out where each section of the file goes
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ORBITAL_ELEMENTS_MAGIC, 8);
+    header.version = ORBITAL_ELEMENTS_VERSION;
+    header.byte_order = ORBITAL_ELEMENTS_BYTE_ORDER;
+    header.record_size = sizeof(orbitalElements);
+    header.names_size = sizeof(orbitalElementsNames);
+    header.item_count = item_count;
+    header.item_secure_count = item_secure_count;
+    header.index_count = index_count;
+    header.hash_count = hash_count;
+    header.revision = revision;
+    header.revision_time = (revision > 0) ? (uint32_t) time(NULL) : 0;
+    header.records_offset = orbitalElements_align(sizeof(header));
+    header.names_offset = orbitalElements_align(header.records_offset +
+                                                (uint64_t) item_count * sizeof(orbitalElements));
+    header.index_offset = orbitalElements_align(header.names_offset +
+                                                (uint64_t) item_count * sizeof(orbitalElementsNames));
+    header.hash_offset = orbitalElements_align(header.index_offset +
+                                               (uint64_t) index_count * sizeof(orbitalElementsIndexEntry));
+    header.file_length = header.hash_offset + (uint64_t) hash_count * sizeof(orbitalElementsHashEntry);
+    header.checksum = orbitalElements_headerChecksum(&header);
+
+    // Write the header, and then each section in turn
+    fwrite((void *) &header, sizeof(header), 1, output);
+    fwrite((void *) padding, 1, header.records_offset - sizeof(header), output);
     fwrite((void *) data, sizeof(orbitalElements), item_count, output);
+    fwrite((void *) padding, 1,
+           header.names_offset - header.records_offset - (uint64_t) item_count * sizeof(orbitalElements), output);
+    fwrite((void *) names, sizeof(orbitalElementsNames), item_count, output);
+    fwrite((void *) padding, 1,
+           header.index_offset - header.names_offset - (uint64_t) item_count * sizeof(orbitalElementsNames), output);
+    fwrite((void *) index, sizeof(orbitalElementsIndexEntry), index_count, output);
+    fwrite((void *) padding, 1,
+           header.hash_offset - header.index_offset - (uint64_t) index_count * sizeof(orbitalElementsIndexEntry),
+           output);
+    fwrite((void *) hash, sizeof(orbitalElementsHashEntry), hash_count, output);
 
     // Close output file
     fclose(output);
@@ -200,6 +493,68 @@ void OrbitalElements_DumpBinaryData(const char *filename, const orbitalElements
     }
 }
 
+//! The number of chunks into which we divide the text files of asteroids and comets, so that they can be parsed by
+//! many threads at once. This is fixed, rather than set by the number of threads, so that the binary files we write
+//! do not depend on the machine.
+#define ORBITAL_ELEMENTS_PARSE_CHUNKS 64
+
+//! orbitalElements_blank - Fill an orbitalElements record, and its names, with the values we use for missing data
+//! \param [out] item - The record to fill
+//! \param [out] names - The names to fill
+
+static void orbitalElements_blank(orbitalElements *item, orbitalElementsNames *names) {
+    memset(item, 0, sizeof(orbitalElements));
+    item->absoluteMag = GSL_NAN;
+    item->meanAnomaly = GSL_NAN;
+    item->argumentPerihelion = GSL_NAN;
+    item->longAscNode = GSL_NAN;
+    item->inclination = GSL_NAN;
+    item->eccentricity = GSL_NAN;
+    item->semiMajorAxis = GSL_NAN;
+    item->perihelionDistance = GSL_NAN;
+    item->epochPerihelion = GSL_NAN;
+    item->epochOsculation = GSL_NAN;
+    item->slopeParam_n = 2;
+    item->slopeParam_G = -999;
+    item->number = -1;
+    item->secureOrbit = 0;
+    item->argumentPerihelion_dot = 0;
+    item->longAscNode_dot = 0;
+    item->inclination_dot = 0;
+    item->eccentricity_dot = 0;
+    item->semiMajorAxis_dot = 0;
+    memset(names, 0, sizeof(orbitalElementsNames));
+    strcpy(names->name, ORBITAL_ELEMENTS_NO_NAME);
+    strcpy(names->name2, ORBITAL_ELEMENTS_NO_NAME);
+}
+
+//! orbitalElements_column - Find the first non-blank character at or after a particular column of a line of a text
+//! file, without going past the end of the line. Lines are not null-terminated, but they always end with a newline,
+//! which stops <get_float>.
+//! \param [in] line - The line of text
+//! \param [in] length - The length of the line
+//! \param [in] column - The column at which the field we want starts
+//! \return - Pointer to the first non-blank character of the field, or to the end of the line if there is none
+
+static const char *orbitalElements_column(const char *line, int length, int column) {
+    int i = column;
+    while ((i < length) && (line[i] > '\0') && (line[i] <= ' ')) i++;
+    return line + ((i < length) ? i : length);
+}
+
+//! orbitalElements_isNumber - Test whether a field of a line of a text file starts with a number, in the same way as
+//! <valid_float>, without looking past the end of the field
+//! \param [in] field - The start of the field
+//! \return - Boolean flag indicating whether the field contains a number
+
+static int orbitalElements_isNumber(const char *field) {
+    if ((*field == '-') || (*field == '+')) field++;
+    for (; ((*field >= '0') && (*field <= '9')) || (*field == '.'); field++) {
+        if (*field != '.') return 1;
+    }
+    return 0;
+}
+
 //! orbitalElements_planets_readAsciiData - Read the asteroid orbital elements contained in the file <data/planets.dat>
 
 void orbitalElements_planets_readAsciiData() {
@@ -208,8 +563,8 @@ void orbitalElements_planets_readAsciiData() {
     FILE *input = NULL;
 
     // Try and read data from binary dump. Only proceed with parsing the text files if binary dump doesn't exist.
-    int status = OrbitalElements_ReadBinaryData("dcfbinary.plt", &planet_database_file, &planet_database_offset,
-                                                &planet_database, &planet_database_items_loaded,
+    int status = OrbitalElements_ReadBinaryData("dcfbinary.plt", &planet_database_records, &planet_database,
+                                                &planet_names_records, &planet_names, &planet_index_records, &planet_hash_records,
                                                 &planet_count, &planet_secure_count);
 
     // If successful, return
@@ -219,7 +574,8 @@ void orbitalElements_planets_readAsciiData() {
     planet_count = 0;
     planet_secure_count = 0;
     planet_database = (orbitalElements *) lt_malloc(MAX_PLANETS * sizeof(orbitalElements));
-    if (planet_database == NULL) {
+    planet_names = (orbitalElementsNames *) lt_malloc(MAX_PLANETS * sizeof(orbitalElementsNames));
+    if ((planet_database == NULL) || (planet_names == NULL)) {
         ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
         exit(1);
     }
@@ -234,6 +590,7 @@ void orbitalElements_planets_readAsciiData() {
         planet_database[i].inclination = GSL_NAN;
         planet_database[i].eccentricity = GSL_NAN;
         planet_database[i].semiMajorAxis = GSL_NAN;
+        planet_database[i].perihelionDistance = GSL_NAN;
         planet_database[i].epochPerihelion = GSL_NAN;
         planet_database[i].epochOsculation = GSL_NAN;
         planet_database[i].slopeParam_n = 2;
@@ -245,8 +602,9 @@ void orbitalElements_planets_readAsciiData() {
         planet_database[i].inclination_dot = 0;
         planet_database[i].eccentricity_dot = 0;
         planet_database[i].semiMajorAxis_dot = 0;
-        strcpy(planet_database[i].name, "Undefined");
-        strcpy(planet_database[i].name2, "Undefined");
+        memset(&planet_names[i], 0, sizeof(orbitalElementsNames));
+        strcpy(planet_names[i].name, ORBITAL_ELEMENTS_NO_NAME);
+        strcpy(planet_names[i].name2, ORBITAL_ELEMENTS_NO_NAME);
     }
 
     if (DEBUG) {
@@ -284,8 +642,8 @@ void orbitalElements_planets_readAsciiData() {
         planet_secure_count++;
 
         // Read planet name
-        for (i = 141, j = 0; (line[i] > ' '); i++, j++) planet_database[body_id].name[j] = line[i];
-        planet_database[body_id].name[j] = '\0';
+        for (i = 141, j = 0; (line[i] > ' '); i++, j++) planet_names[body_id].name[j] = line[i];
+        planet_names[body_id].name[j] = '\0';
 
         // Fill out dummy information
         planet_database[body_id].absoluteMag = 999;
@@ -338,6 +696,10 @@ void orbitalElements_planets_readAsciiData() {
         // radians per day
         planet_database[body_id].argumentPerihelion_dot = (longitude_perihelion_dot -
                                                            planet_database[body_id].longAscNode_dot);
+
+        // AU
+        planet_database[body_id].perihelionDistance = (planet_database[body_id].semiMajorAxis *
+                                                       (1 - planet_database[body_id].eccentricity));
     }
     fclose(input);
 
@@ -351,69 +713,159 @@ void orbitalElements_planets_readAsciiData() {
     }
 
     // Now that we've parsed the text-based version of this data, dump a binary version to make loading faster next time
-    OrbitalElements_DumpBinaryData("dcfbinary.plt", planet_database, &planet_database_offset,
-                                   planet_count, planet_secure_count);
+    int index_count, hash_count;
+    orbitalElementsIndexEntry *index = orbitalElements_buildIndex(planet_names, planet_count, &index_count);
+    orbitalElementsHashEntry *hash = orbitalElements_buildHash(planet_names, index, index_count, &hash_count);
+    OrbitalElements_DumpBinaryData("dcfbinary.plt", planet_database, planet_names, index, hash, planet_count,
+                                   planet_secure_count, index_count, hash_count, 0);
+
+    // We have already loaded all the orbital elements in this table, so serve them from memory
+    record_cache_wrap(&planet_database_records, planet_database, sizeof(orbitalElements), planet_count);
+    record_cache_wrap(&planet_names_records, planet_names, sizeof(orbitalElementsNames), planet_count);
+    if (index_count > 0) {
+        record_cache_wrap(&planet_index_records, index, sizeof(orbitalElementsIndexEntry), index_count);
+    }
+    if (hash_count > 0) {
+        record_cache_wrap(&planet_hash_records, hash, sizeof(orbitalElementsHashEntry), hash_count);
+    }
+}
 
-    // Make table indicating that we have loaded all the orbital elements in this table
-    planet_database_items_loaded = (unsigned char *) lt_malloc(planet_count * sizeof(unsigned char));
-    memset(planet_database_items_loaded, 1, planet_count);
+//! orbitalElements_asteroids_lineNumber - Work out which asteroid a line of astorb.dat describes
+//! \param [in] line - The line of text
+//! \param [in] length - The length of the line
+//! \return - The asteroid's number, or -1 if the line does not describe a numbered asteroid
 
-    // Open a file pointer to the file
-    char filename_with_path[FNAME_LENGTH];
-    snprintf(filename_with_path, FNAME_LENGTH, "%s/%s", DATADIR, "dcfbinary.plt");
-    planet_database_file = fopen(filename_with_path, "rb");
-    snprintf(planet_database_filename, FNAME_LENGTH, "%s", filename_with_path);
+static int orbitalElements_asteroids_lineNumber(const char *line, int length) {
+    int i;
+
+    // Ignore blank lines and comment lines
+    if ((length < 250) || (line[0] == '#')) return -1;
+
+    // Read asteroid number
+    for (i = 0; (line[i] > '\0') && (line[i] <= ' '); i++);
+
+    // Unnumbered asteroid; don't bother adding to catalogue
+    if (i >= 6) return -1;
+
+    const int n = (int) get_float(line + i, NULL);
+    if ((n < 0) || (n >= MAX_ASTEROIDS)) return -1;
+    return n;
+}
+
+//! orbitalElements_asteroids_parseLine - Read the orbital elements of an asteroid from a line of astorb.dat
+//! \param [in] line - The line of text
+//! \param [in] length - The length of the line
+//! \param [in] n - The asteroid's number, from <orbitalElements_asteroids_lineNumber>
+//! \param [out] item - The record to fill, which should already have been blanked
+//! \param [out] names - The names to fill, which should already have been blanked
+
+static void orbitalElements_asteroids_parseLine(const char *line, int length, int n, orbitalElements *item,
+                                                orbitalElementsNames *names) {
+    char err_text[FNAME_LENGTH];
+    int i;
+
+    item->number = n;
+
+    // Read asteroid name
+    for (i = 25; (i > 7) && (line[i] > '\0') && (line[i] <= ' '); i--);
+    strncpy(names->name, line + 7, i - 6);
+    names->name[i - 6] = '\0';
+
+    // Read absolute magnitude
+    item->absoluteMag = get_float(orbitalElements_column(line, length, 42), NULL);
+
+    // Read slope parameter
+    item->slopeParam_G = get_float(orbitalElements_column(line, length, 48), NULL);
+
+    // Read number of days spanned by data used to derive orbit. This field may run into the next one, so we copy it.
+    int day_obs_span;
+    {
+        int j;
+        char buffer[8];
+        snprintf(buffer, 7, "%.6s", line + 94);
+        for (j = 0; (buffer[j] > '\0') && (buffer[j] <= ' '); j++);
+        day_obs_span = (int) get_float(buffer + j, NULL);
+    }
+
+    // Read number of observations used to derive orbit
+    const int obs_count = (int) get_float(orbitalElements_column(line, length, 100), NULL);
+
+    // Orbit deemed secure if more than 10 yrs data
+    item->secureOrbit = (day_obs_span > 3650) && (obs_count > 500);
+
+    // Now start reading orbital elements of object
+    {
+        const double tmp = get_float(orbitalElements_column(line, length, 106), NULL);
+        // julian date
+        item->epochOsculation = julian_day((int) floor(tmp / 10000), ((int) floor(tmp / 100)) % 100,
+                                           ((int) floor(tmp)) % 100, 0, 0, 0, &i, err_text);
+    }
+
+    // Read mean anomaly -- radians; J2000.0
+    item->meanAnomaly = get_float(orbitalElements_column(line, length, 115), NULL) * M_PI / 180;
+
+    // Read argument of perihelion -- radians; J2000.0
+    item->argumentPerihelion = get_float(orbitalElements_column(line, length, 126), NULL) * M_PI / 180;
+
+    // Read longitude of ascending node -- radians; J2000.0
+    item->longAscNode = get_float(orbitalElements_column(line, length, 137), NULL) * M_PI / 180;
+
+    // Read inclination of orbit -- radians; J2000.0
+    item->inclination = get_float(orbitalElements_column(line, length, 147), NULL) * M_PI / 180;
+
+    // Read eccentricity of orbit -- dimensionless
+    item->eccentricity = get_float(orbitalElements_column(line, length, 157), NULL);
+
+    // Read semi-major axis of orbit -- AU
+    item->semiMajorAxis = get_float(orbitalElements_column(line, length, 168), NULL);
+    item->perihelionDistance = item->semiMajorAxis * (1 - item->eccentricity);
+}
+
+//! orbitalElements_asteroids_highestNumber - Find the highest numbered asteroid in a copy of astorb.dat, scanning its
+//! chunks in parallel
+//! \param [in] input - The text file
+//! \param [in] chunk_starts - The chunks into which the file has been divided by <text_file_split>
+//! \return - The highest asteroid number, or -1 if the file contains no numbered asteroids
+
+static int orbitalElements_asteroids_highestNumber(const text_file *input, const size_t *chunk_starts) {
+    int highest_number = -1;
+    int chunk;
+
+#pragma omp parallel for schedule(dynamic) private(chunk) reduction(max:highest_number)
+    for (chunk = 0; chunk < ORBITAL_ELEMENTS_PARSE_CHUNKS; chunk++) {
+        size_t position = chunk_starts[chunk];
+        const char *line;
+        int length;
+        while ((line = text_file_next_line(input, &position, chunk_starts[chunk + 1], &length)) != NULL) {
+            const int n = orbitalElements_asteroids_lineNumber(line, length);
+            if (n > highest_number) highest_number = n;
+        }
+    }
+    return highest_number;
 }
 
 //! orbitalElements_asteroids_readAsciiData - Read the asteroid orbital elements contained in the original astorb.dat
-//! file downloaded from Ted Bowell's website
+//! file downloaded from Ted Bowell's website. The file is mapped into memory, and divided into chunks which are parsed
+//! in parallel: first to find the highest numbered asteroid, so that we only have to initialise that many records,
+//! and then to read each asteroid's elements straight into its record.
 
 void orbitalElements_asteroids_readAsciiData() {
-    int i;
     char fname[FNAME_LENGTH];
-    FILE *input = NULL;
+    size_t chunk_starts[ORBITAL_ELEMENTS_PARSE_CHUNKS + 1];
+    text_file input;
+    int chunk, i;
 
     // Try and read data from binary dump. Only proceed with parsing the text files if binary dump doesn't exist.
-    int status = OrbitalElements_ReadBinaryData("dcfbinary.ast", &asteroid_database_file, &asteroid_database_offset,
-                                                &asteroid_database, &asteroid_database_items_loaded,
-                                                &asteroid_count, &asteroid_secure_count);
+    int status = OrbitalElements_ReadBinaryData("dcfbinary.ast", &asteroid_database_records, &asteroid_database,
+                                                &asteroid_names_records, &asteroid_names, &asteroid_index_records,
+                                                &asteroid_hash_records, &asteroid_count, &asteroid_secure_count);
 
     // If successful, return
     if (status == 0) return;
 
-    // Allocate memory to store asteroid orbital elements, and reset counters of how many objects we have
+    // Reset counters of how many objects we have
     asteroid_count = 0;
     asteroid_secure_count = 0;
-    asteroid_database = (orbitalElements *) lt_malloc(MAX_ASTEROIDS * sizeof(orbitalElements));
-    if (asteroid_database == NULL) {
-        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
-        exit(1);
-    }
-
-    // Pre-fill columns with NANs, which is the best value for data we don't populate later
-    for (i = 0; i < MAX_ASTEROIDS; i++) {
-        memset(&asteroid_database[i], 0, sizeof(orbitalElements));
-        asteroid_database[i].absoluteMag = GSL_NAN;
-        asteroid_database[i].meanAnomaly = GSL_NAN;
-        asteroid_database[i].argumentPerihelion = GSL_NAN;
-        asteroid_database[i].longAscNode = GSL_NAN;
-        asteroid_database[i].inclination = GSL_NAN;
-        asteroid_database[i].eccentricity = GSL_NAN;
-        asteroid_database[i].semiMajorAxis = GSL_NAN;
-        asteroid_database[i].epochPerihelion = GSL_NAN;
-        asteroid_database[i].epochOsculation = GSL_NAN;
-        asteroid_database[i].slopeParam_n = 2;
-        asteroid_database[i].slopeParam_G = -999;
-        asteroid_database[i].number = -1;
-        asteroid_database[i].secureOrbit = 0;
-        asteroid_database[i].argumentPerihelion_dot = 0;
-        asteroid_database[i].longAscNode_dot = 0;
-        asteroid_database[i].inclination_dot = 0;
-        asteroid_database[i].eccentricity_dot = 0;
-        asteroid_database[i].semiMajorAxis_dot = 0;
-        strcpy(asteroid_database[i].name, "Undefined");
-        strcpy(asteroid_database[i].name2, "Undefined");
-    }
 
     if (DEBUG) {
         sprintf(temp_err_string, "Beginning to read ASCII asteroid list.");
@@ -424,178 +876,320 @@ void orbitalElements_asteroids_readAsciiData() {
         sprintf(temp_err_string, "Opening file <%s>", fname);
         ephem_log(temp_err_string);
     }
-    input = fopen(fname, "rt");
-    if (input == NULL) {
+    if (text_file_open(fname, &input) != 0) {
         ephem_fatal(__FILE__, __LINE__, "Could not open asteroid data file.");
         exit(1);
     }
+    text_file_split(&input, ORBITAL_ELEMENTS_PARSE_CHUNKS, chunk_starts);
 
-    // Read through astorb.dat, line by line
-    while ((!feof(input)) && (!ferror(input))) {
-        char line[FNAME_LENGTH];
-
-        // Read a line from the input file
-        file_readline(input, line);
+    // First pass: asteroid_count should be the highest number asteroid we encounter
+    asteroid_count = orbitalElements_asteroids_highestNumber(&input, chunk_starts) + 1;
 
-        // Ignore blank lines and comment lines
-        if (line[0] == '\0') continue;
-        if (line[0] == '#') continue;
-        if (strlen(line) < 250) continue;
-
-        // Read asteroid number
-        for (i = 0; (line[i] > '\0') && (line[i] <= ' '); i++);
+    // Allocate memory to store exactly that many asteroids' orbital elements
+    const int asteroid_allocated = (asteroid_count > 0) ? asteroid_count : 1;
+    asteroid_database = (orbitalElements *) lt_malloc(asteroid_allocated * sizeof(orbitalElements));
+    asteroid_names = (orbitalElementsNames *) lt_malloc(asteroid_allocated * sizeof(orbitalElementsNames));
+    if ((asteroid_database == NULL) || (asteroid_names == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
 
-        // Unnumbered asteroid; don't bother adding to catalogue
-        if (i >= 6) continue;
+    // Pre-fill columns with NANs, which is the best value for data we don't populate later
+#pragma omp parallel for schedule(static) private(i)
+    for (i = 0; i < asteroid_count; i++) orbitalElements_blank(&asteroid_database[i], &asteroid_names[i]);
+
+    // Second pass: read the orbital elements of each asteroid
+    int secure_count = 0;
+#pragma omp parallel for schedule(dynamic) private(chunk) reduction(+:secure_count)
+    for (chunk = 0; chunk < ORBITAL_ELEMENTS_PARSE_CHUNKS; chunk++) {
+        size_t position = chunk_starts[chunk];
+        const char *line;
+        int length;
+        while ((line = text_file_next_line(&input, &position, chunk_starts[chunk + 1], &length)) != NULL) {
+            const int n = orbitalElements_asteroids_lineNumber(line, length);
+            if (n < 0) continue;
+            orbitalElements_asteroids_parseLine(line, length, n, &asteroid_database[n], &asteroid_names[n]);
+
+            // Count how many objects we've seen with secure orbits
+            if (asteroid_database[n].secureOrbit) secure_count++;
+        }
+    }
+    asteroid_secure_count = secure_count;
+    text_file_close(&input);
 
-        const int n = (int) get_float(line + i, NULL);
+    if (DEBUG) {
+        sprintf(temp_err_string, "Asteroid count               = %7d", asteroid_count);
+        ephem_log(temp_err_string);
+    }
+    if (DEBUG) {
+        sprintf(temp_err_string, "Asteroids with secure orbits = %7d", asteroid_secure_count);
+        ephem_log(temp_err_string);
+    }
 
-        // asteroid_count should be the highest number asteroid we have encountered
-        if (asteroid_count <= n) asteroid_count = n + 1;
-        asteroid_database[n].number = n;
+    // Now that we've parsed the text-based version of this data, dump a binary version to make loading faster next time
+    int index_count, hash_count;
+    orbitalElementsIndexEntry *index = orbitalElements_buildIndex(asteroid_names, asteroid_count, &index_count);
+    orbitalElementsHashEntry *hash = orbitalElements_buildHash(asteroid_names, index, index_count, &hash_count);
+    OrbitalElements_DumpBinaryData("dcfbinary.ast", asteroid_database, asteroid_names, index, hash, asteroid_count,
+                                   asteroid_secure_count, index_count, hash_count, 0);
+
+    // We have already loaded all the orbital elements in this table, so serve them from memory
+    record_cache_wrap(&asteroid_database_records, asteroid_database, sizeof(orbitalElements), asteroid_count);
+    record_cache_wrap(&asteroid_names_records, asteroid_names, sizeof(orbitalElementsNames), asteroid_count);
+    if (index_count > 0) {
+        record_cache_wrap(&asteroid_index_records, index, sizeof(orbitalElementsIndexEntry), index_count);
+    }
+    if (hash_count > 0) {
+        record_cache_wrap(&asteroid_hash_records, hash, sizeof(orbitalElementsHashEntry), hash_count);
+    }
+}
 
-        // Read asteroid name
-        for (i = 25; (i > 7) && (line[i] > '\0') && (line[i] <= ' '); i--);
-        strncpy(asteroid_database[n].name, line + 7, i - 6);
-        asteroid_database[n].name[i - 6] = '\0';
 
-        // Read absolute magnitude
-        for (i = 42; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].absoluteMag = get_float(line + i, NULL);
+//! orbitalElements_asteroids_applyUpdate - Bring <data/dcfbinary.ast> up to date with a newer copy of astorb.dat,
+//! without reparsing every asteroid into a fresh table. Asteroids are matched by number. If any asteroid has changed
+//! or been newly numbered, the updated tables and index of names are written to a new file, which is checked and then
+//! renamed over the old one. The old file is never modified in place, so processes which have it mapped into memory
+//! never see a partly updated table, and an interrupted update leaves the old file intact, so the same update can
+//! simply be applied again. Asteroids which are missing from the new copy of astorb.dat keep their old elements.
+//! Each update which changes anything increments the revision number in the file's header; an update which changes
+//! nothing leaves the file, and its revision number, alone. This must not be called once the asteroid table has been
+//! opened by <orbitalElements_asteroids_init>.
+//! \param [in] filename - The filename of the new copy of astorb.dat
+//! \param [out] changed_count - Return the number of asteroids already in the file whose records were rewritten
+//! \param [out] appended_count - Return the number of newly numbered asteroids which were added to the file
+//! \param [out] revision - Return the revision number of the file after the update
+//! \return - Zero on success; non-zero if there is no usable binary file to update, or if it could not be written
+
+int orbitalElements_asteroids_applyUpdate(const char *filename, int *changed_count, int *appended_count,
+                                          unsigned int *revision) {
+    char filename_with_path[FNAME_LENGTH], new_filename[FNAME_LENGTH];
+    size_t chunk_starts[ORBITAL_ELEMENTS_PARSE_CHUNKS + 1];
+    orbitalElementsFileHeader header;
+    text_file input;
+    FILE *file;
+    int chunk, i;
+
+    *changed_count = 0;
+    *appended_count = 0;
+
+    // Read the header of the existing binary file
+    sprintf(filename_with_path, "%s/dcfbinary.ast", DATADIR);
+    if (orbitalElements_readHeader(filename_with_path, &header) != 0) return 1;
+    const int old_count = header.item_count;
+    *revision = header.revision;
 
-        // Read slope parameter
-        for (i = 48; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].slopeParam_G = get_float(line + i, NULL);
+    if (DEBUG) {
+        sprintf(temp_err_string, "Updating <%s> from <%s>.", filename_with_path, filename);
+        ephem_log(temp_err_string);
+    }
+    if (text_file_open(filename, &input) != 0) return 1;
+    text_file_split(&input, ORBITAL_ELEMENTS_PARSE_CHUNKS, chunk_starts);
+
+    // First pass: work out whether any new asteroids have been numbered
+    const int highest_number = orbitalElements_asteroids_highestNumber(&input, chunk_starts);
+    const int new_count = (highest_number >= old_count) ? (highest_number + 1) : old_count;
+
+    // Read the existing tables of orbital elements and names, leaving room for any new asteroids
+    orbitalElements *data = (orbitalElements *) malloc(new_count * sizeof(orbitalElements));
+    orbitalElementsNames *names = (orbitalElementsNames *) malloc(new_count * sizeof(orbitalElementsNames));
+    unsigned char *changed = (unsigned char *) calloc(new_count, 1);
+    if ((data == NULL) || (names == NULL) || (changed == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
 
-        // Read number of days spanned by data used to derive orbit
-        int day_obs_span;
-        {
-            int j;
-            char buffer[8];
-            snprintf(buffer, 7, "%s", line + 94);
-            for (j = 0; (buffer[j] > '\0') && (buffer[j] <= ' '); j++);
-            day_obs_span = (int) get_float(buffer + j, NULL);
+    int status = 1;
+    file = fopen(filename_with_path, "rb");
+    if ((file != NULL) &&
+        (fseek(file, (long) header.records_offset, SEEK_SET) == 0) &&
+        (fread(data, sizeof(orbitalElements), old_count, file) == (size_t) old_count) &&
+        (fseek(file, (long) header.names_offset, SEEK_SET) == 0) &&
+        (fread(names, sizeof(orbitalElementsNames), old_count, file) == (size_t) old_count)) {
+        status = 0;
+    }
+    if (file != NULL) fclose(file);
+    if (status != 0) {
+        text_file_close(&input);
+        free(data);
+        free(names);
+        free(changed);
+        return 1;
+    }
+    for (i = old_count; i < new_count; i++) orbitalElements_blank(&data[i], &names[i]);
+
+    // Second pass: parse each asteroid, and keep only those whose records differ from the ones we already have
+#pragma omp parallel for schedule(dynamic) private(chunk)
+    for (chunk = 0; chunk < ORBITAL_ELEMENTS_PARSE_CHUNKS; chunk++) {
+        size_t position = chunk_starts[chunk];
+        const char *line;
+        int length;
+        while ((line = text_file_next_line(&input, &position, chunk_starts[chunk + 1], &length)) != NULL) {
+            orbitalElements item;
+            orbitalElementsNames item_names;
+            const int n = orbitalElements_asteroids_lineNumber(line, length);
+            if (n < 0) continue;
+            orbitalElements_blank(&item, &item_names);
+            orbitalElements_asteroids_parseLine(line, length, n, &item, &item_names);
+
+            if ((memcmp(&item_names, &names[n], sizeof(orbitalElementsNames)) == 0) &&
+                (memcmp(&item, &data[n], sizeof(orbitalElements)) == 0)) continue;
+            data[n] = item;
+            names[n] = item_names;
+            changed[n] = 1;
         }
+    }
+    text_file_close(&input);
 
-        // Read number of observations used to derive orbit
-        for (i = 100; (line[i] > '\0') && (line[i] <= ' '); i++);
-        const int obs_count = (int) get_float(line + i, NULL);
-
-        // Orbit deemed secure if more than 10 yrs data
-        asteroid_database[n].secureOrbit = (day_obs_span > 3650) && (obs_count > 500);
-
-        // Count how many objects we've seen with secure orbits
-        if (asteroid_database[n].secureOrbit) asteroid_secure_count++;
-
-        // Now start reading orbital elements of object
-        {
-            for (i = 106; (line[i] > '\0') && (line[i] <= ' '); i++);
-            const double tmp = get_float(line + i, NULL);
-            // julian date
-            asteroid_database[n].epochOsculation = julian_day((int) floor(tmp / 10000), ((int) floor(tmp / 100)) % 100,
-                                                              ((int) floor(tmp)) % 100, 0, 0, 0, &i, temp_err_string);
+    int secure_count = 0;
+    for (i = 0; i < new_count; i++) {
+        if (changed[i]) {
+            if (i < old_count) (*changed_count)++;
+            else (*appended_count)++;
         }
-
-        // Read mean anomaly -- radians; J2000.0
-        for (i = 115; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].meanAnomaly = get_float(line + i, NULL) * M_PI / 180;
-
-        // Read argument of perihelion -- radians; J2000.0
-        for (i = 126; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].argumentPerihelion = get_float(line + i, NULL) * M_PI / 180;
-
-        // Read longitude of ascending node -- radians; J2000.0
-        for (i = 137; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].longAscNode = get_float(line + i, NULL) * M_PI / 180;
-
-        // Read inclination of orbit -- radians; J2000.0
-        for (i = 147; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].inclination = get_float(line + i, NULL) * M_PI / 180;
-
-        // Read eccentricity of orbit -- dimensionless
-        for (i = 157; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].eccentricity = get_float(line + i, NULL);
-
-        // Read semi-major axis of orbit -- AU
-        for (i = 168; (line[i] > '\0') && (line[i] <= ' '); i++);
-        asteroid_database[n].semiMajorAxis = get_float(line + i, NULL);
+        if (data[i].secureOrbit) secure_count++;
     }
-    fclose(input);
 
     if (DEBUG) {
-        sprintf(temp_err_string, "Asteroid count               = %7d", asteroid_count);
+        sprintf(temp_err_string, "Asteroids changed = %d; asteroids added = %d", *changed_count, *appended_count);
         ephem_log(temp_err_string);
     }
-    if (DEBUG) {
-        sprintf(temp_err_string, "Asteroids with secure orbits = %7d", asteroid_secure_count);
-        ephem_log(temp_err_string);
+
+    if ((*changed_count > 0) || (*appended_count > 0)) {
+        // Write the updated tables to a new file, check that it was written completely, and then move it into place.
+        // Other processes may have the old file mapped into memory, so it is never modified in place; they keep
+        // reading the old file until they next open it.
+        int index_count, hash_count;
+        orbitalElementsFileHeader new_header;
+        orbitalElementsIndexEntry *index = orbitalElements_buildIndex(names, new_count, &index_count);
+        orbitalElementsHashEntry *hash = orbitalElements_buildHash(names, index, index_count, &hash_count);
+        OrbitalElements_DumpBinaryData("dcfbinary.ast.new", data, names, index, hash, new_count, secure_count,
+                                       index_count, hash_count, header.revision + 1);
+        sprintf(new_filename, "%s/dcfbinary.ast.new", DATADIR);
+        status = (orbitalElements_readHeader(new_filename, &new_header) != 0) ||
+                 (new_header.revision != header.revision + 1);
+        if (status == 0) status = (rename(new_filename, filename_with_path) != 0);
+        if (status != 0) remove(new_filename);
+        else *revision = new_header.revision;
     }
 
-    // Now that we've parsed the text-based version of this data, dump a binary version to make loading faster next time
-    OrbitalElements_DumpBinaryData("dcfbinary.ast", asteroid_database, &asteroid_database_offset,
-                                   asteroid_count, asteroid_secure_count);
+    free(data);
+    free(names);
+    free(changed);
+    return status;
+}
 
-    // Make table indicating that we have loaded all the orbital elements in this table
-    asteroid_database_items_loaded = (unsigned char *) lt_malloc(asteroid_count * sizeof(unsigned char));
-    memset(asteroid_database_items_loaded, 1, asteroid_count);
 
-    // Open a file pointer to the file
-    char filename_with_path[FNAME_LENGTH];
-    snprintf(filename_with_path, FNAME_LENGTH, "%s/%s", DATADIR, "dcfbinary.ast");
-    asteroid_database_file = fopen(filename_with_path, "rb");
-    snprintf(asteroid_database_filename, FNAME_LENGTH, "%s", filename_with_path);
+//! orbitalElements_comets_isComet - Decide whether a line of Soft00Cmt.txt describes a comet
+//! \param [in] line - The line of text
+//! \param [in] length - The length of the line
+//! \return - Boolean flag indicating whether the line describes a comet
+
+static int orbitalElements_comets_isComet(const char *line, int length) {
+    // Ignore blank lines and comment lines
+    return (length >= 100) && (line[0] != '#');
 }
 
+//! orbitalElements_comets_parseLine - Read the orbital elements of a comet from a line of Soft00Cmt.txt, in place
+//! \param [in] line - The line of text
+//! \param [in] length - The length of the line
+//! \param [in] n - The position of the comet in the catalogue
+
+static void orbitalElements_comets_parseLine(const char *line, int length, int n) {
+    orbitalElements *item = &comet_database[n];
+    orbitalElementsNames *names = &comet_names[n];
+    char err_text[FNAME_LENGTH];
+    int j, k;
+    double tmp, perihelion_dist, eccentricity, perihelion_date, epoch, a;
+
+    // Read comet name
+    for (j = 102, k = 0; (j < length) && (line[j] != '(') && (k < 23); j++, k++) names->name[k] = line[j];
+    while ((k > 0) && (names->name[--k] == ' '));
+    names->name[k + 1] = '\0';
+
+    // Read comet's MPC designation
+    for (j = 0, k = 0; (line[j] > '\0') && (line[j] <= ' '); j++);
+    while ((line[j] > ' ') && (k < 23)) names->name2[k++] = line[j++];
+    names->name2[k] = '\0';
+
+    // Read perihelion distance
+    perihelion_dist = get_float(line + 31, NULL);
+
+    // Read perihelion date
+    const int perihelion_year = (int) get_float(orbitalElements_column(line, length, 14), NULL);
+    const int perihelion_month = (int) get_float(orbitalElements_column(line, length, 19), NULL);
+    const double perihelion_day = get_float(orbitalElements_column(line, length, 22), NULL);
+
+    // julian date
+    perihelion_date = julian_day(perihelion_year, perihelion_month, (int) floor(perihelion_day),
+                                 ((int) floor(perihelion_day * 24)) % 24,
+                                 ((int) floor(perihelion_day * 24 * 60)) % 60,
+                                 ((int) floor(perihelion_day * 24 * 3600)) % 60,
+                                 &j, err_text);
+
+    // Read eccentricity of orbit
+    item->eccentricity = eccentricity = get_float(orbitalElements_column(line, length, 41), NULL);
+
+    // Read argument of perihelion, radians, J2000.0
+    item->argumentPerihelion = get_float(orbitalElements_column(line, length, 51), NULL) * M_PI / 180;
+
+    // Read longitude of ascending node, radians, J2000.0
+    item->longAscNode = get_float(orbitalElements_column(line, length, 61), NULL) * M_PI / 180;
+
+    // Read orbital inclination, radians, J2000.0
+    item->inclination = get_float(orbitalElements_column(line, length, 71), NULL) * M_PI / 180;
+
+    // Read epoch of osculation, julian date
+    tmp = get_float(orbitalElements_column(line, length, 81), NULL);
+    item->epochOsculation = epoch = julian_day((int) floor(tmp / 10000), ((int) floor(tmp / 100)) % 100,
+                                               ((int) floor(tmp)) % 100, 0, 0, 0, &j, err_text);
+
+    // Read absolute magnitude
+    const char *field = orbitalElements_column(line, length, 90);
+    if (!orbitalElements_isNumber(field)) item->absoluteMag = GSL_NAN;
+    else item->absoluteMag = get_float(field, NULL);
+
+    // Read slope parameter
+    field = orbitalElements_column(line, length, 96);
+    if (!orbitalElements_isNumber(field)) item->slopeParam_n = 2;
+    else item->slopeParam_n = get_float(field, NULL);
+
+    // Calculate derived quantities
+    item->secureOrbit = 1;
+    // AU
+    item->semiMajorAxis = a = perihelion_dist / (1 - eccentricity);
+    item->perihelionDistance = perihelion_dist;
+    // radians; J2000.0
+    item->meanAnomaly = fmod(
+            sqrt(ORBIT_CONST_GM_SOLAR /
+                 gsl_pow_3(fabs(a) * ORBIT_CONST_ASTRONOMICAL_UNIT)) * (epoch - perihelion_date) * 24 * 3600 +
+            100 * M_PI, 2 * M_PI);
+    // julian date
+    item->epochPerihelion = perihelion_date;
+}
 
 //! orbitalElements_comets_readAsciiData - Read the comet orbital elements contained in the ASCII file downloaded
-//! from the Minor Planet Center's website
+//! from the Minor Planet Center's website. The file is mapped into memory, and divided into chunks which are parsed
+//! in parallel: first to count the comets in each chunk, which tells us where in the catalogue each chunk's comets go,
+//! and then to read each comet's elements straight into its record.
 
 void orbitalElements_comets_readAsciiData() {
-    int i;
     char fname[FNAME_LENGTH];
-    FILE *input = NULL;
+    size_t chunk_starts[ORBITAL_ELEMENTS_PARSE_CHUNKS + 1];
+    int chunk_first[ORBITAL_ELEMENTS_PARSE_CHUNKS + 1];
+    text_file input;
+    int chunk, i;
 
     // Try and read data from binary dump. Only proceed with parsing the text files if binary dump doesn't exist.
-    int status = OrbitalElements_ReadBinaryData("dcfbinary.cmt", &comet_database_file, &comet_database_offset,
-                                                &comet_database, &comet_database_items_loaded,
-                                                &comet_count, &comet_secure_count);
+    int status = OrbitalElements_ReadBinaryData("dcfbinary.cmt", &comet_database_records, &comet_database,
+                                                &comet_names_records, &comet_names, &comet_index_records,
+                                                &comet_hash_records, &comet_count, &comet_secure_count);
 
     // If successful, return
     if (status == 0) return;
 
-    // Allocate memory to store asteroid orbital elements, and reset counters of how many objects we have
+    // Reset counters of how many objects we have
     comet_count = 0;
     comet_secure_count = 0;
-    comet_database = (orbitalElements *) lt_malloc(MAX_COMETS * sizeof(orbitalElements));
-    if (comet_database == NULL) {
-        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
-        exit(1);
-    }
-
-    // Pre-fill columns with NANs, which is the best value for data we don't populate later
-    for (i = 0; i < MAX_COMETS; i++) {
-        memset(&comet_database[i], 0, sizeof(orbitalElements));
-        comet_database[i].absoluteMag = GSL_NAN;
-        comet_database[i].meanAnomaly = GSL_NAN;
-        comet_database[i].argumentPerihelion = GSL_NAN;
-        comet_database[i].longAscNode = GSL_NAN;
-        comet_database[i].inclination = GSL_NAN;
-        comet_database[i].eccentricity = GSL_NAN;
-        comet_database[i].semiMajorAxis = GSL_NAN;
-        comet_database[i].epochPerihelion = GSL_NAN;
-        comet_database[i].epochOsculation = GSL_NAN;
-        comet_database[i].slopeParam_n = 2;
-        comet_database[i].slopeParam_G = -999;
-        comet_database[i].number = -1;
-        comet_database[i].secureOrbit = 0;
-        comet_database[i].argumentPerihelion_dot = 0;
-        comet_database[i].longAscNode_dot = 0;
-        comet_database[i].inclination_dot = 0;
-        comet_database[i].eccentricity_dot = 0;
-        comet_database[i].semiMajorAxis_dot = 0;
-        strcpy(comet_database[i].name, "Undefined");
-        strcpy(comet_database[i].name2, "Undefined");
-    }
 
     // Now start reading the orbital elements of comets from Soft00Cmt.txt
 
@@ -608,108 +1202,59 @@ void orbitalElements_comets_readAsciiData() {
         sprintf(temp_err_string, "Opening file <%s>", fname);
         ephem_log(temp_err_string);
     }
-    input = fopen(fname, "rt");
-    if (input == NULL) {
+    if (text_file_open(fname, &input) != 0) {
         ephem_fatal(__FILE__, __LINE__, "Could not open comet data file.");
         exit(1);
     }
-
-    // Iterate over Soft00Cmt.txt, line by line
-    while ((!feof(input)) && (!ferror(input))) {
-        char line[FNAME_LENGTH];
-        int j, k;
-        double tmp, perihelion_dist, eccentricity, perihelion_date, epoch, a;
-
-        // Read a line from the input file
-        file_readline(input, line);
-
-        // Ignore blank lines and comment lines
-        if (line[0] == '\0') continue;
-        if (line[0] == '#') continue;
-        if (strlen(line) < 100) continue;
-
-        // Read comet name
-        for (j = 102, k = 0; (line[j] != '(') && (line[j] != '\0') && (k < 23); j++, k++) {
-            comet_database[comet_count].name[k] = line[j];
+    text_file_split(&input, ORBITAL_ELEMENTS_PARSE_CHUNKS, chunk_starts);
+
+    // First pass: count the comets in each chunk
+#pragma omp parallel for schedule(dynamic) private(chunk)
+    for (chunk = 0; chunk < ORBITAL_ELEMENTS_PARSE_CHUNKS; chunk++) {
+        size_t position = chunk_starts[chunk];
+        const char *line;
+        int length, count = 0;
+        while ((line = text_file_next_line(&input, &position, chunk_starts[chunk + 1], &length)) != NULL) {
+            count += orbitalElements_comets_isComet(line, length);
         }
-        while ((k > 0) && (comet_database[comet_count].name[--k] == ' '));
-        comet_database[comet_count].name[k + 1] = '\0';
-
-        // Read comet's MPC designation
-        for (j = 0, k = 0; (line[j] > '\0') && (line[j] <= ' '); j++);
-        while ((line[j] > ' ') && (k < 23)) comet_database[comet_count].name2[k++] = line[j++];
-        comet_database[comet_count].name2[k] = '\0';
-
-        // Read perihelion distance
-        perihelion_dist = get_float(line + 31, NULL);
-
-        // Read perihelion date
-        for (j = 14; (line[j] > '\0') && (line[j] <= ' '); j++);
-        const int perihelion_year = (int) get_float(line + j, NULL);
-        for (j = 19; (line[j] > '\0') && (line[j] <= ' '); j++);
-        const int perihelion_month = (int) get_float(line + j, NULL);
-        for (j = 22; (line[j] > '\0') && (line[j] <= ' '); j++);
-        const double perihelion_day = get_float(line + j, NULL);
+        chunk_first[chunk + 1] = count;
+    }
 
-        // julian date
-        perihelion_date = julian_day(perihelion_year, perihelion_month, (int) floor(perihelion_day),
-                                     ((int) floor(perihelion_day * 24)) % 24,
-                                     ((int) floor(perihelion_day * 24 * 60)) % 60,
-                                     ((int) floor(perihelion_day * 24 * 3600)) % 60,
-                                     &j, temp_err_string);
-
-        // Read eccentricity of orbit
-        for (j = 41; (line[j] > '\0') && (line[j] <= ' '); j++);
-        comet_database[comet_count].eccentricity = eccentricity = get_float(line + j, NULL);
-
-        // Read argument of perihelion, radians, J2000.0
-        for (j = 51; (line[j] > '\0') && (line[j] <= ' '); j++);
-        comet_database[comet_count].argumentPerihelion = get_float(line + j, NULL) * M_PI / 180;
-
-        // Read longitude of ascending node, radians, J2000.0
-        for (j = 61; (line[j] > '\0') && (line[j] <= ' '); j++);
-        comet_database[comet_count].longAscNode = get_float(line + j, NULL) * M_PI / 180;
-
-        // Read orbital inclination, radians, J2000.0
-        for (j = 71; (line[j] > '\0') && (line[j] <= ' '); j++);
-        comet_database[comet_count].inclination = get_float(line + j, NULL) * M_PI / 180;
-
-        // Read epoch of osculation, julian date
-        for (j = 81; (line[j] > '\0') && (line[j] <= ' '); j++);
-        tmp = get_float(line + j, NULL);
-        comet_database[comet_count].epochOsculation = epoch = julian_day((int) floor(tmp / 10000),
-                                                                         ((int) floor(tmp / 100)) % 100,
-                                                                         ((int) floor(tmp)) % 100, 0, 0, 0,
-                                                                         &j,
-                                                                         temp_err_string);
-
-        // Read absolute magnitude
-        for (j = 90; (line[j] > '\0') && (line[j] <= ' '); j++);
-        if (!valid_float(line + j, NULL)) comet_database[comet_count].absoluteMag = GSL_NAN;
-        else comet_database[comet_count].absoluteMag = get_float(line + j, NULL);
-
-        // Read slope parameter
-        for (j = 96; (line[j] > '\0') && (line[j] <= ' '); j++);
-        if (!valid_float(line + j, NULL)) comet_database[comet_count].slopeParam_n = 2;
-        else comet_database[comet_count].slopeParam_n = get_float(line + j, NULL);
-
-        // Calculate derived quantities
-        comet_database[comet_count].secureOrbit = 1;
-        // AU
-        comet_database[comet_count].semiMajorAxis = a = perihelion_dist / (1 - eccentricity);
-        // radians; J2000.0
-        comet_database[comet_count].meanAnomaly = fmod(
-                sqrt(ORBIT_CONST_GM_SOLAR /
-                     gsl_pow_3(fabs(a) * ORBIT_CONST_ASTRONOMICAL_UNIT)) * (epoch - perihelion_date) * 24 * 3600 +
-                100 * M_PI, 2 * M_PI);
-        // julian date
-        comet_database[comet_count].epochPerihelion = perihelion_date;
+    // Work out where each chunk's comets go in the catalogue
+    chunk_first[0] = 0;
+    for (chunk = 0; chunk < ORBITAL_ELEMENTS_PARSE_CHUNKS; chunk++) {
+        chunk_first[chunk + 1] += chunk_first[chunk];
+    }
+    comet_count = (chunk_first[ORBITAL_ELEMENTS_PARSE_CHUNKS] < MAX_COMETS) ?
+                  chunk_first[ORBITAL_ELEMENTS_PARSE_CHUNKS] : MAX_COMETS;
+    comet_secure_count = comet_count;
+
+    // Allocate memory to store exactly that many comets' orbital elements
+    const int comet_allocated = (comet_count > 0) ? comet_count : 1;
+    comet_database = (orbitalElements *) lt_malloc(comet_allocated * sizeof(orbitalElements));
+    comet_names = (orbitalElementsNames *) lt_malloc(comet_allocated * sizeof(orbitalElementsNames));
+    if ((comet_database == NULL) || (comet_names == NULL)) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
 
-        // Increment the comet counter
-        comet_count++;
-        comet_secure_count++;
+    // Pre-fill columns with NANs, which is the best value for data we don't populate later
+#pragma omp parallel for schedule(static) private(i)
+    for (i = 0; i < comet_count; i++) orbitalElements_blank(&comet_database[i], &comet_names[i]);
+
+    // Second pass: read the orbital elements of each comet
+#pragma omp parallel for schedule(dynamic) private(chunk)
+    for (chunk = 0; chunk < ORBITAL_ELEMENTS_PARSE_CHUNKS; chunk++) {
+        size_t position = chunk_starts[chunk];
+        const char *line;
+        int length, n = chunk_first[chunk];
+        while ((line = text_file_next_line(&input, &position, chunk_starts[chunk + 1], &length)) != NULL) {
+            if (!orbitalElements_comets_isComet(line, length)) continue;
+            if (n >= comet_count) break;
+            orbitalElements_comets_parseLine(line, length, n++);
+        }
     }
-    fclose(input);
+    text_file_close(&input);
 
     if (DEBUG) {
         sprintf(temp_err_string, "Comet count                  = %7d", comet_count);
@@ -721,60 +1266,56 @@ void orbitalElements_comets_readAsciiData() {
     }
 
     // Now that we've parsed the text-based version of this data, dump a binary version to make loading faster next time
-    OrbitalElements_DumpBinaryData("dcfbinary.cmt", comet_database, &comet_database_offset,
-                                   comet_count, comet_secure_count);
-
-    // Make table indicating that we have loaded all the orbital elements in this table
-    comet_database_items_loaded = (unsigned char *) lt_malloc(comet_count * sizeof(unsigned char));
-    memset(comet_database_items_loaded, 1, comet_count);
-
-    // Open a file pointer to the file
-    char filename_with_path[FNAME_LENGTH];
-    snprintf(filename_with_path, FNAME_LENGTH, "%s/%s", DATADIR, "dcfbinary.cmt");
-    comet_database_file = fopen(filename_with_path, "rb");
-    snprintf(comet_database_filename, FNAME_LENGTH, "%s", filename_with_path);
+    int index_count, hash_count;
+    orbitalElementsIndexEntry *index = orbitalElements_buildIndex(comet_names, comet_count, &index_count);
+    orbitalElementsHashEntry *hash = orbitalElements_buildHash(comet_names, index, index_count, &hash_count);
+    OrbitalElements_DumpBinaryData("dcfbinary.cmt", comet_database, comet_names, index, hash, comet_count,
+                                   comet_secure_count, index_count, hash_count, 0);
+
+    // We have already loaded all the orbital elements in this table, so serve them from memory
+    record_cache_wrap(&comet_database_records, comet_database, sizeof(orbitalElements), comet_count);
+    record_cache_wrap(&comet_names_records, comet_names, sizeof(orbitalElementsNames), comet_count);
+    if (index_count > 0) {
+        record_cache_wrap(&comet_index_records, index, sizeof(orbitalElementsIndexEntry), index_count);
+    }
+    if (hash_count > 0) {
+        record_cache_wrap(&comet_hash_records, hash, sizeof(orbitalElementsHashEntry), hash_count);
+    }
 }
 
 //! orbitalElements_planets_init - Make sure that planet orbital elements are initialised, in thread-safe fashion
 
 void orbitalElements_planets_init() {
-#pragma omp critical (planets_init)
-    {
-        if (planet_database_file == NULL) orbitalElements_planets_readAsciiData();
-    }
+    pthread_once(&planet_database_init, orbitalElements_planets_readAsciiData);
 }
 
 //! orbitalElements_planets_fetch - Fetch the orbitalElements record for bodyId <index>. If needed, load them from disk.
 //! \param index - The bodyId of the object whose orbital elements are to be loaded
 //! \return - An orbitalElements structure for bodyId
 
-orbitalElements *orbitalElements_planets_fetch(int index) {
+const orbitalElements *orbitalElements_planets_fetch(int index) {
     // Check that request is within allowed range
-    if ((index < 0) || (index > planet_count)) return NULL;
+    if ((index < 0) || (index >= planet_count)) return NULL;
 
-    // If we have already loaded these orbital elements, we can return a pointer immediately
-    if (planet_database_items_loaded[index]) return &planet_database[index];
+    // Return a pointer to these orbital elements, loading them from disk if this is the first time they're needed
+    return (const orbitalElements *) record_cache_fetch(&planet_database_records, index);
+}
 
-#pragma omp critical (planets_fetch)
-    {
-        // If not, then read them from disk now
-        long data_position_needed = planet_database_offset + index * sizeof(orbitalElements);
-        fseek(planet_database_file, data_position_needed, SEEK_SET);
-        dcf_fread((void *) &planet_database[index], sizeof(orbitalElements), 1, planet_database_file,
-                  planet_database_filename, __FILE__, __LINE__);
-        planet_database_items_loaded[index] = 1;
-    }
+//! orbitalElements_planets_fetchNames - Fetch the names of bodyId <index>. If needed, load them from disk.
+//! \param index - The bodyId of the object whose names are to be loaded
+//! \return - An orbitalElementsNames structure for bodyId
+
+const orbitalElementsNames *orbitalElements_planets_fetchNames(int index) {
+    // Check that request is within allowed range
+    if ((index < 0) || (index >= planet_count)) return NULL;
 
-    return &planet_database[index];
+    return (const orbitalElementsNames *) record_cache_fetch(&planet_names_records, index);
 }
 
 //! orbitalElements_asteroids_init - Make sure that asteroid orbital elements are initialised, in thread-safe fashion
 
 void orbitalElements_asteroids_init() {
-#pragma omp critical (asteroids_init)
-    {
-        if (asteroid_database_file == NULL) orbitalElements_asteroids_readAsciiData();
-    }
+    pthread_once(&asteroid_database_init, orbitalElements_asteroids_readAsciiData);
 }
 
 //! orbitalElements_asteroids_fetch - Fetch the orbitalElements record for bodyId (10000000 + index). If needed, load
@@ -782,33 +1323,30 @@ void orbitalElements_asteroids_init() {
 //! \param index - The index of the object whose orbital elements are to be loaded (bodyId = 10000000 + index)
 //! \return - An orbitalElements structure for bodyId
 
-orbitalElements *orbitalElements_asteroids_fetch(int index) {
+const orbitalElements *orbitalElements_asteroids_fetch(int index) {
     // Check that request is within allowed range
-    if ((index < 0) || (index > asteroid_count)) return NULL;
+    if ((index < 0) || (index >= asteroid_count)) return NULL;
+
+    // Return a pointer to these orbital elements, loading them from disk if this is the first time they're needed
+    return (const orbitalElements *) record_cache_fetch(&asteroid_database_records, index);
+}
 
-    // If we have already loaded these orbital elements, we can return a pointer immediately
-    if (asteroid_database_items_loaded[index]) return &asteroid_database[index];
+//! orbitalElements_asteroids_fetchNames - Fetch the names of bodyId (10000000 + index). If needed, load them from
+//! disk.
+//! \param index - The index of the object whose names are to be loaded (bodyId = 10000000 + index)
+//! \return - An orbitalElementsNames structure for bodyId
 
-#pragma omp critical (asteroids_fetch)
-    {
-        // If not, then read them from disk now
-        long data_position_needed = asteroid_database_offset + index * sizeof(orbitalElements);
-        fseek(asteroid_database_file, data_position_needed, SEEK_SET);
-        dcf_fread((void *) &asteroid_database[index], sizeof(orbitalElements), 1, asteroid_database_file,
-                  asteroid_database_filename, __FILE__, __LINE__);
-        asteroid_database_items_loaded[index] = 1;
-    }
+const orbitalElementsNames *orbitalElements_asteroids_fetchNames(int index) {
+    // Check that request is within allowed range
+    if ((index < 0) || (index >= asteroid_count)) return NULL;
 
-    return &asteroid_database[index];
+    return (const orbitalElementsNames *) record_cache_fetch(&asteroid_names_records, index);
 }
 
 //! orbitalElements_comets_init - Make sure that comet orbital elements are initialised, in thread-safe fashion
 
 void orbitalElements_comets_init() {
-#pragma omp critical (comets_init)
-    {
-        if (comet_database_file == NULL) orbitalElements_comets_readAsciiData();
-    }
+    pthread_once(&comet_database_init, orbitalElements_comets_readAsciiData);
 }
 
 //! orbitalElements_comets_fetch - Fetch the orbitalElements record for bodyId (20000000 + index). If needed, load
@@ -816,92 +1354,433 @@ void orbitalElements_comets_init() {
 //! \param index - The index of the object whose orbital elements are to be loaded (bodyId = 20000000 + index)
 //! \return - An orbitalElements structure for bodyId
 
-orbitalElements *orbitalElements_comets_fetch(int index) {
+const orbitalElements *orbitalElements_comets_fetch(int index) {
     // Check that request is within allowed range
-    if ((index < 0) || (index > comet_count)) return NULL;
+    if ((index < 0) || (index >= comet_count)) return NULL;
 
-    // If we have already loaded these orbital elements, we can return a pointer immediately
-    if (comet_database_items_loaded[index]) return &comet_database[index];
+    // Return a pointer to these orbital elements, loading them from disk if this is the first time they're needed
+    return (const orbitalElements *) record_cache_fetch(&comet_database_records, index);
+}
 
-#pragma omp critical (comets_fetch)
-    {
-        // If not, then read them from disk now
-        long data_position_needed = comet_database_offset + index * sizeof(orbitalElements);
-        fseek(comet_database_file, data_position_needed, SEEK_SET);
-        dcf_fread((void *) &comet_database[index], sizeof(orbitalElements), 1, comet_database_file,
-                  comet_database_filename, __FILE__, __LINE__);
-        comet_database_items_loaded[index] = 1;
+//! orbitalElements_comets_fetchNames - Fetch the names of bodyId (20000000 + index). If needed, load them from disk.
+//! \param index - The index of the object whose names are to be loaded (bodyId = 20000000 + index)
+//! \return - An orbitalElementsNames structure for bodyId
+
+const orbitalElementsNames *orbitalElements_comets_fetchNames(int index) {
+    // Check that request is within allowed range
+    if ((index < 0) || (index >= comet_count)) return NULL;
+
+    return (const orbitalElementsNames *) record_cache_fetch(&comet_names_records, index);
+}
+
+//! orbitalElements_hasPrefix - Test whether a name begins with a particular prefix, ignoring case in the same way as
+//! <str_cmp_no_case>
+//! \param [in] name - The name to test
+//! \param [in] prefix - The prefix to look for
+//! \return - Boolean flag indicating whether <name> begins with <prefix>
+
+static int orbitalElements_hasPrefix(const char *name, const char *prefix) {
+    for (; *prefix != '\0'; name++, prefix++) {
+        const char a = ((*name >= 'a') && (*name <= 'z')) ? (char) (*name - 'a' + 'A') : *name;
+        const char b = ((*prefix >= 'a') && (*prefix <= 'z')) ? (char) (*prefix - 'a' + 'A') : *prefix;
+        if (a != b) return 0;
     }
+    return 1;
+}
 
-    return &comet_database[index];
+//! orbitalElements_lowerBound - Binary search an index of names for the first entry which is not alphabetically
+//! before <name>
+//! \param [in] names - Record cache for the table of objects' names
+//! \param [in] index - Record cache for the index of names
+//! \param [in] name - The name to search for
+//! \return - The position within the index of the first entry not before <name>; the length of the index if none
+
+static int orbitalElements_lowerBound(record_cache *names, record_cache *index, const char *name) {
+    int lower = 0, upper = index->record_count;
+    while (lower < upper) {
+        const int middle = lower + (upper - lower) / 2;
+        const orbitalElementsIndexEntry *entry = (const orbitalElementsIndexEntry *) record_cache_fetch(index, middle);
+        const orbitalElementsNames *item = (const orbitalElementsNames *) record_cache_fetch(names, entry->record);
+        if (str_cmp_no_case(entry->field ? item->name2 : item->name, name) < 0) {
+            lower = middle + 1;
+        } else {
+            upper = middle;
+        }
+    }
+    return lower;
 }
 
-//! orbitalElements_computeXYZ - Main orbital elements computer. Return 3D position in ICRF, in AU, relative to the
-//! Sun (not the solar system barycentre!!). z-axis points towards the J2000.0 north celestial pole.
-//! \param [in] body_id - The id number of the object whose position is being queried
-//! \param [in] jd - The Julian day number at which the object's position is wanted; TT
-//! \param [out] x - The x position of the object relative to the Sun (in AU; ICRF; points to RA=0)
-//! \param [out] y - The y position of the object relative to the Sun (in AU; ICRF; points to RA=6h)
-//! \param [out] z - The z position of the object relative to the Sun (in AU; ICRF; points to NCP)
+//! orbitalElements_findName - Search a table of objects for one with a particular name, ignoring case. If the table has
+//! a hash table of names, we look the name up directly, touching only one or two records. Failing that, if it has an
+//! index of names, we binary search it. Otherwise we check every object in turn.
+//! \param [in] names - Record cache for the table of objects' names
+//! \param [in] index - Record cache for the index of names (may be empty)
+//! \param [in] hash - Record cache for the hash table of names (may be empty)
+//! \param [in] name - The name to search for; this may match either of the object's names
+//! \return - The index of the first object with this name, or -1 if there is none
 
-void orbitalElements_computeXYZ(int body_id, double jd, double *x, double *y, double *z) {
-    orbitalElements *orbital_elements;
+static int orbitalElements_findName(record_cache *names, record_cache *index, record_cache *hash, const char *name) {
+    int i;
 
-    double v, r;
+    if (hash->record_count > 0) {
+        const uint32_t name_hash = orbitalElements_hashName(name);
+        const int mask = hash->record_count - 1;
+        for (i = (int) (name_hash & (uint32_t) mask); ; i = (i + 1) & mask) {
+            const orbitalElementsHashEntry *slot = (const orbitalElementsHashEntry *) record_cache_fetch(hash, i);
+            if (slot->entry < 0) return -1;
+            if (slot->hash != name_hash) continue;
+            const orbitalElementsIndexEntry *entry =
+                    (const orbitalElementsIndexEntry *) record_cache_fetch(index, slot->entry);
+            const orbitalElementsNames *item = (const orbitalElementsNames *) record_cache_fetch(names, entry->record);
+            if (str_cmp_no_case(entry->field ? item->name2 : item->name, name) == 0) return entry->record;
+        }
+    }
 
-    // const double epsilon = (23.4393 - 3.563E-7 * (jd - 2451544.5)) * M_PI / 180;
+    if (index->record_count == 0) {
+        for (i = 0; i < names->record_count; i++) {
+            const orbitalElementsNames *item = (const orbitalElementsNames *) record_cache_fetch(names, i);
+            if ((str_cmp_no_case(name, item->name) == 0) || (str_cmp_no_case(name, item->name2) == 0)) return i;
+        }
+        return -1;
+    }
 
-    // Case 1: Object is a planet
-    if (body_id < 10000000) {
-        // Planets occupy body numbers 1-19
-        const int index = body_id;
+    // Find the first entry in the index which is not alphabetically before <name>, and check whether it matches
+    const int position = orbitalElements_lowerBound(names, index, name);
+    if (position >= index->record_count) return -1;
+    const orbitalElementsIndexEntry *entry = (const orbitalElementsIndexEntry *) record_cache_fetch(index, position);
+    const orbitalElementsNames *item = (const orbitalElementsNames *) record_cache_fetch(names, entry->record);
+    if (str_cmp_no_case(entry->field ? item->name2 : item->name, name) != 0) return -1;
+    return entry->record;
+}
+
+//! orbitalElements_findPrefix - Search a table of objects for all those with a name beginning with a particular
+//! prefix, ignoring case. Objects are listed in alphabetical order of the name which matched, and objects with two
+//! matching names are listed twice. If the table has no index of names, nothing is found.
+//! \param [in] names - Record cache for the table of objects' names
+//! \param [in] index - Record cache for the index of names (may be empty)
+//! \param [in] prefix - The prefix to search for
+//! \param [out] indices - Array into which to write the indices of the objects found
+//! \param [in] max_count - The length of the array <indices>
+//! \return - The number of objects written to <indices>
+
+static int orbitalElements_findPrefix(record_cache *names, record_cache *index, const char *prefix, int *indices,
+                                      int max_count) {
+    int count = 0;
+    for (int position = orbitalElements_lowerBound(names, index, prefix);
+         (position < index->record_count) && (count < max_count); position++) {
+        const orbitalElementsIndexEntry *entry = (const orbitalElementsIndexEntry *) record_cache_fetch(index, position);
+        const orbitalElementsNames *item = (const orbitalElementsNames *) record_cache_fetch(names, entry->record);
+        if (!orbitalElements_hasPrefix(entry->field ? item->name2 : item->name, prefix)) break;
+        indices[count++] = entry->record;
+    }
+    return count;
+}
+
+//! orbitalElements_planets_findName - Search for a planet by name, ignoring case
+//! \param [in] name - The name to search for
+//! \return - The bodyId of the planet, or -1 if there is none
+
+int orbitalElements_planets_findName(const char *name) {
+    orbitalElements_planets_init();
+    return orbitalElements_findName(&planet_names_records, &planet_index_records, &planet_hash_records, name);
+}
+
+//! orbitalElements_asteroids_findName - Search for an asteroid by name, ignoring case
+//! \param [in] name - The name to search for
+//! \return - The index of the asteroid (bodyId = 10000000 + index), or -1 if there is none
 
+int orbitalElements_asteroids_findName(const char *name) {
+    orbitalElements_asteroids_init();
+    return orbitalElements_findName(&asteroid_names_records, &asteroid_index_records, &asteroid_hash_records, name);
+}
+
+//! orbitalElements_comets_findName - Search for a comet by name or by MPC designation, ignoring case
+//! \param [in] name - The name to search for
+//! \return - The index of the comet (bodyId = 20000000 + index), or -1 if there is none
+
+int orbitalElements_comets_findName(const char *name) {
+    orbitalElements_comets_init();
+    return orbitalElements_findName(&comet_names_records, &comet_index_records, &comet_hash_records, name);
+}
+
+//! orbitalElements_planets_findPrefix - Search for all the planets whose names begin with a prefix, ignoring case
+//! \param [in] prefix - The prefix to search for
+//! \param [out] indices - Array into which to write the bodyIds of the planets found
+//! \param [in] max_count - The length of the array <indices>
+//! \return - The number of planets written to <indices>
+
+int orbitalElements_planets_findPrefix(const char *prefix, int *indices, int max_count) {
+    orbitalElements_planets_init();
+    return orbitalElements_findPrefix(&planet_names_records, &planet_index_records, prefix, indices, max_count);
+}
+
+//! orbitalElements_asteroids_findPrefix - Search for all the asteroids whose names begin with a prefix, ignoring case
+//! \param [in] prefix - The prefix to search for
+//! \param [out] indices - Array into which to write the indices of the asteroids found (bodyId = 10000000 + index)
+//! \param [in] max_count - The length of the array <indices>
+//! \return - The number of asteroids written to <indices>
+
+int orbitalElements_asteroids_findPrefix(const char *prefix, int *indices, int max_count) {
+    orbitalElements_asteroids_init();
+    return orbitalElements_findPrefix(&asteroid_names_records, &asteroid_index_records, prefix, indices, max_count);
+}
+
+//! orbitalElements_comets_findPrefix - Search for all the comets whose names or MPC designations begin with a prefix,
+//! ignoring case
+//! \param [in] prefix - The prefix to search for
+//! \param [out] indices - Array into which to write the indices of the comets found (bodyId = 20000000 + index)
+//! \param [in] max_count - The length of the array <indices>
+//! \return - The number of comets written to <indices>
+
+int orbitalElements_comets_findPrefix(const char *prefix, int *indices, int max_count) {
+    orbitalElements_comets_init();
+    return orbitalElements_findPrefix(&comet_names_records, &comet_index_records, prefix, indices, max_count);
+}
+
+//! The bodies which may be referred to by NAIF-style numbers, e.g. <p5> for Jupiter, and the bodies which are
+//! computed from DE430 rather than from orbital elements, so that they do not appear by name in <data/planets.dat>
+
+static const struct {
+    const char *name;
+    int body_id;
+} orbitalElements_bodyAliases[] = {
+        {"p1",   0},
+        {"p2",   1},
+        {"p3",   19},
+        {"p4",   3},
+        {"p5",   4},
+        {"p6",   5},
+        {"p7",   6},
+        {"p8",   7},
+        {"p9",   8},
+        {"p301", 9},
+        {"moon", 9},
+        {"sun",  10}
+};
+
+//! orbitalElements_bodyName - Fetch the name of any object, loading its catalogue if necessary. This is the inverse
+//! of <orbitalElements_findBody>, for objects which have names.
+//! \param [in] body_id - The id number of the object
+//! \return - The object's name, or NULL if it has none
+
+const char *orbitalElements_bodyName(int body_id) {
+    const orbitalElementsNames *names = NULL;
+
+    if (body_id < 10000000) {
         orbitalElements_planets_init();
+        if (planet_database != NULL) names = orbitalElements_planets_fetchNames(body_id);
+    } else if (body_id < 20000000) {
+        orbitalElements_asteroids_init();
+        if (asteroid_database != NULL) names = orbitalElements_asteroids_fetchNames(body_id - 10000000);
+    } else {
+        orbitalElements_comets_init();
+        if (comet_database != NULL) names = orbitalElements_comets_fetchNames(body_id - 20000000);
+    }
+    if ((names != NULL) && (strcmp(names->name, ORBITAL_ELEMENTS_NO_NAME) != 0)) return names->name;
+
+    // The Sun and the Moon are not in the catalogue of planets, but have aliases
+    for (int i = 0; i < (int) (sizeof(orbitalElements_bodyAliases) / sizeof(orbitalElements_bodyAliases[0])); i++) {
+        if ((orbitalElements_bodyAliases[i].body_id == body_id) && (orbitalElements_bodyAliases[i].name[0] != 'p')) {
+            return orbitalElements_bodyAliases[i].name;
+        }
+    }
+    return NULL;
+}
+
+//! Whether a catalogue of asteroids is installed, as determined once by <orbitalElements_asteroids_checkAvailable>
+static int orbitalElements_asteroids_installed = 0;
+static pthread_once_t orbitalElements_asteroids_checked = PTHREAD_ONCE_INIT;
+
+//! orbitalElements_asteroids_checkAvailable - Check whether either <data/dcfbinary.ast> or <data/astorb.dat> exists
 
-        // Return NaN if object is not in database
-        if ((planet_database_file == NULL) || (index >= planet_count)) {
-            *x = *y = *z = GSL_NAN;
+static void orbitalElements_asteroids_checkAvailable() {
+    const char *filenames[2] = {"dcfbinary.ast", "astorb.dat"};
+    char filename_with_path[FNAME_LENGTH];
+
+    for (int i = 0; i < 2; i++) {
+        snprintf(filename_with_path, FNAME_LENGTH, "%s/%s", DATADIR, filenames[i]);
+        FILE *input = fopen(filename_with_path, "rb");
+        if (input != NULL) {
+            fclose(input);
+            orbitalElements_asteroids_installed = 1;
             return;
         }
+    }
+}
+
+//! orbitalElements_asteroids_available - Check whether we have a catalogue of asteroids to search, without treating
+//! its absence as fatal in the way that <orbitalElements_asteroids_init> does
+//! \return - Boolean flag indicating whether a catalogue of asteroids is installed
+
+static int orbitalElements_asteroids_available() {
+    pthread_once(&orbitalElements_asteroids_checked, orbitalElements_asteroids_checkAvailable);
+    return orbitalElements_asteroids_installed;
+}
 
-        // Fetch data from the binary database file
-        orbital_elements = orbitalElements_planets_fetch(index);
+//! orbitalElements_findBody - Convert the name of any solar system object into a bodyId, ignoring case. We accept:
+//! * The names of planets, the Sun and the Moon, optionally prefixed with <p>, e.g. <jupiter> or <pjupiter>
+//! * NAIF-style numbers, e.g. <p5> for Jupiter or <p301> for the Moon
+//! * <A> followed by an asteroid number, e.g. <A433>, or <C> followed by the position of a comet in Soft00Cmt.txt
+//! * The names or MPC designations of comets, e.g. <C/2022 E3> or <CK22E030>, or numbered periodic comets, e.g. <1P>
+//! * The names of asteroids, or a bare asteroid number, e.g. <433>, if a catalogue of asteroids is installed
+//! \param [in] name - The name to search for
+//! \return - The bodyId of the object, or -1 if there is none
+
+int orbitalElements_findBody(const char *name) {
+    int i, index;
+
+    // The Sun, the Moon, and NAIF-style numbers
+    for (i = 0; i < (int) (sizeof(orbitalElements_bodyAliases) / sizeof(orbitalElements_bodyAliases[0])); i++) {
+        if (str_cmp_no_case(name, orbitalElements_bodyAliases[i].name) == 0) return orbitalElements_bodyAliases[i].body_id;
+        if (((name[0] == 'p') || (name[0] == 'P')) &&
+            (str_cmp_no_case(name + 1, orbitalElements_bodyAliases[i].name) == 0) &&
+            (orbitalElements_bodyAliases[i].name[0] != 'p')) {
+            return orbitalElements_bodyAliases[i].body_id;
+        }
     }
 
-        // Case 2: Object is an asteroid
-    else if (body_id < 20000000) {
-        // Asteroids occupy body numbers 1e7 - 2e7
-        const int index = body_id - 10000000;
+    // Planets, whose names may be prefixed with <p>
+    index = orbitalElements_planets_findName(name);
+    if ((index < 0) && ((name[0] == 'p') || (name[0] == 'P'))) index = orbitalElements_planets_findName(name + 1);
+    if (index >= 0) return index;
 
-        orbitalElements_asteroids_init();
+    // Asteroids and comets referred to by number
+    if (((name[0] == 'a') || (name[0] == 'A')) && valid_float(name + 1, NULL)) {
+        return 10000000 + (int) get_float(name + 1, NULL);
+    }
+    if (((name[0] == 'c') || (name[0] == 'C')) && valid_float(name + 1, NULL)) {
+        return 20000000 + (int) get_float(name + 1, NULL);
+    }
 
-        // Return NaN if object is not in database
-        if ((asteroid_database_file == NULL) || (index >= asteroid_count)) {
-            *x = *y = *z = GSL_NAN;
-            return;
+    // Comets, by name or designation
+    index = orbitalElements_comets_findName(name);
+    if (index >= 0) return 20000000 + index;
+
+    // Numbered periodic comets, e.g. <1P>, whose MPC designations are zero padded, e.g. <0001P>
+    const size_t length = strlen(name);
+    if ((length > 1) && (length <= 5) && ((name[length - 1] == 'p') || (name[length - 1] == 'P'))) {
+        char designation[8];
+        int all_digits = 1;
+        for (i = 0; i < (int) length - 1; i++) all_digits = all_digits && (name[i] >= '0') && (name[i] <= '9');
+        if (all_digits) {
+            snprintf(designation, sizeof(designation), "%04dP", atoi(name));
+            index = orbitalElements_comets_findName(designation);
+            if (index >= 0) return 20000000 + index;
         }
+    }
 
-        // Fetch data from the binary database file
-        orbital_elements = orbitalElements_asteroids_fetch(index);
+    // Asteroids, by name or number, if we have a catalogue of them
+    if (orbitalElements_asteroids_available()) {
+        index = orbitalElements_asteroids_findName(name);
+        if (index >= 0) return 10000000 + index;
+        if (valid_float(name, NULL)) {
+            index = (int) get_float(name, NULL);
+            if ((index == get_float(name, NULL)) && (orbitalElements_asteroids_fetch(index) != NULL) &&
+                (orbitalElements_asteroids_fetch(index)->number == index)) {
+                return 10000000 + index;
+            }
+        }
+    }
+
+    return -1;
+}
+
+//! orbitalElements_findBodiesByPrefix - Search the catalogues of planets, comets and (if installed) asteroids for all
+//! the objects with a name or designation beginning with a prefix, ignoring case. This is intended for completing the
+//! names of objects as they are typed.
+//! \param [in] prefix - The prefix to search for
+//! \param [out] body_ids - Array into which to write the bodyIds of the objects found
+//! \param [in] max_count - The length of the array <body_ids>
+//! \return - The number of objects written to <body_ids>
+
+int orbitalElements_findBodiesByPrefix(const char *prefix, int *body_ids, int max_count) {
+    int i, count;
+
+    count = orbitalElements_planets_findPrefix(prefix, body_ids, max_count);
+
+    const int comets_found = orbitalElements_comets_findPrefix(prefix, body_ids + count, max_count - count);
+    for (i = 0; i < comets_found; i++) body_ids[count + i] += 20000000;
+    count += comets_found;
+
+    if (orbitalElements_asteroids_available()) {
+        const int asteroids_found = orbitalElements_asteroids_findPrefix(prefix, body_ids + count, max_count - count);
+        for (i = 0; i < asteroids_found; i++) body_ids[count + i] += 10000000;
+        count += asteroids_found;
+    }
+    return count;
+}
+
+//! orbitalElements_fetchBody - Fetch the orbital elements of any object, loading its catalogue if necessary
+//! \param [in] body_id - The id number of the object
+//! \return - The object's orbital elements, or NULL if it is not in its catalogue
+
+const orbitalElements *orbitalElements_fetchBody(int body_id) {
+    // Case 1: Object is a planet
+    if (body_id < 10000000) {
+        // Planets occupy body numbers 1-19
+        orbitalElements_planets_init();
+        if (planet_database == NULL) return NULL;
+        return orbitalElements_planets_fetch(body_id);
+    }
+
+        // Case 2: Object is an asteroid
+    else if (body_id < 20000000) {
+        // Asteroids occupy body numbers 1e7 - 2e7
+        orbitalElements_asteroids_init();
+        if (asteroid_database == NULL) return NULL;
+        return orbitalElements_asteroids_fetch(body_id - 10000000);
     }
 
         // Case 3: Object is a comet
     else {
         // Comets occupy body numbers 2e7 - 3e7
-        const int index = body_id - 20000000;
-
         orbitalElements_comets_init();
+        if (comet_database == NULL) return NULL;
+        return orbitalElements_comets_fetch(body_id - 20000000);
+    }
+}
 
-        // Return NaN if object is not in database
-        if ((comet_database_file == NULL) || (index >= comet_count)) {
-            *x = *y = *z = GSL_NAN;
-            return;
-        }
+//! orbitalElements_computeXYZ - Main orbital elements computer. Return 3D position in ICRF, in AU, relative to the
+//! Sun (not the solar system barycentre!!). z-axis points towards the J2000.0 north celestial pole.
+//! \param [in] body_id - The id number of the object whose position is being queried
+//! \param [in] jd - The Julian day number at which the object's position is wanted; TT
+//! \param [out] x - The x position of the object relative to the Sun (in AU; ICRF; points to RA=0)
+//! \param [out] y - The y position of the object relative to the Sun (in AU; ICRF; points to RA=6h)
+//! \param [out] z - The z position of the object relative to the Sun (in AU; ICRF; points to NCP)
+
+void orbitalElements_computeXYZ(int body_id, double jd, double *x, double *y, double *z) {
+    // Fetch data from the binary database file
+    const orbitalElements *orbital_elements = orbitalElements_fetchBody(body_id);
+
+    // Return NaN if object is not in database
+    if (orbital_elements == NULL) {
+        *x = *y = *z = GSL_NAN;
+        return;
+    }
 
-        // Fetch data from the binary database file
-        orbital_elements = orbitalElements_comets_fetch(index);
+    // When debugging, show intermediate calculation
+    if (DEBUG) {
+        sprintf(temp_err_string, "Object ID = %d", body_id);
+        ephem_log(temp_err_string);
     }
 
+    orbitalElements_propagate(orbital_elements, jd, x, y, z);
+}
+
+//! orbitalElements_propagate - Compute the 3D position of an object from its orbital elements, in ICRF, in AU,
+//! relative to the Sun. z-axis points towards the J2000.0 north celestial pole. Near-parabolic and hyperbolic orbits
+//! are handed to <orbitalElements_propagateUniversal>. Elliptic orbits are still solved by Newton's method on the
+//! eccentric anomaly, which handles the planets, whose elements drift with time, directly from their mean anomalies,
+//! and keeps the positions of planets and asteroids exactly as they were. <keplerBatch_compute>, which computes many
+//! objects with fixed elements at once, solves all of them in universal variables instead, whatever their
+//! eccentricity.
+//! \param [in] orbital_elements - The object's orbital elements
+//! \param [in] jd - The Julian day number at which the object's position is wanted; TT
+//! \param [out] x - The x position of the object relative to the Sun (in AU; ICRF; points to RA=0)
+//! \param [out] y - The y position of the object relative to the Sun (in AU; ICRF; points to RA=6h)
+//! \param [out] z - The z position of the object relative to the Sun (in AU; ICRF; points to NCP)
+
+void orbitalElements_propagate(const orbitalElements *orbital_elements, double jd, double *x, double *y, double *z) {
     // Extract orbital elements from structure
     const double offset_from_epoch = jd - orbital_elements->epochOsculation;
     const double a = orbital_elements->semiMajorAxis + orbital_elements->semiMajorAxis_dot * offset_from_epoch;
@@ -921,86 +1800,51 @@ void orbitalElements_computeXYZ(int body_id, double jd, double *x, double *y, do
 
     // When debugging, show intermediate calculation
     if (DEBUG) {
-        sprintf(temp_err_string, "Object ID = %d", body_id);
-        ephem_log(temp_err_string);
         sprintf(temp_err_string, "JD = %.5f", jd);
         ephem_log(temp_err_string);
     }
 
-    if (e > 1.02) {
-        // Hyperbolic orbit
-        // See <https://stjarnhimlen.se/comp/ppcomp.html> section 20
-
-        const double M_hyperbolic = (jd - orbital_elements->epochPerihelion) * mean_motion * 24 * 3600;
+    // Near-parabolic and hyperbolic orbits are propagated in universal variables, which remain exact as the
+    // eccentricity passes through one, unlike the series approximation in <https://stjarnhimlen.se/comp/ppcomp.html>
+    // section 19, and which converge at any distance from perihelion, unlike the iteration on the hyperbolic anomaly
+    // in section 20
+    if (e >= 0.98) {
+        orbitalElements_propagateUniversal(orbital_elements, jd, x, y, z);
+        return;
+    }
 
-        double F0, F1, ratio = 0.5;
+    // Elliptic orbit
+    int j;
+    double E0, E1, delta_E = 1;
+    E0 = M + e * sin(M);
+
+    // Iteratively solve inverse Kepler's equation for eccentric anomaly
+    for (j = 0; ((j < 100) && (fabs(delta_E) > 1e-12)); j++) {
+        // See Explanatory Supplement to the Astronomical Almanac, eq 8.37
+        const double delta_M = M - (E0 - e * sin(E0));
+        delta_E = delta_M / (1 - e * cos(E0));
+        E1 = E0 + delta_E;
+        E0 = E1;
+    }
 
-        // Initial guess
-        F0 = M_hyperbolic;
+    const double xv = a * (cos(E0) - e);
+    const double yv = a * (sqrt(1 - gsl_pow_2(e)) * sin(E0));
 
-        // Iteratively solve Kepler's equation
-        for (int j = 0; ((j < 100) && (ratio > 1e-12)); j++) {
-            F1 = (M_hyperbolic + e * (F0 * cosh(F0) - sinh(F0))) / (e * cosh(F0) - 1); // Newton's method
-            ratio = fabs(F1 / F0);
-            if (ratio < 1) ratio = 1 / ratio;
-            ratio -= 1;
-            F0 = F1;
-        }
+    const double v = atan2(yv, xv);
+    const double r = sqrt(gsl_pow_2(xv) + gsl_pow_2(yv));
 
-        v = 2 * atan(sqrt((e + 1) / (e - 1)) * tanh(F0 / 2));
-        r = a * (1 - e * e) / (1 + e * cos(v));
-    } else if (e < 0.98) {
-        int j;
-        double E0, E1, delta_E = 1;
-        E0 = M + e * sin(M);
-
-        // Iteratively solve inverse Kepler's equation for eccentric anomaly
-        for (j = 0; ((j < 100) && (fabs(delta_E) > 1e-12)); j++) {
-            // See Explanatory Supplement to the Astronomical Almanac, eq 8.37
-            const double delta_M = M - (E0 - e * sin(E0));
-            delta_E = delta_M / (1 - e * cos(E0));
-            E1 = E0 + delta_E;
-            E0 = E1;
-        }
-
-        const double xv = a * (cos(E0) - e);
-        const double yv = a * (sqrt(1 - gsl_pow_2(e)) * sin(E0));
-
-        v = atan2(yv, xv);
-        r = sqrt(gsl_pow_2(xv) + gsl_pow_2(yv));
-
-        // When debugging, show intermediate calculation
-        if (DEBUG) {
-            sprintf(temp_err_string, "E0 = %.10f deg", E0 * 180 / M_PI);
-            ephem_log(temp_err_string);
-            sprintf(temp_err_string, "delta_E = %.10e deg", delta_E * 180 / M_PI);
-            ephem_log(temp_err_string);
-            sprintf(temp_err_string, "xv = %.10f km", xv * ORBIT_CONST_ASTRONOMICAL_UNIT / 1e3);
-            ephem_log(temp_err_string);
-            sprintf(temp_err_string, "yv = %.10f km", yv * ORBIT_CONST_ASTRONOMICAL_UNIT / 1e3);
-            ephem_log(temp_err_string);
-            sprintf(temp_err_string, "j = %d iterations", j);
-            ephem_log(temp_err_string);
-        }
-    } else {
-        // Near-parabolic orbit
-        // See <https://stjarnhimlen.se/comp/ppcomp.html> section 19
-
-        const double k = 0.01720209895;
-        const double q = a * (1 - e);
-        const double ddt = (jd - orbital_elements->epochPerihelion);
-        const double A = 0.75 * ddt * k * sqrt((1 + e) / (gsl_pow_3(q)));
-        const double B = sqrt(1 + A * A);
-        const double W = pow(B + A, 0.333333333) - pow(B - A, 0.33333333);
-        const double F = (1 - e) / (1 + e);
-        const double A1 = (2. / 3) + (2. / 5) * gsl_pow_2(W);
-        const double A2 = (7. / 5) + (33. / 35) * gsl_pow_2(W) + (37. / 175) * gsl_pow_4(W);
-        const double A3 = gsl_pow_2(W) * ((432. / 175) + (956. / 1125) * gsl_pow_2(W) + (84. / 1575) * gsl_pow_4(W));
-        const double C = gsl_pow_2(W) / (1 + gsl_pow_2(W));
-        const double G = F * gsl_pow_2(C);
-        const double w = W * (1 + F * C * (A1 + A2 * G + A3 * gsl_pow_2(G)));
-        v = 2 * atan(w);
-        r = q * (1 + gsl_pow_2(w)) / (1 + gsl_pow_2(w) * F);
+    // When debugging, show intermediate calculation
+    if (DEBUG) {
+        sprintf(temp_err_string, "E0 = %.10f deg", E0 * 180 / M_PI);
+        ephem_log(temp_err_string);
+        sprintf(temp_err_string, "delta_E = %.10e deg", delta_E * 180 / M_PI);
+        ephem_log(temp_err_string);
+        sprintf(temp_err_string, "xv = %.10f km", xv * ORBIT_CONST_ASTRONOMICAL_UNIT / 1e3);
+        ephem_log(temp_err_string);
+        sprintf(temp_err_string, "yv = %.10f km", yv * ORBIT_CONST_ASTRONOMICAL_UNIT / 1e3);
+        ephem_log(temp_err_string);
+        sprintf(temp_err_string, "j = %d iterations", j);
+        ephem_log(temp_err_string);
     }
 
     // Position of object relative to the Sun, in ecliptic coordinates (Eq 8.34)
@@ -1039,13 +1883,174 @@ void orbitalElements_computeXYZ(int body_id, double jd, double *x, double *y, do
     }
 }
 
+//! orbitalElements_universalSetup - Work out the quantities needed to propagate an object in universal variables,
+//! with <universalKepler_solve>. For objects whose elements change with time (i.e. planets), these are only valid
+//! close to the Julian date given; otherwise they are valid at all times.
+//! \param [in] orbital_elements - The object's orbital elements
+//! \param [in] jd - The Julian day number at which the object's position is wanted; TT
+//! \param [out] alpha - The reciprocal of the semi-major axis (1/AU)
+//! \param [out] q - Perihelion distance (AU)
+//! \param [out] perihelion_time - The Julian date of perihelion; TT
+//! \param [out] P - 3-element array; the position at perihelion, in ICRF, relative to the Sun (AU)
+//! \param [out] Q - 3-element array; the velocity at perihelion, in ICRF (AU/day)
+
+void orbitalElements_universalSetup(const orbitalElements *orbital_elements, double jd, double *alpha, double *q,
+                                    double *perihelion_time, double *P, double *Q) {
+    const double mu = universalKepler_mu();
+
+    // Extract orbital elements from structure
+    const double offset_from_epoch = jd - orbital_elements->epochOsculation;
+    const double a = orbital_elements->semiMajorAxis + orbital_elements->semiMajorAxis_dot * offset_from_epoch;
+    const double e = orbital_elements->eccentricity + orbital_elements->eccentricity_dot * offset_from_epoch;
+    const double N = orbital_elements->longAscNode + orbital_elements->longAscNode_dot * offset_from_epoch;
+    const double inc = orbital_elements->inclination + orbital_elements->inclination_dot * offset_from_epoch;
+    const double w = orbital_elements->argumentPerihelion + (orbital_elements->argumentPerihelion_dot *
+                                                             offset_from_epoch);
+
+    // Perihelion distance. For parabolas, the semi-major axis is infinite, so we need the stored value.
+    const int fixed_shape = (orbital_elements->semiMajorAxis_dot == 0) && (orbital_elements->eccentricity_dot == 0);
+    *q = (fixed_shape && gsl_finite(orbital_elements->perihelionDistance)) ? orbital_elements->perihelionDistance :
+         a * (1 - e);
+    *alpha = (1 - e) / *q;
+
+    // Time of perihelion. Comets record this directly; for other objects, work back from the mean anomaly.
+    if (gsl_finite(orbital_elements->epochPerihelion)) {
+        *perihelion_time = orbital_elements->epochPerihelion;
+    } else {
+        const double mean_motion = sqrt(ORBIT_CONST_GM_SOLAR /
+                                        gsl_pow_3(fabs(a) * ORBIT_CONST_ASTRONOMICAL_UNIT)) * 24 * 3600;
+        const double M = orbital_elements->meanAnomaly + offset_from_epoch * mean_motion;
+        *perihelion_time = jd - M / mean_motion;
+    }
+
+    // Unit vectors towards perihelion, and 90 degrees ahead of it, in ecliptic coordinates
+    const double P_ecliptic[3] = {
+            cos(N) * cos(w) - sin(N) * sin(w) * cos(inc),
+            sin(N) * cos(w) + cos(N) * sin(w) * cos(inc),
+            sin(w) * sin(inc)
+    };
+    const double Q_ecliptic[3] = {
+            -cos(N) * sin(w) - sin(N) * cos(w) * cos(inc),
+            -sin(N) * sin(w) + cos(N) * cos(w) * cos(inc),
+            cos(w) * sin(inc)
+    };
+
+    // Transfer ecliptic coordinates into J2000.0 coordinates (i.e. ICRF), and scale them by the distance and speed
+    // at perihelion
+    const double epsilon = 23.4392794444 * M_PI / 180;
+    const double speed = sqrt(mu * (1 + e) / *q);
+    P[0] = *q * P_ecliptic[0];
+    P[1] = *q * (P_ecliptic[1] * cos(epsilon) - P_ecliptic[2] * sin(epsilon));
+    P[2] = *q * (P_ecliptic[1] * sin(epsilon) + P_ecliptic[2] * cos(epsilon));
+    Q[0] = speed * Q_ecliptic[0];
+    Q[1] = speed * (Q_ecliptic[1] * cos(epsilon) - Q_ecliptic[2] * sin(epsilon));
+    Q[2] = speed * (Q_ecliptic[1] * sin(epsilon) + Q_ecliptic[2] * cos(epsilon));
+}
+
+//! orbitalElements_propagateUniversal - Compute the 3D position of an object from its orbital elements, in ICRF, in
+//! AU, relative to the Sun, by solving Kepler's equation in universal variables. This uses the same method for
+//! elliptic, parabolic and hyperbolic orbits, and is exact for near-parabolic orbits.
+//! \param [in] orbital_elements - The object's orbital elements
+//! \param [in] jd - The Julian day number at which the object's position is wanted; TT
+//! \param [out] x - The x position of the object relative to the Sun (in AU; ICRF; points to RA=0)
+//! \param [out] y - The y position of the object relative to the Sun (in AU; ICRF; points to RA=6h)
+//! \param [out] z - The z position of the object relative to the Sun (in AU; ICRF; points to NCP)
+
+void orbitalElements_propagateUniversal(const orbitalElements *orbital_elements, double jd,
+                                        double *x, double *y, double *z) {
+    double alpha, q, perihelion_time, P[3], Q[3], f, g;
+
+    orbitalElements_universalSetup(orbital_elements, jd, &alpha, &q, &perihelion_time, P, Q);
+    universalKepler_solve(alpha, q, jd - perihelion_time, &f, &g);
+
+    *x = f * P[0] + g * Q[0];
+    *y = f * P[1] + g * Q[1];
+    *z = f * P[2] + g * Q[2];
+}
+
+//! orbitalElements_velocity - Compute the 3D velocity of an object from its orbital elements, in ICRF, in AU per day,
+//! relative to the Sun, by differentiating its two-body orbit in universal variables. For objects whose elements
+//! change with time (i.e. planets), the rates of change of the elements are differentiated too, so that the result
+//! is the rate of change of the position given by <orbitalElements_propagate>.
+//! \param [in] orbital_elements - The object's orbital elements
+//! \param [in] jd - The Julian day number at which the object's velocity is wanted; TT
+//! \param [out] vx - The x velocity of the object relative to the Sun (in AU/day; ICRF; points to RA=0)
+//! \param [out] vy - The y velocity of the object relative to the Sun (in AU/day; ICRF; points to RA=6h)
+//! \param [out] vz - The z velocity of the object relative to the Sun (in AU/day; ICRF; points to NCP)
+
+void orbitalElements_velocity(const orbitalElements *orbital_elements, double jd, double *vx, double *vy, double *vz) {
+    double alpha, q, perihelion_time, P[3], Q[3], f, g, f_dot, g_dot;
+
+    orbitalElements_universalSetup(orbital_elements, jd, &alpha, &q, &perihelion_time, P, Q);
+    universalKepler_solveState(alpha, q, jd - perihelion_time, &f, &g, &f_dot, &g_dot);
+
+    *vx = f_dot * P[0] + g_dot * Q[0];
+    *vy = f_dot * P[1] + g_dot * Q[1];
+    *vz = f_dot * P[2] + g_dot * Q[2];
+
+    const double offset_from_epoch = jd - orbital_elements->epochOsculation;
+    const double r[3] = {f * P[0] + g * Q[0], f * P[1] + g * Q[1], f * P[2] + g * Q[2]};
+    const double a_dot = orbital_elements->semiMajorAxis_dot, e_dot = orbital_elements->eccentricity_dot;
+    if (((a_dot != 0) || (e_dot != 0)) && (alpha > 0)) {
+        const double a = 1 / alpha, e = 1 - alpha * q;
+        const double b = a * sqrt(1 - e * e);
+
+        // <orbitalElements_propagate> advances the mean anomaly at the mean motion for the current semi-major axis,
+        // which itself changes with time
+        const double mean_motion_ratio = 1 - 1.5 * offset_from_epoch * a_dot / a;
+
+        // Eccentric anomaly, from the position within the plane of the orbit
+        const double Q_length = sqrt(Q[0] * Q[0] + Q[1] * Q[1] + Q[2] * Q[2]);
+        const double cos_E = f * q / a + e, sin_E = g * Q_length / b;
+
+        // Rate of change of the position within the plane of the orbit, at fixed mean anomaly, as the size and
+        // shape of the orbit change
+        const double dE_de = sin_E / (1 - e * cos_E);
+        const double dx = (a_dot / a) * f * q + e_dot * a * (-sin_E * dE_de - 1);
+        const double dy = (a_dot / a) * g * Q_length + e_dot * (-a * e * sin_E / sqrt(1 - e * e) + b * cos_E * dE_de);
+
+        *vx = *vx * mean_motion_ratio + dx * P[0] / q + dy * Q[0] / Q_length;
+        *vy = *vy * mean_motion_ratio + dx * P[1] / q + dy * Q[1] / Q_length;
+        *vz = *vz * mean_motion_ratio + dx * P[2] / q + dy * Q[2] / Q_length;
+    }
+
+    // The rate at which the orbit rotates, about the ecliptic pole, the line of nodes and the orbit's pole, in ecliptic
+    // coordinates; radians per day
+    const double N = orbital_elements->longAscNode + orbital_elements->longAscNode_dot * offset_from_epoch;
+    const double inc = orbital_elements->inclination + orbital_elements->inclination_dot * offset_from_epoch;
+    const double N_dot = orbital_elements->longAscNode_dot, inc_dot = orbital_elements->inclination_dot;
+    const double w_dot = orbital_elements->argumentPerihelion_dot;
+    if ((N_dot == 0) && (inc_dot == 0) && (w_dot == 0)) return;
+    const double omega_ecliptic[3] = {
+            inc_dot * cos(N) + w_dot * sin(inc) * sin(N),
+            inc_dot * sin(N) - w_dot * sin(inc) * cos(N),
+            N_dot + w_dot * cos(inc)
+    };
+
+    // Transfer into J2000.0 coordinates (i.e. ICRF), and add the motion of the object with the rotating orbit
+    const double epsilon = 23.4392794444 * M_PI / 180;
+    const double omega[3] = {
+            omega_ecliptic[0],
+            omega_ecliptic[1] * cos(epsilon) - omega_ecliptic[2] * sin(epsilon),
+            omega_ecliptic[1] * sin(epsilon) + omega_ecliptic[2] * cos(epsilon)
+    };
+    *vx += omega[1] * r[2] - omega[2] * r[1];
+    *vy += omega[2] * r[0] - omega[0] * r[2];
+    *vz += omega[0] * r[1] - omega[1] * r[0];
+}
+
 //! orbitalElements_computeEphemeris - Main entry point for estimating the position, brightness, etc of an object at
 //! a particular time, using orbital elements.
 //! \param [in] bodyId - The object ID number we want to query. 0=Mercury. 2=Earth/Moon barycentre. 9=Pluto. 10=Sun, etc
-//! \param [in] jd - The Julian date to query; TT
+//! \param [in] observer - The positions of the Earth and Sun at the Julian date to query, from <observerState_compute>
 //! \param [out] x - x,y,z position of body, in ICRF v2, in AU, relative to solar system barycentre.
 //! \param [out] y - x points to RA=0. y points to RA=6h.
 //! \param [out] z - z points to celestial north pole (i.e. J2000.0).
+//! \param [out] vx - x,y,z velocity of body, in ICRF v2, in AU/day, relative to solar system barycentre, at the
+//! time the light we see left it. May be NULL, along with <vy> and <vz>, if the velocity is not wanted, in which case
+//! it is not computed.
+//! \param [out] vy - y component of velocity (AU/day)
+//! \param [out] vz - z component of velocity (AU/day)
 //! \param [out] ra - Right ascension of the object (J2000.0, radians, relative to geocentre)
 //! \param [out] dec - Declination of the object (J2000.0, radians, relative to geocentre)
 //! \param [out] mag - Estimated V-band magnitude of the object
@@ -1061,36 +2066,22 @@ void orbitalElements_computeXYZ(int body_id, double jd, double *x, double *y, do
 //! \param [out] eclipticLatitude - The ecliptic latitude of the object (J2000.0 radians)
 //! \param [out] eclipticDistance - The separation of the object from the Sun, in ecliptic longitude (radians)
 //! \param [in] ra_dec_epoch - The epoch of the RA/Dec coordinates to output. Supply 2451545.0 for J2000.0.
-//! \param [in] do_topocentric_correction - Boolean indicating whether to apply topocentric correction to (ra, dec)
-//! \param [in] topocentric_latitude - Latitude (deg) of observer on Earth, if topocentric correction is applied.
-//! \param [in] topocentric_longitude - Longitude (deg) of observer on Earth, if topocentric correction is applied.
-
-void orbitalElements_computeEphemeris(int bodyId, double jd, double *x, double *y, double *z, double *ra,
-                                      double *dec, double *mag, double *phase, double *angSize, double *phySize,
-                                      double *albedo, double *sunDist, double *earthDist, double *sunAngDist,
-                                      double *theta_eso, double *eclipticLongitude, double *eclipticLatitude,
-                                      double *eclipticDistance, double ra_dec_epoch,
-                                      int do_topocentric_correction,
-                                      double topocentric_latitude, double topocentric_longitude) {
-    // Position of the Sun relative to the solar system barycentre, J2000.0 equatorial coordinates, AU
-    double sun_pos_x, sun_pos_y, sun_pos_z;
 
-    // Position of the Earth-Moon barycentre, relative to the solar system barycentre, AU
-    double EMX, EMY, EMZ;
+void orbitalElements_computeEphemeris(int bodyId, const observerState *observer, double *x, double *y, double *z,
+                                      double *vx, double *vy, double *vz, double *ra, double *dec, double *mag,
+                                      double *phase, double *angSize, double *phySize, double *albedo, double *sunDist,
+                                      double *earthDist, double *sunAngDist, double *theta_eso,
+                                      double *eclipticLongitude, double *eclipticLatitude, double *eclipticDistance,
+                                      double ra_dec_epoch) {
+    const double jd = observer->jd;
 
-    // Moon's position relative to the Earth-Moon barycentre, AU
-    double moon_pos_x, moon_pos_y, moon_pos_z;
-
-    // Earth's position relative to the solar system barycentre, J2000.0 equatorial coordinates, AU
-    double earth_pos_x, earth_pos_y, earth_pos_z;
+    // Positions of the Earth and Sun, relative to the solar system barycentre, J2000.0 equatorial coordinates, AU
+    const double *earth_pos = observer->earth_pos, *earth_vel = observer->earth_vel;
+    const double *sun_pos = observer->sun_pos, *sun_vel = observer->sun_vel;
 
     // Boolean flags indicating whether this is the Earth, Sun or Moon (which need special treatment)
     int is_moon = 0, is_earth = 0, is_sun = 0;
 
-    double EMX_future, EMY_future, EMZ_future; // Position of the Earth-Moon centre of mass
-    double moon_pos_x_future, moon_pos_y_future, moon_pos_z_future;
-    double earth_pos_x_future, earth_pos_y_future, earth_pos_z_future;
-
     // Earth: Need to convert from Earth/Moon barycentre to geocentre
     if (bodyId == 19) {
         bodyId = 2;
@@ -1107,58 +2098,40 @@ void orbitalElements_computeEphemeris(int bodyId, double jd, double *x, double *
         is_sun = 1;
     }
 
-    // Look up position of the Earth at this JD, so that we can convert XYZ coordinates relative to Sun into
-    // RA and Dec as observed from the Earth.
-    // Below are values of GM3 and GMM from DE405. See
-    // <https://web.archive.org/web/20120220062549/http://iau-comm4.jpl.nasa.gov/de405iom/de405iom.pdf>
-    const double earth_mass = 0.8887692390113509e-9;
-    const double moon_mass = 0.1093189565989898e-10;
-    const double moon_earth_mass_ratio = moon_mass / (moon_mass + earth_mass);
-
-    // Look up the Earth-Moon centre of mass position
-    jpl_computeXYZ(2, jd, &EMX, &EMY, &EMZ);
-
-    // Look up the Moon's position relative to the E-M centre of mass
-    jpl_computeXYZ(9, jd, &moon_pos_x, &moon_pos_y, &moon_pos_z);
-
-    // Calculate the position of the Earth's centre of mass
-    earth_pos_x = EMX - moon_earth_mass_ratio * moon_pos_x;
-    earth_pos_y = EMY - moon_earth_mass_ratio * moon_pos_y;
-    earth_pos_z = EMZ - moon_earth_mass_ratio * moon_pos_z;
-
-    // Look up the Sun's position, taking light travel time into account
-    {
-        jpl_computeXYZ(10, jd, &sun_pos_x, &sun_pos_y, &sun_pos_z);
-
-        // Calculate light travel time
-        const double distance = gsl_hypot3(sun_pos_x - earth_pos_x,
-                                           sun_pos_y - earth_pos_y,
-                                           sun_pos_z - earth_pos_z);  // AU
-        const double light_travel_time = distance * ORBIT_CONST_ASTRONOMICAL_UNIT / ORBIT_CONST_SPEED_OF_LIGHT;
-
-        // Look up position of requested object at the time the light left the object
-        jpl_computeXYZ(10, jd - light_travel_time / 86400, &sun_pos_x, &sun_pos_y, &sun_pos_z);
-    }
-
     // If the user's query was about the Earth, we already know its position
     if (is_earth) {
-        *x = earth_pos_x;
-        *y = earth_pos_y;
-        *z = earth_pos_z;
+        *x = earth_pos[0];
+        *y = earth_pos[1];
+        *z = earth_pos[2];
+        if (vx != NULL) {
+            *vx = earth_vel[0];
+            *vy = earth_vel[1];
+            *vz = earth_vel[2];
+        }
     }
 
         // If the user's query was about the Sun, we already know that position too
     else if (is_sun) {
-        *x = sun_pos_x;
-        *y = sun_pos_y;
-        *z = sun_pos_z;
+        *x = sun_pos[0];
+        *y = sun_pos[1];
+        *z = sun_pos[2];
+        if (vx != NULL) {
+            *vx = sun_vel[0];
+            *vy = sun_vel[1];
+            *vz = sun_vel[2];
+        }
     }
 
         // If the user's query was about the Moon, we already know that position too
     else if (is_moon) {
-        *x = moon_pos_x + earth_pos_x;
-        *y = moon_pos_y + earth_pos_y;
-        *z = moon_pos_z + earth_pos_z;
+        *x = observer->moon_pos[0] + earth_pos[0];
+        *y = observer->moon_pos[1] + earth_pos[1];
+        *z = observer->moon_pos[2] + earth_pos[2];
+        if (vx != NULL) {
+            *vx = observer->moon_vel[0] + earth_vel[0];
+            *vy = observer->moon_vel[1] + earth_vel[1];
+            *vz = observer->moon_vel[2] + earth_vel[2];
+        }
     }
 
         // Otherwise we need to use the orbital elements for the particular object the user was looking for,
@@ -1170,73 +2143,85 @@ void orbitalElements_computeEphemeris(int bodyId, double jd, double *x, double *
         orbitalElements_computeXYZ(bodyId, jd, &x_from_sun, &y_from_sun, &z_from_sun);
 
         // Convert to barycentric coordinates (to match DE430's coordinate system)
-        const double x_barycentric_0 = x_from_sun + sun_pos_x;
-        const double y_barycentric_0 = y_from_sun + sun_pos_y;
-        const double z_barycentric_0 = z_from_sun + sun_pos_z;
+        const double x_barycentric_0 = x_from_sun + sun_pos[0];
+        const double y_barycentric_0 = y_from_sun + sun_pos[1];
+        const double z_barycentric_0 = z_from_sun + sun_pos[2];
 
         // Calculate light travel time
-        const double distance = gsl_hypot3(x_barycentric_0 - earth_pos_x,
-                                           y_barycentric_0 - earth_pos_y,
-                                           z_barycentric_0 - earth_pos_z);  // AU
+        const double distance = gsl_hypot3(x_barycentric_0 - earth_pos[0],
+                                           y_barycentric_0 - earth_pos[1],
+                                           z_barycentric_0 - earth_pos[2]);  // AU
         const double light_travel_time = distance * ORBIT_CONST_ASTRONOMICAL_UNIT / ORBIT_CONST_SPEED_OF_LIGHT;
 
         // Look up position of requested object at the time the light left the object
         orbitalElements_computeXYZ(bodyId, jd - light_travel_time / 86400,
                                    &x_from_sun, &y_from_sun, &z_from_sun);
-        const double x_barycentric_1 = x_from_sun + sun_pos_x;
-        const double y_barycentric_1 = y_from_sun + sun_pos_y;
-        const double z_barycentric_1 = z_from_sun + sun_pos_z;
+        const double x_barycentric_1 = x_from_sun + sun_pos[0];
+        const double y_barycentric_1 = y_from_sun + sun_pos[1];
+        const double z_barycentric_1 = z_from_sun + sun_pos[2];
 
         // Store result
         *x = x_barycentric_1;
         *y = y_barycentric_1;
         *z = z_barycentric_1;
+
+        // If the velocity is wanted, differentiate the orbit at the time the light left the object, and add the
+        // Sun's velocity
+        if (vx != NULL) {
+            const orbitalElements *orbital_elements = orbitalElements_fetchBody(bodyId);
+            if (orbital_elements == NULL) {
+                *vx = *vy = *vz = GSL_NAN;
+            } else {
+                orbitalElements_velocity(orbital_elements, jd - light_travel_time / 86400, vx, vy, vz);
+                *vx += sun_vel[0];
+                *vy += sun_vel[1];
+                *vz += sun_vel[2];
+            }
+        }
     }
 
-    // Look up the Earth-Moon centre of mass position, a short time in the future
-    // We use this to calculate the Earth's velocity vector, which is needed to correct for aberration
+    // Equation (7.118) of the Explanatory Supplement - correct for aberration, using the Earth's velocity vector
     // (see eqn 7.119 of the Explanatory Supplement)
-    const double eb_dot_timestep = 1e-6; // days
-    const double eb_dot_timestep_sec = eb_dot_timestep * 86400;
-    jpl_computeXYZ(2, jd + eb_dot_timestep, &EMX_future, &EMY_future, &EMZ_future);
-    jpl_computeXYZ(9, jd + eb_dot_timestep, &moon_pos_x_future, &moon_pos_y_future, &moon_pos_z_future);
-    earth_pos_x_future = EMX_future - moon_earth_mass_ratio * moon_pos_x_future;
-    earth_pos_y_future = EMY_future - moon_earth_mass_ratio * moon_pos_y_future;
-    earth_pos_z_future = EMZ_future - moon_earth_mass_ratio * moon_pos_z_future;
-
-    // Equation (7.118) of the Explanatory Supplement - correct for aberration
     if (!is_earth) {
         const double u1[3] = {
-                *x - earth_pos_x,
-                *y - earth_pos_y,
-                *z - earth_pos_z
+                *x - earth_pos[0],
+                *y - earth_pos[1],
+                *z - earth_pos[2]
         };
         const double u1_mag = gsl_hypot3(u1[0], u1[1], u1[2]);
         const double u[3] = {u1[0] / u1_mag, u1[1] / u1_mag, u1[2] / u1_mag};
-        const double eb_dot[3] = {
-                earth_pos_x_future - earth_pos_x,
-                earth_pos_y_future - earth_pos_y,
-                earth_pos_z_future - earth_pos_z
-        };
 
-        // Speed of light in AU per time step
-        const double c = ORBIT_CONST_SPEED_OF_LIGHT / ORBIT_CONST_ASTRONOMICAL_UNIT * eb_dot_timestep_sec;
-        const double V[3] = {eb_dot[0] / c, eb_dot[1] / c, eb_dot[2] / c};
+        // Speed of light in AU per day
+        const double c = ORBIT_CONST_SPEED_OF_LIGHT / ORBIT_CONST_ASTRONOMICAL_UNIT * 86400;
+        const double V[3] = {earth_vel[0] / c, earth_vel[1] / c, earth_vel[2] / c};
         const double V_mag = gsl_hypot3(V[0], V[1], V[2]);
         const double beta = sqrt(1 - gsl_pow_2(V_mag));
         const double f1 = u[0] * V[0] + u[1] * V[1] + u[2] * V[2];
         const double f2 = 1 + f1 / (1 + beta);
 
         // Correct for aberration
-        *x = earth_pos_x + (beta * u1[0] + f2 * u1_mag * V[0]) / (1 + f1);
-        *y = earth_pos_y + (beta * u1[1] + f2 * u1_mag * V[1]) / (1 + f1);
-        *z = earth_pos_z + (beta * u1[2] + f2 * u1_mag * V[2]) / (1 + f1);
+        *x = earth_pos[0] + (beta * u1[0] + f2 * u1_mag * V[0]) / (1 + f1);
+        *y = earth_pos[1] + (beta * u1[1] + f2 * u1_mag * V[1]) / (1 + f1);
+        *z = earth_pos[2] + (beta * u1[2] + f2 * u1_mag * V[2]) / (1 + f1);
     }
 
     // Populate other quantities, like the brightness, RA and Dec of the object, based on its XYZ position
-    magnitudeEstimate(bodyId, *x, *y, *z, earth_pos_x, earth_pos_y, earth_pos_z, sun_pos_x, sun_pos_y, sun_pos_z, ra,
-                      dec, mag, phase, angSize, phySize,
-                      albedo, sunDist, earthDist, sunAngDist, theta_eso, eclipticLongitude, eclipticLatitude,
-                      eclipticDistance, ra_dec_epoch, jd,
-                      do_topocentric_correction, topocentric_latitude, topocentric_longitude);
+    magnitudeEstimate(bodyId, *x, *y, *z, observer, ra, dec, mag, phase, angSize, phySize, albedo, sunDist, earthDist,
+                      sunAngDist, theta_eso, eclipticLongitude, eclipticLatitude, eclipticDistance, ra_dec_epoch);
+}
+
+//! orbitalElements_cacheStats - Report how many orbital element fetches were served from memory, and how many needed
+//! a read from disk, totalled over the planet, asteroid and comet databases.
+//! \param [out] hits - The number of fetches which found the orbital elements already loaded
+//! \param [out] misses - The number of fetches which read the orbital elements from disk
+
+void orbitalElements_cacheStats(unsigned long *hits, unsigned long *misses) {
+    record_cache *caches[3] = {&planet_database_records, &asteroid_database_records, &comet_database_records};
+    *hits = *misses = 0;
+    for (int i = 0; i < 3; i++) {
+        unsigned long cache_hits, cache_misses;
+        record_cache_stats(caches[i], &cache_hits, &cache_misses);
+        *hits += cache_hits;
+        *misses += cache_misses;
+    }
 }
@@ -26,14 +26,19 @@
 #define SRCDIR "/src/"
 #endif
 
+#include "coreUtils/recordCache.h"
 #include "coreUtils/strConstants.h"
+#include "ephemCalc/bodyLookup.h"
+#include "ephemCalc/observerState.h"
 
 #define MAX_ASTEROIDS 1500000
 #define MAX_COMETS     200000
 #define MAX_PLANETS        50
 
+//! orbitalElements - The orbital elements of a solar system object. Objects' names are held separately, in
+//! <orbitalElementsNames>, so that these records contain only numbers and can be used in place from a mapped file.
+
 typedef struct {
-    char name[24], name2[24];
     int number;  // bodyId for planets; bodyId-10000000 for asteroids; bodyId-20000000 for comets
     int secureOrbit;  // boolean flag indicating whether orbit is deemed secure
     double epochOsculation;  // Julian date
@@ -50,34 +55,57 @@ typedef struct {
     double eccentricity_dot; // rate of change; per day
     double semiMajorAxis;  // AU
     double semiMajorAxis_dot; // rate of change; AU per day
+    double perihelionDistance;  // AU; at epoch of osculation. Unlike <semiMajorAxis>, this is finite for parabolas.
     double slopeParam_n, slopeParam_G;
 } orbitalElements;
 
-#ifndef ORBITALELEMENTS_C
-// Binary files containing the orbital elements of solar system objects
-extern FILE *planet_database_file;
-extern FILE *asteroid_database_file;
-extern FILE *comet_database_file;
+//! orbitalElementsNames - The names of a solar system object, e.g. its common name and its MPC designation
+
+typedef struct {
+    char name[24], name2[24];
+} orbitalElementsNames;
 
-// Filenames of binary files
-extern char planet_database_filename[FNAME_LENGTH];
-extern char asteroid_database_filename[FNAME_LENGTH];
-extern char comet_database_filename[FNAME_LENGTH];
+//! orbitalElementsIndexEntry - An entry in the index of objects' names, which is sorted by case-folded name
+
+typedef struct {
+    int record;  // The index of the object within its catalogue
+    int field;  // Which of the object's names this entry refers to: 0 for <name>; 1 for <name2>
+} orbitalElementsIndexEntry;
 
-// Blocks of memory used to hold the orbital elements
+//! orbitalElementsHashEntry - A slot in the hash table of objects' names, which is an open-addressed table with linear
+//! probing. Each name appears once, however many objects share it.
+
+typedef struct {
+    unsigned int hash;  // The case-folded hash of the name, as computed by <orbitalElements_hashName>
+    int entry;  // The position within the index of names of the first object with this name; -1 for an empty slot
+} orbitalElementsHashEntry;
+
+#ifndef ORBITALELEMENTS_C
+// Caches of the orbital elements of solar system objects, which load records from the binary files on demand
+extern record_cache planet_database_records;
+extern record_cache asteroid_database_records;
+extern record_cache comet_database_records;
+
+// Caches of the names of solar system objects, and the indices of these names
+extern record_cache planet_names_records;
+extern record_cache asteroid_names_records;
+extern record_cache comet_names_records;
+extern record_cache planet_index_records;
+extern record_cache asteroid_index_records;
+extern record_cache comet_index_records;
+extern record_cache planet_hash_records;
+extern record_cache asteroid_hash_records;
+extern record_cache comet_hash_records;
+
+// Blocks of memory holding the orbital elements (entries are only valid once they have been fetched)
 extern orbitalElements *planet_database;
 extern orbitalElements *asteroid_database;
 extern orbitalElements *comet_database;
 
-// Record of which entries we have loaded from each database
-extern unsigned char *planet_database_items_loaded;
-extern unsigned char *asteroid_database_items_loaded;
-extern unsigned char *comet_database_items_loaded;
-
-// Pointers to the positions in the files where the orbitalElement structures begin
-extern int planet_database_offset;
-extern int asteroid_database_offset;
-extern int comet_database_offset;
+// Blocks of memory holding the names of objects (entries are only valid once they have been fetched)
+extern orbitalElementsNames *planet_names;
+extern orbitalElementsNames *asteroid_names;
+extern orbitalElementsNames *comet_names;
 
 // Number of objects in each list
 extern int planet_count;
@@ -92,24 +120,60 @@ extern int comet_secure_count;
 
 void orbitalElements_planets_init();
 
-orbitalElements *orbitalElements_planets_fetch(int index);
+const orbitalElements *orbitalElements_planets_fetch(int index);
+
+const orbitalElementsNames *orbitalElements_planets_fetchNames(int index);
 
 void orbitalElements_asteroids_init();
 
-orbitalElements *orbitalElements_asteroids_fetch(int index);
+const orbitalElements *orbitalElements_asteroids_fetch(int index);
+
+const orbitalElementsNames *orbitalElements_asteroids_fetchNames(int index);
+
+int orbitalElements_asteroids_applyUpdate(const char *filename, int *changed_count, int *appended_count,
+                                          unsigned int *revision);
 
 void orbitalElements_comets_init();
 
-orbitalElements *orbitalElements_comets_fetch(int index);
+const orbitalElements *orbitalElements_comets_fetch(int index);
+
+const orbitalElementsNames *orbitalElements_comets_fetchNames(int index);
+
+unsigned int orbitalElements_hashName(const char *name);
+
+int orbitalElements_planets_findName(const char *name);
+
+int orbitalElements_asteroids_findName(const char *name);
+
+int orbitalElements_comets_findName(const char *name);
+
+int orbitalElements_planets_findPrefix(const char *prefix, int *indices, int max_count);
+
+int orbitalElements_asteroids_findPrefix(const char *prefix, int *indices, int max_count);
+
+int orbitalElements_comets_findPrefix(const char *prefix, int *indices, int max_count);
+
+void orbitalElements_cacheStats(unsigned long *hits, unsigned long *misses);
+
+const orbitalElements *orbitalElements_fetchBody(int body_id);
 
 void orbitalElements_computeXYZ(int body_id, double jd, double *x, double *y, double *z);
 
-void orbitalElements_computeEphemeris(int bodyId, double jd, double *x, double *y, double *z, double *ra,
-                                      double *dec, double *mag, double *phase, double *angSize, double *phySize,
-                                      double *albedo, double *sunDist, double *earthDist, double *sunAngDist,
-                                      double *theta_eso, double *eclipticLongitude, double *eclipticLatitude,
-                                      double *eclipticDistance, double ra_dec_epoch,
-                                      int do_topocentric_correction,
-                                      double topocentric_latitude, double topocentric_longitude);
+void orbitalElements_propagate(const orbitalElements *orbital_elements, double jd, double *x, double *y, double *z);
+
+void orbitalElements_universalSetup(const orbitalElements *orbital_elements, double jd, double *alpha, double *q,
+                                    double *perihelion_time, double *P, double *Q);
+
+void orbitalElements_propagateUniversal(const orbitalElements *orbital_elements, double jd,
+                                        double *x, double *y, double *z);
+
+void orbitalElements_velocity(const orbitalElements *orbital_elements, double jd, double *vx, double *vy, double *vz);
+
+void orbitalElements_computeEphemeris(int bodyId, const observerState *observer, double *x, double *y, double *z,
+                                      double *vx, double *vy, double *vz, double *ra, double *dec, double *mag,
+                                      double *phase, double *angSize, double *phySize, double *albedo, double *sunDist,
+                                      double *earthDist, double *sunAngDist, double *theta_eso,
+                                      double *eclipticLongitude, double *eclipticLatitude, double *eclipticDistance,
+                                      double ra_dec_epoch);
 
 #endif
@@ -0,0 +1,357 @@
+// spk.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+// Reader for the SPK files distributed by JPL (e.g. de440.bsp), which use NAIF's Double precision Array File (DAF)
+// format. See <https://naif.jpl.nasa.gov/pub/naif/toolkit_docs/C/req/daf.html> and
+// <https://naif.jpl.nasa.gov/pub/naif/toolkit_docs/C/req/spk.html>. Only segments of types 2 and 3 are read, which
+// are those used by all of the JPL planetary ephemerides.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "coreUtils/errorReport.h"
+#include "coreUtils/strConstants.h"
+
+#include "mathsTools/chebyshev.h"
+
+#include "spk.h"
+
+//! The length of each record in a DAF file, in bytes
+#define SPK_RECORD_BYTES 1024
+
+//! The deepest chain of centres we follow before deciding that an SPK file is corrupt (e.g. Moon -> EMB -> SSB)
+#define SPK_MAX_CHAIN 16
+
+//! spk_fail - Report that an SPK file could not be read, and release anything we allocated while trying
+//! \param [in] spk - The partially-opened SPK file
+//! \param [in] filename - The filename of the SPK file
+//! \param [in] reason - Description of the problem
+//! \return - Always returns 1, to indicate failure
+
+static int spk_fail(spk_file *spk, const char *filename, const char *reason) {
+    snprintf(temp_err_string, FNAME_LENGTH, "Could not read SPK file <%s>: %s", filename, reason);
+    ephem_error(temp_err_string);
+    spk_close(spk);
+    return 1;
+}
+
+//! spk_open - Open an SPK file, and index its segments of types 2 and 3. If possible, the file is memory-mapped and
+//! its records are used in place. Otherwise it is read into memory.
+//! \param [in] filename - The filename of the SPK file
+//! \param [out] out - The opened SPK file
+//! \return - Zero on success
+
+int spk_open(const char *filename, spk_file *out) {
+    const unsigned char *data;
+    size_t length;
+    int segments_allocated = 0;
+    int i, j;
+
+    memset(out, 0, sizeof(spk_file));
+
+    // Map the file into memory if we can; otherwise read it
+    if (mapped_file_open(filename, &out->map) == 0) {
+        data = out->map.data;
+        length = out->map.length;
+    } else {
+        FILE *input = fopen(filename, "rb");
+        if (input == NULL) return 1;
+        fseek(input, 0L, SEEK_END);
+        length = (size_t) ftell(input);
+        fseek(input, 0L, SEEK_SET);
+        out->buffer = (unsigned char *) malloc(length > 0 ? length : 1);
+        if (out->buffer == NULL) {
+            ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+            exit(1);
+        }
+        if (fread(out->buffer, 1, length, input) != length) {
+            fclose(input);
+            return spk_fail(out, filename, "short read.");
+        }
+        fclose(input);
+        data = out->buffer;
+    }
+
+    // The file record identifies the file, and gives the layout of the segment summaries
+    if ((length < SPK_RECORD_BYTES) || (memcmp(data, "DAF/SPK ", 8) != 0)) {
+        return spk_fail(out, filename, "not a DAF/SPK file.");
+    }
+
+    // We read the doubles and integers in place, so the file must use this machine's byte order. Very old files
+    // don't state their byte order, in which case we have to assume that it is ours.
+    {
+        const unsigned int one = 1;
+        const char *native_format = (*(const unsigned char *) &one == 1) ? "LTL-IEEE" : "BIG-IEEE";
+        if ((memcmp(data + 88, "LTL-IEEE", 8) == 0 || memcmp(data + 88, "BIG-IEEE", 8) == 0) &&
+            (memcmp(data + 88, native_format, 8) != 0)) {
+            return spk_fail(out, filename, "byte order does not match this machine.");
+        }
+    }
+
+    int nd, ni, forward;
+    memcpy(&nd, data + 8, sizeof(int));
+    memcpy(&ni, data + 12, sizeof(int));
+    memcpy(&forward, data + 76, sizeof(int));
+
+    // SPK summaries always contain two doubles (start and end time) and six integers
+    if ((nd != 2) || (ni != 6)) return spk_fail(out, filename, "unexpected summary format.");
+    const int summary_length = nd + (ni + 1) / 2;  // doubles
+
+    // Walk the linked list of summary records
+    const double *words = (const double *) data;
+    const size_t word_count = length / sizeof(double);
+    const int max_records = (int) (length / SPK_RECORD_BYTES);
+    int record = forward, records_visited = 0;
+
+    while (record > 0) {
+        if ((record > max_records) || (++records_visited > max_records)) {
+            return spk_fail(out, filename, "corrupt summary records.");
+        }
+
+        const double *summary_record = words + (size_t) (record - 1) * (SPK_RECORD_BYTES / sizeof(double));
+        const int next = (int) summary_record[0];
+        const int summary_count = (int) summary_record[2];
+
+        if ((summary_count < 0) || (3 + summary_count * summary_length > (int) (SPK_RECORD_BYTES / sizeof(double)))) {
+            return spk_fail(out, filename, "corrupt summary records.");
+        }
+
+        for (i = 0; i < summary_count; i++) {
+            const double *summary = summary_record + 3 + i * summary_length;
+            int ints[6];
+            memcpy(ints, summary + nd, sizeof(ints));
+
+            const int type = ints[3];
+            const int start_address = ints[4], end_address = ints[5];  // FORTRAN numbering starts at 1
+
+            // We only read Chebyshev segments
+            if ((type != 2) && (type != 3)) {
+                if (DEBUG) {
+                    snprintf(temp_err_string, FNAME_LENGTH, "Skipping SPK segment for body %d of type %d.", ints[0],
+                             type);
+                    ephem_log(temp_err_string);
+                }
+                continue;
+            }
+
+            if ((start_address < 1) || (end_address < start_address + 3) || ((size_t) end_address > word_count)) {
+                return spk_fail(out, filename, "segment lies outside file.");
+            }
+
+            // The last four words of each segment are its directory: the start time of the first record, the time
+            // span of each record, the number of words in each record, and the number of records
+            const double *directory = words + end_address - 4;
+            spk_segment segment;
+            segment.target = ints[0];
+            segment.center = ints[1];
+            segment.type = type;
+            segment.et_start = summary[0];
+            segment.et_end = summary[1];
+            segment.init = directory[0];
+            segment.interval = directory[1];
+            segment.record_size = (int) directory[2];
+            segment.record_count = (int) directory[3];
+            segment.coeff_count = (segment.record_size - 2) / ((type == 2) ? 3 : 6);
+            segment.records = words + start_address - 1;
+
+            if ((segment.coeff_count < 1) || (segment.record_count < 1) || (segment.interval <= 0) ||
+                ((long) segment.record_size * segment.record_count + 4 != end_address - start_address + 1)) {
+                return spk_fail(out, filename, "inconsistent segment directory.");
+            }
+
+            if (out->segment_count >= segments_allocated) {
+                segments_allocated = (segments_allocated > 0) ? 2 * segments_allocated : 32;
+                out->segments = (spk_segment *) realloc(out->segments, segments_allocated * sizeof(spk_segment));
+                if (out->segments == NULL) {
+                    ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+                    exit(1);
+                }
+            }
+            out->segments[out->segment_count++] = segment;
+        }
+
+        record = next;
+    }
+
+    // Sort the segments by target, keeping segments for the same target in file order, since later segments take
+    // precedence. There are only a few dozen, so an insertion sort will do.
+    for (i = 1; i < out->segment_count; i++) {
+        const spk_segment segment = out->segments[i];
+        for (j = i; (j > 0) && (out->segments[j - 1].target > segment.target); j--) {
+            out->segments[j] = out->segments[j - 1];
+        }
+        out->segments[j] = segment;
+    }
+
+    if (DEBUG) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Read %d segments from SPK file <%s>.", out->segment_count, filename);
+        ephem_log(temp_err_string);
+    }
+    return 0;
+}
+
+//! spk_close - Release an SPK file opened by <spk_open>
+//! \param [in] spk - The SPK file to close
+
+void spk_close(spk_file *spk) {
+    mapped_file_close(&spk->map);
+    free(spk->buffer);
+    free(spk->segments);
+    spk->buffer = NULL;
+    spk->segments = NULL;
+    spk->segment_count = 0;
+}
+
+//! spk_firstSegment - Find the first segment for a particular target, in the index sorted by target
+//! \param [in] spk - The SPK file to search
+//! \param [in] target - The NAIF ID of the body to search for
+//! \return - The index of the first segment for the target, or the index where it would be if there is none
+
+static int spk_firstSegment(const spk_file *spk, int target) {
+    int low = 0, high = spk->segment_count;
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (spk->segments[middle].target < target) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+//! spk_findSegment - Find the segment which gives the position of a target at a particular time
+//! \param [in] spk - The SPK file to search
+//! \param [in] target - The NAIF ID of the body to search for
+//! \param [in] et - TDB seconds since J2000.0
+//! \return - The segment, or NULL if no segment covers this time
+
+static const spk_segment *spk_findSegment(const spk_file *spk, int target, double et) {
+    const int first = spk_firstSegment(spk, target);
+    int last = first, i;
+
+    while ((last < spk->segment_count) && (spk->segments[last].target == target)) last++;
+
+    // Later segments take precedence over earlier ones
+    for (i = last - 1; i >= first; i--) {
+        if ((et >= spk->segments[i].et_start) && (et <= spk->segments[i].et_end)) return &spk->segments[i];
+    }
+    return NULL;
+}
+
+//! spk_coverage - Report the span of time covered by the segments for a particular target
+//! \param [in] spk - The SPK file to search
+//! \param [in] target - The NAIF ID of the body to search for
+//! \param [out] et_start - The earliest time covered; TDB seconds since J2000.0
+//! \param [out] et_end - The latest time covered; TDB seconds since J2000.0
+//! \return - Zero on success; one if the file has no segments for the target
+
+int spk_coverage(const spk_file *spk, int target, double *et_start, double *et_end) {
+    int i = spk_firstSegment(spk, target);
+    if ((i >= spk->segment_count) || (spk->segments[i].target != target)) return 1;
+
+    *et_start = spk->segments[i].et_start;
+    *et_end = spk->segments[i].et_end;
+    for (; (i < spk->segment_count) && (spk->segments[i].target == target); i++) {
+        if (spk->segments[i].et_start < *et_start) *et_start = spk->segments[i].et_start;
+        if (spk->segments[i].et_end > *et_end) *et_end = spk->segments[i].et_end;
+    }
+    return 0;
+}
+
+//! spk_prefetch - Load the records which cover a span of time into memory, for every segment in the file, so that
+//! evaluating positions within that span does not wait on disk I/O. This only has any effect if the file is
+//! memory-mapped; otherwise the whole file is already in memory.
+//! \param [in] spk - The SPK file
+//! \param [in] et_start - The start of the span of time; TDB seconds since J2000.0
+//! \param [in] et_end - The end of the span of time; TDB seconds since J2000.0
+
+void spk_prefetch(const spk_file *spk, double et_start, double et_end) {
+    if (spk->map.data == NULL) return;
+
+    for (int i = 0; i < spk->segment_count; i++) {
+        const spk_segment *segment = &spk->segments[i];
+        if ((et_end < segment->et_start) || (et_start > segment->et_end)) continue;
+
+        int first = (int) floor((et_start - segment->init) / segment->interval);
+        int last = (int) floor((et_end - segment->init) / segment->interval);
+        if (first < 0) first = 0;
+        if (last >= segment->record_count) last = segment->record_count - 1;
+        if (first > last) continue;
+
+        const unsigned char *start = (const unsigned char *) (segment->records + (size_t) first * segment->record_size);
+        mapped_file_prefetch(&spk->map, (size_t) (start - spk->map.data),
+                             (size_t) (last - first + 1) * segment->record_size * sizeof(double));
+    }
+}
+
+//! spk_computeState - Evaluate the position, and optionally the velocity, of a body relative to the solar system
+//! barycentre, following the chain of centres (e.g. Moon -> Earth-Moon barycentre -> solar system barycentre).
+//! \param [in] spk - The SPK file to use
+//! \param [in] target - The NAIF ID of the body to evaluate
+//! \param [in] et - TDB seconds since J2000.0
+//! \param [out] position - 3-element array; the position of the body, km, in the frame of the SPK file (ICRF)
+//! \param [out] velocity - 3-element array; the velocity of the body, km/s. May be NULL if not wanted.
+//! \return - Zero on success; one if some link of the chain is not covered at this time
+
+int spk_computeState(const spk_file *spk, int target, double et, double *position, double *velocity) {
+    int depth, i;
+
+    for (i = 0; i < 3; i++) {
+        position[i] = 0;
+        if (velocity != NULL) velocity[i] = 0;
+    }
+
+    for (depth = 0; target != 0; depth++) {
+        const spk_segment *segment = spk_findSegment(spk, target, et);
+        if ((segment == NULL) || (depth >= SPK_MAX_CHAIN)) return 1;
+
+        // Work out which record contains this time, and clamp it within sensible range
+        int record_index = (int) floor((et - segment->init) / segment->interval);
+        if (record_index < 0) record_index = 0;
+        if (record_index >= segment->record_count) record_index = segment->record_count - 1;
+
+        // Each record starts with the midpoint and half-length of the time span it covers
+        const double *record = segment->records + (long) record_index * segment->record_size;
+        const double tc = (et - record[0]) / record[1];
+        const int n = segment->coeff_count;
+
+        double link_position[3], link_velocity[3];
+        if (velocity == NULL) {
+            chebyshev3(record + 2, n, tc, link_position, NULL);
+        } else if (segment->type == 2) {
+            // Differentiate the position, which is a function of <tc>
+            chebyshev3(record + 2, n, tc, link_position, link_velocity);
+            for (i = 0; i < 3; i++) link_velocity[i] /= record[1];
+        } else {
+            // Type 3 segments have separate series for the velocity
+            chebyshev3(record + 2, n, tc, link_position, NULL);
+            chebyshev3(record + 2 + 3 * n, n, tc, link_velocity, NULL);
+        }
+
+        for (i = 0; i < 3; i++) {
+            position[i] += link_position[i];
+            if (velocity != NULL) velocity[i] += link_velocity[i];
+        }
+
+        target = segment->center;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+// spk.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef SPK_H
+#define SPK_H 1
+
+#include "coreUtils/mappedFile.h"
+
+//! spk_segment - A segment of an SPK file, giving the position of one body relative to another over a span of time,
+//! as a series of records of Chebyshev coefficients (SPK types 2 and 3)
+
+typedef struct {
+    int target;  // NAIF ID of the body whose position the segment gives
+    int center;  // NAIF ID of the body relative to which the position is given
+    int type;  // SPK data type: 2 (Chebyshev position) or 3 (Chebyshev position and velocity)
+    double et_start, et_end;  // The span of time covered by the segment; TDB seconds since J2000.0
+    double init;  // The start time of the first record; TDB seconds since J2000.0
+    double interval;  // The length of time covered by each record; seconds
+    int record_size;  // The number of doubles in each record
+    int record_count;  // The number of records in the segment
+    int coeff_count;  // The number of Chebyshev coefficients for each component
+    const double *records;  // The first record
+} spk_segment;
+
+//! spk_file - An SPK file, with an index of its segments sorted by target body
+
+typedef struct {
+    mapped_file map;  // The file mapped into memory, if the platform allows it
+    unsigned char *buffer;  // Otherwise, a copy of the file read into memory
+    spk_segment *segments;  // The type 2 and 3 segments in the file, sorted by target. Within each target, segments
+    // keep the order in which they appear in the file.
+    int segment_count;
+} spk_file;
+
+int spk_open(const char *filename, spk_file *out);
+
+void spk_close(spk_file *spk);
+
+int spk_coverage(const spk_file *spk, int target, double *et_start, double *et_end);
+
+void spk_prefetch(const spk_file *spk, double et_start, double et_end);
+
+int spk_computeState(const spk_file *spk, int target, double et, double *position, double *velocity);
+
+#endif
@@ -0,0 +1,233 @@
+// universalKepler.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+// Kepler's equation in universal variables, which describes elliptic, parabolic and hyperbolic orbits with a single
+// formula, and so lets us propagate any mixture of orbits with one iteration. See Chapter 4 of Bate, Mueller and White,
+// "Fundamentals of Astrodynamics" (1971), and Conway (1986), Celestial Mechanics 39, 199, for the Laguerre iteration.
+//
+// Every object starts at perihelion, at distance q, moving perpendicular to the Sun-object line. In terms of the
+// universal anomaly chi, and z = alpha chi^2, where alpha = 1/a is the reciprocal of the semi-major axis,
+//   sqrt(mu) dt = (1 - alpha q) chi^3 S(z) + q chi
+//   r = q + (1 - alpha q) chi^2 C(z)
+// where C and S are Stumpff functions. The position after time dt is then f * r0 + g * v0, where r0 and v0 are the
+// position and velocity at perihelion, and
+//   f = 1 - chi^2 C(z) / q ;  g = dt - chi^3 S(z) / sqrt(mu)
+// and the velocity is f_dot * r0 + g_dot * v0, where
+//   f_dot = sqrt(mu) chi (z S(z) - 1) / (r q) ;  g_dot = 1 - chi^2 C(z) / r
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "universalKepler.h"
+
+// Numerical constants
+const static double UNIVERSAL_CONST_ASTRONOMICAL_UNIT = 149597870700.; // m
+const static double UNIVERSAL_CONST_GM_SOLAR = 1.32712440041279419e20; // m^3 s^-2
+
+//! The number of objects whose equations are solved together by <universalKepler_solveBatch>
+#define UNIVERSAL_KEPLER_BLOCK 256
+
+//! The largest number of Laguerre iterations we take before giving up
+#define UNIVERSAL_KEPLER_ITERATIONS 50
+
+//! universalKepler_mu - The Sun's gravitational parameter, in AU^3 per day^2
+//! \return - GM_sun
+
+double universalKepler_mu() {
+    return UNIVERSAL_CONST_GM_SOLAR / (UNIVERSAL_CONST_ASTRONOMICAL_UNIT * UNIVERSAL_CONST_ASTRONOMICAL_UNIT *
+                                       UNIVERSAL_CONST_ASTRONOMICAL_UNIT) * 86400. * 86400.;
+}
+
+//! The number of terms of the power series for the Stumpff functions, which we use when |z| < 4. The next term is
+//! smaller than 1e-19 of the sum.
+#define UNIVERSAL_KEPLER_SERIES_TERMS 12
+
+//! universalKepler_stumpff - Evaluate the Stumpff functions C(z) and S(z). Close to z=0, where the closed forms lose
+//! precision to cancellation, and where most near-parabolic orbits spend their time, we sum their power series
+//! instead, which is also much quicker than evaluating trigonometric or hyperbolic functions.
+//! \param [in] z - The argument of the Stumpff functions
+//! \param [out] C - C(z) = (1 - cos(sqrt(z))) / z
+//! \param [out] S - S(z) = (sqrt(z) - sin(sqrt(z))) / sqrt(z)^3
+
+static void universalKepler_stumpff(double z, double *C, double *S) {
+    // The coefficients of the power series: C(z) = sum_k (-z)^k / (2k+2)! ; S(z) = sum_k (-z)^k / (2k+3)!
+    static const double c_coefficients[UNIVERSAL_KEPLER_SERIES_TERMS] = {
+            1. / 2, -1. / 24, 1. / 720, -1. / 40320, 1. / 3628800, -1. / 479001600, 1. / 87178291200.,
+            -1. / 20922789888000., 1. / 6402373705728000., -1. / 2432902008176640000.,
+            1. / 1124000727777607680000., -1. / 620448401733239439360000.
+    };
+    static const double s_coefficients[UNIVERSAL_KEPLER_SERIES_TERMS] = {
+            1. / 6, -1. / 120, 1. / 5040, -1. / 362880, 1. / 39916800, -1. / 6227020800., 1. / 1307674368000.,
+            -1. / 355687428096000., 1. / 121645100408832000., -1. / 51090942171709440000.,
+            1. / 25852016738884976640000., -1. / 15511210043330985984000000.
+    };
+
+    if (z > 4) {
+        const double s = sqrt(z);
+        *C = (1 - cos(s)) / z;
+        *S = (s - sin(s)) / (z * s);
+    } else if (z < -4) {
+        const double s = sqrt(-z);
+        *C = (cosh(s) - 1) / (-z);
+        *S = (sinh(s) - s) / (-z * s);
+    } else {
+        double c = 0, s = 0;
+        for (int k = UNIVERSAL_KEPLER_SERIES_TERMS - 1; k >= 0; k--) {
+            c = c_coefficients[k] + z * c;
+            s = s_coefficients[k] + z * s;
+        }
+        *C = c;
+        *S = s;
+    }
+}
+
+//! universalKepler_solve - Solve Kepler's equation in universal variables for a single object
+//! \param [in] alpha - The reciprocal of the semi-major axis (1/AU); positive for ellipses, zero for parabolas and
+//! negative for hyperbolas
+//! \param [in] q - Perihelion distance (AU)
+//! \param [in] dt - Time since perihelion (days)
+//! \param [out] f - The Lagrange coefficient f; the position is f times the position at perihelion, plus g times the
+//! velocity at perihelion
+//! \param [out] g - The Lagrange coefficient g (days)
+
+void universalKepler_solve(double alpha, double q, double dt, double *f, double *g) {
+    universalKepler_solveBatch(1, &alpha, &q, &dt, f, g);
+}
+
+//! universalKepler_anomaly - Solve Kepler's equation in universal variables for a block of objects at once, finding
+//! the universal anomaly of each. The objects take Laguerre steps together, until every object in the block has
+//! converged. The loops are marked for vectorisation, but <universalKepler_stumpff> chooses between its power series
+//! and closed forms for each object, so how far the compiler can vectorise them depends on it inlining and
+//! if-converting that choice.
+//! \param [in] n - The number of objects; at most <UNIVERSAL_KEPLER_BLOCK>
+//! \param [in] a - Array of the reciprocals of the objects' semi-major axes (1/AU)
+//! \param [in] r0 - Array of the objects' perihelion distances (AU)
+//! \param [in] t0 - Array of the times since perihelion (days)
+//! \param [out] chi - Array of the universal anomalies (AU^1/2)
+//! \param [out] t - Array of the times since perihelion, with whole orbits of elliptic objects removed (days)
+
+static void universalKepler_anomaly(int n, const double *a, const double *r0, const double *t0, double *chi,
+                                    double *t) {
+    const double sqrt_mu = sqrt(universalKepler_mu());
+    int i, iteration;
+
+    // Remove whole orbits from the time since perihelion, and make an initial guess at chi. This is the root of
+    // the cubic we get by setting S(z) = 1/6, which is exact for parabolas, and an upper bound on chi for
+    // hyperbolas. For ellipses it is a lower bound, which we cap at the value reached at aphelion.
+#pragma omp simd
+    for (i = 0; i < n; i++) {
+        const double e = 1 - a[i] * r0[i];
+        const double period = 2 * M_PI / (sqrt_mu * a[i] * sqrt(fabs(a[i])));
+        t[i] = (a[i] > 0) ? t0[i] - period * floor(t0[i] / period + 0.5) : t0[i];
+
+        // Cardano's formula for e chi^3 / 6 + q chi = sqrt(mu) t
+        const double e_guess = (e > 0.01) ? e : 0.01;
+        const double A = 2 * r0[i] / e_guess, B = 3 * sqrt_mu * t[i] / e_guess;
+        const double D = sqrt(B * B + A * A * A);
+        const double guess = cbrt(B + D) - cbrt(D - B);
+        const double aphelion = (a[i] > 0) ? M_PI / sqrt(fabs(a[i])) : HUGE_VAL;
+        chi[i] = (fabs(guess) < aphelion) ? guess : copysign(aphelion, t[i]);
+    }
+
+    // Laguerre-Conway iteration, which converges from any starting point for all but pathological orbits. Close
+    // to the root it converges cubically, so once every step is smaller than 1e-8 of chi, the remaining error is
+    // far below rounding error.
+    for (iteration = 0; iteration < UNIVERSAL_KEPLER_ITERATIONS; iteration++) {
+        double largest_step = 0;
+#pragma omp simd reduction(max:largest_step)
+        for (i = 0; i < n; i++) {
+            double C, S;
+            const double e = 1 - a[i] * r0[i];
+            const double z = a[i] * chi[i] * chi[i];
+            universalKepler_stumpff(z, &C, &S);
+            const double F = e * chi[i] * chi[i] * chi[i] * S + r0[i] * chi[i] - sqrt_mu * t[i];
+            const double F1 = r0[i] + e * chi[i] * chi[i] * C;
+            const double F2 = e * chi[i] * (1 - z * S);
+            const double step = 5 * F / (F1 + sqrt(fabs(16 * F1 * F1 - 20 * F * F2)));
+            chi[i] -= step;
+            const double relative_step = fabs(step) / (1 + fabs(chi[i]));
+            largest_step = (relative_step > largest_step) ? relative_step : largest_step;
+        }
+        if (!(largest_step > 1e-8)) break;
+    }
+}
+
+//! universalKepler_solveState - Solve Kepler's equation in universal variables for a single object, returning the
+//! Lagrange coefficients for its velocity as well as its position
+//! \param [in] alpha - The reciprocal of the semi-major axis (1/AU)
+//! \param [in] q - Perihelion distance (AU)
+//! \param [in] dt - Time since perihelion (days)
+//! \param [out] f - The Lagrange coefficient f, as returned by <universalKepler_solve>
+//! \param [out] g - The Lagrange coefficient g (days)
+//! \param [out] f_dot - The rate of change of f (per day); the velocity is f_dot times the position at perihelion,
+//! plus g_dot times the velocity at perihelion
+//! \param [out] g_dot - The rate of change of g
+
+void universalKepler_solveState(double alpha, double q, double dt, double *f, double *g, double *f_dot,
+                                double *g_dot) {
+    const double sqrt_mu = sqrt(universalKepler_mu());
+    double chi, t, C, S;
+
+    universalKepler_anomaly(1, &alpha, &q, &dt, &chi, &t);
+    const double z = alpha * chi * chi;
+    universalKepler_stumpff(z, &C, &S);
+
+    // Distance from the Sun
+    const double r = q + (1 - alpha * q) * chi * chi * C;
+
+    *f = 1 - chi * chi * C / q;
+    *g = t - chi * chi * chi * S / sqrt_mu;
+    *f_dot = sqrt_mu / (r * q) * chi * (z * S - 1);
+    *g_dot = 1 - chi * chi * C / r;
+}
+
+//! universalKepler_solveBatch - Solve Kepler's equation in universal variables for many objects at once, a block of
+//! <UNIVERSAL_KEPLER_BLOCK> objects at a time (see <universalKepler_anomaly>)
+//! \param [in] count - The number of objects
+//! \param [in] alpha - Array of the reciprocals of the objects' semi-major axes (1/AU)
+//! \param [in] q - Array of the objects' perihelion distances (AU)
+//! \param [in] dt - Array of the times since perihelion (days)
+//! \param [out] f - Array of the Lagrange coefficients f
+//! \param [out] g - Array of the Lagrange coefficients g (days)
+
+void universalKepler_solveBatch(int count, const double *alpha, const double *q, const double *dt, double *f,
+                                double *g) {
+    const double sqrt_mu = sqrt(universalKepler_mu());
+
+    for (int first = 0; first < count; first += UNIVERSAL_KEPLER_BLOCK) {
+        const int n = (count - first < UNIVERSAL_KEPLER_BLOCK) ? count - first : UNIVERSAL_KEPLER_BLOCK;
+        const double *a = alpha + first, *r0 = q + first;
+        double chi[UNIVERSAL_KEPLER_BLOCK], t[UNIVERSAL_KEPLER_BLOCK];
+        int i;
+
+        universalKepler_anomaly(n, a, r0, dt + first, chi, t);
+
+        // Lagrange coefficients
+#pragma omp simd
+        for (i = 0; i < n; i++) {
+            double C, S;
+            universalKepler_stumpff(a[i] * chi[i] * chi[i], &C, &S);
+            f[first + i] = 1 - chi[i] * chi[i] * C / r0[i];
+            g[first + i] = t[i] - chi[i] * chi[i] * chi[i] * S / sqrt_mu;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+// universalKepler.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef UNIVERSALKEPLER_H
+#define UNIVERSALKEPLER_H 1
+
+double universalKepler_mu();
+
+void universalKepler_solve(double alpha, double q, double dt, double *f, double *g);
+
+void universalKepler_solveState(double alpha, double q, double dt, double *f, double *g, double *f_dot,
+                                double *g_dot);
+
+void universalKepler_solveBatch(int count, const double *alpha, const double *q, const double *dt, double *f,
+                                double *g);
+
+#endif
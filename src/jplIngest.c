@@ -0,0 +1,69 @@
+// jplIngest.c
+// Dominic Ford
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+// This is a simple tool for converting the DE430 ASCII files in <data/> into the binary file <data/dcfbinary.430>,
+// using all available cores. This saves a long wait the first time that ephemerides are computed on a new machine.
+
+// On the command line, you may optionally specify:
+// * The filename of the binary file to write (default <data/dcfbinary.430>)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coreUtils/strConstants.h"
+#include "coreUtils/errorReport.h"
+
+#include "ephemCalc/jpl.h"
+
+#include "listTools/ltMemory.h"
+
+int jplIngest_main(int argc, char **argv) {
+    char fname[FNAME_LENGTH];
+    struct timespec start, end;
+
+    // Initialise sub-modules
+    lt_memoryInit(&ephem_error, &ephem_log);
+
+    if (argc > 2) {
+        ephem_error("Usage: jplIngest.bin [<output filename>]");
+        return 1;
+    }
+    if (argc > 1) snprintf(fname, FNAME_LENGTH, "%s", argv[1]);
+    else snprintf(fname, FNAME_LENGTH, "%s/dcfbinary.430", DATADIR);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (jpl_ingestAsciiData(fname) != 0) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Could not write binary file <%.*s>.", FNAME_LENGTH - 64, fname);
+        ephem_error(temp_err_string);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("Wrote <%s> in %.2f sec.\n", fname,
+           (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec));
+
+    lt_freeAll(0);
+    lt_memoryStop();
+    return 0;
+}
@@ -0,0 +1,101 @@
+// jplSlice.c
+// Dominic Ford
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+// This is a simple tool for cutting down the binary file <data/dcfbinary.430> to cover only the span of time and the
+// bodies which are needed on a particular installation. The file it writes may be installed in place of
+// <data/dcfbinary.430>, and is read in exactly the same way. It is first written under a temporary name, and only
+// moved into place once it is complete, so it may be written directly over <data/dcfbinary.430>, even while other
+// processes are reading it.
+
+// On the command line, you need to specify:
+// * The earliest Julian day that the new file needs to cover
+// * The latest Julian day that the new file needs to cover
+// * The filename of the binary file to write
+// You may optionally specify:
+// * A comma-separated list of the series within DE430 to keep: 0=Mercury ... 8=Pluto, 9=Moon, 10=Sun, 11=nutations,
+//   12=librations (default all). The Earth-Moon barycentre, the Moon and the Sun are always kept.
+// * The largest position error, in km, which may be introduced by dropping Chebyshev coefficients (default 0)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coreUtils/asciiDouble.h"
+#include "coreUtils/strConstants.h"
+#include "coreUtils/errorReport.h"
+
+#include "ephemCalc/jpl.h"
+
+#include "listTools/ltMemory.h"
+
+int jplSlice_main(int argc, char **argv) {
+    int series[13], series_count = 0;
+    double tolerance = 0;
+    int i;
+
+    // Initialise sub-modules
+    lt_memoryInit(&ephem_error, &ephem_log);
+
+    if ((argc < 4) || (argc > 6) || !valid_float(argv[1], NULL) || !valid_float(argv[2], NULL)) {
+        ephem_error("Usage: jplSlice.bin <JD min> <JD max> <output filename> [<series list>] [<tolerance (km)>]");
+        return 1;
+    }
+
+    // Read the list of series to keep
+    if (argc > 4) {
+        const char *in = argv[4];
+        while (*in != '\0') {
+            int chars;
+            if ((series_count >= 13) || (*in < '0') || (*in > '9')) {
+                snprintf(temp_err_string, FNAME_LENGTH, "Could not read list of series <%s>.", argv[4]);
+                ephem_error(temp_err_string);
+                return 1;
+            }
+            series[series_count++] = (int) get_float(in, &chars);
+            in += chars;
+            if (*in == ',') in++;
+        }
+    } else {
+        for (i = 0; i < 13; i++) series[series_count++] = i;
+    }
+
+    // Read the tolerance for dropping Chebyshev coefficients
+    if (argc > 5) {
+        if (!valid_float(argv[5], NULL)) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Could not read tolerance <%s>.", argv[5]);
+            ephem_error(temp_err_string);
+            return 1;
+        }
+        tolerance = get_float(argv[5], NULL);
+    }
+
+    if (jpl_writeSlice(argv[3], get_float(argv[1], NULL), get_float(argv[2], NULL), series, series_count,
+                       tolerance) != 0) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Could not write binary file <%s>.", argv[3]);
+        ephem_error(temp_err_string);
+        return 1;
+    }
+
+    lt_freeAll(0);
+    lt_memoryStop();
+    return 0;
+}
@@ -35,18 +35,16 @@
 #include "coreUtils/strConstants.h"
 #include "coreUtils/errorReport.h"
 
+#include "ephemCalc/ephemContext.h"
 #include "ephemCalc/jpl.h"
 #include "ephemCalc/orbitalElements.h"
 #include "ephemCalc/magnitudeEstimate.h"
-#include "mathsTools/precess_equinoxes.h"
 
 #include "listTools/ltMemory.h"
 
 #include "settings/settings.h"
 
 #define DEBUG 0
-#define N_PARAMETERS 17
-static double buffer[N_PARAMETERS * MAX_OBJECTS];
 
 static const char *const usage[] = {
         "ephem.bin [options] [[--] args]",
@@ -56,144 +54,12 @@ static const char *const usage[] = {
 
 // Main entry point to compute an ephemeris, with parameters described by a settings structure
 void compute_ephemeris(settings *s) {
+    ephem_context context;
     FILE *output = stdout;
 
-    // Initial processing of settings for this ephemeris
     settings_process(s);
-
-    // Loop over all the time points in the ephemeris
-    const int steps_total = (int) ceil((s->jd_max - s->jd_min) / s->jd_step);
-    if (0) printf("min=%f, max=%f, steps=%d\n", s->jd_min, s->jd_max, steps_total);
-    for (int step_count = 0; step_count < steps_total; step_count++) {
-        const double jd = s->jd_min + step_count * s->jd_step;  // TT
-
-        // When producing a text-based ephemeris, the first column in Julian day number (TT)
-        // Binary ephemerides have no JD column to save space.
-        if (!s->output_binary) fprintf(output, "%.12f   ", jd);
-
-        // Compute ephemeris
-        int i;
-#pragma omp parallel for shared(output) private(i)
-        for (i = 0; i < s->objects_count; i++) {
-            const int o = step_count * N_PARAMETERS;
-            double ra = 0, dec = 0, x = 0, y = 0, z = 0;
-            double mag = 0, phase = 0, ang_size = 0, phy_size = 0, albedo = 0;
-            double sun_dist = 0, earth_dist = 0, sun_ang_dist = 0, theta_eso = 0;
-            double ecliptic_longitude = 0, ecliptic_latitude = 0, ecliptic_distance = 0;
-
-            // If the <use_orbital_elements> is 0, we use DE430
-            if (s->use_orbital_elements == 0)
-                jpl_computeEphemeris(s->body_id[i], jd, &x, &y, &z, &ra, &dec, &mag, &phase, &ang_size, &phy_size,
-                                     &albedo,
-                                     &sun_dist, &earth_dist, &sun_ang_dist, &theta_eso, &ecliptic_longitude,
-                                     &ecliptic_latitude, &ecliptic_distance, s->ra_dec_epoch,
-                                     s->enable_topocentric_correction,
-                                     s->latitude, s->longitude);
-
-                // If the <use_orbital_elements> is 1, we use orbital elements
-            else if (s->use_orbital_elements == 1)
-                orbitalElements_computeEphemeris(s->body_id[i], jd, &x, &y, &z, &ra, &dec, &mag, &phase, &ang_size,
-                                                 &phy_size,
-                                                 &albedo, &sun_dist, &earth_dist, &sun_ang_dist, &theta_eso,
-                                                 &ecliptic_longitude, &ecliptic_latitude,
-                                                 &ecliptic_distance, s->ra_dec_epoch,
-                                                 s->enable_topocentric_correction,
-                                                 s->latitude, s->longitude);
-
-            // Negative output formats use ecliptic coordinates, not RA and Declination
-            if (s->output_format < 0) {
-                double x2, y2, z2;
-                double epsilon = (23. + 26. / 60. + 21.448 / 3600.) / 180. * M_PI; // Meeus (22.2)
-
-                // negative x-axis points to the vernal equinox; (y,z) get tipped up by 23.5 degrees from (ra,dec)
-                // to equatorial coordinates
-                x2 = x;
-                y2 = cos(epsilon) * y + sin(epsilon) * z;
-                z2 = -sin(epsilon) * y + cos(epsilon) * z;
-                x = x2;
-                y = y2;
-                z = z2;
-            }
-
-            // Convert ecliptic longitude we output to epoch of observation
-            double eclTo_lat, eclTo_lng;
-            precess(2451545.0, jd, ecliptic_longitude, ecliptic_latitude, &eclTo_lng, &eclTo_lat);
-
-
-            buffer[o + 0] = x;
-            buffer[o + 1] = y;
-            buffer[o + 2] = z;
-            buffer[o + 3] = ra;
-            buffer[o + 4] = dec;
-            buffer[o + 5] = mag;
-            buffer[o + 6] = phase;
-            buffer[o + 7] = ang_size;
-            buffer[o + 8] = phy_size;
-            buffer[o + 9] = albedo;
-            buffer[o + 10] = sun_dist;
-            buffer[o + 11] = earth_dist;
-            buffer[o + 12] = sun_ang_dist;
-            buffer[o + 13] = theta_eso;
-            buffer[o + 14] = eclTo_lng; // ecliptic longitude in epoch of jd, not J2000.0
-            buffer[o + 15] = ecliptic_distance;
-            buffer[o + 16] = eclTo_lat;
-
-            // fix ecliptic longitude for precession of the equinoxes
-            if (buffer[o + 14] > M_PI) buffer[o + 14] -= 2 * M_PI;
-            if (buffer[o + 14] < -M_PI) buffer[o + 14] += 2 * M_PI;
-        }
-
-        // Produce output to file -- loop over objects producing a set of columns for each
-        for (i = 0; i < s->objects_count; i++) {
-            const int o = i * N_PARAMETERS;
-
-            // Produce text-based output
-            if (!s->output_binary) {
-                //-1 - x y z   (ecliptic)
-                // 0 - x y z   (J2000)
-                // 1 - ra dec  (degrees)
-                // 2 - x y z ra dec mag phase AngSize
-                // 3 - x y z ra dec mag phase AngSize physical_size albedo
-
-                // Write XYZ coordinates (in all modes but 1)
-                if (s->output_format != 1) {
-                    fprintf(output, "%12.9f %12.9f %12.9f   ", buffer[o + 0], buffer[o + 1], buffer[o + 2]);
-                }
-
-                // Write RA and Dec in modes 1,2,3
-                if (s->output_format >= 1) {
-                    fprintf(output, "%12.9f %12.9f   ", buffer[o + 3]*180/M_PI, buffer[o + 4]*180/M_PI);
-                }
-
-                // Write magnitude, phase and angular size in modes 2,3
-                if (s->output_format >= 2) {
-                    fprintf(output, "%6.3f %7.4f %12.9f   ", buffer[o + 5], buffer[o + 6], buffer[o + 7]);
-                }
-
-                // Write physical size, albedo, sun_dist, earth_dist, sun_ang_dist, theta_edo, eclLng, eclDist, eclLat
-                if (s->output_format >= 3) {
-                    fprintf(output, "%12.6e %8.5f %12.9f %12.9f %12.9f %12.9f %12.9f %12.9f %12.9f  ", buffer[o + 8],
-                            buffer[o + 9], buffer[o + 10], buffer[o + 11], buffer[o + 12], buffer[o + 13],
-                            buffer[o + 14], buffer[o + 15], buffer[o + 16]);
-                }
-            }
-
-                // Produce binary output
-            else {
-                if (s->output_format != 1) fwrite((void *) (buffer + o + 0), sizeof(double), 3, output);
-                if (s->output_format >= 1) fwrite((void *) (buffer + o + 3), sizeof(double), 2, output);
-                if (s->output_format >= 2) fwrite((void *) (buffer + o + 5), sizeof(double), 3, output);
-                if (s->output_format >= 3) fwrite((void *) (buffer + o + 8), sizeof(double), 9, output);
-            }
-        }
-        if (!s->output_binary) fprintf(output, "\n");
-    }
-
-    if (DEBUG) {
-        char line[FNAME_LENGTH];
-        strcpy(line, "Finished computing ephemeris.");
-        ephem_log(line);
-    }
+    ephem_context_init(&context, s);
+    ephem_context_compute(&context, output);
     fclose(output);
     settings_close(s);
 }
@@ -235,9 +101,21 @@ int main_args(int argc, const char **argv) {
             OPT_INTEGER('o', "use_orbital_elements", &ephemeris_settings.use_orbital_elements,
                         "Set the either 0 (use DE430) or 1 (use orbital elements)"),
             OPT_INTEGER('b', "output_binary", &ephemeris_settings.output_binary,
-                        "Set to either 0 (text output) or 1 (binary output)"),
+                        "Set to either 0 (text output), 1 (raw binary output) or 2 (columnar binary output)"),
+            OPT_INTEGER('v', "output_velocity", &ephemeris_settings.output_velocity,
+                        "Set to either 0 (no velocities) or 1 (append vx vy vz, in AU/day, to each object's columns)"),
+            OPT_FLOAT('k', "interpolation_tolerance", &ephemeris_settings.interpolation_tolerance,
+                      "If positive, compute a coarse grid of times in full, and interpolate between them to this "
+                      "accuracy (arcsec). Speeds up ephemerides with closely-spaced time steps."),
             OPT_STRING('o', "objects", &ephemeris_settings.objects_input_list,
                        "The list of objects to produce ephemerides for. See README.md."),
+            OPT_STRING('f', "objects_file", &ephemeris_settings.objects_input_file,
+                       "A file listing the objects to produce ephemerides for, one or more per line; - for stdin"),
+            OPT_STRING('i', "sites", &ephemeris_settings.sites_input_list,
+                       "A list of observation sites, as latitude,longitude (deg) separated by semicolons. The "
+                       "ephemeris is computed topocentrically for each site in turn."),
+            OPT_STRING('j', "sites_file", &ephemeris_settings.sites_input_file,
+                       "A file listing observation sites, as latitude and longitude (deg), one per line; - for stdin"),
             OPT_END(),
     };
 
@@ -278,9 +156,6 @@ int main_args(int argc, const char **argv) {
 #endif
 
 // my_program.c
-static char body[20];
-static settings ephemeris_settings;
-
 char *datadir;
 char *srcdir;
 
@@ -324,8 +199,16 @@ void print_ra_dec(double ra, double dec) {
 
 double *ephem(const char *body, double jd, double latitude, double longitude)
 {
-  double ra, dec, mag;
-  printf("selected body: **%s**\n", body);
+  // Each thread has its own settings and results, so threads may call this at once. The results returned are
+  // overwritten by the next call from the same thread.
+  static EPHEM_THREAD_LOCAL settings ephemeris_settings;
+  static EPHEM_THREAD_LOCAL ephem_context context;
+
+  if (DEBUG) {
+    char message[FNAME_LENGTH];
+    snprintf(message, sizeof(message), "Selected body: <%s>.", body);
+    ephem_log(message);
+  }
   // Set up default settings
   settings_default(&ephemeris_settings);
   ephemeris_settings.objects_input_list = body;
@@ -337,9 +220,12 @@ double *ephem(const char *body, double jd, double latitude, double longitude)
   ephemeris_settings.enable_topocentric_correction = 0.0;
   ephemeris_settings.output_format = 2.0;
 
-  // Create ephemeris
-  compute_ephemeris(&ephemeris_settings);
-  return buffer;
+  // Create ephemeris, keeping only the results
+  settings_process(&ephemeris_settings);
+  ephem_context_init(&context, &ephemeris_settings);
+  ephem_context_compute(&context, NULL);
+  settings_close(&ephemeris_settings);
+  return context.results;
 }
 
 int ephem_main(const char *data, const char *src) {
@@ -0,0 +1,328 @@
+// chebyshev.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+// Pick the widest vector unit the compiler has been told it may use. Each kernel performs exactly the same sequence of
+// multiplications, subtractions and additions as the scalar function <chebyshev>, in every lane, so all of them give
+// bit-identical results. We deliberately avoid fused multiply-add instructions for this reason, and stop the compiler
+// from fusing them itself: by default GCC and clang contract a*b+c into one instruction wherever the target has one
+// (e.g. arm64, or x86 built with -mfma), which rounds differently, and would do so differently in each kernel.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CHEBYSHEV_AVX 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CHEBYSHEV_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CHEBYSHEV_NEON 1
+#endif
+
+#include "coreUtils/errorReport.h"
+
+#include "chebyshev.h"
+
+//! chebyshev - Evaluate a Chebyshev polynomial
+//! \param coeffs - The coefficients of the Chebyshev polynomial
+//! \param Ncoeff - The number of coefficients
+//! \param x - The point at which to evaluate the Chebyshev polynomial
+//! \return The value of the Chebyshev polynomial
+
+double chebyshev(const double *coeffs, int Ncoeff, double x) {
+    double x2 = 2 * x;
+    double d = 0, dd = 0, ddd = 0;
+    int k = Ncoeff - 1;
+
+    while (k > 0) {
+        ddd = dd;
+        dd = d;
+        d = x2 * dd - ddd + coeffs[k];
+        k--;
+    }
+    return x * d - dd + coeffs[0];
+}
+
+// The Clenshaw recurrence for a Chebyshev series f(x) = sum c_k T_k(x) is
+//   b_k = 2x b_{k+1} - b_{k+2} + c_k ;  f = x b_1 - b_2 + c_0
+// Differentiating it with respect to x gives a second recurrence which runs alongside the first
+//   b'_k = 2 b_{k+1} + 2x b'_{k+1} - b'_{k+2} ;  f' = b_1 + x b'_1 - b'_2
+// In the kernels below, <d>, <dd> and <ddd> hold b_k, b_{k+1} and b_{k+2}; <e>, <ee> and <eee> hold their derivatives.
+
+#if CHEBYSHEV_AVX
+
+//! chebyshev3_avx - Evaluate three Chebyshev series at once, holding the x, y and z axes in three lanes of a 256-bit
+//! AVX register.
+
+static void chebyshev3_avx(const double *coeffs, int Ncoeff, double x, double *out, double *out_dot) {
+    const double *cx = coeffs, *cy = coeffs + Ncoeff, *cz = coeffs + 2 * Ncoeff;
+    const __m256d xv = _mm256_set1_pd(x);
+    const __m256d x2 = _mm256_set1_pd(2 * x);
+    __m256d d = _mm256_setzero_pd(), dd = d, ddd;
+    double result[4];
+    int k;
+
+    if (out_dot == NULL) {
+        for (k = Ncoeff - 1; k > 0; k--) {
+            ddd = dd;
+            dd = d;
+            d = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(x2, dd), ddd), _mm256_set_pd(0, cz[k], cy[k], cx[k]));
+        }
+    } else {
+        const __m256d two = _mm256_set1_pd(2);
+        __m256d e = _mm256_setzero_pd(), ee = e, eee;
+        for (k = Ncoeff - 1; k > 0; k--) {
+            ddd = dd;
+            dd = d;
+            eee = ee;
+            ee = e;
+            d = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(x2, dd), ddd), _mm256_set_pd(0, cz[k], cy[k], cx[k]));
+            e = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(two, dd), _mm256_mul_pd(x2, ee)), eee);
+        }
+        _mm256_storeu_pd(result, _mm256_sub_pd(_mm256_add_pd(d, _mm256_mul_pd(xv, e)), ee));
+        out_dot[0] = result[0];
+        out_dot[1] = result[1];
+        out_dot[2] = result[2];
+    }
+
+    _mm256_storeu_pd(result, _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(xv, d), dd),
+                                           _mm256_set_pd(0, cz[0], cy[0], cx[0])));
+    out[0] = result[0];
+    out[1] = result[1];
+    out[2] = result[2];
+}
+
+#elif CHEBYSHEV_SSE2
+
+//! chebyshev3_sse2 - Evaluate three Chebyshev series at once, holding the x and y axes in one 128-bit SSE2 register
+//! and the z axis in a second.
+
+static void chebyshev3_sse2(const double *coeffs, int Ncoeff, double x, double *out, double *out_dot) {
+    const double *cx = coeffs, *cy = coeffs + Ncoeff, *cz = coeffs + 2 * Ncoeff;
+    const __m128d xv = _mm_set1_pd(x);
+    const __m128d x2 = _mm_set1_pd(2 * x);
+    __m128d d_xy = _mm_setzero_pd(), dd_xy = d_xy, ddd_xy;
+    __m128d d_z = _mm_setzero_pd(), dd_z = d_z, ddd_z;
+    int k;
+
+    if (out_dot == NULL) {
+        for (k = Ncoeff - 1; k > 0; k--) {
+            ddd_xy = dd_xy;
+            dd_xy = d_xy;
+            ddd_z = dd_z;
+            dd_z = d_z;
+            d_xy = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(x2, dd_xy), ddd_xy), _mm_set_pd(cy[k], cx[k]));
+            d_z = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(x2, dd_z), ddd_z), _mm_set_sd(cz[k]));
+        }
+    } else {
+        const __m128d two = _mm_set1_pd(2);
+        __m128d e_xy = _mm_setzero_pd(), ee_xy = e_xy, eee_xy;
+        __m128d e_z = _mm_setzero_pd(), ee_z = e_z, eee_z;
+        for (k = Ncoeff - 1; k > 0; k--) {
+            ddd_xy = dd_xy;
+            dd_xy = d_xy;
+            ddd_z = dd_z;
+            dd_z = d_z;
+            eee_xy = ee_xy;
+            ee_xy = e_xy;
+            eee_z = ee_z;
+            ee_z = e_z;
+            d_xy = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(x2, dd_xy), ddd_xy), _mm_set_pd(cy[k], cx[k]));
+            d_z = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(x2, dd_z), ddd_z), _mm_set_sd(cz[k]));
+            e_xy = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(two, dd_xy), _mm_mul_pd(x2, ee_xy)), eee_xy);
+            e_z = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(two, dd_z), _mm_mul_pd(x2, ee_z)), eee_z);
+        }
+        _mm_storeu_pd(out_dot, _mm_sub_pd(_mm_add_pd(d_xy, _mm_mul_pd(xv, e_xy)), ee_xy));
+        _mm_store_sd(out_dot + 2, _mm_sub_pd(_mm_add_pd(d_z, _mm_mul_pd(xv, e_z)), ee_z));
+    }
+
+    _mm_storeu_pd(out, _mm_add_pd(_mm_sub_pd(_mm_mul_pd(xv, d_xy), dd_xy), _mm_set_pd(cy[0], cx[0])));
+    _mm_store_sd(out + 2, _mm_add_pd(_mm_sub_pd(_mm_mul_pd(xv, d_z), dd_z), _mm_set_sd(cz[0])));
+}
+
+#elif CHEBYSHEV_NEON
+
+//! chebyshev3_neon - Evaluate three Chebyshev series at once, holding the x and y axes in one 128-bit NEON register
+//! and the z axis in a second.
+
+static void chebyshev3_neon(const double *coeffs, int Ncoeff, double x, double *out, double *out_dot) {
+    const double *cx = coeffs, *cy = coeffs + Ncoeff, *cz = coeffs + 2 * Ncoeff;
+    const float64x2_t xv = vdupq_n_f64(x);
+    const float64x2_t x2 = vdupq_n_f64(2 * x);
+    float64x2_t d_xy = vdupq_n_f64(0), dd_xy = d_xy, ddd_xy;
+    float64x2_t d_z = vdupq_n_f64(0), dd_z = d_z, ddd_z;
+    int k;
+
+    if (out_dot == NULL) {
+        for (k = Ncoeff - 1; k > 0; k--) {
+            ddd_xy = dd_xy;
+            dd_xy = d_xy;
+            ddd_z = dd_z;
+            dd_z = d_z;
+            d_xy = vaddq_f64(vsubq_f64(vmulq_f64(x2, dd_xy), ddd_xy), vcombine_f64(vld1_f64(cx + k), vld1_f64(cy + k)));
+            d_z = vaddq_f64(vsubq_f64(vmulq_f64(x2, dd_z), ddd_z), vdupq_n_f64(cz[k]));
+        }
+    } else {
+        const float64x2_t two = vdupq_n_f64(2);
+        float64x2_t e_xy = vdupq_n_f64(0), ee_xy = e_xy, eee_xy;
+        float64x2_t e_z = vdupq_n_f64(0), ee_z = e_z, eee_z;
+        for (k = Ncoeff - 1; k > 0; k--) {
+            ddd_xy = dd_xy;
+            dd_xy = d_xy;
+            ddd_z = dd_z;
+            dd_z = d_z;
+            eee_xy = ee_xy;
+            ee_xy = e_xy;
+            eee_z = ee_z;
+            ee_z = e_z;
+            d_xy = vaddq_f64(vsubq_f64(vmulq_f64(x2, dd_xy), ddd_xy), vcombine_f64(vld1_f64(cx + k), vld1_f64(cy + k)));
+            d_z = vaddq_f64(vsubq_f64(vmulq_f64(x2, dd_z), ddd_z), vdupq_n_f64(cz[k]));
+            e_xy = vsubq_f64(vaddq_f64(vmulq_f64(two, dd_xy), vmulq_f64(x2, ee_xy)), eee_xy);
+            e_z = vsubq_f64(vaddq_f64(vmulq_f64(two, dd_z), vmulq_f64(x2, ee_z)), eee_z);
+        }
+        vst1q_f64(out_dot, vsubq_f64(vaddq_f64(d_xy, vmulq_f64(xv, e_xy)), ee_xy));
+        out_dot[2] = vgetq_lane_f64(vsubq_f64(vaddq_f64(d_z, vmulq_f64(xv, e_z)), ee_z), 0);
+    }
+
+    vst1q_f64(out, vaddq_f64(vsubq_f64(vmulq_f64(xv, d_xy), dd_xy), vcombine_f64(vld1_f64(cx), vld1_f64(cy))));
+    out[2] = vgetq_lane_f64(vaddq_f64(vsubq_f64(vmulq_f64(xv, d_z), dd_z), vdupq_n_f64(cz[0])), 0);
+}
+
+#else
+
+//! chebyshev3_scalar - Evaluate three Chebyshev series at once, interleaving the three recurrences so that the CPU
+//! can overlap them.
+
+static void chebyshev3_scalar(const double *coeffs, int Ncoeff, double x, double *out, double *out_dot) {
+    const double *c[3] = {coeffs, coeffs + Ncoeff, coeffs + 2 * Ncoeff};
+    const double x2 = 2 * x;
+    double d[3] = {0, 0, 0}, dd[3] = {0, 0, 0}, ddd[3];
+    double e[3] = {0, 0, 0}, ee[3] = {0, 0, 0}, eee[3];
+    int j, k;
+
+    for (k = Ncoeff - 1; k > 0; k--) {
+        for (j = 0; j < 3; j++) {
+            ddd[j] = dd[j];
+            dd[j] = d[j];
+            d[j] = x2 * dd[j] - ddd[j] + c[j][k];
+        }
+        if (out_dot != NULL) {
+            for (j = 0; j < 3; j++) {
+                eee[j] = ee[j];
+                ee[j] = e[j];
+                e[j] = 2 * dd[j] + x2 * ee[j] - eee[j];
+            }
+        }
+    }
+
+    for (j = 0; j < 3; j++) out[j] = x * d[j] - dd[j] + c[j][0];
+    if (out_dot != NULL) {
+        for (j = 0; j < 3; j++) out_dot[j] = d[j] + x * e[j] - ee[j];
+    }
+}
+
+#endif
+
+//! chebyshev3 - Evaluate three Chebyshev series with the same length, whose coefficients are stored one after another
+//! (as the x, y and z coordinates of each body are stored in DE430), and optionally their derivatives, in one pass.
+//! The values are bit-identical to those returned by calling <chebyshev> on each series in turn.
+//! \param [in] coeffs - The coefficients of the three series, stored consecutively (3 * Ncoeff values)
+//! \param [in] Ncoeff - The number of coefficients in each series
+//! \param [in] x - The point at which to evaluate the series, in the range -1 to 1
+//! \param [out] out - The values of the three series
+//! \param [out] out_dot - The derivatives of the three series with respect to <x>. May be NULL if not wanted.
+
+void chebyshev3(const double *coeffs, int Ncoeff, double x, double *out, double *out_dot) {
+#if CHEBYSHEV_AVX
+    chebyshev3_avx(coeffs, Ncoeff, x, out, out_dot);
+#elif CHEBYSHEV_SSE2
+    chebyshev3_sse2(coeffs, Ncoeff, x, out, out_dot);
+#elif CHEBYSHEV_NEON
+    chebyshev3_neon(coeffs, Ncoeff, x, out, out_dot);
+#else
+    chebyshev3_scalar(coeffs, Ncoeff, x, out, out_dot);
+#endif
+}
+
+//! chebyshev3_kernel_name - Return the name of the vector instruction set used by <chebyshev3> in this build
+//! \return - Name of the kernel
+
+const char *chebyshev3_kernel_name() {
+#if CHEBYSHEV_AVX
+    return "avx";
+#elif CHEBYSHEV_SSE2
+    return "sse2";
+#elif CHEBYSHEV_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+//! chebyshev_node - Return one of the points at which a function must be sampled for <chebyshev_fit> to fit a
+//! Chebyshev series to it. These are the zeros of the Chebyshev polynomial T_Ncoeff, and run from near 1 down to
+//! near -1.
+//! \param [in] j - The number of the point, from 0 to Ncoeff-1
+//! \param [in] Ncoeff - The number of coefficients in the series to be fitted
+//! \return - The point, in the range -1 to 1
+
+double chebyshev_node(int j, int Ncoeff) {
+    return cos(M_PI * (j + 0.5) / Ncoeff);
+}
+
+//! chebyshev_fit - Fit Chebyshev series to a set of functions, each sampled at the points given by <chebyshev_node>.
+//! Each series passes exactly through every sample of its function, and may be evaluated with <chebyshev>.
+//! \param [in] values - The value of each function at each point. The value of function v at point j is
+//! <values[j * count + v]>.
+//! \param [in] count - The number of functions
+//! \param [in] Ncoeff - The number of points, and of coefficients to fit to each function
+//! \param [out] coeffs - The coefficients of the fitted series. The series for function v is held in
+//! <coeffs[v * Ncoeff]> to <coeffs[v * Ncoeff + Ncoeff - 1]>.
+
+void chebyshev_fit(const double *values, int count, int Ncoeff, double *coeffs) {
+    // Tabulate T_k at each point, which is the same for every function
+    double *basis = (double *) malloc(Ncoeff * Ncoeff * sizeof(double));
+    if (basis == NULL) {
+        ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+        exit(1);
+    }
+    for (int k = 0; k < Ncoeff; k++) {
+        for (int j = 0; j < Ncoeff; j++) basis[k * Ncoeff + j] = cos(M_PI * k * (j + 0.5) / Ncoeff);
+    }
+
+    for (int v = 0; v < count; v++) {
+        for (int k = 0; k < Ncoeff; k++) {
+            double sum = 0;
+            for (int j = 0; j < Ncoeff; j++) sum += values[j * count + v] * basis[k * Ncoeff + j];
+            coeffs[v * Ncoeff + k] = ((k == 0) ? 1. : 2.) * sum / Ncoeff;
+        }
+    }
+
+    free(basis);
+}
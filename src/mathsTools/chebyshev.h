@@ -0,0 +1,36 @@
+// chebyshev.h
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+#ifndef CHEBYSHEV_H
+#define CHEBYSHEV_H 1
+
+double chebyshev(const double *coeffs, int Ncoeff, double x);
+
+void chebyshev3(const double *coeffs, int Ncoeff, double x, double *out, double *out_dot);
+
+const char *chebyshev3_kernel_name();
+
+double chebyshev_node(int j, int Ncoeff);
+
+void chebyshev_fit(const double *values, int count, int Ncoeff, double *coeffs);
+
+#endif
+
@@ -0,0 +1,354 @@
+// server.c
+//
+// -------------------------------------------------
+// Copyright 2015-2024 Dominic Ford
+//
+// This file is part of EphemerisCompute.
+//
+// EphemerisCompute is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// EphemerisCompute is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with EphemerisCompute.  If not, see <http://www.gnu.org/licenses/>.
+// -------------------------------------------------
+
+// This is a long-running server which loads the ephemeris data once, and then answers any number of requests for
+// ephemerides, without paying the cost of starting a new process for each one.
+
+// On the command line, you may optionally specify:
+// * The path of a Unix domain socket to listen on. Each connection is served by its own thread, so several clients
+//   may be answered at once. If no path is given, or the path is -, requests are read from stdin and answered on
+//   stdout, one at a time.
+// * The largest number of values (time steps multiplied by objects, and by sites if several are listed) which a
+//   single request may ask for (default 10000000). Each response is assembled in memory before it is sent, so this
+//   bounds the memory used per request.
+
+// Each request is one line of text, containing settings of the form <name>=<value>, separated by spaces. The names
+// are the same as those of the command-line options of ephem.bin: objects, jd_min, jd_max, jd_step, latitude,
+// longitude, sites, enable_topocentric_correction, epoch, output_format, output_binary, output_velocity,
+// interpolation_tolerance and use_orbital_elements. Settings which are not given take the same default values as in
+// ephem.bin. For example:
+//
+//   objects=mars,jupiter jd_min=2451545 jd_max=2451555 jd_step=1 output_format=3
+//
+// Each response begins with a line reading either <OK n>, followed by the n bytes of the ephemeris exactly as
+// ephem.bin would write it (as text or as binary, according to <output_binary>), or <ERROR message>. Blank lines
+// are ignored, and a line reading <quit> ends the session.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#include "coreUtils/asciiDouble.h"
+#include "coreUtils/strConstants.h"
+#include "coreUtils/errorReport.h"
+
+#include "ephemCalc/ephemContext.h"
+#include "ephemCalc/jpl.h"
+#include "ephemCalc/orbitalElements.h"
+
+#include "listTools/ltMemory.h"
+
+#include "settings/settings.h"
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define SERVER_AVAILABLE 1
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+//! The default for the largest number of values which a single request may ask for
+#define SERVER_DEFAULT_MAX_VALUES 10000000
+
+//! The largest number of values which a single request may ask for
+static double server_max_values = SERVER_DEFAULT_MAX_VALUES;
+
+//! server_setting - A setting which may be given in a request, and where it is stored in a <settings> structure
+
+typedef struct {
+    const char *name;
+    char type;  // 'f' for a double, 'i' for an int, 's' for a string
+    size_t offset;  // The offset of the setting within <settings>
+} server_setting;
+
+static const server_setting server_settings[] = {
+        {"objects",                       's', offsetof(settings, objects_input_list)},
+        {"jd_min",                        'f', offsetof(settings, jd_min)},
+        {"jd_max",                        'f', offsetof(settings, jd_max)},
+        {"jd_step",                       'f', offsetof(settings, jd_step)},
+        {"latitude",                      'f', offsetof(settings, latitude)},
+        {"longitude",                     'f', offsetof(settings, longitude)},
+        {"sites",                         's', offsetof(settings, sites_input_list)},
+        {"enable_topocentric_correction", 'i', offsetof(settings, enable_topocentric_correction)},
+        {"epoch",                         'f', offsetof(settings, ra_dec_epoch)},
+        {"output_format",                 'i', offsetof(settings, output_format)},
+        {"output_binary",                 'i', offsetof(settings, output_binary)},
+        {"output_velocity",               'i', offsetof(settings, output_velocity)},
+        {"interpolation_tolerance",       'f', offsetof(settings, interpolation_tolerance)},
+        {"use_orbital_elements",          'i', offsetof(settings, use_orbital_elements)}
+};
+
+//! server_parseRequest - Parse a request into a settings structure
+//! \param [in] line - The request, which is modified by having its settings null-terminated. The settings structure
+//! refers to it, so it must stay in place until the request has been answered.
+//! \param [out] s - The settings structure to populate
+//! \return - Zero on success; otherwise the problem is described in <temp_err_string>
+
+static int server_parseRequest(char *line, settings *s) {
+    char *save = NULL;
+
+    settings_default(s);
+
+    for (char *word = strtok_r(line, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save)) {
+        char *value = strchr(word, '=');
+        if (value == NULL) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Expected <name>=<value>, but received <%s>", word);
+            return 1;
+        }
+        *(value++) = '\0';
+
+        const server_setting *setting = NULL;
+        for (int i = 0; i < (int) (sizeof(server_settings) / sizeof(server_settings[0])); i++) {
+            if (strcmp(word, server_settings[i].name) == 0) setting = &server_settings[i];
+        }
+        if (setting == NULL) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Unrecognised setting <%s>", word);
+            return 1;
+        }
+
+        void *target = ((char *) s) + setting->offset;
+        if (setting->type == 's') {
+            *((const char **) target) = value;
+            continue;
+        }
+
+        // Integer settings must consist entirely of an integer, rather than being rounded from e.g. 2.7
+        if (setting->type == 'i') {
+            char *end;
+            errno = 0;
+            const long integer = strtol(value, &end, 10);
+            if ((end == value) || (*end != '\0') || (errno != 0) || (integer < INT_MIN) || (integer > INT_MAX)) {
+                snprintf(temp_err_string, FNAME_LENGTH, "Setting <%s> should be an integer, but received <%s>",
+                         word, value);
+                return 1;
+            }
+            *((int *) target) = (int) integer;
+            continue;
+        }
+
+        // Other numeric settings must consist entirely of a number
+        int end = (int) strlen(value);
+        if (!valid_float(value, &end)) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Setting <%s> should be a number, but received <%s>", word, value);
+            return 1;
+        }
+        *((double *) target) = get_float(value, NULL);
+    }
+
+    // Reject requests which the engine cannot answer, rather than terminating the server
+    if (!(s->jd_step > 0) || !(s->jd_max >= s->jd_min)) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Invalid range of times: jd_min=%f jd_max=%f jd_step=%f",
+                 s->jd_min, s->jd_max, s->jd_step);
+        return 1;
+    }
+    if ((s->output_format < -1) || (s->output_format > 3) || (s->output_binary < 0) || (s->output_binary > 2)) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Invalid output format: output_format=%d output_binary=%d",
+                 s->output_format, s->output_binary);
+        return 1;
+    }
+    return 0;
+}
+
+//! server_answer - Answer a single request
+//! \param [in] line - The request, which is modified while it is parsed
+//! \param [in] output - The stream to write the response to
+
+static void server_answer(char *line, FILE *output) {
+    settings s;
+    char *response = NULL;
+    size_t response_length = 0;
+
+    // Check the request, and that all of its objects are recognised, before starting to compute anything. The lists
+    // of objects and sites are resolved here, once, and <ephem_context_compute> uses them as they are.
+    int status = server_parseRequest(line, &s);
+    if (status == 0) status = settings_resolveObjects(&s);
+    if (status == 0) status = settings_resolveSites(&s);
+    if ((status == 0) && (s.objects_count == 0)) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Request lists no objects");
+        status = 1;
+    }
+    if (status == 0) {
+        // Check the number of time steps on its own too, so that it cannot overflow the engine's step counter
+        const double steps = ceil((s.jd_max - s.jd_min) / s.jd_step);
+        const double values = steps * s.objects_count * ((s.sites_count > 0) ? s.sites_count : 1);
+        if ((steps > server_max_values) || (steps >= INT_MAX) || (values > server_max_values)) {
+            snprintf(temp_err_string, FNAME_LENGTH, "Request is too large: %.0f values, but at most %.0f allowed",
+                     values, server_max_values);
+            status = 1;
+        }
+    }
+
+    // Compute the ephemeris into memory, so that its length can be sent before it
+    if (status == 0) {
+        ephem_context *context = (ephem_context *) malloc(sizeof(ephem_context));
+        FILE *stream = open_memstream(&response, &response_length);
+        if ((context == NULL) || (stream == NULL)) {
+            ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+            exit(1);
+        }
+        ephem_context_init(context, &s);
+        ephem_context_compute(context, stream);
+        fclose(stream);
+        free(context);
+    }
+
+    if (status == 0) {
+        fprintf(output, "OK %lu\n", (unsigned long) response_length);
+        fwrite(response, 1, response_length, output);
+    } else {
+        fprintf(output, "ERROR %s\n", temp_err_string);
+    }
+    fflush(output);
+
+    free(response);
+    settings_close(&s);
+}
+
+//! server_serveStream - Answer requests read from a stream, one at a time, until the stream ends or a client says
+//! <quit>
+//! \param [in] input - The stream to read requests from
+//! \param [in] output - The stream to write responses to
+
+static void server_serveStream(FILE *input, FILE *output) {
+    char *line = NULL;
+    size_t line_allocated = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &line_allocated, input)) >= 0) {
+        while ((length > 0) && ((line[length - 1] == '\n') || (line[length - 1] == '\r'))) line[--length] = '\0';
+        const char *start = line;
+        while ((*start > '\0') && (*start <= ' ')) start++;
+        if (*start == '\0') continue;
+        if (strcmp(start, "quit") == 0) break;
+        server_answer(line, output);
+    }
+
+    free(line);
+}
+
+//! server_connectionThread - Serve a single client which has connected to the Unix domain socket
+//! \param [in] arg - Pointer to the file descriptor of the connection, which this thread takes ownership of
+//! \return - NULL
+
+static void *server_connectionThread(void *arg) {
+    const int connection = *((int *) arg);
+    free(arg);
+
+    FILE *input = fdopen(connection, "r");
+    FILE *output = fdopen(dup(connection), "w");
+    if ((input != NULL) && (output != NULL)) server_serveStream(input, output);
+    if (output != NULL) fclose(output);
+    if (input != NULL) fclose(input);
+    else close(connection);
+    return NULL;
+}
+
+//! server_listen - Listen on a Unix domain socket, serving each client which connects in a thread of its own
+//! \param [in] path - The path of the socket
+//! \return - Nonzero if the socket could not be set up; otherwise this never returns
+
+static int server_listen(const char *path) {
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Socket path <%s> is too long.", path);
+        ephem_error(temp_err_string);
+        return 1;
+    }
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if ((listener < 0) || (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0) ||
+        (listen(listener, SOMAXCONN) != 0)) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Could not listen on socket <%s>.", path);
+        ephem_error(temp_err_string);
+        return 1;
+    }
+
+    snprintf(temp_err_string, FNAME_LENGTH, "Listening on socket <%s>.", path);
+    ephem_report(temp_err_string);
+
+    while (1) {
+        const int connection = accept(listener, NULL, NULL);
+        if (connection < 0) continue;
+
+        int *arg = (int *) malloc(sizeof(int));
+        pthread_t thread;
+        if (arg == NULL) {
+            ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+            exit(1);
+        }
+        *arg = connection;
+        if (pthread_create(&thread, NULL, server_connectionThread, arg) != 0) {
+            close(connection);
+            free(arg);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+#endif
+
+int server_main(int argc, char **argv) {
+    // Initialise sub-modules
+    lt_memoryInit(&ephem_error, &ephem_log);
+
+#ifdef SERVER_AVAILABLE
+    // The largest number of values per request must consist entirely of a positive number
+    int end = (argc > 2) ? (int) strlen(argv[2]) : 0;
+    if ((argc > 3) || ((argc > 2) && (!valid_float(argv[2], &end) || !(get_float(argv[2], NULL) > 0)))) {
+        ephem_error("Usage: server.bin [<socket path> | -] [<max values per request>]");
+        return 1;
+    }
+    if (argc > 2) server_max_values = get_float(argv[2], NULL);
+
+    // A client which disconnects before reading its response should not terminate the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // Load the catalogue of planets and DE430 once, up front, rather than when the first request arrives. Comets
+    // and asteroids are loaded the first time that they are requested, and then kept for all later requests.
+    orbitalElements_planets_init();
+    jpl_setActiveWindow(2451545.0, 2451545.0);
+
+    if ((argc > 1) && (strcmp(argv[1], "-") != 0)) {
+        if (server_listen(argv[1]) != 0) return 1;
+    } else {
+        server_serveStream(stdin, stdout);
+    }
+#else
+    ephem_error("The ephemeris server is not available on this platform.");
+    return 1;
+#endif
+
+    lt_freeAll(0);
+    lt_memoryStop();
+    return 0;
+}
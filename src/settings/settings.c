@@ -26,6 +26,8 @@
 #include <unistd.h>
 #include <coreUtils/errorReport.h>
 
+#include <gsl/gsl_math.h>
+
 #include "coreUtils/asciiDouble.h"
 #include "ephemCalc/orbitalElements.h"
 
@@ -44,104 +46,256 @@ void settings_default(settings *i) {
     i->use_orbital_elements = 0;
     i->output_constellations = 0;
     i->output_binary = 0;
+    i->output_velocity = 0;
+    i->interpolation_tolerance = 0;
     i->objects_count = 0;
+    i->objects_allocated = 0;
+    i->body_id = NULL;
     i->objects_input_list = "jupiter";
+    i->objects_input_file = NULL;
+    i->sites_count = 0;
+    i->sites_allocated = 0;
+    i->site_latitude = NULL;
+    i->site_longitude = NULL;
+    i->sites_input_list = NULL;
+    i->sites_input_file = NULL;
 }
 
-// Process the contents of a settings structure before producing the ephemeris
-void settings_process(settings *i) {
-    int k, l;
+//! settings_addObject - Add an object, given by name, to the list of objects to compute ephemerides for
+//! \param [in,out] i - The settings to add the object to
+//! \param [in] object_name - The name of the object; need not be null-terminated
+//! \param [in] length - The number of characters in <object_name>
+//! \return - Zero on success; otherwise the object was not recognised, as described in <temp_err_string>
+
+static int settings_addObject(settings *i, const char *object_name, int length) {
     char name[FNAME_LENGTH];
 
-    // Transfer the names of objects we are to compute ephemerides for from <i->objects_input_list> to <i->object_name>
-    k = l = 0;
-    while (i->objects_input_list[k] > '\0') {
-        // Commas are used to separate object names on the command line
-        if (i->objects_input_list[k] == ',') {
-            if (l > 0) {
-                i->object_name[i->objects_count][l] = '\0';
-                i->objects_count++;
-                l = 0;
-            }
-            k++; // next character
-            continue;
+    if (length >= FNAME_LENGTH) length = FNAME_LENGTH - 1;
+    memcpy(name, object_name, length);
+    name[length] = '\0';
+    str_strip(name, name);
+    str_lower(name, name);
+
+    // Skip empty names, e.g. from doubled or trailing commas
+    if (name[0] == '\0') return 0;
+
+    // Convert the name of the requested object into a numeric object ID
+    const int body_id = orbitalElements_findBody(name);
+
+    if (body_id < 0) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Unrecognised object name <%s>", name);
+        return 1;
+    }
+
+    // Grow the list of objects by doubling, so that adding each object takes constant time on average
+    if (i->objects_count >= i->objects_allocated) {
+        const int allocated = (i->objects_allocated > 0) ? (2 * i->objects_allocated) : 64;
+        int *grown = (int *) realloc(i->body_id, allocated * sizeof(int));
+        if (grown == NULL) {
+            ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+            exit(1);
         }
+        i->body_id = grown;
+        i->objects_allocated = allocated;
+    }
 
-        // All characters other than commas are part of object names
-        i->object_name[i->objects_count][l++] = i->objects_input_list[k++];
+    i->body_id[i->objects_count++] = body_id;
+    return 0;
+}
+
+//! settings_addObjectList - Add each of a comma-separated list of objects to the list of objects to compute
+//! ephemerides for
+//! \param [in,out] i - The settings to add the objects to
+//! \param [in] list - The comma-separated list of object names
+//! \return - Zero on success; otherwise an object was not recognised, as described in <temp_err_string>
+
+static int settings_addObjectList(settings *i, const char *list) {
+    while (1) {
+        const char *comma = strchr(list, ',');
+        const int length = (comma == NULL) ? (int) strlen(list) : (int) (comma - list);
+        if (settings_addObject(i, list, length) != 0) return 1;
+        if (comma == NULL) return 0;
+        list = comma + 1;
     }
+}
 
-    // Make sure that last object is added to list
-    if (l > 0) {
-        i->object_name[i->objects_count][l] = '\0';
-        i->objects_count++;
+//! settings_readObjectFile - Add the objects listed in a file to the list of objects to compute ephemerides for.
+//! Each line may list one object, or several separated by commas. Blank lines and lines starting with '#' are
+//! ignored.
+//! \param [in,out] i - The settings to add the objects to
+//! \param [in] filename - The file to read, or "-" to read from stdin
+//! \return - Zero on success; otherwise the problem is described in <temp_err_string>
+
+static int settings_readObjectFile(settings *i, const char *filename) {
+    char line[LSTR_LENGTH];
+    const int use_stdin = (strcmp(filename, "-") == 0);
+    FILE *input = use_stdin ? stdin : fopen(filename, "r");
+
+    if (input == NULL) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Could not open list of objects <%s>", filename);
+        return 1;
     }
 
-    // Loop over all the objects we are producing an ephemeris for
-    for (k = 0; k < i->objects_count; k++) {
-        i->body_id[k] = -1;
-
-        // Convert the name of the requested objects into numeric object IDs
-        strncpy(name, i->object_name[k], FNAME_LENGTH);
-        name[FNAME_LENGTH - 1] = '\0';
-        str_strip(name, name);
-        str_lower(name, name);
-        if ((strcmp(name, "mercury") == 0) || (strcmp(name, "pmercury") == 0) || (strcmp(name, "p1") == 0))
-            i->body_id[k] = 0;
-        else if ((strcmp(name, "venus") == 0) || (strcmp(name, "pvenus") == 0) || (strcmp(name, "p2") == 0))
-            i->body_id[k] = 1;
-        else if ((strcmp(name, "earth") == 0) || (strcmp(name, "pearth") == 0) || (strcmp(name, "p3") == 0))
-            i->body_id[k] = 19;
-        else if ((strcmp(name, "mars") == 0) || (strcmp(name, "pmars") == 0) || (strcmp(name, "p4") == 0))
-            i->body_id[k] = 3;
-        else if ((strcmp(name, "jupiter") == 0) || (strcmp(name, "pjupiter") == 0) || (strcmp(name, "p5") == 0))
-            i->body_id[k] = 4;
-        else if ((strcmp(name, "saturn") == 0) || (strcmp(name, "psaturn") == 0) || (strcmp(name, "p6") == 0))
-            i->body_id[k] = 5;
-        else if ((strcmp(name, "uranus") == 0) || (strcmp(name, "puranus") == 0) || (strcmp(name, "p7") == 0))
-            i->body_id[k] = 6;
-        else if ((strcmp(name, "neptune") == 0) || (strcmp(name, "pneptune") == 0) || (strcmp(name, "p8") == 0))
-            i->body_id[k] = 7;
-        else if ((strcmp(name, "pluto") == 0) || (strcmp(name, "ppluto") == 0) || (strcmp(name, "p9") == 0))
-            i->body_id[k] = 8;
-        else if ((strcmp(name, "moon") == 0) || (strcmp(name, "pmoon") == 0) || (strcmp(name, "p301") == 0))
-            i->body_id[k] = 9;
-        else if (strcmp(name, "sun") == 0)
-            i->body_id[k] = 10;
-        else if (((name[0] == 'a') || (name[0] == 'A')) && valid_float(name + 1, NULL)) {
-            // Asteroid, e.g. A1
-            i->body_id[k] = 10000000 + (int) get_float(name + 1, NULL);
-        } else if (((name[0] == 'c') || (name[0] == 'C')) && valid_float(name + 1, NULL)) {
-            // Comet, e.g. C1 (first in datafile)
-            i->body_id[k] = 20000000 + (int) get_float(name + 1, NULL);
-        } else {
-            // Search for comets with matching names
-
-            // Open comet database
-            orbitalElements_comets_init();
-
-            // Loop over comets seeing if names match
-            int index;
-            for (index = 0; index < comet_count; index++) {
-                // Fetch comet information
-                orbitalElements *item = orbitalElements_comets_fetch(index);
-
-                if ((str_cmp_no_case(name, item->name) == 0) || (str_cmp_no_case(name, item->name2) == 0)) {
-                    i->body_id[k] = 20000000 + index;
-                    break;
-                }
-            }
-        }
+    int status = 0;
+    while ((status == 0) && (!feof(input)) && (!ferror(input))) {
+        file_readline(input, line);
+        const char *start = line;
+        while ((*start > '\0') && (*start <= ' ')) start++;
+        if ((*start == '\0') || (*start == '#')) continue;
+        status = settings_addObjectList(i, start);
+    }
+
+    if (!use_stdin) fclose(input);
+    return status;
+}
+
+//! settings_resolveObjects - Build the list of objects we are to compute ephemerides for, either from a file, or from
+//! the comma-separated list given on the command line, converting their names into numeric object IDs
+//! \param [in,out] i - The settings whose list of objects is to be built
+//! \return - Zero on success; otherwise the problem, e.g. an unrecognised object name, is described in
+//! <temp_err_string>
+
+int settings_resolveObjects(settings *i) {
+    i->objects_count = 0;
+    if (i->objects_input_file != NULL) return settings_readObjectFile(i, i->objects_input_file);
+    return settings_addObjectList(i, i->objects_input_list);
+}
+
+//! settings_addSite - Add an observing site to the list of sites to compute ephemerides for
+//! \param [in,out] i - The settings to add the site to
+//! \param [in] site - The latitude and longitude of the site, in degrees, separated by a comma or by whitespace;
+//! need not be null-terminated
+//! \param [in] length - The number of characters in <site>
+//! \return - Zero on success; otherwise the site could not be read, as described in <temp_err_string>
+
+static int settings_addSite(settings *i, const char *site, int length) {
+    char text[FNAME_LENGTH];
+    char *end;
+
+    if (length >= FNAME_LENGTH) length = FNAME_LENGTH - 1;
+    memcpy(text, site, length);
+    text[length] = '\0';
+    str_strip(text, text);
+
+    // Skip empty sites, e.g. from doubled or trailing semicolons
+    if (text[0] == '\0') return 0;
 
-        if (i->body_id[k] < 0) {
-            snprintf(temp_err_string, FNAME_LENGTH, "Unrecognised object name <%s>", name);
-            ephem_fatal(__FILE__, __LINE__, temp_err_string);
+    const double latitude = strtod(text, &end);
+    int valid = (end != text);
+    while ((*end == ',') || ((*end > '\0') && (*end <= ' '))) end++;
+    const char *longitude_text = end;
+    const double longitude = strtod(longitude_text, &end);
+    valid = valid && (end != longitude_text);
+    while ((*end > '\0') && (*end <= ' ')) end++;
+    valid = valid && (*end == '\0') && (latitude >= -90) && (latitude <= 90) && gsl_finite(longitude);
+
+    if (!valid) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Could not read site <%.*s>; expected <latitude>,<longitude>",
+                 FNAME_LENGTH - 64, text);
+        return 1;
+    }
+
+    // Grow the list of sites by doubling, as for the list of objects
+    if (i->sites_count >= i->sites_allocated) {
+        const int allocated = (i->sites_allocated > 0) ? (2 * i->sites_allocated) : 16;
+        double *grown_latitude = (double *) realloc(i->site_latitude, allocated * sizeof(double));
+        if (grown_latitude == NULL) {
+            ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
             exit(1);
         }
+        i->site_latitude = grown_latitude;
+        double *grown_longitude = (double *) realloc(i->site_longitude, allocated * sizeof(double));
+        if (grown_longitude == NULL) {
+            ephem_fatal(__FILE__, __LINE__, "Malloc fail.");
+            exit(1);
+        }
+        i->site_longitude = grown_longitude;
+        i->sites_allocated = allocated;
+    }
+
+    i->site_latitude[i->sites_count] = latitude;
+    i->site_longitude[i->sites_count] = longitude;
+    i->sites_count++;
+    return 0;
+}
+
+//! settings_readSiteFile - Add the observing sites listed in a file to the list of sites to compute ephemerides for.
+//! Each line lists one site, as its latitude and longitude in degrees. Blank lines and lines starting with '#' are
+//! ignored.
+//! \param [in,out] i - The settings to add the sites to
+//! \param [in] filename - The file to read, or "-" to read from stdin
+//! \return - Zero on success; otherwise the problem is described in <temp_err_string>
+
+static int settings_readSiteFile(settings *i, const char *filename) {
+    char line[LSTR_LENGTH];
+    const int use_stdin = (strcmp(filename, "-") == 0);
+    FILE *input = use_stdin ? stdin : fopen(filename, "r");
+
+    if (input == NULL) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Could not open list of sites <%s>", filename);
+        return 1;
+    }
+
+    int status = 0;
+    while ((status == 0) && (!feof(input)) && (!ferror(input))) {
+        file_readline(input, line);
+        const char *start = line;
+        while ((*start > '\0') && (*start <= ' ')) start++;
+        if ((*start == '\0') || (*start == '#')) continue;
+        status = settings_addSite(i, start, (int) strlen(start));
+    }
+
+    if (!use_stdin) fclose(input);
+    return status;
+}
+
+//! settings_resolveSites - Build the list of observing sites we are to compute ephemerides for, either from a file,
+//! or from the semicolon-separated list given on the command line. If neither is given, the list is left empty, and
+//! the ephemeris is computed for the single site at <latitude>, <longitude>.
+//! \param [in,out] i - The settings whose list of sites is to be built
+//! \return - Zero on success; otherwise the problem is described in <temp_err_string>
+
+int settings_resolveSites(settings *i) {
+    i->sites_count = 0;
+    if (i->sites_input_file != NULL) {
+        if (settings_readSiteFile(i, i->sites_input_file) != 0) return 1;
+    } else if (i->sites_input_list != NULL) {
+        const char *list = i->sites_input_list;
+        while (1) {
+            const char *separator = strchr(list, ';');
+            const int length = (separator == NULL) ? (int) strlen(list) : (int) (separator - list);
+            if (settings_addSite(i, list, length) != 0) return 1;
+            if (separator == NULL) break;
+            list = separator + 1;
+        }
+    }
+
+    // Columnar binary output holds only one site
+    if ((i->sites_count > 0) && (i->output_binary == 2)) {
+        snprintf(temp_err_string, FNAME_LENGTH, "Columnar binary output cannot be produced for a list of sites");
+        return 1;
+    }
+    return 0;
+}
+
+// Process the contents of a settings structure before producing the ephemeris
+void settings_process(settings *i) {
+    if ((settings_resolveObjects(i) != 0) || (settings_resolveSites(i) != 0)) {
+        ephem_fatal(__FILE__, __LINE__, temp_err_string);
+        exit(1);
     }
 }
 
 // Delete any memory allocated within a settings structure
 void settings_close(settings *i) {
+    free(i->body_id);
+    i->body_id = NULL;
+    i->objects_allocated = 0;
+    i->objects_count = 0;
+    free(i->site_latitude);
+    free(i->site_longitude);
+    i->site_latitude = NULL;
+    i->site_longitude = NULL;
+    i->sites_allocated = 0;
+    i->sites_count = 0;
 }
-
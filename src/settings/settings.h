@@ -24,24 +24,43 @@
 
 #include "coreUtils/strConstants.h"
 
-#define MAX_OBJECTS 48
-
 typedef struct settings {
     double jd_min, jd_max, jd_step, ra_dec_epoch;  // All specified in TT
     double latitude, longitude;  // Used for topocentric correction
     int enable_topocentric_correction;  // Boolean
     int use_orbital_elements, output_binary, output_format, output_constellations;
-    int body_id[MAX_OBJECTS];
-    char object_name[MAX_OBJECTS][FNAME_LENGTH];
-    const char *objects_input_list;
+    int output_velocity;  // Boolean; append each object's velocity (AU/day) to its columns
+    double interpolation_tolerance;  // If positive, interpolate between sparser times, to this accuracy; arcsec
+    int *body_id;  // The objects to compute; grown as needed, so there is no limit on the number of objects
+    int objects_allocated;  // The number of entries allocated in <body_id>
+    const char *objects_input_list;  // Comma-separated list of object names
+    const char *objects_input_file;  // File listing object names, or "-" for stdin; overrides <objects_input_list>
     int objects_count;
+    double *site_latitude, *site_longitude;  // If any sites are listed, the ephemeris is computed topocentrically
+    // for each site in turn, in place of the single site at <latitude>, <longitude>; degrees
+    int sites_allocated;  // The number of entries allocated in <site_latitude> and <site_longitude>
+    const char *sites_input_list;  // Semicolon-separated list of sites, each given as <latitude>,<longitude>
+    const char *sites_input_file;  // File listing sites, one per line, or "-" for stdin; overrides <sites_input_list>
+    int sites_count;
 } settings;
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void settings_default(settings *i);
 
+int settings_resolveObjects(settings *i);
+
+int settings_resolveSites(settings *i);
+
 void settings_process(settings *i);
 
 void settings_close(settings *i);
 
+#ifdef __cplusplus
+};
+#endif
+
 #endif
 